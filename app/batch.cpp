@@ -0,0 +1,337 @@
+/*
+    nes_batch - runs a manifest of ROMs headless, spread over every core.
+
+    Usage: nes_batch <manifest> [-j threads] [-o output_dir] [--audio]
+
+    The manifest has one job per line, '#' starts a comment:
+
+        <rom> <movie|-> <frames> <outputs|-> [instances]
+
+    movie      Raw input, two bytes per frame (controller 1, controller 2), or a
+               movie recorded with nes_emulator --record, which starts from its
+               own first keyframe. Frames past the end of the movie get no
+               buttons pressed.
+    outputs    Comma separated list of extra files to write for the job:
+                 frames      hash of every frame's picture and savestate, one pair per line (<job>.frames)
+                 screenshot  BMP of the last frame (<job>.bmp)
+                 state       savestate taken after the last frame (<job>.state)
+                 audio       32-bit float WAV of everything the job played (<job>.wav),
+                             turns audio on for that job
+    instances  Runs the job this many times (default 1), each on its own Emulator.
+
+    Timing, the last frame hash and the final savestate hash of every job are
+    written to <output_dir>/results.csv and summarised on stdout.
+
+    Jobs run with audio off, the APU keeps its state but mixes nothing.
+    --audio turns mixing and resampling back on (and throws the samples away),
+    which shows what sound costs; hashes are the same either way.
+*/
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Cartridge.h"
+#include "AudioWriter.h"
+#include "Emulator.h"
+#include "Hash.h"
+#include "ImageWriter.h"
+#include "Movie.h"
+#include "WorkStealingPool.h"
+
+namespace fs = std::filesystem;
+
+struct BatchJob {
+	std::string name;
+	std::string romPath;
+	std::string moviePath;
+	int frames = 0;
+	bool frameHashes = false;
+	bool screenshot = false;
+	bool saveState = false;
+	bool audio = false;
+	std::shared_ptr<Cartridge> cart;            // Shared by every job running this ROM
+	std::shared_ptr<std::vector<uint8_t>> movie;
+	std::shared_ptr<Movie> recording;           // When the movie file is a Movie rather than raw input
+};
+
+struct BatchResult {
+	bool ok = false;
+	std::string error;
+	double milliseconds = 0.0;
+	uint64_t frameHash = 0;
+	uint64_t stateHash = 0;
+};
+
+static std::vector<uint8_t> readFile(const std::string& path) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		return {};
+	}
+	return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static std::string hex64(uint64_t value) {
+	char text[17];
+	std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(value));
+	return text;
+}
+
+static bool parseManifest(const std::string& path, std::vector<BatchJob>& jobs) {
+	std::ifstream manifest(path);
+	if (!manifest.is_open()) {
+		std::cerr << "Failed to open manifest: " << path << std::endl;
+		return false;
+	}
+
+	// ROMs and movies are loaded once and shared, they are never written to
+	std::map<std::string, std::shared_ptr<Cartridge>> carts;
+	std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> movies;
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(manifest, line)) {
+		lineNumber++;
+		line = line.substr(0, line.find('#'));
+		std::istringstream fields(line);
+		BatchJob job;
+		std::string outputs;
+		int instances = 1;
+		if (!(fields >> job.romPath)) {
+			continue; // Blank or comment line
+		}
+		if (!(fields >> job.moviePath >> job.frames >> outputs)) {
+			std::cerr << path << ":" << lineNumber << ": expected <rom> <movie|-> <frames> <outputs|-> [instances]" << std::endl;
+			return false;
+		}
+		if (!(fields >> instances) || instances < 1) {
+			instances = 1;
+		}
+
+		std::istringstream outputList(outputs);
+		std::string output;
+		while (std::getline(outputList, output, ',')) {
+			if (output == "frames") job.frameHashes = true;
+			else if (output == "screenshot") job.screenshot = true;
+			else if (output == "state") job.saveState = true;
+			else if (output == "audio") job.audio = true;
+			else if (output != "-") {
+				std::cerr << path << ":" << lineNumber << ": unknown output '" << output << "'" << std::endl;
+				return false;
+			}
+		}
+
+		auto& cart = carts[job.romPath];
+		if (!cart) {
+			std::vector<uint8_t> romData = readFile(job.romPath);
+			if (!Emulator::IsNesRom(romData)) {
+				std::cerr << path << ":" << lineNumber << ": not an NES ROM: " << job.romPath << std::endl;
+				return false;
+			}
+			cart = std::make_shared<Cartridge>(romData);
+		}
+		job.cart = cart;
+
+		if (job.moviePath != "-") {
+			auto& movie = movies[job.moviePath];
+			if (!movie) {
+				movie = std::make_shared<std::vector<uint8_t>>(readFile(job.moviePath));
+			}
+			if (Movie::IsMovie(*movie)) {
+				job.recording = std::make_shared<Movie>();
+				if (!job.recording->deserialize(*movie)) {
+					std::cerr << path << ":" << lineNumber << ": can't read movie " << job.moviePath << std::endl;
+					return false;
+				}
+			}
+			else {
+				job.movie = movie;
+			}
+		}
+
+		std::string stem = fs::path(job.romPath).stem().string();
+		for (int i = 0; i < instances; ++i) {
+			BatchJob instance = job;
+			instance.name = std::to_string(jobs.size()) + "_" + stem;
+			jobs.push_back(instance);
+		}
+	}
+	return true;
+}
+
+static BatchResult runJob(const BatchJob& job, const fs::path& outputDir, bool audio) {
+	BatchResult result;
+	auto emulator = std::make_unique<Emulator>();
+	emulator->setAudioEnabled(audio || job.audio);
+	if (!emulator->loadRom(job.cart)) {
+		result.error = "failed to load ROM";
+		return result;
+	}
+	if (job.recording && !job.recording->seek(*emulator, 0)) {
+		result.error = "movie doesn't match the ROM";
+		return result;
+	}
+	AudioWriter audioOut;
+	if (job.audio && !audioOut.open((outputDir / (job.name + ".wav")).string(), 44100, AudioWriter::Format::Wav)) {
+		result.error = "failed to create audio file";
+		return result;
+	}
+
+	std::vector<std::pair<uint64_t, uint64_t>> frameHashes;
+	if (job.frameHashes) {
+		frameHashes.reserve(job.frames);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < job.frames; ++frame) {
+		if (job.recording && !job.recording->apply(*emulator, frame)) {
+			emulator->setInput(0, 0);
+			emulator->setInput(1, 0);
+		}
+		if (job.movie) {
+			size_t offset = static_cast<size_t>(frame) * 2;
+			bool inMovie = offset + 1 < job.movie->size();
+			emulator->setInput(0, inMovie ? (*job.movie)[offset] : 0);
+			emulator->setInput(1, inMovie ? (*job.movie)[offset + 1] : 0);
+		}
+		emulator->runFrame();
+		audioOut.push(emulator->audio());
+		if (job.frameHashes) {
+			frameHashes.emplace_back(emulator->frameHash(), emulator->stateHash());
+		}
+	}
+	auto end = std::chrono::steady_clock::now();
+	result.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+
+	result.frameHash = emulator->frameHash();
+	std::vector<uint8_t> state = emulator->saveState();
+	result.stateHash = Hash::XXH64(state.data(), state.size());
+
+	if (job.frameHashes) {
+		std::ofstream out(outputDir / (job.name + ".frames"));
+		for (const auto& [frameHash, stateHash] : frameHashes) {
+			out << hex64(frameHash) << ' ' << hex64(stateHash) << '\n';
+		}
+	}
+	if (job.screenshot) {
+		ImageWriter::WriteBmp((outputDir / (job.name + ".bmp")).string(), emulator->framebuffer(), PPU_WIDTH, PPU_HEIGHT);
+	}
+	if (job.saveState) {
+		std::ofstream out(outputDir / (job.name + ".state"), std::ios::binary);
+		out.write(reinterpret_cast<const char*>(state.data()), state.size());
+	}
+	if (job.audio && !audioOut.close()) {
+		result.error = "failed to write audio file";
+		return result;
+	}
+	result.ok = true;
+	return result;
+}
+
+static constexpr unsigned maxThreads = 1024;
+
+// A whole number from 1 to maxThreads, nothing else on the end
+static bool parseThreads(const char* text, unsigned& threads) {
+	char* end = nullptr;
+	errno = 0;
+	long value = std::strtol(text, &end, 10);
+	if (end == text || *end != '\0' || errno != 0 || value < 1 || value > static_cast<long>(maxThreads)) {
+		return false;
+	}
+	threads = static_cast<unsigned>(value);
+	return true;
+}
+
+int main(int argc, const char* argv[]) {
+	std::string manifestPath;
+	fs::path outputDir = "batch_output";
+	unsigned threads = std::thread::hardware_concurrency();
+	bool audio = false;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "-j" && i + 1 < argc) {
+			if (!parseThreads(argv[++i], threads)) {
+				std::cerr << "-j needs a thread count from 1 to " << maxThreads << ", not '" << argv[i] << "'" << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "-o" && i + 1 < argc) {
+			outputDir = argv[++i];
+		}
+		else if (arg == "--audio") {
+			audio = true;
+		}
+		else {
+			manifestPath = arg;
+		}
+	}
+	if (manifestPath.empty()) {
+		std::cerr << "Usage: nes_batch <manifest> [-j threads] [-o output_dir] [--audio]" << std::endl;
+		return 1;
+	}
+
+	std::vector<BatchJob> jobs;
+	if (!parseManifest(manifestPath, jobs)) {
+		return 1;
+	}
+	fs::create_directories(outputDir);
+
+	std::vector<BatchResult> results(jobs.size());
+	auto start = std::chrono::steady_clock::now();
+	{
+		WorkStealingPool pool(threads);
+		std::cout << "Running " << jobs.size() << " jobs on " << pool.size() << " threads" << std::endl;
+		for (size_t i = 0; i < jobs.size(); ++i) {
+			// Each job writes only its own result slot, so no locking is needed. A job that throws fails on
+			// its own rather than taking the whole batch down with it.
+			pool.submit([&jobs, &results, &outputDir, audio, i] {
+				try {
+					results[i] = runJob(jobs[i], outputDir, audio);
+				}
+				catch (const std::exception& e) {
+					results[i] = BatchResult();
+					results[i].error = std::string("exception: ") + e.what();
+				}
+				catch (...) {
+					results[i] = BatchResult();
+					results[i].error = "unknown exception";
+				}
+			});
+		}
+		pool.wait();
+	}
+	double totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::ofstream csv(outputDir / "results.csv");
+	csv << "job,rom,frames,ms,fps,frame_hash,state_hash,status\n";
+	long long totalFrames = 0;
+	int failures = 0;
+	for (size_t i = 0; i < jobs.size(); ++i) {
+		const BatchJob& job = jobs[i];
+		const BatchResult& result = results[i];
+		double fps = result.milliseconds > 0.0 ? job.frames * 1000.0 / result.milliseconds : 0.0;
+		csv << job.name << ',' << job.romPath << ',' << job.frames << ',' << result.milliseconds << ',' << fps << ','
+			<< hex64(result.frameHash) << ',' << hex64(result.stateHash) << ',' << (result.ok ? "ok" : result.error) << '\n';
+		if (result.ok) {
+			totalFrames += job.frames;
+		}
+		else {
+			failures++;
+			std::cerr << job.name << ": " << result.error << std::endl;
+		}
+	}
+
+	std::cout << "Ran " << totalFrames << " frames in " << totalSeconds << " s ("
+		<< (totalSeconds > 0.0 ? totalFrames / totalSeconds : 0.0) << " frames/s), "
+		<< failures << " failed. Results in " << (outputDir / "results.csv").string() << std::endl;
+	return failures == 0 ? 0 : 1;
+}
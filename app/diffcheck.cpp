@@ -0,0 +1,147 @@
+/*
+    nes_diffcheck - runs a ROM on a fast and an accurate core side by side and
+    stops at the first frame they disagree on.
+
+    Usage: nes_diffcheck <rom> [--movie file] [--frames n] [--paths list] [-o output_dir]
+
+    movie      A movie recorded with nes_emulator --record, replayed on both
+               from its first keyframe. Without one both run from power-on
+               with no buttons pressed.
+    frames     Frames to check (default 3600, a minute); with a movie, its length.
+    paths      Comma separated fast paths the fast core turns on, to qualify
+               them one at a time (default all):
+                 idle    idle-loop skipping
+                 blocks  the decoded-block cache
+                 jit     the x86-64 JIT
+               The accurate core runs with every one of them off.
+
+    After every frame the hashes of both CPUs' registers and framebuffers are
+    compared. On the first difference the frame number and hashes are printed
+    and three savestates written to output_dir (default diffcheck_output):
+    fast.state and accurate.state after the frame, start.state before it.
+    Exits with 0 if the cores agreed on every frame, 1 otherwise.
+*/
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Cartridge.h"
+#include "DiffCheck.h"
+#include "Emulator.h"
+#include "Movie.h"
+
+namespace fs = std::filesystem;
+
+static std::vector<uint8_t> readFile(const std::string& path) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		return {};
+	}
+	return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static bool writeFile(const fs::path& path, const std::vector<uint8_t>& data) {
+	std::ofstream file(path, std::ios::binary);
+	file.write(reinterpret_cast<const char*>(data.data()), data.size());
+	if (!file) {
+		std::cerr << "Failed to write " << path.string() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+static std::string hex64(uint64_t value) {
+	char text[17];
+	std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(value));
+	return text;
+}
+
+int main(int argc, const char* argv[]) {
+	std::string romPath;
+	std::string moviePath;
+	long long frames = -1;
+	std::string paths = "idle,blocks,jit";
+	fs::path outputDir = "diffcheck_output";
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--movie" && i + 1 < argc) {
+			moviePath = argv[++i];
+		}
+		else if (arg == "--frames" && i + 1 < argc) {
+			frames = std::stoll(argv[++i]);
+		}
+		else if (arg == "--paths" && i + 1 < argc) {
+			paths = argv[++i];
+		}
+		else if (arg == "-o" && i + 1 < argc) {
+			outputDir = argv[++i];
+		}
+		else {
+			romPath = arg;
+		}
+	}
+	if (romPath.empty()) {
+		std::cerr << "Usage: nes_diffcheck <rom> [--movie file] [--frames n] [--paths list] [-o output_dir]" << std::endl;
+		return 1;
+	}
+
+	std::vector<uint8_t> romData = readFile(romPath);
+	if (!Emulator::IsNesRom(romData)) {
+		std::cerr << "Not an NES ROM: " << romPath << std::endl;
+		return 1;
+	}
+	auto cart = std::make_shared<Cartridge>(romData);
+	Movie movie;
+	if (!moviePath.empty() && !movie.load(moviePath)) {
+		return 1;
+	}
+	if (frames < 0) {
+		frames = moviePath.empty() ? 3600 : static_cast<long long>(movie.frameCount());
+	}
+
+	bool idle = false, blocks = false, jit = false;
+	std::istringstream pathList(paths);
+	std::string path;
+	while (std::getline(pathList, path, ',')) {
+		if (path == "idle") idle = true;
+		else if (path == "blocks") blocks = true;
+		else if (path == "jit") jit = true;
+		else {
+			std::cerr << "Unknown fast path '" << path << "'" << std::endl;
+			return 1;
+		}
+	}
+	if (jit && !Jit::Available) {
+		std::cerr << "No JIT on this host, checking without it" << std::endl;
+	}
+
+	DiffCheck check;
+	check.fast = [idle, blocks, jit](Emulator& emulator) {
+		emulator.setIdleLoopSkipping(idle);
+		emulator.setBlockCache(blocks);
+		emulator.setJit(jit);
+	};
+	DiffCheck::Result result;
+	if (!check.run(cart, moviePath.empty() ? nullptr : &movie, static_cast<uint64_t>(frames), result)) {
+		return 1;
+	}
+	if (!result.diverged) {
+		std::cout << "Fast (" << paths << ") and accurate cores agreed on all " << result.frames << " frames" << std::endl;
+		return 0;
+	}
+
+	uint64_t frame = result.frames - 1;
+	std::cout << "Diverged on frame " << frame << ":" << std::endl
+		<< "  CPU hash    fast " << hex64(result.fastCpuHash) << "  accurate " << hex64(result.accurateCpuHash) << std::endl
+		<< "  frame hash  fast " << hex64(result.fastFrameHash) << "  accurate " << hex64(result.accurateFrameHash) << std::endl;
+	fs::create_directories(outputDir);
+	if (writeFile(outputDir / "fast.state", result.fastState) && writeFile(outputDir / "accurate.state", result.accurateState) &&
+		writeFile(outputDir / "start.state", result.startState)) {
+		std::cout << "Savestates in " << outputDir.string() << std::endl;
+	}
+	return 1;
+}
@@ -10,16 +10,18 @@
 #include <Utilities.h>
 #include "CPU.h"
 #include "PPU.h"
+#include "Emulator.h"
+#include "RewindBuffer.h"
+#include "AudioOutput.h"
+#include "AudioWriter.h"
+#include "Movie.h"
+#include "Trace.h"
 #include <memory>
 #include "event/EventDispatcher.h"
 #include "input.h"
 #include <OAM.h>
 #include <random>
 
-#define CPU_CYCLES_PER_FRAME 29780
-
-static constexpr std::array<uint8_t, 4> magicNumbers = { 0x4E, 0x45, 0x53, 0x1A }; // NES<EOF> magic numbers to identify a NES ROM file
-
 SDL_Texture* LoadBMP(const std::string& filePath, SDL_Renderer* renderer) {
 	SDL_Surface* imageSurface = SDL_LoadBMP(filePath.c_str());
 	if (!imageSurface) {
@@ -45,12 +47,16 @@ void runAnimationTests(CPU& cpu, PPU& ppu, int& scanlineOffset, int frameCount)
 }
 
 void present_frame(SDL_Texture* texture, SDL_Renderer* renderer, const uint32_t* framebuffer, int width, int height) {
-    void* pixels;
-    int pitch;
-    SDL_LockTexture(texture, NULL, &pixels, &pitch);
-    memcpy(pixels, framebuffer, width * height * sizeof(uint32_t));
-    SDL_UnlockTexture(texture);
-
+    {
+        TRACE_SCOPE("texture upload");
+        void* pixels;
+        int pitch;
+        SDL_LockTexture(texture, NULL, &pixels, &pitch);
+        memcpy(pixels, framebuffer, width * height * sizeof(uint32_t));
+        SDL_UnlockTexture(texture);
+    }
+
+    TRACE_SCOPE("present");
     SDL_RenderClear(renderer);
     SDL_RenderCopy(renderer, texture, NULL, NULL);
     SDL_RenderPresent(renderer);
@@ -61,10 +67,55 @@ int main(int argc, const char* argv[]) {
 		std::ifstream romFile;
 	std::vector<uint8_t> romData;
 	std::string filePath;
-	if (argc > 1) {
-		filePath = argv[1];
+	std::string audioOutPath;
+	std::string recordPath;
+	std::string playPath;
+	std::string profilePath;
+	std::string heatmapPath;
+	std::string tracePath = "trace.json";
+	bool tracing = false;
+	int runAhead = 0;
+	int audioBuffer = 512;
+	bool allowVsync = true;
+	bool sound = true;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--run-ahead" && i + 1 < argc) {
+			runAhead = std::stoi(argv[++i]); // Frames, 1-4 hides most games' built in input lag
+		}
+		else if (arg == "--audio-buffer" && i + 1 < argc) {
+			audioBuffer = std::stoi(argv[++i]); // Samples per device callback, 256-512 for low latency
+		}
+		else if (arg == "--no-vsync") {
+			allowVsync = false;
+		}
+		else if (arg == "--no-audio") {
+			sound = false; // No device is opened and the APU mixes nothing
+		}
+		else if (arg == "--record" && i + 1 < argc) {
+			recordPath = argv[++i]; // Input movie of the session from power on, saved every keyframe and on exit
+		}
+		else if (arg == "--play" && i + 1 < argc) {
+			playPath = argv[++i]; // Replays a movie, then hands control back to the player
+		}
+		else if (arg == "--audio-out" && i + 1 < argc) {
+			audioOutPath = argv[++i]; // Records everything played at a fixed rate, .wav or raw float32 for any other name
+		}
+		else if (arg == "--profile" && i + 1 < argc) {
+			profilePath = argv[++i]; // Guest hot spots written on exit, needs a -DNES_PROFILER=ON build
+		}
+		else if (arg == "--bus-heatmap" && i + 1 < argc) {
+			heatmapPath = argv[++i]; // PPM of CPU bus traffic plus a register table on stdout at exit, needs -DNES_BUS_STATS=ON
+		}
+		else if (arg == "--trace" && i + 1 < argc) {
+			tracePath = argv[++i]; // Chrome trace-event timeline written on exit, F9 switches recording on and off
+			tracing = true;
+		}
+		else {
+			filePath = arg;
+		}
 	}
-	else {
+	if (filePath.empty()) {
 		filePath = Utilities::OpenFileDialog();
 	}
 	romFile.open(filePath, std::ios::binary);
@@ -77,19 +128,21 @@ int main(int argc, const char* argv[]) {
 		std::cout << "Failed to open file: " << filePath << std::endl;
 		return(0);
 	}
-	// Check for valid NES ROM file header
-	for (int i = 0; i < magicNumbers.size(); i++) {
-		if (romData[i] != magicNumbers[i]) {
-			std::cout << "Invalid NES ROM file" << std::endl;
-			return(0);
+	auto emulator = std::make_unique<Emulator>();
+	if (!emulator->loadRom(romData)) { // Checks for a valid NES ROM file header
+		return(0);
+	}
+	emulator->setRunAhead(runAhead);
+	Trace::SetThreadName("main");
+	Trace::SetEnabled(tracing);
+	std::unique_ptr<Profiler> profiler;
+	if (!profilePath.empty()) {
+		if (!Profiler::Available) {
+			std::cerr << "--profile needs a build with NES_PROFILER on, nothing will be recorded" << std::endl;
 		}
+		profiler = std::make_unique<Profiler>();
+		emulator->setProfiler(profiler.get());
 	}
-	auto cart = std::make_shared<Cartridge>(romData);
-	auto bus = std::make_shared<Bus>();
-	auto oam = std::make_shared<OAM>();
-	CPU cpu(bus, cart, oam); // Create CPU instance
-	PPU ppu(bus, cart, oam); // Create PPU instance
-	ppu.loadPatternTable(cart->getCHRROM()); // load the CHR ROM into PPU's pattern tables
 
 	// ppu.dumpPatternTablesToBitmap("output.bmp"); // dump the pattern tables to BMP
 	InputHandler inputHandler; // Create an InputHandler instance
@@ -107,7 +160,14 @@ int main(int argc, const char* argv[]) {
 	}
 
 	// initialize the renderer
-	SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+	// Lock video to vsync only on displays close to the NES's 60.0988 Hz, dynamic rate control
+	// can absorb that difference in the audio. Anything else is paced by the sound card instead,
+	// and so is an --audio-out capture: its samples must stay at the rate its header gives.
+	SDL_DisplayMode displayMode;
+	bool vsync = allowVsync && audioOutPath.empty() && SDL_GetCurrentDisplayMode(0, &displayMode) == 0 &&
+		displayMode.refresh_rate >= 59 && displayMode.refresh_rate <= 61;
+	Uint32 rendererFlags = SDL_RENDERER_ACCELERATED | (vsync ? SDL_RENDERER_PRESENTVSYNC : 0);
+	SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, rendererFlags);
 	if (!renderer) {
 		std::cerr << "Renderer could not be created! SDL_Error: " << SDL_GetError() << std::endl;
 		SDL_DestroyWindow(window);
@@ -115,6 +175,16 @@ int main(int argc, const char* argv[]) {
 		return -1;
 	}
 
+	AudioOutput audio;
+	if (sound && audio.open(44100, audioBuffer)) {
+		emulator->setAudioSampleRate(audio.sampleRate());
+	}
+	AudioWriter audioOut;
+	if (!audioOutPath.empty()) {
+		audioOut.open(audioOutPath, static_cast<int>(audio.isOpen() ? audio.sampleRate() : 44100), AudioWriter::FormatFor(audioOutPath));
+	}
+	emulator->setAudioEnabled(audio.isOpen() || audioOut.isOpen());
+
 	bool running = true;
 	SDL_Event event;
 	int scanline = 0;
@@ -128,53 +198,127 @@ int main(int argc, const char* argv[]) {
 		return -1;
 	}
 
-	int frame = 0;
+	Movie movie;
+	bool playing = !playPath.empty() && movie.load(playPath) && movie.seek(*emulator, 0);
+	bool recording = !recordPath.empty();
+	if (recording && !playing) {
+		movie.start(*emulator);
+	}
+	uint64_t movieFrame = 0;
+	uint8_t commands = MovieInput::None;
+
+	RewindBuffer rewind; // Last minute of play, hold Backspace to step back through it
+	std::vector<uint8_t> state;
 
 	while (running) {
 		Uint32 frameStart = SDL_GetTicks(); // Start time
-		Uint32 curTime;
+		Trace::Clock::time_point inputStart = Trace::Now();
 
 		while (SDL_PollEvent(&event)) {
 			if (event.type == SDL_QUIT) {
 				running = false;
 			}
+			else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F9 && !event.key.repeat) {
+				Trace::SetEnabled(!Trace::Enabled());
+				std::cout << "Tracing " << (Trace::Enabled() ? "on" : "off") << std::endl;
+			}
+			else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F5) {
+				commands |= MovieInput::Reset;
+			}
+			else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F6) {
+				commands |= MovieInput::Power;
+			}
 			inputHandler.processEvent(event); // Use the InputHandler class
 		}
 
-		//print time elapsed
-		curTime = SDL_GetTicks();
-		std::cout << "Time elapsed for input handling: " << (curTime - frameStart) << " ms" << std::endl;
-
-		cpu.controller1_state = inputHandler.getControllerState();
-
-		// print time elapsed
-		curTime = SDL_GetTicks();
-		std::cout << "Time elapsed for controller state: " << (curTime - frameStart) << " ms" << std::endl;
-
-		int framecycles = 0;
-		while (framecycles < CPU_CYCLES_PER_FRAME) {
-			int cycles = cpu.execute(); // Executes one instruction
-			framecycles += cycles;
-
-			// Step the PPU for each CPU cycle (3 PPU steps per CPU cycle)
-			for (int i = 0; i < cycles * 3; ++i) {
-				ppu.step();
+		MovieInput input;
+		input.pads[0] = inputHandler.getControllerState();
+		input.commands = commands;
+		commands = MovieInput::None;
+		Trace::Complete("input poll", inputStart, Trace::Now());
+
+		// Movies play straight through, stepping back would leave the recording behind
+		if (!playing && !recording && SDL_GetKeyboardState(nullptr)[SDL_SCANCODE_BACKSPACE]) {
+			// Savestates don't hold the picture, so run one frame from the restored state to draw it
+			if (rewind.pop(state) && emulator->loadState(state)) {
+				emulator->runFrame();
 			}
 		}
-		//print time elapsed
-		curTime = SDL_GetTicks();
-		std::cout << "Time elapsed for CPU execution: " << (curTime - frameStart) << " ms" << std::endl;
-
-		frame++;
-
-		present_frame(texture, renderer, ppu.getFrameBuffer(), 256, 240);
+		else {
+			if (audio.isOpen() && vsync) {
+				emulator->setAudioSampleRate(audio.adjustedSampleRate()); // Only video pacing lets the ring drift
+			}
+			if (playing && !movie.apply(*emulator, movieFrame++)) {
+				std::cout << "Movie finished after " << movie.frameCount() << " frames" << std::endl;
+				playing = false; // With --record too, the recording carries on from the end of the movie
+			}
+			if (!playing) {
+				if (recording) {
+					movie.record(*emulator, input);
+					if (movie.frameCount() % movie.keyframeInterval() == 0) {
+						movie.save(recordPath);
+					}
+				}
+				else {
+					if (input.commands & MovieInput::Power) {
+						emulator->power();
+					}
+					if (input.commands & MovieInput::Reset) {
+						emulator->reset();
+					}
+					emulator->setInput(0, input.pads[0]);
+				}
+			}
+			emulator->runFrame();
+			TRACE_SCOPE("rewind save");
+			emulator->saveState(state);
+			rewind.push(state);
+		}
 
-		curTime = SDL_GetTicks();
-		std::cout << "Time elapsed for render: " << (curTime - frameStart) << " ms" << std::endl;
+		audioOut.push(emulator->audio()); // Hands off to the writer thread, never waits for the disk
+		if (audio.isOpen()) {
+			TRACE_SCOPE("audio queue and pacing");
+			audio.push(emulator->audio());
+			// Without vsync the sound card's clock paces the loop: wait while more than the target is still queued
+			while (!vsync && audio.buffered() > audio.targetBuffered()) {
+				SDL_Delay(1);
+			}
+		}
+		else if (!vsync) {
+			// Nothing else to keep time, hold the loop near 60 frames a second
+			while (SDL_GetTicks() - frameStart < 16) {
+				SDL_Delay(1);
+			}
+		}
 
-		std::cout << "Frame: " << frame << " Framecycles: " << framecycles << std::endl;
+		present_frame(texture, renderer, emulator->framebuffer(), 256, 240);
 	}
 
+	if (recording) {
+		movie.save(recordPath);
+	}
+	if (!heatmapPath.empty()) {
+#ifdef NES_BUS_STATS
+		emulator->bus().stats.report(std::cout);
+		emulator->bus().stats.writeHeatmap(heatmapPath);
+#else
+		std::cerr << "--bus-heatmap needs a build with NES_BUS_STATS on" << std::endl;
+#endif
+	}
+	if (Trace::EventCount() > 0) {
+		Trace::WriteJson(tracePath);
+	}
+	if (profiler) {
+		std::ofstream profileFile(profilePath);
+		if (profileFile.is_open()) {
+			profiler->report(profileFile, emulator->cpu());
+		}
+		else {
+			std::cerr << "Failed to create " << profilePath << std::endl;
+		}
+	}
+	audio.close();
+	audioOut.close();
 	SDL_DestroyTexture(texture);
 	SDL_DestroyWindow(window);
 	SDL_Quit();
@@ -0,0 +1,157 @@
+#include "Bench.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace {
+	volatile uint64_t sink = 0;
+
+	double timeCall(const Bench::Case& benchmark, uint64_t iterations, uint64_t& operations) {
+		auto start = std::chrono::steady_clock::now();
+		operations = benchmark.body(iterations);
+		auto end = std::chrono::steady_clock::now();
+		return std::chrono::duration<double>(end - start).count();
+	}
+
+	std::string jsonEscape(const std::string& text) {
+		std::string out;
+		for (char c : text) {
+			if (c == '"' || c == '\\') {
+				out += '\\';
+			}
+			out += c;
+		}
+		return out;
+	}
+
+	// Value of "key": in a line WriteJson wrote, false if it isn't there
+	bool findField(const std::string& line, const std::string& key, std::string& value) {
+		std::string pattern = "\"" + key + "\": ";
+		size_t start = line.find(pattern);
+		if (start == std::string::npos) {
+			return false;
+		}
+		start += pattern.size();
+		if (start < line.size() && line[start] == '"') {
+			size_t end = line.find('"', start + 1);
+			value = line.substr(start + 1, end - start - 1);
+		}
+		else {
+			size_t end = line.find_first_of(",}", start);
+			value = line.substr(start, end - start);
+		}
+		return true;
+	}
+}
+
+namespace Bench {
+	void Keep(uint64_t value) {
+		sink = sink + value;
+	}
+
+	std::vector<Result> Run(const std::vector<Case>& cases, const Options& options) {
+		std::vector<Result> results;
+		for (const Case& benchmark : cases) {
+			if (!options.filter.empty() && benchmark.name.find(options.filter) == std::string::npos) {
+				continue;
+			}
+			// Grow the count until one call is long enough to time reliably
+			uint64_t iterations = 1;
+			uint64_t operations = 0;
+			double seconds = timeCall(benchmark, iterations, operations);
+			while (seconds < options.minSeconds && iterations < (1ull << 40)) {
+				double scale = seconds > 0.0 ? options.minSeconds * 1.2 / seconds : 10.0;
+				iterations = static_cast<uint64_t>(iterations * std::clamp(scale, 2.0, 10.0));
+				seconds = timeCall(benchmark, iterations, operations);
+			}
+
+			std::vector<double> times = { seconds };
+			for (int i = 1; i < options.repetitions; ++i) {
+				times.push_back(timeCall(benchmark, iterations, operations));
+			}
+			std::sort(times.begin(), times.end());
+
+			Result result;
+			result.name = benchmark.name;
+			result.unit = benchmark.unit;
+			result.operations = operations;
+			result.seconds = times[times.size() / 2];
+			result.opsPerSecond = operations / result.seconds;
+			result.nsPerOp = result.seconds * 1e9 / std::max<uint64_t>(operations, 1);
+			result.subUnit = benchmark.subUnit;
+			result.subPerSecond = result.opsPerSecond * benchmark.subPerOp;
+			results.push_back(result);
+			PrintTable({ result });
+		}
+		return results;
+	}
+
+	void PrintTable(const std::vector<Result>& results) {
+		for (const Result& result : results) {
+			std::printf("%-36s %14.0f %-14s %10.2f ns", result.name.c_str(), result.opsPerSecond,
+				(result.unit + "/s").c_str(), result.nsPerOp);
+			if (!result.subUnit.empty()) {
+				std::printf("   %14.0f %s/s", result.subPerSecond, result.subUnit.c_str());
+			}
+			std::printf("\n");
+		}
+		std::fflush(stdout);
+	}
+
+	bool WriteJson(const std::string& path, const std::vector<Result>& results) {
+		std::ofstream out(path);
+		if (!out.is_open()) {
+			std::cerr << "Failed to create " << path << std::endl;
+			return false;
+		}
+		out << "{\n  \"benchmarks\": [\n";
+		for (size_t i = 0; i < results.size(); ++i) {
+			const Result& result = results[i];
+			char numbers[256];
+			std::snprintf(numbers, sizeof(numbers),
+				"\"operations\": %llu, \"seconds\": %.9g, \"ops_per_second\": %.9g, \"ns_per_op\": %.6g",
+				static_cast<unsigned long long>(result.operations), result.seconds, result.opsPerSecond, result.nsPerOp);
+			out << "    {\"name\": \"" << jsonEscape(result.name) << "\", \"unit\": \"" << jsonEscape(result.unit) << "\", " << numbers;
+			if (!result.subUnit.empty()) {
+				out << ", \"sub_unit\": \"" << jsonEscape(result.subUnit) << "\", \"sub_per_second\": " << result.subPerSecond;
+			}
+			out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+		}
+		out << "  ]\n}\n";
+		return static_cast<bool>(out);
+	}
+
+	std::map<std::string, double> ReadJson(const std::string& path) {
+		std::map<std::string, double> rates;
+		std::ifstream in(path);
+		if (!in.is_open()) {
+			std::cerr << "Failed to open " << path << std::endl;
+			return rates;
+		}
+		std::string line, name, rate;
+		while (std::getline(in, line)) {
+			if (findField(line, "name", name) && findField(line, "ops_per_second", rate)) {
+				rates[name] = std::strtod(rate.c_str(), nullptr);
+			}
+		}
+		if (rates.empty()) {
+			std::cerr << "No benchmarks in " << path << std::endl;
+		}
+		return rates;
+	}
+
+	void PrintComparison(const std::vector<Result>& results, const std::map<std::string, double>& baseline) {
+		std::printf("\n%-36s %14s %14s %9s\n", "benchmark", "baseline/s", "now/s", "change");
+		for (const Result& result : results) {
+			auto old = baseline.find(result.name);
+			if (old == baseline.end() || old->second <= 0.0) {
+				std::printf("%-36s %14s %14.0f %9s\n", result.name.c_str(), "-", result.opsPerSecond, "new");
+				continue;
+			}
+			double change = (result.opsPerSecond / old->second - 1.0) * 100.0;
+			std::printf("%-36s %14.0f %14.0f %+8.1f%%\n", result.name.c_str(), old->second, result.opsPerSecond, change);
+		}
+	}
+}
@@ -0,0 +1,59 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Small in-tree benchmark harness behind nes_bench.
+ *
+ * A benchmark is a body that does some number of operations and returns how
+ * many it did. The runner calls it with a growing iteration count until one
+ * call takes at least minSeconds, then times a few repetitions at that count
+ * and keeps the median, which shrugs off the odd preempted run.
+ *
+ * Results go to stdout as a table and, if asked, to a JSON file with one
+ * benchmark per line, which compare() reads back to diff two runs.
+ */
+namespace Bench {
+	struct Case {
+		std::string name;   // group/what, e.g. "cpu/branch"
+		std::string unit;   // What one operation is, e.g. "instructions"
+		std::function<uint64_t(uint64_t iterations)> body;
+		std::string subUnit = {};  // Optional finer unit reported alongside, e.g. "dots" per scanline
+		double subPerOp = 0.0;
+	};
+
+	struct Result {
+		std::string name;
+		std::string unit;
+		uint64_t operations = 0;   // Per timed repetition
+		double seconds = 0.0;      // Median repetition
+		double opsPerSecond = 0.0;
+		double nsPerOp = 0.0;
+		std::string subUnit;
+		double subPerSecond = 0.0;
+	};
+
+	struct Options {
+		std::string filter;     // Runs only names containing this
+		double minSeconds = 0.2;
+		int repetitions = 3;
+	};
+
+	// Keeps a computed value alive so the optimiser can't drop the work behind it
+	void Keep(uint64_t value);
+
+	std::vector<Result> Run(const std::vector<Case>& cases, const Options& options);
+	void PrintTable(const std::vector<Result>& results);
+	bool WriteJson(const std::string& path, const std::vector<Result>& results);
+
+	// Name to ops/second from a file WriteJson made, empty (with a message on stderr) if unreadable
+	std::map<std::string, double> ReadJson(const std::string& path);
+	void PrintComparison(const std::vector<Result>& results, const std::map<std::string, double>& baseline);
+}
+
+#endif // BENCH_H
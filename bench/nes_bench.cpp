@@ -0,0 +1,339 @@
+/*
+    nes_bench - micro and macro benchmarks for the emulator core.
+
+    Usage: nes_bench [--filter text] [--min-time seconds] [--repetitions n]
+                     [--json out.json] [--compare baseline.json]
+
+    Groups:
+        cpu/        instructions per second for each class of opcode, executed
+                    straight through CPU::execute with nothing else stepping;
+                    the _interpreted cases turn the decoded-block cache off
+        bus/        CPU reads and writes per second for each region of the
+                    address space (RAM, PPU and APU registers, controller, PRG)
+        ppu/        scanlines (and dots) per second with rendering on, skipped
+                    and off, and the cost of sprite evaluation
+        frame/      whole frames per second on small synthetic ROMs, including
+                    the assembled workloads from the test tree's Workloads.h;
+                    the _no_idle_skip cases run the same wait loops with
+                    idle-loop skipping off, for the speedup it gives, and the
+                    _jit cases compile hot blocks to host code (x86-64 only)
+        savestate/  savestate save, load and round trips per second
+
+    Every benchmark runs until a call takes --min-time (default 0.2 s), then
+    the median of --repetitions (default 3) is reported. --json writes the
+    results for later; --compare prints the change against such a file.
+    Build in Release, debug numbers say little.
+*/
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Bench.h"
+#include "Emulator.h"
+#include "TestRom.h"
+#include "Workloads.h"
+
+namespace {
+	// Synthetic workloads. Each starts at $8000 and loops forever; none turn on NMI
+	// unless noted, so the CPU benchmarks run exactly the listed instructions.
+	const std::vector<uint8_t> loadStore = {
+		0xA9, 0x12, 0x85, 0x10, 0xA5, 0x10, 0x8D, 0x00, 0x03, 0xAD, 0x00, 0x03, // LDA # / STA zp / LDA zp / STA abs / LDA abs
+		0xA2, 0x05, 0x86, 0x11, 0xA6, 0x11, 0xA0, 0x07, 0x84, 0x12, 0xA4, 0x12, // LDX # / STX zp / LDX zp / LDY # / STY zp / LDY zp
+		0x9D, 0x00, 0x03, 0xBD, 0x00, 0x03, 0xB5, 0x10, 0x95, 0x20,             // STA abs,X / LDA abs,X / LDA zp,X / STA zp,X
+		0x4C, 0x00, 0x80,
+	};
+	const std::vector<uint8_t> arithmetic = {
+		0x18, 0x69, 0x01, 0x38, 0xE9, 0x01, 0x29, 0xFF, 0x09, 0x01, // CLC / ADC # / SEC / SBC # / AND # / ORA #
+		0x49, 0x55, 0xC9, 0x10, 0x65, 0x10, 0xE0, 0x00, 0xC0, 0x00, // EOR # / CMP # / ADC zp / CPX # / CPY #
+		0x24, 0x10, 0x4C, 0x00, 0x80,                               // BIT zp
+	};
+	const std::vector<uint8_t> shiftModify = {
+		0x0A, 0x06, 0x10, 0x26, 0x10, 0x46, 0x10, 0x66, 0x10, // ASL A / ASL zp / ROL zp / LSR zp / ROR zp
+		0xE6, 0x10, 0xC6, 0x10, 0xEE, 0x00, 0x03, 0xCE, 0x00, 0x03, // INC zp / DEC zp / INC abs / DEC abs
+		0x4C, 0x00, 0x80,
+	};
+	const std::vector<uint8_t> branch = {
+		0xA2, 0x10,       // LDX #16
+		0xCA, 0xD0, 0xFD, // DEX / BNE back to DEX
+		0x4C, 0x00, 0x80,
+	};
+	const std::vector<uint8_t> stack = {
+		0x48, 0x08, 0x68, 0x28, 0x48, 0x68, // PHA / PHP / PLA / PLP / PHA / PLA
+		0x4C, 0x00, 0x80,
+	};
+	const std::vector<uint8_t> subroutine = {
+		0x20, 0x07, 0x80, // JSR $8007
+		0x4C, 0x00, 0x80,
+		0xEA,
+		0x60,             // $8007 RTS
+	};
+	const std::vector<uint8_t> transfer = {
+		0xAA, 0x8A, 0xA8, 0x98, 0xE8, 0xC8, 0xCA, 0x88, 0x18, 0x38, 0xB8, 0xD8, 0xEA, // TAX TXA TAY TYA INX INY DEX DEY CLC SEC CLV CLD NOP
+		0x4C, 0x00, 0x80,
+	};
+
+	// Turns on background, sprites and NMI, then counts in zero page; NMI lands back in the loop
+	//   $8000  LDA #$1E / STA $2001 / LDA #$80 / STA $2000
+	//   $800A  INX / STX $10 / JMP $800A
+	const std::vector<uint8_t> renderLoop = {
+		0xA9, 0x1E, 0x8D, 0x01, 0x20, 0xA9, 0x80, 0x8D, 0x00, 0x20,
+		0xE8, 0x86, 0x10, 0x4C, 0x0A, 0x80,
+	};
+
+	// Pulse and noise playing with running length counters, polling $4015
+	const std::vector<uint8_t> soundLoop = {
+		0xA9, 0x0F, 0x8D, 0x15, 0x40, 0xA9, 0x9F, 0x8D, 0x00, 0x40,
+		0xA9, 0xFD, 0x8D, 0x02, 0x40, 0xA9, 0x08, 0x8D, 0x03, 0x40,
+		0xA9, 0x1F, 0x8D, 0x0C, 0x40, 0xA9, 0x03, 0x8D, 0x0E, 0x40,
+		0xA9, 0x18, 0x8D, 0x0F, 0x40, 0xA9, 0x80, 0x8D, 0x00, 0x20,
+		0xAD, 0x15, 0x40, 0x85, 0x10, 0xE8, 0x86, 0x11, 0x4C, 0x28, 0x80,
+	};
+
+	std::unique_ptr<Emulator> loadImage(const std::vector<uint8_t>& rom) {
+		auto emulator = std::make_unique<Emulator>();
+		if (!emulator->loadRom(rom)) {
+			std::cerr << "Synthetic ROM failed to load" << std::endl;
+			std::exit(1);
+		}
+		return emulator;
+	}
+
+	std::unique_ptr<Emulator> load(const std::vector<uint8_t>& code, uint16_t nmiAddress = 0x8005) {
+		return loadImage(TestRom::Make(code, nmiAddress));
+	}
+
+	Bench::Case cpuCase(const std::string& name, std::shared_ptr<Emulator> emulator) {
+		return { "cpu/" + name, "instructions", [emulator](uint64_t iterations) {
+			CPU& cpu = emulator->cpu();
+			uint64_t cycles = 0;
+			for (uint64_t i = 0; i < iterations; ++i) {
+				cycles += cpu.execute();
+			}
+			Bench::Keep(cycles + cpu.accumulator);
+			return iterations;
+		} };
+	}
+
+	Bench::Case cpuCase(const std::string& name, const std::vector<uint8_t>& code) {
+		return cpuCase(name, load(code));
+	}
+
+	template <typename Access>
+	Bench::Case busCase(const std::string& name, std::shared_ptr<Emulator> emulator, Access access) {
+		return { "bus/" + name, "accesses", [emulator, access](uint64_t iterations) {
+			CPU& cpu = emulator->cpu();
+			uint64_t sum = 0;
+			for (uint64_t i = 0; i < iterations; ++i) {
+				sum += access(cpu, static_cast<uint32_t>(i));
+			}
+			Bench::Keep(sum);
+			return iterations;
+		} };
+	}
+
+	// Steps the PPU alone, one scanline (341 dots) per operation
+	Bench::Case ppuCase(const std::string& name, uint8_t mask, bool render, int spriteSpacing) {
+		std::shared_ptr<Emulator> emulator = load(TestRom::counterLoop);
+		emulator->bus().memory[0x2001] = mask; // The PPU picks its registers up off the bus as it steps
+		emulator->ppu().skipRendering = !render;
+		for (int i = 0; i < oamSize; ++i) {
+			Sprite& sprite = emulator->ppu().m_oam->sprites[i];
+			// Spacing 0 leaves every sprite below the picture, otherwise they're stacked down the screen
+			sprite.y_pos = static_cast<int8_t>(spriteSpacing ? i * spriteSpacing : -16);
+			sprite.x_pos = static_cast<int8_t>(i * 4);
+			sprite.tile_index = static_cast<int8_t>(i);
+			sprite.attributes = 0;
+		}
+		return { "ppu/" + name, "scanlines", [emulator](uint64_t iterations) {
+			PPU& ppu = emulator->ppu();
+			for (uint64_t i = 0; i < iterations * 341; ++i) {
+				ppu.step();
+			}
+			Bench::Keep(ppu.getFrameBuffer()[128 * 256 + 128]);
+			return iterations;
+		}, "dots", 341.0 };
+	}
+
+	Bench::Case frameCase(const std::string& name, std::shared_ptr<Emulator> emulator, bool render = true,
+		int runAhead = 0, bool audio = true) {
+		emulator->setRunAhead(runAhead);
+		emulator->setAudioEnabled(audio);
+		return { "frame/" + name, "frames", [emulator, render](uint64_t iterations) {
+			for (uint64_t i = 0; i < iterations; ++i) {
+				emulator->runFrame(render);
+			}
+			Bench::Keep(emulator->frameCount());
+			return iterations;
+		} };
+	}
+
+	Bench::Case frameCase(const std::string& name, const std::vector<uint8_t>& code, uint16_t nmiAddress,
+		bool render = true, int runAhead = 0, bool audio = true) {
+		return frameCase(name, load(code, nmiAddress), render, runAhead, audio);
+	}
+
+	std::unique_ptr<Emulator> loadWorkload(const char* source) {
+		std::vector<uint8_t> rom = Workloads::Build(source);
+		if (rom.empty()) {
+			std::exit(1);
+		}
+		return loadImage(rom);
+	}
+
+	std::unique_ptr<Emulator> interpreted(std::unique_ptr<Emulator> emulator) {
+		emulator->setBlockCache(false);
+		return emulator;
+	}
+
+	std::unique_ptr<Emulator> withoutIdleSkipping(std::unique_ptr<Emulator> emulator) {
+		emulator->setIdleLoopSkipping(false);
+		return emulator;
+	}
+
+	std::unique_ptr<Emulator> withJit(std::unique_ptr<Emulator> emulator) {
+		emulator->setJit(true);
+		return emulator;
+	}
+
+	std::vector<Bench::Case> allCases() {
+		std::vector<Bench::Case> cases;
+		cases.push_back(cpuCase("load_store", loadStore));
+		cases.push_back(cpuCase("arithmetic", arithmetic));
+		cases.push_back(cpuCase("shift_modify", shiftModify));
+		cases.push_back(cpuCase("branch", branch));
+		cases.push_back(cpuCase("stack", stack));
+		cases.push_back(cpuCase("subroutine", subroutine));
+		cases.push_back(cpuCase("transfer_flags", transfer));
+		cases.push_back(cpuCase("alu_loop", loadWorkload(Workloads::aluLoop)));
+		cases.push_back(cpuCase("memcpy_loop", loadWorkload(Workloads::memcpyLoop)));
+		cases.push_back(cpuCase("alu_loop_interpreted", interpreted(loadWorkload(Workloads::aluLoop))));
+		cases.push_back(cpuCase("memcpy_loop_interpreted", interpreted(loadWorkload(Workloads::memcpyLoop))));
+		if (Profiler::Available) {
+			// Cost of the guest profiler against cpu/alu_loop
+			auto profiler = std::make_shared<Profiler>();
+			std::shared_ptr<Emulator> profiled = loadWorkload(Workloads::aluLoop);
+			profiled->setProfiler(profiler.get());
+			Bench::Case profiledCase = cpuCase("alu_loop_profiled", profiled);
+			profiledCase.body = [profiledCase, profiler](uint64_t iterations) { return profiledCase.body(iterations); };
+			cases.push_back(profiledCase);
+		}
+
+		std::shared_ptr<Emulator> busEmulator = load(TestRom::counterLoop);
+		cases.push_back(busCase("ram_read", busEmulator, [](CPU& cpu, uint32_t i) { return cpu.read(i & 0x07FF); }));
+		cases.push_back(busCase("ram_write", busEmulator, [](CPU& cpu, uint32_t i) { cpu.write(i & 0x07FF, static_cast<uint8_t>(i)); return 0; }));
+		cases.push_back(busCase("ppu_status_read", busEmulator, [](CPU& cpu, uint32_t) { return cpu.read(0x2002); }));
+		cases.push_back(busCase("ppu_register_write", busEmulator, [](CPU& cpu, uint32_t i) { cpu.write(0x2000 + (i & 7), static_cast<uint8_t>(i)); return 0; }));
+		cases.push_back(busCase("apu_register_write", busEmulator, [](CPU& cpu, uint32_t i) { cpu.write(0x4000 + (i % 0x10), static_cast<uint8_t>(i)); return 0; }));
+		cases.push_back(busCase("apu_status_read", busEmulator, [](CPU& cpu, uint32_t) { return cpu.read(0x4015); }));
+		cases.push_back(busCase("controller_read", busEmulator, [](CPU& cpu, uint32_t) { return cpu.read(0x4016); }));
+		cases.push_back(busCase("prg_read", busEmulator, [](CPU& cpu, uint32_t i) { return cpu.read(0x8000 | (i & 0x7FFF)); }));
+		cases.push_back(busCase("raw_memory_read", busEmulator, [busEmulator](CPU&, uint32_t i) { return busEmulator->bus().read(i & 0xFFFF); }));
+
+		cases.push_back(ppuCase("render", 0x1E, true, 0));
+		cases.push_back(ppuCase("render_skipped", 0x1E, false, 0));
+		cases.push_back(ppuCase("rendering_off", 0x00, true, 0));
+		cases.push_back(ppuCase("sprite_eval_off", 0x08, true, 2));    // Background only, sprites never looked at
+		cases.push_back(ppuCase("sprite_eval_sparse", 0x18, true, 2)); // About four sprites on each line
+		cases.push_back(ppuCase("sprite_eval_crowded", 0x18, true, 1)); // Past eight on most lines, overflow set
+
+		cases.push_back(frameCase("counter_loop", TestRom::counterLoop, 0x8005));
+		cases.push_back(frameCase("render_loop", renderLoop, 0x800A));
+		cases.push_back(frameCase("render_loop_no_picture", renderLoop, 0x800A, false));
+		cases.push_back(frameCase("render_loop_run_ahead_2", renderLoop, 0x800A, true, 2));
+		cases.push_back(frameCase("sound_loop", soundLoop, 0x8028));
+		cases.push_back(frameCase("sound_loop_audio_off", soundLoop, 0x8028, true, 0, false));
+		cases.push_back(frameCase("pad_loop", TestRom::PadLoop(), 0x8000)); // Strobes and reads the controller nonstop
+		cases.push_back(frameCase("alu_loop", loadWorkload(Workloads::aluLoop)));
+		cases.push_back(frameCase("memcpy_loop", loadWorkload(Workloads::memcpyLoop)));
+		if (Jit::Available) {
+			cases.push_back(frameCase("alu_loop_jit", withJit(loadWorkload(Workloads::aluLoop))));
+			cases.push_back(frameCase("alu_loop_no_picture", loadWorkload(Workloads::aluLoop), false));
+			cases.push_back(frameCase("alu_loop_no_picture_jit", withJit(loadWorkload(Workloads::aluLoop)), false));
+			cases.push_back(frameCase("memcpy_loop_jit", withJit(loadWorkload(Workloads::memcpyLoop))));
+			cases.push_back(frameCase("memcpy_loop_no_picture", loadWorkload(Workloads::memcpyLoop), false));
+			cases.push_back(frameCase("memcpy_loop_no_picture_jit", withJit(loadWorkload(Workloads::memcpyLoop)), false));
+		}
+		cases.push_back(frameCase("sprite_scene", loadWorkload(Workloads::spriteScene)));
+		cases.push_back(frameCase("scroll_scene", loadWorkload(Workloads::scrollScene)));
+		cases.push_back(frameCase("nmi_frame_loop", loadWorkload(Workloads::nmiFrameLoop)));
+		cases.push_back(frameCase("nmi_frame_loop_no_idle_skip", withoutIdleSkipping(loadWorkload(Workloads::nmiFrameLoop))));
+		cases.push_back(frameCase("vblank_wait", loadWorkload(Workloads::vblankWait)));
+		cases.push_back(frameCase("vblank_wait_no_idle_skip", withoutIdleSkipping(loadWorkload(Workloads::vblankWait))));
+		cases.push_back(frameCase("vblank_wait_no_picture", loadWorkload(Workloads::vblankWait), false));
+		cases.push_back(frameCase("vblank_wait_no_picture_no_idle_skip", withoutIdleSkipping(loadWorkload(Workloads::vblankWait)), false));
+
+		std::shared_ptr<Emulator> stateEmulator = load(renderLoop, 0x800A);
+		for (int i = 0; i < 60; ++i) {
+			stateEmulator->runFrame();
+		}
+		auto state = std::make_shared<std::vector<uint8_t>>(stateEmulator->saveState());
+		double stateBytes = static_cast<double>(state->size());
+		cases.push_back({ "savestate/save", "states", [stateEmulator, state](uint64_t iterations) {
+			for (uint64_t i = 0; i < iterations; ++i) {
+				stateEmulator->saveState(*state);
+			}
+			Bench::Keep(state->size());
+			return iterations;
+		}, "bytes", stateBytes });
+		cases.push_back({ "savestate/load", "states", [stateEmulator, state](uint64_t iterations) {
+			for (uint64_t i = 0; i < iterations; ++i) {
+				stateEmulator->loadState(*state);
+			}
+			Bench::Keep(stateEmulator->frameCount());
+			return iterations;
+		}, "bytes", stateBytes });
+		cases.push_back({ "savestate/round_trip", "round trips", [stateEmulator, state](uint64_t iterations) {
+			for (uint64_t i = 0; i < iterations; ++i) {
+				stateEmulator->saveState(*state);
+				stateEmulator->loadState(*state);
+			}
+			Bench::Keep(stateEmulator->frameCount());
+			return iterations;
+		} });
+		return cases;
+	}
+}
+
+int main(int argc, const char* argv[]) {
+	Bench::Options options;
+	std::string jsonPath;
+	std::string comparePath;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--filter" && i + 1 < argc) {
+			options.filter = argv[++i];
+		}
+		else if (arg == "--min-time" && i + 1 < argc) {
+			options.minSeconds = std::stod(argv[++i]);
+		}
+		else if (arg == "--repetitions" && i + 1 < argc) {
+			options.repetitions = std::max(1, std::stoi(argv[++i]));
+		}
+		else if (arg == "--json" && i + 1 < argc) {
+			jsonPath = argv[++i];
+		}
+		else if (arg == "--compare" && i + 1 < argc) {
+			comparePath = argv[++i];
+		}
+		else {
+			std::cerr << "Usage: nes_bench [--filter text] [--min-time seconds] [--repetitions n] [--json out.json] [--compare baseline.json]" << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<Bench::Result> results = Bench::Run(allCases(), options);
+	if (!jsonPath.empty() && !Bench::WriteJson(jsonPath, results)) {
+		return 1;
+	}
+	if (!comparePath.empty()) {
+		std::map<std::string, double> baseline = Bench::ReadJson(comparePath);
+		if (baseline.empty()) {
+			return 1;
+		}
+		Bench::PrintComparison(results, baseline);
+	}
+	return 0;
+}
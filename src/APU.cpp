@@ -2,121 +2,707 @@
     Created by Gwyn Shafer on 11/28/2024
     Last Updated: 11/28/2024
 */
-#include "APU.h"
+#include "apu.h"
+#include <algorithm>
+#include <array>
 #include <iostream>
-#include <cmath>
-
-
-APU::APU()
-{
-    SDL_Init(SDL_INIT_AUDIO);
-    SDL_memset(&want, 0, sizeof(want));
-    want.freq = 44100; // Sample rate
-    want.format = AUDIO_F32SYS; // 32-bit floating-point audio
-    want.channels = 1; // Mono audio
-    want.samples = 4096;
-    want.callback = audioCallback;
-
-    dev = SDL_OpenAudioDevice(NULL, 0, &want, &have, SDL_AUDIO_ALLOW_FORMAT_CHANGE);
-    if (dev == 0)
-    {
-        std::cerr << "Failed to open audio: " << SDL_GetError() << std::endl;
-    }
-    else
-    {
-        SDL_PauseAudioDevice(dev, 0); // Start audio playback
-    }
-}
-
-APU::~APU()
-{
-    if (dev != 0)
-    {
-        SDL_CloseAudioDevice(dev);
-    }
-    SDL_Quit();
-}
-
-void APU::test()
-{
-    std::cout << "APU Test!" << std::endl;
-}
-
-void APU::sdlAudioTest()
-{
-    // Play a 440 Hz tone for 1 second
-    SDL_Delay(5000);
-}
-
-void APU::audioCallback(void* userdata, Uint8* stream, int len)
-{
-    float* buffer = reinterpret_cast<float*>(stream);
-    static double phase = 0.0;
-    static int currentDutyCycle = 0;  // Track which duty cycle we are on
-    static int samplesElapsed = 0;    // Track samples elapsed to switch every second
-    const double frequency = 440.0;   // A4
-    const double sampleRate = 44100.0;
-    const double phaseIncrementSquare = (frequency / sampleRate) * 8.0; // 8-step duty cycle
-    const double phaseIncrementTriangle = (frequency / sampleRate) * 32.0; // 32-step triangle wave
-    const int samplesPerSecond = static_cast<int>(sampleRate);  // 1 second of samples
-    static bool useTriangleWave = false; // Switch to triangle wave after all square patterns
-
-    // NES duty cycles (each is an 8-step pattern)
-    const uint8_t dutyPatternsSquare[4] = {
-        0b01000000,  // 12.5%
-        0b01100000,  // 25%
-        0b01111000,  // 50%
-        0b01111110   // 75%
-    };
-
-    const uint8_t trianglePattern[32] = { 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
-
-    const float volume = 0.08f;
-
-    for (int i = 0; i < len / sizeof(float); ++i)
-    {
-        if (!useTriangleWave)
-        {
-            int step = static_cast<int>(phase) & 7;  // Keep phase within 8 steps
-            buffer[i] = (dutyPatternsSquare[currentDutyCycle] & (1 << step)) ? volume : -volume;
-
-            phase += phaseIncrementSquare;
-            if (phase >= 8.0)
-            {
-                phase -= 8.0;
-            }
-
-            // Track elapsed samples and switch duty cycle every second
-            if (++samplesElapsed >= samplesPerSecond)
-            {
-                samplesElapsed = 0;
-                currentDutyCycle = (currentDutyCycle + 1) % 4;  // Cycle through the 4 duty patterns
-                if (currentDutyCycle == 0) // After completing one cycle of duty patterns, switch to triangle wave
-                {
-                    useTriangleWave = true;
-                    phase = 0.0; // Reset phase for triangle wave
-                }
-            }
-        }
-        else
-        {
-            int step = static_cast<int>(phase) & 31;  // Keep phase within 32 steps
-            buffer[i] = (trianglePattern[step] / 15.0f - 0.5f) * volume; // Normalize and scale
-
-            phase += phaseIncrementTriangle;
-            if (phase >= 32.0)
-            {
-                phase -= 32.0;
-            }
-        }
-    }
-}
-
-
-int main()
-{
-    APU testAPU;
-    testAPU.test();
-    testAPU.sdlAudioTest();
-    return 0;
-}
\ No newline at end of file
+
+namespace {
+	const uint8_t lengthTable[32] = {
+		10, 254, 20, 2, 40, 4, 80, 6, 160, 8, 60, 10, 14, 12, 26, 14,
+		12, 16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30
+	};
+
+	// NES duty cycles (each is an 8-step pattern)
+	const uint8_t dutyPatterns[4][8] = {
+		{ 0, 1, 0, 0, 0, 0, 0, 0 }, // 12.5%
+		{ 0, 1, 1, 0, 0, 0, 0, 0 }, // 25%
+		{ 0, 1, 1, 1, 1, 0, 0, 0 }, // 50%
+		{ 1, 0, 0, 1, 1, 1, 1, 1 }  // 25% negated
+	};
+
+	const uint8_t trianglePattern[32] = { 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+
+	// Timer periods in CPU cycles (NTSC)
+	const uint16_t noisePeriods[16] = { 4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068 };
+	const uint16_t dmcPeriods[16] = { 428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54 };
+
+	// Frame sequencer steps in CPU cycles from the $4017 write - https://www.nesdev.org/wiki/APU_Frame_Counter
+	struct FrameStep {
+		uint32_t cycle;
+		bool quarter;
+		bool half;
+		bool irq;
+	};
+	const FrameStep fourStepSequence[] = {
+		{ 7457, true, false, false },
+		{ 14913, true, true, false },
+		{ 22371, true, false, false },
+		{ 29829, true, true, true },
+		{ 29830, false, false, true },
+	};
+	const FrameStep fiveStepSequence[] = {
+		{ 7457, true, false, false },
+		{ 14913, true, true, false },
+		{ 22371, true, false, false },
+		{ 37281, true, true, false },
+		{ 37282, false, false, false },
+	};
+	constexpr int frameSteps = 5;
+
+	constexpr uint32_t never = UINT32_MAX;
+
+	// The 2A03 mixes its channels through resistor networks, so loud channels drown each other out
+	// rather than adding up. Both groups are tabulated over every input they can see.
+	// https://www.nesdev.org/wiki/APU_Mixer
+	struct MixerTables {
+		std::array<float, 31> pulse;  // Indexed by pulse1 + pulse2
+		std::array<float, 203> tnd;   // Indexed by 3 * triangle + 2 * noise + dmc
+	};
+
+	MixerTables makeMixerTables() {
+		MixerTables tables{};
+		for (size_t n = 1; n < tables.pulse.size(); ++n) {
+			tables.pulse[n] = static_cast<float>(95.52 / (8128.0 / n + 100.0));
+		}
+		for (size_t n = 1; n < tables.tnd.size(); ++n) {
+			tables.tnd[n] = static_cast<float>(163.67 / (24329.0 / n + 100.0));
+		}
+		return tables;
+	}
+
+	const MixerTables& mixerTables() {
+		static const MixerTables tables = makeMixerTables();
+		return tables;
+	}
+
+	// Number of timer reloads in the given cycles, leaving timer at the cycles to the next one
+	uint32_t advanceTimer(uint32_t& timer, uint32_t reload, uint32_t cycles) {
+		if (cycles < timer) {
+			timer -= cycles;
+			return 0;
+		}
+		cycles -= timer;
+		timer = reload - cycles % reload;
+		return 1 + cycles / reload;
+	}
+}
+
+void Envelope::clock() {
+	if (start) {
+		start = false;
+		decay = 15;
+		divider = period;
+	}
+	else if (divider == 0) {
+		divider = period;
+		if (decay > 0) {
+			decay--;
+		}
+		else if (loop) {
+			decay = 15;
+		}
+	}
+	else {
+		divider--;
+	}
+}
+
+uint16_t PulseChannel::sweepTarget() const {
+	int change = period >> sweepShift;
+	if (sweepNegate) {
+		int target = period - change - (onesComplement ? 1 : 0);
+		return static_cast<uint16_t>(std::max(target, 0));
+	}
+	return static_cast<uint16_t>(period + change);
+}
+
+void PulseChannel::clockSweep() {
+	uint16_t target = sweepTarget();
+	if (sweepDivider == 0 && sweepEnabled && sweepShift > 0 && period >= 8 && target <= 0x7FF) {
+		period = target;
+	}
+	if (sweepDivider == 0 || sweepReload) {
+		sweepDivider = sweepPeriod;
+		sweepReload = false;
+	}
+	else {
+		sweepDivider--;
+	}
+}
+
+uint8_t PulseChannel::output() const {
+	if (length == 0 || period < 8 || sweepTarget() > 0x7FF) {
+		return 0;
+	}
+	return dutyPatterns[duty][sequence] ? envelope.volume() : 0;
+}
+
+// Cycles until the output can change, never while muted. A tone only changes on duty pattern edges.
+uint32_t PulseChannel::nextChange() const {
+	if (length == 0 || period < 8 || sweepTarget() > 0x7FF || envelope.volume() == 0) {
+		return never;
+	}
+	const uint8_t* pattern = dutyPatterns[duty];
+	uint32_t cycles = timer;
+	for (int step = 1; step < 8; ++step) {
+		if (pattern[(sequence - step) & 7] != pattern[sequence]) {
+			break;
+		}
+		cycles += (period + 1) * 2;
+	}
+	return cycles;
+}
+
+void PulseChannel::advance(uint32_t cycles) {
+	uint32_t clocks = advanceTimer(timer, (period + 1) * 2, cycles); // Pulse timers tick every other CPU cycle
+	sequence = (sequence - clocks) & 7; // The sequencer counts down
+}
+
+uint8_t TriangleChannel::output() const {
+	return trianglePattern[sequence];
+}
+
+uint32_t TriangleChannel::nextChange() const {
+	return running() ? timer : never; // A stopped triangle holds its level and its timer
+}
+
+void TriangleChannel::advance(uint32_t cycles) {
+	if (running()) {
+		sequence = (sequence + advanceTimer(timer, period + 1, cycles)) & 31;
+	}
+}
+
+uint32_t NoiseChannel::nextChange() const {
+	return (length == 0 || envelope.volume() == 0) ? never : timer;
+}
+
+void NoiseChannel::advance(uint32_t cycles) {
+	// The shift register still runs while muted, it decides what comes out when the channel is heard again
+	for (uint32_t clocks = advanceTimer(timer, period, cycles); clocks > 0; --clocks) {
+		uint16_t feedback = (shift & 1) ^ ((shift >> (mode ? 6 : 1)) & 1);
+		shift = (shift >> 1) | (feedback << 14);
+	}
+}
+
+APU::APU(std::shared_ptr<Bus> bus, std::shared_ptr<Cartridge> cart) : m_bus(bus), m_cart(cart) {
+	pulse1.onesComplement = true;
+	pulse1.timer = pulse2.timer = 2;
+	triangle.timer = 1;
+	noise.timer = noise.period;
+	dmc.timer = dmc.period;
+	m_output = mix(); // The triangle idles at a non-zero level, that's the baseline rather than a step
+	scheduleEvents();
+}
+
+APU::APU() : APU(nullptr, nullptr) {
+}
+
+void APU::cpuWrite(uint16_t address, uint8_t data) {
+	sync();
+	switch (address) {
+	case 0x4000:
+	case 0x4004: {
+		PulseChannel& pulse = address == 0x4000 ? pulse1 : pulse2;
+		pulse.duty = data >> 6;
+		pulse.envelope.loop = data & 0x20;
+		pulse.envelope.constantVolume = data & 0x10;
+		pulse.envelope.period = data & 0x0F;
+		break;
+	}
+	case 0x4001:
+	case 0x4005: {
+		PulseChannel& pulse = address == 0x4001 ? pulse1 : pulse2;
+		pulse.sweepEnabled = data & 0x80;
+		pulse.sweepPeriod = (data >> 4) & 0x07;
+		pulse.sweepNegate = data & 0x08;
+		pulse.sweepShift = data & 0x07;
+		pulse.sweepReload = true;
+		break;
+	}
+	case 0x4002:
+	case 0x4006: {
+		PulseChannel& pulse = address == 0x4002 ? pulse1 : pulse2;
+		pulse.period = (pulse.period & 0x0700) | data;
+		break;
+	}
+	case 0x4003:
+	case 0x4007: {
+		PulseChannel& pulse = address == 0x4003 ? pulse1 : pulse2;
+		pulse.period = (pulse.period & 0x00FF) | ((data & 0x07) << 8);
+		if (pulse.enabled) {
+			pulse.length = lengthTable[data >> 3];
+		}
+		pulse.sequence = 0;
+		pulse.envelope.start = true;
+		break;
+	}
+	case 0x4008:
+		triangle.control = data & 0x80;
+		triangle.linearPeriod = data & 0x7F;
+		break;
+	case 0x400A:
+		triangle.period = (triangle.period & 0x0700) | data;
+		break;
+	case 0x400B:
+		triangle.period = (triangle.period & 0x00FF) | ((data & 0x07) << 8);
+		if (triangle.enabled) {
+			triangle.length = lengthTable[data >> 3];
+		}
+		triangle.linearReload = true;
+		break;
+	case 0x400C:
+		noise.envelope.loop = data & 0x20;
+		noise.envelope.constantVolume = data & 0x10;
+		noise.envelope.period = data & 0x0F;
+		break;
+	case 0x400E:
+		noise.mode = data & 0x80;
+		noise.period = noisePeriods[data & 0x0F];
+		break;
+	case 0x400F:
+		if (noise.enabled) {
+			noise.length = lengthTable[data >> 3];
+		}
+		noise.envelope.start = true;
+		break;
+	case 0x4010:
+		dmc.irqEnabled = data & 0x80;
+		if (!dmc.irqEnabled) {
+			dmcIrq = false;
+		}
+		dmc.loop = data & 0x40;
+		dmc.period = dmcPeriods[data & 0x0F];
+		break;
+	case 0x4011:
+		dmc.level = data & 0x7F;
+		break;
+	case 0x4012:
+		dmc.sampleAddress = 0xC000 + data * 64;
+		break;
+	case 0x4013:
+		dmc.sampleLength = data * 16 + 1;
+		break;
+	case 0x4015:
+		pulse1.enabled = data & 0x01;
+		pulse2.enabled = data & 0x02;
+		triangle.enabled = data & 0x04;
+		noise.enabled = data & 0x08;
+		if (!pulse1.enabled) pulse1.length = 0;
+		if (!pulse2.enabled) pulse2.length = 0;
+		if (!triangle.enabled) triangle.length = 0;
+		if (!noise.enabled) noise.length = 0;
+		if (!(data & 0x10)) {
+			dmc.bytesRemaining = 0;
+		}
+		else if (dmc.bytesRemaining == 0) {
+			dmc.currentAddress = dmc.sampleAddress;
+			dmc.bytesRemaining = dmc.sampleLength;
+			fillDmcBuffer();
+		}
+		dmcIrq = false;
+		break;
+	case 0x4017:
+		fiveStepMode = data & 0x80;
+		irqInhibit = data & 0x40;
+		if (irqInhibit) {
+			frameIrq = false;
+		}
+		frameCounterCycle = 0;
+		if (fiveStepMode) {
+			clockQuarterFrame();
+			clockHalfFrame();
+		}
+		break;
+	default:
+		break; // $4009, $400D and $4014 (OAM DMA) aren't APU registers
+	}
+	updateOutput();
+	scheduleEvents();
+	if (m_scheduler && m_dmaStall > 0) {
+		// Starting the DMC with $4015 fetches straight away, pay for it right after this instruction
+		m_scheduler->schedule(SchedulerEvent::DmcDma, m_scheduler->now());
+	}
+}
+
+uint8_t APU::readStatus() {
+	sync();
+	uint8_t status = 0;
+	status |= pulse1.length > 0 ? 0x01 : 0;
+	status |= pulse2.length > 0 ? 0x02 : 0;
+	status |= triangle.length > 0 ? 0x04 : 0;
+	status |= noise.length > 0 ? 0x08 : 0;
+	status |= dmc.bytesRemaining > 0 ? 0x10 : 0;
+	status |= frameIrq ? 0x40 : 0;
+	status |= dmcIrq ? 0x80 : 0;
+	frameIrq = false;
+	return status;
+}
+
+void APU::sync() {
+	uint32_t cycles = m_pending;
+	m_pending = 0;
+	advance(cycles);
+	scheduleEvents();
+}
+
+void APU::advance(uint32_t cycles) {
+	// Jump straight to the next cycle where the output or the frame sequencer can change instead of stepping every cycle.
+	// Channels that don't change in between are moved along in one go.
+	while (cycles > 0) {
+		uint32_t step = std::min({ cycles, nextFrameCounterEvent(), dmcNextChange() });
+		if (m_outputEnabled) {
+			step = std::min({ step, pulse1.nextChange(), pulse2.nextChange(), triangle.nextChange(), noise.nextChange() });
+		}
+		// Without output only what the CPU can see needs stopping for: length counters and interrupts from
+		// the frame sequencer, and the DMC's fetches. The tone channels keep their exact phase regardless.
+
+		m_time += step;
+		cycles -= step;
+		frameCounterCycle += step;
+		pulse1.advance(step);
+		pulse2.advance(step);
+		triangle.advance(step);
+		noise.advance(step);
+		advanceDmc(step);
+		stepFrameCounter();
+		updateOutput();
+	}
+}
+
+void APU::endFrame(std::vector<float>& out) {
+	sync();
+	if (m_outputEnabled) {
+		m_blip.endFrame(m_time);
+		size_t start = out.size();
+		out.resize(start + m_blip.samplesAvailable());
+		out.resize(start + m_blip.readSamples(out.data() + start, out.size() - start));
+	}
+	m_time = 0;
+}
+
+uint32_t APU::nextFrameCounterEvent() const {
+	const FrameStep* sequence = fiveStepMode ? fiveStepSequence : fourStepSequence;
+	for (int i = 0; i < frameSteps; ++i) {
+		if (sequence[i].cycle > frameCounterCycle) {
+			return sequence[i].cycle - frameCounterCycle;
+		}
+	}
+	return 1; // Only reachable from a damaged savestate, stepFrameCounter restarts the sequence
+}
+
+void APU::stepFrameCounter() {
+	const FrameStep* sequence = fiveStepMode ? fiveStepSequence : fourStepSequence;
+	for (int i = 0; i < frameSteps; ++i) {
+		if (sequence[i].cycle != frameCounterCycle) {
+			continue;
+		}
+		if (sequence[i].quarter) {
+			clockQuarterFrame();
+		}
+		if (sequence[i].half) {
+			clockHalfFrame();
+		}
+		if (sequence[i].irq && !irqInhibit) {
+			frameIrq = true;
+		}
+		if (i == frameSteps - 1) {
+			frameCounterCycle = 0; // The last step starts the sequence over
+		}
+		return;
+	}
+	if (frameCounterCycle > sequence[frameSteps - 1].cycle) {
+		frameCounterCycle = 0;
+	}
+}
+
+// Cycles until the frame counter or DMC raises an interrupt, the CPU has to see it on time
+uint32_t APU::nextIrqEvent() const {
+	uint32_t cycles = never;
+	if (!fiveStepMode && !irqInhibit) {
+		for (const FrameStep& step : fourStepSequence) {
+			if (step.irq && step.cycle > frameCounterCycle) {
+				cycles = step.cycle - frameCounterCycle;
+				break;
+			}
+		}
+		if (cycles == never) {
+			cycles = nextFrameCounterEvent(); // Past the end, the sequence restarts first
+		}
+	}
+	if (dmc.irqEnabled && !dmc.loop && dmc.bytesRemaining == 1) {
+		cycles = std::min(cycles, nextDmcFetch()); // Fetching the last byte ends the sample
+	}
+	return cycles;
+}
+
+// Cycles until the output unit empties its shift register and the DMC reads the next byte
+uint32_t APU::nextDmcFetch() const {
+	if (!dmc.bufferFull || dmc.bytesRemaining == 0) {
+		return never;
+	}
+	return dmc.timer + (dmc.bitsRemaining - 1) * dmc.period;
+}
+
+void APU::attach(Scheduler* scheduler) {
+	m_scheduler = scheduler;
+	m_syncDeadline = never;
+	scheduleEvents();
+}
+
+void APU::scheduleEvents() {
+	if (!m_scheduler) {
+		m_syncDeadline = nextIrqEvent();
+		return;
+	}
+	// Event times count from where the channels are, which is m_pending behind the clock
+	uint64_t synced = m_scheduler->now() - m_pending;
+	auto at = [synced](uint32_t cycles) { return cycles == never ? Scheduler::never : synced + cycles; };
+	m_scheduler->schedule(SchedulerEvent::ApuIrq, at(nextIrqEvent()));
+	m_scheduler->schedule(SchedulerEvent::DmcDma, at(nextDmcFetch()));
+}
+
+void APU::clockQuarterFrame() {
+	pulse1.envelope.clock();
+	pulse2.envelope.clock();
+	noise.envelope.clock();
+	if (triangle.linearReload) {
+		triangle.linearCounter = triangle.linearPeriod;
+	}
+	else if (triangle.linearCounter > 0) {
+		triangle.linearCounter--;
+	}
+	if (!triangle.control) {
+		triangle.linearReload = false;
+	}
+}
+
+void APU::clockHalfFrame() {
+	if (!pulse1.envelope.loop && pulse1.length > 0) pulse1.length--;
+	if (!pulse2.envelope.loop && pulse2.length > 0) pulse2.length--;
+	if (!triangle.control && triangle.length > 0) triangle.length--;
+	if (!noise.envelope.loop && noise.length > 0) noise.length--;
+	pulse1.clockSweep();
+	pulse2.clockSweep();
+}
+
+uint32_t APU::dmcNextChange() const {
+	return dmc.idle() ? never : dmc.timer;
+}
+
+void APU::advanceDmc(uint32_t cycles) {
+	uint32_t clocks = advanceTimer(dmc.timer, dmc.period, cycles);
+	if (dmc.idle()) {
+		// Only the bit counter moves while idle, it sets when a newly started sample begins to play
+		dmc.shift = clocks >= 8 ? 0 : dmc.shift >> clocks;
+		dmc.bitsRemaining = static_cast<uint8_t>((dmc.bitsRemaining - 1 + 8 - clocks % 8) % 8 + 1);
+		return;
+	}
+	for (; clocks > 0; --clocks) {
+		clockDmc();
+	}
+}
+
+void APU::clockDmc() {
+	if (!dmc.silence) {
+		if (dmc.shift & 1) {
+			if (dmc.level <= 125) dmc.level += 2;
+		}
+		else if (dmc.level >= 2) {
+			dmc.level -= 2;
+		}
+	}
+	dmc.shift >>= 1;
+	if (--dmc.bitsRemaining == 0) {
+		dmc.bitsRemaining = 8;
+		if (dmc.bufferFull) {
+			dmc.silence = false;
+			dmc.shift = dmc.buffer;
+			dmc.bufferFull = false;
+			fillDmcBuffer();
+		}
+		else {
+			dmc.silence = true;
+		}
+	}
+}
+
+void APU::fillDmcBuffer() {
+	if (dmc.bufferFull || dmc.bytesRemaining == 0) {
+		return;
+	}
+	uint16_t address = dmc.currentAddress;
+	if (address >= 0x8000 && m_cart) {
+		dmc.buffer = m_cart->ReadPrgRom(address - 0x8000);
+	}
+	else {
+		dmc.buffer = m_bus ? m_bus->read(address) : 0;
+	}
+	dmc.bufferFull = true;
+	m_dmaStall += 4; // The CPU is halted while the DMC has the bus, 3 or 4 cycles depending on alignment
+	dmc.currentAddress = address == 0xFFFF ? 0x8000 : address + 1;
+	if (--dmc.bytesRemaining == 0) {
+		if (dmc.loop) {
+			dmc.currentAddress = dmc.sampleAddress;
+			dmc.bytesRemaining = dmc.sampleLength;
+		}
+		else if (dmc.irqEnabled) {
+			dmcIrq = true;
+		}
+	}
+}
+
+float APU::mix() const {
+	const MixerTables& tables = mixerTables();
+	return tables.pulse[pulse1.output() + pulse2.output()] +
+		tables.tnd[3 * triangle.output() + 2 * noise.output() + dmc.output()];
+}
+
+void APU::updateOutput() {
+	// m_output is the level the blip buffer last heard, so it stays put while output is off
+	if (!m_outputEnabled) {
+		return;
+	}
+	float output = mix();
+	if (output != m_output) {
+		m_blip.addDelta(m_time, output - m_output);
+		m_output = output;
+	}
+}
+
+void APU::saveState(StateWriter& out) const {
+	auto writeEnvelope = [&out](const Envelope& envelope) {
+		out.writeBool(envelope.start);
+		out.writeBool(envelope.loop);
+		out.writeBool(envelope.constantVolume);
+		out.write8(envelope.period);
+		out.write8(envelope.divider);
+		out.write8(envelope.decay);
+	};
+	for (const PulseChannel* pulse : { &pulse1, &pulse2 }) {
+		out.writeBool(pulse->enabled);
+		out.write8(pulse->duty);
+		out.write8(pulse->sequence);
+		out.write16(pulse->period);
+		out.write32(pulse->timer);
+		out.write8(pulse->length);
+		writeEnvelope(pulse->envelope);
+		out.writeBool(pulse->sweepEnabled);
+		out.writeBool(pulse->sweepNegate);
+		out.writeBool(pulse->sweepReload);
+		out.write8(pulse->sweepPeriod);
+		out.write8(pulse->sweepShift);
+		out.write8(pulse->sweepDivider);
+	}
+
+	out.writeBool(triangle.enabled);
+	out.writeBool(triangle.control);
+	out.writeBool(triangle.linearReload);
+	out.write8(triangle.linearPeriod);
+	out.write8(triangle.linearCounter);
+	out.write8(triangle.sequence);
+	out.write16(triangle.period);
+	out.write32(triangle.timer);
+	out.write8(triangle.length);
+
+	out.writeBool(noise.enabled);
+	out.writeBool(noise.mode);
+	out.write16(noise.period);
+	out.write32(noise.timer);
+	out.write16(noise.shift);
+	out.write8(noise.length);
+	writeEnvelope(noise.envelope);
+
+	out.writeBool(dmc.irqEnabled);
+	out.writeBool(dmc.loop);
+	out.write16(dmc.period);
+	out.write32(dmc.timer);
+	out.write8(dmc.level);
+	out.write16(dmc.sampleAddress);
+	out.write16(dmc.sampleLength);
+	out.write16(dmc.currentAddress);
+	out.write16(dmc.bytesRemaining);
+	out.write8(dmc.buffer);
+	out.writeBool(dmc.bufferFull);
+	out.write8(dmc.shift);
+	out.write8(dmc.bitsRemaining);
+	out.writeBool(dmc.silence);
+
+	out.writeBool(fiveStepMode);
+	out.writeBool(irqInhibit);
+	out.writeBool(frameIrq);
+	out.writeBool(dmcIrq);
+	out.write32(frameCounterCycle);
+}
+
+bool APU::loadState(StateReader& in) {
+	auto readEnvelope = [&in](Envelope& envelope) {
+		envelope.start = in.readBool();
+		envelope.loop = in.readBool();
+		envelope.constantVolume = in.readBool();
+		envelope.period = in.read8();
+		envelope.divider = in.read8();
+		envelope.decay = in.read8();
+	};
+	for (PulseChannel* pulse : { &pulse1, &pulse2 }) {
+		pulse->enabled = in.readBool();
+		pulse->duty = in.read8() & 0x03;
+		pulse->sequence = in.read8() & 0x07;
+		pulse->period = in.read16();
+		pulse->timer = std::max<uint32_t>(in.read32(), 1);
+		pulse->length = in.read8();
+		readEnvelope(pulse->envelope);
+		pulse->sweepEnabled = in.readBool();
+		pulse->sweepNegate = in.readBool();
+		pulse->sweepReload = in.readBool();
+		pulse->sweepPeriod = in.read8();
+		pulse->sweepShift = in.read8();
+		pulse->sweepDivider = in.read8();
+	}
+
+	triangle.enabled = in.readBool();
+	triangle.control = in.readBool();
+	triangle.linearReload = in.readBool();
+	triangle.linearPeriod = in.read8();
+	triangle.linearCounter = in.read8();
+	triangle.sequence = in.read8() & 0x1F;
+	triangle.period = in.read16();
+	triangle.timer = std::max<uint32_t>(in.read32(), 1);
+	triangle.length = in.read8();
+
+	noise.enabled = in.readBool();
+	noise.mode = in.readBool();
+	noise.period = std::max<uint16_t>(in.read16(), 1);
+	noise.timer = std::max<uint32_t>(in.read32(), 1);
+	noise.shift = in.read16();
+	noise.length = in.read8();
+	readEnvelope(noise.envelope);
+
+	dmc.irqEnabled = in.readBool();
+	dmc.loop = in.readBool();
+	dmc.period = std::max<uint16_t>(in.read16(), 1);
+	dmc.timer = std::max<uint32_t>(in.read32(), 1);
+	dmc.level = in.read8() & 0x7F;
+	dmc.sampleAddress = in.read16();
+	dmc.sampleLength = in.read16();
+	dmc.currentAddress = in.read16();
+	dmc.bytesRemaining = in.read16();
+	dmc.buffer = in.read8();
+	dmc.bufferFull = in.readBool();
+	dmc.shift = in.read8();
+	dmc.bitsRemaining = std::max<uint8_t>(in.read8(), 1);
+	dmc.silence = in.readBool();
+
+	fiveStepMode = in.readBool();
+	irqInhibit = in.readBool();
+	frameIrq = in.readBool();
+	dmcIrq = in.readBool();
+	frameCounterCycle = in.read32();
+	m_pending = 0;
+	m_dmaStall = 0;
+	scheduleEvents();
+
+	// Step the output to the restored level instead of letting it glide there
+	updateOutput();
+	return in.ok();
+}
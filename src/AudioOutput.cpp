@@ -0,0 +1,91 @@
+#include "AudioOutput.h"
+#include <algorithm>
+#include <iostream>
+
+AudioOutput::~AudioOutput() {
+	close();
+}
+
+bool AudioOutput::open(int sampleRate, int bufferSamples) {
+	close();
+	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+		std::cerr << "Failed to initialise audio: " << SDL_GetError() << std::endl;
+		return false;
+	}
+
+	SDL_AudioSpec want, have;
+	SDL_memset(&want, 0, sizeof(want));
+	want.freq = sampleRate;
+	want.format = AUDIO_F32SYS; // 32-bit floating-point audio
+	want.channels = 1; // Mono audio
+	want.samples = static_cast<Uint16>(std::clamp(bufferSamples, 64, 8192));
+	want.callback = audioCallback;
+	want.userdata = this;
+
+	m_device = SDL_OpenAudioDevice(NULL, 0, &want, &have, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+	if (m_device == 0) {
+		std::cerr << "Failed to open audio: " << SDL_GetError() << std::endl;
+		return false;
+	}
+	m_sampleRate = have.freq;
+	m_bufferSamples = have.samples;
+
+	// Room for the target fill level twice over, so a slow frame doesn't overrun straight away
+	m_ring = std::make_unique<AudioRing>(targetBuffered() * 2);
+	m_lastSample = 0.0f;
+	m_started = false; // Playback starts once push() has filled the ring to the target
+	return true;
+}
+
+void AudioOutput::close() {
+	if (m_device != 0) {
+		SDL_CloseAudioDevice(m_device); // Waits for a running callback to return
+		m_device = 0;
+	}
+	m_ring.reset();
+}
+
+void AudioOutput::push(const std::vector<float>& samples) {
+	if (!m_ring) {
+		return;
+	}
+	size_t written = m_ring->write(samples.data(), samples.size());
+	if (written < samples.size()) {
+		m_metrics.overruns.fetch_add(1, std::memory_order_relaxed);
+		m_metrics.overrunSamples.fetch_add(samples.size() - written, std::memory_order_relaxed);
+	}
+	if (!m_started && m_ring->size() >= targetBuffered()) {
+		SDL_PauseAudioDevice(m_device, 0); // Start audio playback
+		m_started = true;
+	}
+}
+
+double AudioOutput::AdjustRate(double sampleRate, size_t buffered, size_t target, double maxDeviation) {
+	if (target == 0) {
+		return sampleRate;
+	}
+	// -1 when empty, 0 on target, +1 at twice the target or more
+	double fill = (static_cast<double>(buffered) - static_cast<double>(target)) / static_cast<double>(target);
+	return sampleRate * (1.0 - maxDeviation * std::clamp(fill, -1.0, 1.0));
+}
+
+// Runs on SDL's audio thread: copy out of the ring and nothing else
+void AudioOutput::audioCallback(void* userdata, Uint8* stream, int len)
+{
+	AudioOutput* output = static_cast<AudioOutput*>(userdata);
+	Trace::Scope trace("audio callback", output->m_trace);
+	float* buffer = reinterpret_cast<float*>(stream);
+	size_t wanted = len / sizeof(float);
+	size_t got = output->m_ring->read(buffer, wanted);
+
+	output->m_metrics.callbacks.fetch_add(1, std::memory_order_relaxed);
+	if (got > 0) {
+		output->m_lastSample = buffer[got - 1];
+	}
+	if (got < wanted) {
+		// Hold the last level instead of dropping to zero, a jump to silence clicks
+		std::fill(buffer + got, buffer + wanted, output->m_lastSample);
+		output->m_metrics.underruns.fetch_add(1, std::memory_order_relaxed);
+		output->m_metrics.underrunSamples.fetch_add(wanted - got, std::memory_order_relaxed);
+	}
+}
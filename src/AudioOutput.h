@@ -0,0 +1,81 @@
+#ifndef AUDIOOUTPUT_H
+#define AUDIOOUTPUT_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <SDL2/SDL.h>
+#include "AudioRing.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+/**
+ * @brief SDL sound device fed from an AudioRing.
+ *
+ * The emulation thread push()es each frame's samples; SDL's callback only
+ * copies out of the ring. The callback never allocates or locks, so a small
+ * device buffer (256-512 samples, 6-12 ms) doesn't glitch just because the
+ * emulation thread is busy. A short ring pads with the last sample (no click)
+ * and counts an underrun; a full ring drops the newest samples and counts an
+ * overrun.
+ */
+class AudioOutput
+{
+public:
+	AudioOutput() = default;
+	~AudioOutput();
+	AudioOutput(const AudioOutput&) = delete;
+	AudioOutput& operator=(const AudioOutput&) = delete;
+
+	/**
+	 * @brief Opens the default device.
+	 *
+	 * @param sampleRate Requested rate, the device may pick another (see sampleRate())
+	 * @param bufferSamples Samples SDL asks for per callback, lower is less latency
+	 * @return false (with a message on stderr) if there's no usable device
+	 */
+	bool open(int sampleRate = 44100, int bufferSamples = 512);
+	void close();
+	bool isOpen() const { return m_device != 0; }
+
+	// Emulation thread only
+	void push(const std::vector<float>& samples);
+
+	int sampleRate() const { return m_sampleRate; }
+	int bufferSamples() const { return m_bufferSamples; }
+	size_t buffered() const { return m_ring ? m_ring->size() : 0; }
+	size_t capacity() const { return m_ring ? m_ring->capacity() : 0; }
+
+	// Samples worth keeping queued: one device buffer plus a frame to cover the time until the next push
+	size_t targetBuffered() const { return m_bufferSamples + m_sampleRate / 60; }
+
+	/**
+	 * @brief Dynamic rate control: the rate to resample the next frame to.
+	 *
+	 * When video sets the pace (vsync), the emulator's 60.0988 Hz and the
+	 * sound card's clock never quite agree and the ring slowly fills or drains.
+	 * Producing slightly fewer samples when the ring is above its target and
+	 * slightly more when below keeps it near the target for good. The change
+	 * is at most maxDeviation (0.5% is well under what the ear notices as pitch).
+	 */
+	double adjustedSampleRate(double maxDeviation = 0.005) const {
+		return AdjustRate(m_sampleRate, buffered(), targetBuffered(), maxDeviation);
+	}
+	static double AdjustRate(double sampleRate, size_t buffered, size_t target, double maxDeviation);
+
+	const AudioMetrics& metrics() const { return m_metrics; }
+
+private:
+	static void audioCallback(void* userdata, Uint8* stream, int len);
+
+	SDL_AudioDeviceID m_device = 0;
+	int m_sampleRate = 0;
+	int m_bufferSamples = 0;
+	std::unique_ptr<AudioRing> m_ring;
+	AudioMetrics m_metrics;
+	float m_lastSample = 0.0f; // Callback thread only
+	Trace::Track* m_trace = Trace::NewTrack("audio callback"); // Registered here so the callback never has to
+	bool m_started = false;
+};
+
+#endif // AUDIOOUTPUT_H
@@ -0,0 +1,48 @@
+#include "AudioRing.h"
+#include <algorithm>
+
+AudioRing::AudioRing(size_t capacity) {
+	size_t size = 1;
+	while (size < capacity) {
+		size <<= 1;
+	}
+	m_buffer.resize(size, 0.0f);
+	m_mask = size - 1;
+}
+
+// The indices count samples ever written or read and are only masked on access,
+// so full (write - read == capacity) and empty (write == read) can't be confused.
+size_t AudioRing::write(const float* samples, size_t count) {
+	size_t write = m_writeIndex.load(std::memory_order_relaxed);
+	size_t read = m_readIndex.load(std::memory_order_acquire);
+	count = std::min(count, capacity() - (write - read));
+
+	size_t start = write & m_mask;
+	size_t first = std::min(count, capacity() - start);
+	std::copy(samples, samples + first, m_buffer.begin() + start);
+	std::copy(samples + first, samples + count, m_buffer.begin());
+
+	m_writeIndex.store(write + count, std::memory_order_release);
+	return count;
+}
+
+size_t AudioRing::read(float* out, size_t count) {
+	size_t read = m_readIndex.load(std::memory_order_relaxed);
+	size_t write = m_writeIndex.load(std::memory_order_acquire);
+	count = std::min(count, write - read);
+
+	size_t start = read & m_mask;
+	size_t first = std::min(count, capacity() - start);
+	std::copy(m_buffer.begin() + start, m_buffer.begin() + start + first, out);
+	std::copy(m_buffer.begin(), m_buffer.begin() + (count - first), out + first);
+
+	m_readIndex.store(read + count, std::memory_order_release);
+	return count;
+}
+
+size_t AudioRing::size() const {
+	// The read index never passes the write index, so loading it first keeps the difference from going negative
+	size_t read = m_readIndex.load(std::memory_order_acquire);
+	size_t write = m_writeIndex.load(std::memory_order_acquire);
+	return write - read;
+}
@@ -0,0 +1,40 @@
+#ifndef AUDIORING_H
+#define AUDIORING_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief Single-producer single-consumer ring of audio samples.
+ *
+ * The emulation thread writes, the audio callback reads, and neither ever
+ * blocks, locks or allocates: each side owns one index and only publishes it
+ * with a release store once the samples are copied. Capacity is rounded up to
+ * a power of two so wrapping is a mask.
+ */
+class AudioRing
+{
+public:
+	explicit AudioRing(size_t capacity = 4096);
+
+	// Producer only. Copies as many samples as fit and returns how many that was.
+	size_t write(const float* samples, size_t count);
+
+	// Consumer only. Copies up to count samples out and returns how many that was.
+	size_t read(float* out, size_t count);
+
+	// Samples waiting to be read. Exact from either side, a snapshot from anywhere else.
+	size_t size() const;
+	size_t capacity() const { return m_buffer.size(); }
+
+private:
+	std::vector<float> m_buffer;
+	size_t m_mask;
+
+	// Each index lives on its own cache line so the two threads don't keep stealing it from each other
+	alignas(64) std::atomic<size_t> m_writeIndex{ 0 };
+	alignas(64) std::atomic<size_t> m_readIndex{ 0 };
+};
+
+#endif // AUDIORING_H
@@ -0,0 +1,167 @@
+#include "AudioWriter.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+
+namespace {
+	void put16(std::vector<uint8_t>& out, uint16_t value) {
+		out.push_back(value & 0xFF);
+		out.push_back(value >> 8);
+	}
+
+	void put32(std::vector<uint8_t>& out, uint32_t value) {
+		put16(out, value & 0xFFFF);
+		put16(out, value >> 16);
+	}
+
+	void putTag(std::vector<uint8_t>& out, const char* tag) {
+		out.insert(out.end(), tag, tag + 4);
+	}
+
+	// RIFF, fmt (IEEE float, 18 bytes), fact and the data chunk header
+	constexpr uint32_t wavHeaderSize = 12 + 26 + 12 + 8;
+}
+
+AudioWriter::~AudioWriter() {
+	close();
+}
+
+bool AudioWriter::open(const std::string& path, int sampleRate, Format format) {
+	close();
+	m_file.open(path, std::ios::binary | std::ios::trunc);
+	if (!m_file.is_open()) {
+		std::cerr << "Failed to create audio file: " << path << std::endl;
+		return false;
+	}
+	m_format = format;
+	m_sampleRate = sampleRate;
+	m_pushed = 0;
+	m_written = 0;
+	m_failed = false;
+	m_filling.clear();
+	m_writing.clear();
+	m_filling.reserve(blockSamples);
+	m_writing.reserve(blockSamples);
+	m_handedOver = false;
+	m_stopping = false;
+	if (m_format == Format::Wav) {
+		writeWavHeader(0); // Placeholder sizes until close()
+	}
+	m_thread = std::thread(&AudioWriter::writerLoop, this);
+	return true;
+}
+
+AudioWriter::Format AudioWriter::FormatFor(const std::string& path) {
+	std::string extension = path.size() >= 4 ? path.substr(path.size() - 4) : "";
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	return extension == ".wav" ? Format::Wav : Format::RawFloat;
+}
+
+void AudioWriter::push(const float* samples, size_t count) {
+	if (!isOpen()) {
+		return;
+	}
+	m_filling.insert(m_filling.end(), samples, samples + count);
+	m_pushed += count;
+	if (m_filling.size() < blockSamples) {
+		return;
+	}
+	// Hand the block over only if that's free right now, otherwise keep filling and try next time
+	std::unique_lock<std::mutex> lock(m_mutex, std::try_to_lock);
+	if (lock.owns_lock() && !m_handedOver) {
+		std::swap(m_filling, m_writing);
+		m_handedOver = true;
+		lock.unlock();
+		m_wake.notify_one();
+	}
+}
+
+bool AudioWriter::close() {
+	if (!isOpen()) {
+		return !m_failed;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wake.notify_one();
+	m_thread.join(); // Finishes the block it was handed first
+
+	writeSamples(m_filling);
+	m_filling.clear();
+	if (m_format == Format::Wav) {
+		m_file.seekp(0);
+		writeWavHeader(static_cast<uint32_t>(std::min<uint64_t>(m_written, (UINT32_MAX - wavHeaderSize) / 4)));
+	}
+	m_file.close();
+	if (m_file.fail()) {
+		m_failed = true;
+	}
+	return !m_failed;
+}
+
+void AudioWriter::writerLoop() {
+	Trace::SetThreadName("audio writer");
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true) {
+		m_wake.wait(lock, [this] { return m_handedOver || m_stopping; });
+		if (m_handedOver) {
+			// The block is ours until m_handedOver goes back to false, write it without holding the lock
+			lock.unlock();
+			TRACE_SCOPE("audio file write");
+			writeSamples(m_writing);
+			m_writing.clear();
+			lock.lock();
+			m_handedOver = false;
+		}
+		else {
+			return;
+		}
+	}
+}
+
+void AudioWriter::writeSamples(const std::vector<float>& samples) {
+	std::vector<uint8_t> bytes(samples.size() * 4);
+	for (size_t i = 0; i < samples.size(); ++i) {
+		uint32_t bits;
+		std::memcpy(&bits, &samples[i], sizeof(bits));
+		bytes[i * 4 + 0] = bits & 0xFF;
+		bytes[i * 4 + 1] = (bits >> 8) & 0xFF;
+		bytes[i * 4 + 2] = (bits >> 16) & 0xFF;
+		bytes[i * 4 + 3] = bits >> 24;
+	}
+	m_file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+	if (m_file.fail()) {
+		m_failed = true;
+	}
+	m_written += samples.size();
+}
+
+void AudioWriter::writeWavHeader(uint32_t sampleCount) {
+	const uint32_t dataSize = sampleCount * 4;
+	std::vector<uint8_t> header;
+	header.reserve(wavHeaderSize);
+	putTag(header, "RIFF");
+	put32(header, wavHeaderSize - 8 + dataSize);
+	putTag(header, "WAVE");
+
+	putTag(header, "fmt ");
+	put32(header, 18);
+	put16(header, 3); // WAVE_FORMAT_IEEE_FLOAT
+	put16(header, 1); // Mono
+	put32(header, m_sampleRate);
+	put32(header, m_sampleRate * 4); // Bytes per second
+	put16(header, 4); // Bytes per sample frame
+	put16(header, 32); // Bits per sample
+	put16(header, 0); // No extension
+
+	putTag(header, "fact"); // Required for non-PCM formats
+	put32(header, 4);
+	put32(header, sampleCount);
+
+	putTag(header, "data");
+	put32(header, dataSize);
+	m_file.write(reinterpret_cast<const char*>(header.data()), header.size());
+}
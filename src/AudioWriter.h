@@ -0,0 +1,88 @@
+#ifndef AUDIOWRITER_H
+#define AUDIOWRITER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Streams mono float samples to a WAV or raw file from a background thread.
+ *
+ * The emulation thread push()es into one block while the writer thread
+ * writes the other to disk; a full block is handed over by swapping the two.
+ * push() never waits for the disk: if the writer is still busy (or holds the
+ * lock for that instant), the current block just keeps growing and goes
+ * over on a later push. Once both blocks have reached their working size
+ * nothing is allocated either.
+ *
+ * WAV files are 32-bit IEEE float so captures compare bit for bit; the
+ * header's sizes are filled in by close(). Raw files are bare little-endian
+ * float32 samples.
+ */
+class AudioWriter
+{
+public:
+	enum class Format {
+		Wav,
+		RawFloat,
+	};
+
+	AudioWriter() = default;
+	~AudioWriter(); // Closes, so the file is always complete
+	AudioWriter(const AudioWriter&) = delete;
+	AudioWriter& operator=(const AudioWriter&) = delete;
+
+	/**
+	 * @brief Creates the file and starts the writer thread.
+	 *
+	 * @return false (with a message on stderr) if the file can't be created
+	 */
+	bool open(const std::string& path, int sampleRate, Format format);
+
+	// .wav (any case) is a WAV file, anything else raw float
+	static Format FormatFor(const std::string& path);
+
+	// Emulation thread only
+	void push(const float* samples, size_t count);
+	void push(const std::vector<float>& samples) { push(samples.data(), samples.size()); }
+
+	/**
+	 * @brief Writes what's left, finishes the header and closes the file.
+	 *
+	 * @return false if any write failed along the way
+	 */
+	bool close();
+	bool isOpen() const { return m_thread.joinable(); }
+
+	// Samples pushed since open, written or still queued
+	uint64_t samplesPushed() const { return m_pushed; }
+
+	static constexpr size_t blockSamples = 16384; // About a third of a second at 48 kHz
+
+private:
+	void writerLoop();
+	void writeSamples(const std::vector<float>& samples);
+	void writeWavHeader(uint32_t sampleCount);
+
+	std::ofstream m_file;
+	Format m_format = Format::Wav;
+	int m_sampleRate = 0;
+	uint64_t m_pushed = 0;
+	uint64_t m_written = 0;            // Writer thread while running, close() after
+	std::atomic<bool> m_failed{ false };
+
+	std::vector<float> m_filling;      // Emulation thread
+	std::vector<float> m_writing;      // Writer thread, while m_handedOver
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	bool m_handedOver = false;
+	bool m_stopping = false;
+	std::thread m_thread;
+};
+
+#endif // AUDIOWRITER_H
@@ -0,0 +1,159 @@
+#include "BlipBuffer.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BLIP_SSE2 1
+#endif
+
+namespace {
+	constexpr int phases = 1 << BlipBuffer::phaseBits;
+	constexpr int taps = BlipBuffer::kernelTaps;
+	constexpr double pi = 3.14159265358979323846;
+
+	using Kernel = std::array<std::array<float, taps>, phases>;
+
+	// Blackman-windowed sinc, one row per sub-sample phase, each row summing to 1 so a
+	// step of delta always settles at exactly delta
+	Kernel makeKernel() {
+		const double cutoff = 0.9; // Fraction of the output Nyquist frequency kept
+		Kernel kernel{};
+		for (int phase = 0; phase < phases; ++phase) {
+			double sum = 0.0;
+			for (int i = 0; i < taps; ++i) {
+				double x = i - (taps / 2 - 1) - static_cast<double>(phase) / phases;
+				double sinc = x == 0.0 ? 1.0 : std::sin(pi * cutoff * x) / (pi * cutoff * x);
+				double w = 0.42 + 0.5 * std::cos(2.0 * pi * x / taps) + 0.08 * std::cos(4.0 * pi * x / taps);
+				kernel[phase][i] = static_cast<float>(sinc * w);
+				sum += kernel[phase][i];
+			}
+			for (int i = 0; i < taps; ++i) {
+				kernel[phase][i] = static_cast<float>(kernel[phase][i] / sum);
+			}
+		}
+		return kernel;
+	}
+
+	const Kernel& kernel() {
+		static const Kernel table = makeKernel();
+		return table;
+	}
+
+	// Pole of the DC blocker. Integrating and then blocking DC (y = s[n] - s[n-1] + decay * y) is the
+	// same as leaking the integrator directly, y = x[n] + decay * y, which is what both paths do.
+	constexpr float decay = 0.999f;
+
+	void addKernelScalar(float* out, const float* row, float delta) {
+		for (int i = 0; i < taps; ++i) {
+			out[i] += row[i] * delta;
+		}
+	}
+
+	float integrateScalar(const float* in, float* out, size_t count, float level) {
+		for (size_t i = 0; i < count; ++i) {
+			level = in[i] + decay * level;
+			out[i] = level;
+		}
+		return level;
+	}
+
+#ifdef BLIP_SSE2
+	void addKernelSse(float* out, const float* row, float delta) {
+		__m128 scale = _mm_set1_ps(delta);
+		for (int i = 0; i < taps; i += 4) {
+			_mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(_mm_loadu_ps(row + i), scale)));
+		}
+	}
+
+	// Four samples at a time: a two step scan leaves each lane with its decayed sum of the block so far,
+	// then the level carried in from the previous block is decayed onto every lane
+	float integrateSse(const float* in, float* out, size_t count, float level) {
+		const __m128 decay1 = _mm_set1_ps(decay);
+		const __m128 decay2 = _mm_set1_ps(decay * decay);
+		const __m128 carryDecay = _mm_setr_ps(decay, decay * decay, decay * decay * decay, decay * decay * decay * decay);
+		__m128 carry = _mm_set1_ps(level);
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4) {
+			__m128 v = _mm_loadu_ps(in + i);
+			v = _mm_add_ps(v, _mm_mul_ps(decay1, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 4))));
+			v = _mm_add_ps(v, _mm_mul_ps(decay2, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 8))));
+			v = _mm_add_ps(v, _mm_mul_ps(carryDecay, carry));
+			_mm_storeu_ps(out + i, v);
+			carry = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+		}
+		return integrateScalar(in + i, out + i, count - i, _mm_cvtss_f32(carry));
+	}
+#endif
+}
+
+bool BlipBuffer::SimdAvailable() {
+#ifdef BLIP_SSE2
+	return true;
+#else
+	return false;
+#endif
+}
+
+BlipBuffer::BlipBuffer(double clockRate, double sampleRate) {
+	setRates(clockRate, sampleRate);
+}
+
+void BlipBuffer::setRates(double clockRate, double sampleRate) {
+	m_clockRate = clockRate;
+	m_sampleRate = sampleRate;
+	m_factor = static_cast<uint64_t>(sampleRate / clockRate * static_cast<double>(1ULL << fracBits) + 0.5);
+	// Room for a tenth of a second (several frames) of unread samples plus the kernel tail
+	size_t size = static_cast<size_t>(sampleRate / 10.0) + taps + 1;
+	if (m_buffer.size() < size) {
+		m_buffer.resize(size, 0.0f);
+	}
+}
+
+void BlipBuffer::addDelta(uint32_t clockTime, float delta) {
+	uint64_t position = m_offset + clockTime * m_factor;
+	size_t sample = static_cast<size_t>(position >> fracBits);
+	int phase = static_cast<int>(position >> (fracBits - phaseBits)) & (phases - 1);
+	if (sample + taps > m_buffer.size()) {
+		return; // Nobody is reading samples, drop rather than overflow
+	}
+	const float* row = kernel()[phase].data();
+	float* out = &m_buffer[sample];
+#ifdef BLIP_SSE2
+	if (m_simd) {
+		addKernelSse(out, row, delta);
+		return;
+	}
+#endif
+	addKernelScalar(out, row, delta);
+}
+
+void BlipBuffer::endFrame(uint32_t clockDuration) {
+	m_offset += clockDuration * m_factor;
+	uint64_t limit = static_cast<uint64_t>(m_buffer.size() - taps) << fracBits;
+	m_offset = std::min(m_offset, limit);
+}
+
+size_t BlipBuffer::readSamples(float* out, size_t count) {
+	count = std::min(count, samplesAvailable());
+	// Integrate the impulses back into steps. The NES output never goes negative, a DC blocker centres it around zero.
+#ifdef BLIP_SSE2
+	m_output = m_simd ? integrateSse(m_buffer.data(), out, count, m_output) : integrateScalar(m_buffer.data(), out, count, m_output);
+#else
+	m_output = integrateScalar(m_buffer.data(), out, count, m_output);
+#endif
+
+	// Shift what's left (later samples and kernel tails) down to the start
+	size_t remaining = samplesAvailable() - count + taps;
+	std::copy(m_buffer.begin() + count, m_buffer.begin() + count + remaining, m_buffer.begin());
+	std::fill(m_buffer.begin() + remaining, m_buffer.begin() + remaining + count, 0.0f);
+	m_offset -= static_cast<uint64_t>(count) << fracBits;
+	return count;
+}
+
+void BlipBuffer::clear() {
+	std::fill(m_buffer.begin(), m_buffer.end(), 0.0f);
+	m_offset = 0;
+	m_output = 0.0f;
+}
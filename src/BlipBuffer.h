@@ -0,0 +1,68 @@
+#ifndef BLIPBUFFER_H
+#define BLIPBUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Turns amplitude changes at CPU clock times into band-limited samples.
+ *
+ * Instead of sampling the APU on every cycle, channels report only the moments
+ * their output changes (addDelta). Each change is spread over a few output
+ * samples as a band-limited impulse, and reading integrates those impulses
+ * back into steps. The result is the same as filtering the 1.79 MHz signal
+ * down to the output rate, at a cost proportional to the number of changes
+ * instead of the number of cycles.
+ *
+ * Usage per frame: addDelta() any number of times with times relative to the
+ * start of the frame, endFrame() with the frame length, then readSamples().
+ *
+ * The kernel accumulation and the integrate/DC-block pass over a frame use
+ * SSE where the target has it, with a plain loop as the reference and
+ * fallback; the two agree to float rounding (see setSimd).
+ */
+class BlipBuffer
+{
+public:
+	BlipBuffer(double clockRate = 1789773.0, double sampleRate = 44100.0);
+
+	// Output samples per second of input clock. Can be nudged while running (see rate control).
+	void setRates(double clockRate, double sampleRate);
+	double sampleRate() const { return m_sampleRate; }
+
+	// Amplitude changes by delta at clockTime cycles after the start of the current frame
+	void addDelta(uint32_t clockTime, float delta);
+
+	// Ends the frame after clockDuration cycles, making its samples readable
+	void endFrame(uint32_t clockDuration);
+
+	size_t samplesAvailable() const { return static_cast<size_t>(m_offset >> fracBits); }
+
+	// Moves up to count finished samples to out, returns how many were written
+	size_t readSamples(float* out, size_t count);
+
+	// Drops all pending samples and filter history
+	void clear();
+
+	// Vector paths on or off, off runs the scalar reference. On by default when SimdAvailable().
+	void setSimd(bool enabled) { m_simd = enabled && SimdAvailable(); }
+	static bool SimdAvailable();
+
+	static constexpr int kernelTaps = 16;   // Output samples an impulse is spread over
+	static constexpr int phaseBits = 6;     // Sub-sample positions the kernel is tabulated for
+
+private:
+	static constexpr int fracBits = 32;     // Fixed point fraction of sample positions
+
+	double m_clockRate = 0.0;
+	double m_sampleRate = 0.0;
+	uint64_t m_factor = 0;  // Samples per clock, fixed point
+	uint64_t m_offset = 0;  // Start of the current frame in samples, fixed point
+
+	std::vector<float> m_buffer; // Impulses waiting to be integrated
+	float m_output = 0.0f;       // Last sample out of the leaky integrator
+	bool m_simd = SimdAvailable();
+};
+
+#endif // BLIPBUFFER_H
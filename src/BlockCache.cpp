@@ -0,0 +1,78 @@
+#include "BlockCache.h"
+#include "CPU.h"
+#include <algorithm>
+
+namespace {
+	// Branches, jumps, calls, returns and BRK: where the next instruction isn't the following bytes
+	bool endsBlock(uint8_t opcode) {
+		switch (opcode) {
+		case 0x10: case 0x30: case 0x50: case 0x70: case 0x90: case 0xB0: case 0xD0: case 0xF0:
+		case 0x4C: case 0x6C: case 0x20: case 0x60: case 0x40: case 0x00:
+			return true;
+		default:
+			return false;
+		}
+	}
+}
+
+const DecodedInstruction* BlockCache::decode(const CPU& cpu, uint16_t pc) {
+	if (pc < 0x8000) {
+		return nullptr;
+	}
+	auto block = std::make_unique<Block>();
+	block->bank = BankOf(pc);
+	block->instructions.reserve(maxBlockInstructions);
+	uint32_t address = pc;
+	while (block->instructions.size() < maxBlockInstructions) {
+		DecodedInstruction instruction;
+		instruction.pc = static_cast<uint16_t>(address);
+		instruction.opcode = cpu.peek(instruction.pc);
+		CPU::DecodedOpcode decoded = CPU::DecodedHandler(instruction.opcode);
+		instruction.handler = decoded.handler;
+		instruction.length = decoded.length;
+		if (address + instruction.length > 0x10000) {
+			break; // Its operand would wrap around to $0000
+		}
+		for (int i = 1; i < instruction.length; ++i) {
+			instruction.operand |= cpu.peek(static_cast<uint16_t>(address + i)) << (8 * (i - 1));
+		}
+		block->instructions.push_back(instruction);
+		address += instruction.length;
+		if (endsBlock(instruction.opcode) || address > 0xFFFF || m_entries[address & 0x7FFF] ||
+			BankOf(static_cast<uint16_t>(address)) != block->bank) {
+			break;
+		}
+	}
+	if (block->instructions.empty()) {
+		return nullptr;
+	}
+	for (const DecodedInstruction& instruction : block->instructions) {
+		m_entries[instruction.pc & 0x7FFF] = &instruction;
+	}
+	m_blocks.push_back(std::move(block));
+	return &m_blocks.back()->instructions.front();
+}
+
+void BlockCache::invalidateBank(int bank) {
+	auto stale = std::stable_partition(m_blocks.begin(), m_blocks.end(),
+		[bank](const std::unique_ptr<Block>& block) { return block->bank != bank; });
+	for (auto it = stale; it != m_blocks.end(); ++it) {
+		for (const DecodedInstruction& instruction : (*it)->instructions) {
+			m_entries[instruction.pc & 0x7FFF] = nullptr;
+		}
+	}
+	m_blocks.erase(stale, m_blocks.end());
+}
+
+void BlockCache::clear() {
+	m_blocks.clear();
+	std::fill(m_entries.begin(), m_entries.end(), nullptr);
+}
+
+size_t BlockCache::instructionCount() const {
+	size_t count = 0;
+	for (const auto& block : m_blocks) {
+		count += block->instructions.size();
+	}
+	return count;
+}
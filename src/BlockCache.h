@@ -0,0 +1,70 @@
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class CPU;
+
+// One pre-decoded instruction: the handler for its opcode and addressing mode, and its operand
+struct DecodedInstruction {
+	uint8_t (*handler)(CPU& cpu, const DecodedInstruction& instruction) = nullptr; // Runs it, returns its cycles
+	uint16_t pc = 0;
+	uint16_t operand = 0; // The bytes after the opcode, low byte first
+	uint8_t opcode = 0;
+	uint8_t length = 1;
+};
+
+/**
+ * @brief Cached interpreter: PRG ROM code decoded once into basic blocks.
+ *
+ * Without it every instruction is fetched byte by byte through CPU::read and
+ * goes through the big opcode switch. With a cache attached (CPU::SetBlockCache)
+ * the CPU looks up the instruction at PC here and calls its handler, which
+ * already knows the addressing mode, operand, length and cycles. The CPU still
+ * runs one instruction per execute(), so the PPU and APU are stepped between
+ * instructions exactly as before.
+ *
+ * A block is decoded the first time the CPU lands on an address nothing covers
+ * yet and runs up to the next branch, jump, call, return or BRK, or into code
+ * that is already decoded. Blocks are keyed by PRG bank and address: each
+ * remembers the bank it was decoded from and invalidateBank drops the blocks of
+ * a bank being switched out. Only addresses from $8000 up are cached; code
+ * running from RAM, which can be rewritten at any time, is always interpreted.
+ */
+class BlockCache
+{
+public:
+	static constexpr int maxBlockInstructions = 64;
+
+	// The instruction at pc (from $8000 up), decoding its block first if needed. nullptr if it
+	// can't be decoded (it would run past $FFFF) and has to be interpreted.
+	const DecodedInstruction* find(const CPU& cpu, uint16_t pc) {
+		const DecodedInstruction* instruction = m_entries[pc & 0x7FFF];
+		return instruction ? instruction : decode(cpu, pc);
+	}
+
+	// PRG bank mapped at an address. Every cartridge here is NROM, so that is always bank 0;
+	// a bank-switching mapper would answer from its registers and call invalidateBank on a switch.
+	static int BankOf(uint16_t) { return 0; }
+
+	void invalidateBank(int bank);
+	void clear();
+
+	size_t blockCount() const { return m_blocks.size(); }
+	size_t instructionCount() const;
+
+private:
+	struct Block {
+		int bank = 0;
+		std::vector<DecodedInstruction> instructions;
+	};
+
+	const DecodedInstruction* decode(const CPU& cpu, uint16_t pc);
+
+	std::vector<std::unique_ptr<Block>> m_blocks; // unique_ptr keeps the entries' pointers valid as blocks are added
+	std::vector<const DecodedInstruction*> m_entries = std::vector<const DecodedInstruction*>(0x8000, nullptr); // By PC - $8000
+};
+
+#endif // BLOCKCACHE_H
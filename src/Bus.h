@@ -6,6 +6,7 @@
 #include <cstdint>
 #include <memory>
 #include <vector>
+#include "BusStats.h"
 
 class Bus
 {
@@ -18,6 +19,9 @@ public:
 	uint8_t read(uint16_t address);
     std::vector<uint8_t> memory;
 	bool nmi = false; // CPU and PPU set this.
+#ifdef NES_BUS_STATS
+	BusStats stats; // CPU traffic by page and register, see BusStats.h
+#endif
 private:
 	
 
@@ -0,0 +1,118 @@
+#include "BusStats.h"
+#include "ImageWriter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+namespace {
+	const char* registerNames[BusStats::registers] = {
+		"PPUCTRL", "PPUMASK", "PPUSTATUS", "OAMADDR", "OAMDATA", "PPUSCROLL", "PPUADDR", "PPUDATA",
+		"SQ1_VOL", "SQ1_SWEEP", "SQ1_LO", "SQ1_HI", "SQ2_VOL", "SQ2_SWEEP", "SQ2_LO", "SQ2_HI",
+		"TRI_LINEAR", "unused", "TRI_LO", "TRI_HI", "NOISE_VOL", "unused", "NOISE_LO", "NOISE_HI",
+		"DMC_FREQ", "DMC_RAW", "DMC_START", "DMC_LEN", "OAMDMA", "SND_CHN", "JOY1", "JOY2/FRAME",
+		"test", "test", "test", "test", "test", "test", "test", "test",
+	};
+
+	// 0-255 on a log scale, so a page touched a few times still shows next to a polling loop
+	uint32_t level(uint64_t count, double logMax) {
+		if (count == 0 || logMax <= 0.0) {
+			return 0;
+		}
+		return static_cast<uint32_t>(std::lround(40.0 + 215.0 * std::log2(1.0 + count) / logMax));
+	}
+}
+
+void BusStats::clear() {
+	std::fill(std::begin(m_pageReads), std::end(m_pageReads), 0);
+	std::fill(std::begin(m_pageWrites), std::end(m_pageWrites), 0);
+	std::fill(std::begin(m_registerReads), std::end(m_registerReads), 0);
+	std::fill(std::begin(m_registerWrites), std::end(m_registerWrites), 0);
+}
+
+void BusStats::frameStart() {
+	if (resetEachFrame) {
+		clear();
+	}
+}
+
+std::string BusStats::RegisterName(int index) {
+	char text[40];
+	uint16_t address = static_cast<uint16_t>(index < ppuRegisters ? 0x2000 + index : 0x4000 + index - ppuRegisters);
+	std::snprintf(text, sizeof(text), "%s ($%04X)", registerNames[index], address);
+	return text;
+}
+
+void BusStats::report(std::ostream& out, size_t topPages) const {
+	char line[120];
+	std::vector<int> registers;
+	for (int i = 0; i < BusStats::registers; ++i) {
+		if (m_registerReads[i] || m_registerWrites[i]) {
+			registers.push_back(i);
+		}
+	}
+	std::sort(registers.begin(), registers.end(), [this](int a, int b) {
+		return m_registerReads[a] + m_registerWrites[a] > m_registerReads[b] + m_registerWrites[b];
+	});
+	out << "Registers\n           reads          writes  register\n";
+	for (int index : registers) {
+		std::snprintf(line, sizeof(line), "%16llu%16llu  %s\n", static_cast<unsigned long long>(m_registerReads[index]),
+			static_cast<unsigned long long>(m_registerWrites[index]), RegisterName(index).c_str());
+		out << line;
+	}
+
+	std::vector<int> pages;
+	for (int page = 0; page < 256; ++page) {
+		if (m_pageReads[page] || m_pageWrites[page]) {
+			pages.push_back(page);
+		}
+	}
+	std::sort(pages.begin(), pages.end(), [this](int a, int b) {
+		return m_pageReads[a] + m_pageWrites[a] > m_pageReads[b] + m_pageWrites[b];
+	});
+	pages.resize(std::min(pages.size(), topPages));
+	out << "\nPages\n           reads          writes  page\n";
+	for (int page : pages) {
+		std::snprintf(line, sizeof(line), "%16llu%16llu  $%02X00-$%02XFF\n", static_cast<unsigned long long>(m_pageReads[page]),
+			static_cast<unsigned long long>(m_pageWrites[page]), page, page);
+		out << line;
+	}
+}
+
+std::vector<uint32_t> BusStats::heatmap() const {
+	uint64_t busiest = 0;
+	for (int i = 0; i < 256; ++i) {
+		busiest = std::max({ busiest, m_pageReads[i], m_pageWrites[i] });
+	}
+	for (int i = 0; i < registers; ++i) {
+		busiest = std::max({ busiest, m_registerReads[i], m_registerWrites[i] });
+	}
+	double logMax = std::log2(1.0 + busiest);
+
+	std::vector<uint32_t> pixels(heatmapWidth * heatmapHeight, 0x00202020); // Dark grey shows the gaps
+	auto fill = [&](int x0, int y0, int size, uint64_t reads, uint64_t writes) {
+		uint32_t color = (level(writes, logMax) << 16) | (level(reads, logMax) << 8);
+		// A pixel of border between cells
+		for (int y = y0 + 1; y < y0 + size; ++y) {
+			for (int x = x0 + 1; x < x0 + size; ++x) {
+				pixels[y * heatmapWidth + x] = color;
+			}
+		}
+	};
+	for (int page = 0; page < 256; ++page) {
+		fill((page % 16) * 16, (page / 16) * 16, 16, m_pageReads[page], m_pageWrites[page]);
+	}
+	for (int i = 0; i < registers; ++i) {
+		fill(i * 6, 256 + 5, 6, m_registerReads[i], m_registerWrites[i]);
+	}
+	return pixels;
+}
+
+bool BusStats::writeHeatmap(const std::string& path) const {
+	std::vector<uint32_t> pixels = heatmap();
+	if (!ImageWriter::WritePpm(path, pixels.data(), heatmapWidth, heatmapHeight)) {
+		std::cerr << "Failed to write " << path << std::endl;
+		return false;
+	}
+	return true;
+}
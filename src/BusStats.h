@@ -0,0 +1,97 @@
+#ifndef BUSSTATS_H
+#define BUSSTATS_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief How often the CPU touches each part of the address space.
+ *
+ * Reads and writes are counted for each 256-byte page and for each PPU
+ * register ($2000-$2007, mirrors folded in) and APU/IO register
+ * ($4000-$401F). A $2002 polling loop, say, shows up as millions of
+ * PPUSTATUS reads, which is what makes it worth a fast path.
+ *
+ * The counting lives in Bus and is fed from CPU::read and CPU::write, only in
+ * builds configured with -DNES_BUS_STATS=ON; otherwise neither the member nor
+ * the calls exist. INC and DEC change RAM in place and count their own
+ * accesses, so every instruction the interpreter runs is covered.
+ */
+class BusStats
+{
+public:
+	static constexpr bool Available =
+#ifdef NES_BUS_STATS
+		true;
+#else
+		false;
+#endif
+
+	static constexpr int ppuRegisters = 8;   // $2000-$2007
+	static constexpr int ioRegisters = 0x20; // $4000-$401F
+	static constexpr int registers = ppuRegisters + ioRegisters;
+
+	void read(uint16_t address) {
+		m_pageReads[address >> 8]++;
+		int index = registerIndex(address);
+		if (index >= 0) {
+			m_registerReads[index]++;
+		}
+	}
+	void write(uint16_t address) {
+		m_pageWrites[address >> 8]++;
+		int index = registerIndex(address);
+		if (index >= 0) {
+			m_registerWrites[index]++;
+		}
+	}
+
+	void clear();
+	// Called by Emulator before each frame, clears the counts when resetEachFrame is set
+	void frameStart();
+	bool resetEachFrame = false;
+
+	uint64_t pageReads(uint8_t page) const { return m_pageReads[page]; }
+	uint64_t pageWrites(uint8_t page) const { return m_pageWrites[page]; }
+	// index: 0-7 for $2000-$2007, 8 and up for $4000-$401F
+	uint64_t registerReads(int index) const { return m_registerReads[index]; }
+	uint64_t registerWrites(int index) const { return m_registerWrites[index]; }
+	static std::string RegisterName(int index); // "PPUSTATUS ($2002)"
+
+	// Register and page tables, busiest first, skipping anything never touched
+	void report(std::ostream& out, size_t topPages = 16) const;
+
+	/**
+	 * @brief Heatmap of the counts as packed 0x00RRGGBB pixels, 256 wide and heatmapHeight tall.
+	 *
+	 * The top 256x256 is a 16x16 grid of pages ($00xx top left, $FFxx bottom
+	 * right), below it one cell per register. Writes are red, reads green, both
+	 * on a log scale against the busiest cell.
+	 */
+	std::vector<uint32_t> heatmap() const;
+	static constexpr int heatmapWidth = 256;
+	static constexpr int heatmapHeight = 256 + 16;
+
+	// heatmap() as a PPM file, false (with a message on stderr) if it can't be written
+	bool writeHeatmap(const std::string& path) const;
+
+private:
+	static int registerIndex(uint16_t address) {
+		if (address >= 0x2000 && address < 0x4000) {
+			return address & 0x07;
+		}
+		if (address >= 0x4000 && address < 0x4020) {
+			return ppuRegisters + (address - 0x4000);
+		}
+		return -1;
+	}
+
+	uint64_t m_pageReads[256] = {};
+	uint64_t m_pageWrites[256] = {};
+	uint64_t m_registerReads[registers] = {};
+	uint64_t m_registerWrites[registers] = {};
+};
+
+#endif // BUSSTATS_H
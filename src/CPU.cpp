@@ -1,5 +1,9 @@
 #include "CPU.h"
 #include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <array>
+#include <type_traits>
 
 void CPU::respTest()
 {
@@ -51,26 +55,29 @@ void CPU::respTest()
     std::cout << "Expected value after ROR: " << std::hex << static_cast<int>(0x2A) << std::endl;
 }
 
-CPU::CPU(std::shared_ptr<Bus> bus, std::shared_ptr<Cartridge> cart, std::shared_ptr<OAM> oam) : stack_pointer(0xFF), memory(65536, 0), program_counter(reset_vector),
-m_oam(oam), m_cart(cart), m_bus(bus) // Initialize 64KB of memory
+CPU::CPU(std::shared_ptr<Bus> bus, std::shared_ptr<Cartridge> cart, std::shared_ptr<OAM> oam) : stack_pointer(0xFF), program_counter(reset_vector),
+m_bus(bus), memory(bus->memory), m_cart(cart), m_oam(oam) // 64KB of memory owned by the bus
 {
     uint16_t temp = read(program_counter++);
     temp = temp << 8;
     temp |= read(program_counter);
     program_counter = Utilities::ByteSwap(temp); // Now we jump!!!!
-    bus->memory = memory; // Initialize the bus memory with the CPU memory (hacky copies for now)
+    setInterruptDisableFlag(true); // IRQs start masked, as on hardware, until the game is ready for them
 }
-CPU::CPU(){
+CPU::CPU() : m_bus(std::make_shared<Bus>()), memory(m_bus->memory) {
 	// m_cart = std::make_shared<Cartridge>();
-	m_bus = std::make_shared<Bus>();
 	m_oam = std::make_shared<OAM>();
-    memory = std::vector<uint8_t>(0xFFFF);
-    m_bus->memory = memory; // Initialize the bus memory with the CPU memory (hacky copies for now)
 }
 uint8_t CPU::read(uint16_t addr)
 {
+    #ifdef NES_BUS_STATS
+    m_bus->stats.read(addr);
+    #endif
     if (addr == 0x4016) {
         // Controller 1 serial read
+        if (controller_strobe) {
+            latchControllers(); // While strobe is high the shift register keeps reloading, so this is button A right now
+        }
         uint8_t value = (controller1_shift & 1);
         if (!controller_strobe) {
             controller1_shift >>= 1;
@@ -82,8 +89,16 @@ uint8_t CPU::read(uint16_t addr)
         memory[addr] &= 0x7F;
         return val;
     }
+    else if (addr == 0x4015 && m_apu) {
+        uint8_t value = m_apu->readStatus();
+        irq_signal = m_apu->irqPending(); // Reading acknowledges the frame interrupt
+        return value;
+    }
     else if (addr == 0x4017) {
         // (Optional) Controller 2 serial read (if you have a second controller)
+        if (controller_strobe) {
+            latchControllers();
+        }
         uint8_t value = (controller2_shift & 1);
         if (!controller_strobe) {
             controller2_shift >>= 1;
@@ -100,18 +115,36 @@ uint8_t CPU::read(uint16_t addr)
 
 void CPU::write(uint16_t addr, uint8_t data)
 {
+    #ifdef NES_BUS_STATS
+    m_bus->stats.write(addr);
+    #endif
     if (addr == 0x4016) {
-        controller_strobe = data & 1;
-        if (controller_strobe) {
-            // On strobe high (1), latch the current input state into the shift register
-            controller1_shift = controller1_state;
-            controller2_shift = controller2_state; // if you have controller 2
+        // The shift registers load while strobe is high and hold once it drops, so the buttons
+        // are sampled on both writes; the one that ends the strobe decides what the game reads
+        if (controller_strobe || (data & 1)) {
+            latchControllers();
         }
+        controller_strobe = data & 1;
+    }
+    else if (addr >= 0x4000 && addr <= 0x4017 && m_apu) {
+        m_apu->cpuWrite(addr, data);
+        irq_signal = m_apu->irqPending(); // $4010, $4015 and $4017 can clear (or start) an interrupt
+        memory[addr] = data;
     }
     else {
         memory[addr] = data;
     }
 }
+
+void CPU::latchControllers()
+{
+    if (m_ports) {
+        controller1_state = m_ports->get(0);
+        controller2_state = m_ports->get(1);
+    }
+    controller1_shift = controller1_state;
+    controller2_shift = controller2_state;
+}
 ///////////////////////////////////////////////////////////////////
 // ADDRESSING MODES
 ///////////////////////////////////////////////////////////////////
@@ -191,7 +224,12 @@ uint16_t CPU::addr_indirect()
 {
     uint16_t ptr_low = read(program_counter++);
     uint16_t ptr_high = read(program_counter++);
-    uint16_t ptr = (ptr_high << 8) | ptr_low;
+    return indirect((ptr_high << 8) | ptr_low);
+}
+
+uint16_t CPU::indirect(uint16_t ptr)
+{
+    uint16_t ptr_low = ptr & 0xFF;
 
     // Handle the 6502 JMP indirect bug
     // If the pointer is at the end of a page, it wraps around within the same page
@@ -217,8 +255,11 @@ uint16_t CPU::addr_indirect()
 // Indexed Indirect (X) 
 uint16_t CPU::addr_indexed_indirect_x()
 {
-    uint8_t base = read(program_counter++);
+    return indexedIndirectX(read(program_counter++));
+}
 
+uint16_t CPU::indexedIndirectX(uint8_t base)
+{
     // Zero page wraps around
     uint8_t ptr = (base + x) & 0xFF; 
 
@@ -233,8 +274,11 @@ uint16_t CPU::addr_indexed_indirect_x()
 // Indirect Indexed (Y) 
 uint16_t CPU::addr_indirect_indexed_y()
 {
-    uint8_t ptr = read(program_counter++);
+    return indirectIndexedY(read(program_counter++));
+}
 
+uint16_t CPU::indirectIndexedY(uint8_t ptr)
+{
     uint16_t low_byte = read(ptr);
 
     // Zero page wraps around
@@ -355,6 +399,60 @@ void CPU::setStackBackTESTING(uint8_t value) {
     stack_pointer--;
 }
 
+///////////////////////////////////////////////////////////////////
+// SAVESTATES
+///////////////////////////////////////////////////////////////////
+
+// Memory is not written here, it belongs to the bus and is saved with it.
+void CPU::saveState(StateWriter& out) const
+{
+    out.write8(accumulator);
+    out.write8(x);
+    out.write8(y);
+    out.write8(stack_pointer);
+    out.write16(program_counter);
+    out.write8(status);
+    out.write8(controller1_state);
+    out.write8(controller1_shift);
+    out.write8(controller2_state);
+    out.write8(controller2_shift);
+    out.writeBool(controller_strobe);
+    out.writeBool(irq_signal);
+    out.writeBool(nmi_signal);
+    out.writeBool(reset_signal);
+    out.writeBool(previous_nmi_state);
+    out.write64(instructionCount);
+    out.writeVector(stack);
+}
+
+bool CPU::loadState(StateReader& in)
+{
+    accumulator = in.read8();
+    x = in.read8();
+    y = in.read8();
+    stack_pointer = in.read8();
+    program_counter = in.read16();
+    status = in.read8();
+    controller1_state = in.read8();
+    controller1_shift = in.read8();
+    controller2_state = in.read8();
+    controller2_shift = in.read8();
+    controller_strobe = in.readBool();
+    irq_signal = in.readBool();
+    nmi_signal = in.readBool();
+    reset_signal = in.readBool();
+    previous_nmi_state = in.readBool();
+    instructionCount = in.read64();
+    // The stack is the only variable sized piece of CPU state
+    uint32_t stackSize = in.read32();
+    if (stackSize > in.remaining()) {
+        return false;
+    }
+    stack.resize(stackSize);
+    in.readBytes(stack.data(), stack.size());
+    return in.ok();
+}
+
 ///////////////////////////////////////////////////////////////////
 // INTERRUPT OPERATIONS
 ///////////////////////////////////////////////////////////////////
@@ -370,7 +468,6 @@ void CPU::setIRQ(bool state)
 void CPU::setNMI(bool state)
 {
     // NMI is edge-triggered (only triggered on transition)
-    static bool previous_nmi_state = false;
     if (!previous_nmi_state && state) {
         nmi_signal = true;
         handleInterrupts();
@@ -385,7 +482,7 @@ void CPU::setRESET(bool state)
     if (state) {
         // Reset CPU state
         stack_pointer = 0xFF;
-        program_counter = reset_vector;
+        program_counter = read(reset_vector) | (read(reset_vector + 1) << 8); // Jump through the vector, as at power on
         setInterruptDisableFlag(true);
         status = status & (~break_mask);  // Clear break flag
 
@@ -418,6 +515,11 @@ void CPU::handleInterrupts()
         stack_pointer -= 3;
         setInterruptDisableFlag(true);
         program_counter = read(0xFFFA) | (read(0xFFFB) << 8); // NMI vector
+        #ifdef NES_PROFILER
+        if (m_profiler) {
+            m_profiler->interrupt(program_counter);
+        }
+        #endif
         nmi_signal = false;
         m_bus->nmi = false; // Clear NMI signal on the bus
         return;
@@ -436,6 +538,11 @@ void CPU::handleInterrupts()
         stack_pointer -= 3;
         setInterruptDisableFlag(true);
         program_counter = read(0xFFFE) | (read(0xFFFF) << 8); // IRQ vector
+        #ifdef NES_PROFILER
+        if (m_profiler) {
+            m_profiler->interrupt(program_counter);
+        }
+        #endif
 
         return;
     }
@@ -503,63 +610,35 @@ void CPU::ROR(uint16_t addr) // Rotate Right
 }
 
 // Arithmetic Opcodes
+// A + value + C, for ADC and (with the value inverted) SBC
+void CPU::addWithCarry(uint8_t value) {
+    uint16_t sum = accumulator + value + getCarryFlag();
+    uint8_t result = sum & 0xFF;
+    // Overflow when both inputs have the same sign and the result has the other
+    setOverflowFlag((accumulator ^ result) & (value ^ result) & negative_mask);
+    setCarryFlag(sum > 0xFF);
+    accumulator = result;
+    setZeroFlag(result == 0);
+    setNegativeFlag(result & negative_mask);
+}
+
 // Add with carry OP code
 void CPU::ADC(uint16_t addr) {
-    uint16_t sum = accumulator + memory[addr] + getCarryFlag();
-    accumulator = (sum & 0xFF);
-    if (~((sum ^ accumulator) & (sum ^ memory[addr]) & negative_mask) & 0x80)
-    {
-        setOverflowFlag(true);
-    }
-    else{
-        setOverflowFlag(false);
-    }
-    if (sum > 0xFF) {
-        setCarryFlag(true);
-    }
-    else{
-        setCarryFlag(false);
-    }
-    setZeroFlag(sum == 0);
-    if (sum & negative_mask) {
-        setNegativeFlag(true);
-    }
-    else{
-        setNegativeFlag(false);
-    }
-    
+    addWithCarry(read(addr));
 }
 
-// Add with carry OP code
+// Subtract with carry OP code
 void CPU::SBC(uint16_t addr) {
-    uint16_t inverse = memory[addr] ^ 0xFF;
-    uint16_t sum = accumulator + inverse + getCarryFlag();
-    accumulator = (sum & 0xFF);
-    if (~((sum ^ accumulator) & (sum ^ inverse) & negative_mask) & 0x80)
-    {
-        setOverflowFlag(true);
-    }
-    else{
-        setOverflowFlag(false);
-    }
-    if (sum > 0xFF) {
-        setCarryFlag(true);
-    }
-    else{
-        setCarryFlag(false);
-    }
-    setZeroFlag(sum == 0);
-    if (sum & negative_mask) {
-        setNegativeFlag(true);
-    }
-    else{
-        setNegativeFlag(false);
-    }
-    
+    addWithCarry(read(addr) ^ 0xFF);
 }
 
 void CPU::INC(uint16_t addr)
 {
+    #ifdef NES_BUS_STATS
+    // Changes memory in place, past CPU::read and CPU::write, so both are counted here
+    m_bus->stats.read(addr);
+    m_bus->stats.write(addr);
+    #endif
     uint16_t sum = ++memory[addr];
     if (sum & negative_mask) {
         setNegativeFlag(true);
@@ -572,6 +651,10 @@ void CPU::INC(uint16_t addr)
 
 void CPU::DEC(uint16_t addr)
 {
+    #ifdef NES_BUS_STATS
+    m_bus->stats.read(addr);
+    m_bus->stats.write(addr);
+    #endif
     uint16_t sum = --memory[addr];
     if (sum & negative_mask) {
         setNegativeFlag(true);
@@ -865,6 +948,11 @@ void CPU::JMP_IND(uint16_t addr)
 
 void CPU::JSR(uint16_t addr)
 {
+    #ifdef NES_PROFILER
+    if (m_profiler) {
+        m_profiler->call(program_counter - 3, addr);
+    }
+    #endif
     program_counter--;
     stack.push_back((program_counter >> 8)); // MSB
     stack.push_back(program_counter & 0x00FF); // LSB
@@ -872,15 +960,39 @@ void CPU::JSR(uint16_t addr)
     program_counter = addr;
 }
 
+uint8_t CPU::pull()
+{
+    stack_pointer++;
+    if (stack.empty()) {
+        return 0;
+    }
+    uint8_t value = stack.back();
+    stack.pop_back();
+    return value;
+}
+
+// The stack holds what was pushed rather than living in page 1, so pulling more than that can't wrap
+// around as it would on the 6502. A program that does has lost track of its stack: say so, and the
+// missing bytes read as 0 so the registers show it rather than keeping what they had.
+void CPU::checkPull(const char* instruction, size_t bytes) const
+{
+    if (stack.size() < bytes) {
+        std::cerr << instruction << " at $" << std::hex << (program_counter - 1) << std::dec << " pulls " << bytes
+            << " bytes from a stack holding " << stack.size() << std::endl;
+    }
+}
+
 void CPU::RTS(uint16_t addr)
 {
     // Pop program counter bytes into program counter
-    program_counter = 0;
-    program_counter = stack.back();
-    stack.pop_back();
-    program_counter |= stack.back() << 8;
-    stack.pop_back();
-    stack_pointer += 2;
+    checkPull("RTS", 2);
+    #ifdef NES_PROFILER
+    if (m_profiler) {
+        m_profiler->ret(false);
+    }
+    #endif
+    program_counter = pull();
+    program_counter |= pull() << 8;
 
     program_counter++; // We return to the next address after the JMP that brought us here (otherwise this becomes a portal emulator)
 
@@ -888,23 +1000,32 @@ void CPU::RTS(uint16_t addr)
 
 void CPU::BRK()
 {
-    status |= break_mask; // b flag is set prior to pushing status to the stack.
-    program_counter += 2;
-    stack.push_back(program_counter & 0x0F); // low byte
-    stack.push_back((program_counter & 0xF0) >> 1); // high byte
-    stack.push_back(status);
+    // Same frame as an IRQ (see handleInterrupts) so RTI can return from either. The byte after BRK is skipped.
+    program_counter++;
+    stack.push_back((program_counter >> 8) & 0xFF); // high byte
+    stack.push_back(program_counter & 0xFF); // low byte
+    stack.push_back(status | break_mask); // b flag is only set in the pushed copy
+    stack_pointer -= 3;
     status |= interrupt_disable_mask; // irq disable flag is set after pushing status to the stack.
-    program_counter = 0xFFFE;
+    program_counter = read(irq_vector) | (read(irq_vector + 1) << 8);
+    #ifdef NES_PROFILER
+    if (m_profiler) {
+        m_profiler->interrupt(program_counter);
+    }
+    #endif
 }
 
 void CPU::RTI()
 {
-    status = stack.back();
-    stack.pop_back();
-    program_counter = stack.back() << 1; // high byte
-    stack.pop_back();
-    program_counter |= stack.back(); // low byte
-    stack.pop_back();
+    checkPull("RTI", 3);
+    #ifdef NES_PROFILER
+    if (m_profiler) {
+        m_profiler->ret(true);
+    }
+    #endif
+    status = pull() & ~break_mask;
+    program_counter = pull(); // low byte
+    program_counter |= pull() << 8; // high byte
 }
 
 // Branch Opcodes
@@ -922,7 +1043,6 @@ void CPU::BCS(uint16_t addr)
 {
     if (getCarryFlag())
     {
-        program_counter--;
         // Signed value, need to cast
         int8_t offset = static_cast<int8_t>(read(addr));
         program_counter += offset;
@@ -998,10 +1118,23 @@ void CPU::NOP() {
 ///////////////////////////////////////////////////////////////////
 
 uint8_t CPU::execute() {
-    // Handle interrupts prior to executing instructions
-    handleInterrupts();
-    std::copy(m_bus->memory.begin(), m_bus->memory.end(), memory.begin()); // Copy bus to memory
+    // IRQs are taken where they are raised (setIRQ) when I is clear. What's left has to be looked at
+    // on instruction boundaries, as the 6502 does: an IRQ still held when CLI, PLP or RTI clears I,
+    // and the NMI line, which the PPU drives through the Bus with no way to reach the CPU. The edge
+    // detector follows the line so it sees it drop and the next vblank can fire again. One inline
+    // test covers all of it; taken before the fetch, so the handler's first opcode runs next.
+    if (interruptPending()) {
+        setNMI(m_bus->nmi);
+        handleInterrupts();
+    }
+    if (m_blockCache && program_counter >= 0x8000) {
+        const DecodedInstruction* instruction = m_blockCache->find(*this, program_counter);
+        if (instruction) {
+            return finishInstruction(instruction->pc, instruction->opcode, instruction->handler(*this, *instruction));
+        }
+    }
     // Fetch the next instruction
+    uint16_t fetch_address = program_counter;
     uint8_t opcode = read(program_counter++);
     #ifdef __DEBUG_PRINT
     file.open("out.txt", std::ios::app);
@@ -1016,9 +1149,6 @@ uint8_t CPU::execute() {
     uint16_t addr = 0;
     uint16_t addr_abs = 0;
     uint8_t cycles = 0;
-    if(m_bus->nmi) {
-        setNMI(true);
-    }
 
     switch (opcode) {
         // ADC 
@@ -1059,7 +1189,7 @@ uint8_t CPU::execute() {
             addr = addr_absolute_y();
             ADC(addr);
             cycles = 4;
-            if ((addr & 0xFF00) != ((addr - x) & 0xFF00)) {
+            if ((addr & 0xFF00) != ((addr - y) & 0xFF00)) {
                 cycles += 1;
             }
             break;
@@ -1071,10 +1201,10 @@ uint8_t CPU::execute() {
             break;
 
         case 0x71:
-            addr = addr_indexed_indirect_x();
+            addr = addr_indirect_indexed_y();
             ADC(addr);
             cycles = 5;
-            if ((addr & 0xFF00) != ((addr - x) & 0xFF00)) {
+            if ((addr & 0xFF00) != ((addr - y) & 0xFF00)) {
                 cycles += 1;
             }
             break;
@@ -1119,7 +1249,7 @@ uint8_t CPU::execute() {
             AND(addr);
             cycles = 4;
             // Check if page boundry was crossed
-            if ((addr & 0xFF00) != ((addr - x) & 0xFF00)) {
+            if ((addr & 0xFF00) != ((addr - y) & 0xFF00)) {
                 cycles += 1;
             }
             break;
@@ -1135,7 +1265,7 @@ uint8_t CPU::execute() {
             AND(addr);
             cycles = 5;
             // Check if page boundry was crossed
-            if ((addr & 0xFF00) != ((addr - x) & 0xFF00)) {
+            if ((addr & 0xFF00) != ((addr - y) & 0xFF00)) {
                 cycles += 1;
             }
             break;
@@ -2108,6 +2238,25 @@ uint8_t CPU::execute() {
             cycles = 2;
             break;
     }
+    return finishInstruction(fetch_address, opcode, cycles);
+}
+
+uint8_t CPU::finishInstruction(uint16_t pc, uint8_t opcode, uint8_t cycles)
+{
+    copyOam();
+    #ifdef NES_PROFILER
+    if (m_profiler) {
+        m_profiler->record(pc, opcode, cycles);
+    }
+    #else
+    (void)pc;
+    (void)opcode;
+    #endif
+    return cycles;
+}
+
+void CPU::copyOam()
+{
     // Copy sprite data from memory into OAM
     if (m_oam != nullptr) {
         std::memcpy(m_oam->sprites.data(), memory.data() + oamAddr, oamSize);
@@ -2115,10 +2264,349 @@ uint8_t CPU::execute() {
         //     std::cout << "Sprite: " << val << std::endl;
         // }
     }
-    std::copy(memory.begin(), memory.end(), m_bus->memory.begin()); // Copy memory to bus
+}
+
+///////////////////////////////////////////////////////////////////
+// CACHED INTERPRETER
+///////////////////////////////////////////////////////////////////
+
+// One opcode as BlockCache runs it: the same addressing, operation and cycles as its case in
+// execute, with the operand already decoded instead of fetched
+template <CPU::Mode M, auto Op, uint8_t Cycles, CPU::Extra E, auto Flag, bool Taken>
+uint8_t CPU::runDecoded(CPU& cpu, const DecodedInstruction& instruction)
+{
+    cpu.program_counter = instruction.pc + instruction.length;
+    #ifdef NES_BUS_STATS
+    // The fetches execute would have made: the opcode, and the operand unless the operation reads it itself
+    cpu.m_bus->stats.read(instruction.pc);
+    if constexpr (M != Mode::Implied && M != Mode::Accumulator && M != Mode::Immediate && M != Mode::Relative) {
+        for (int i = 1; i < instruction.length; ++i) {
+            cpu.m_bus->stats.read(instruction.pc + i);
+        }
+    }
+    #endif
+    uint8_t zero_page = instruction.operand & 0xFF;
+    uint16_t addr = 0;
+    if constexpr (M == Mode::Immediate || M == Mode::Relative) {
+        addr = instruction.pc + 1;
+    }
+    else if constexpr (M == Mode::ZeroPage) {
+        addr = zero_page;
+    }
+    else if constexpr (M == Mode::ZeroPageX) {
+        addr = (zero_page + cpu.x) & 0xFF;
+    }
+    else if constexpr (M == Mode::ZeroPageY) {
+        addr = (zero_page + cpu.y) & 0xFF;
+    }
+    else if constexpr (M == Mode::Absolute) {
+        addr = instruction.operand;
+    }
+    else if constexpr (M == Mode::AbsoluteX) {
+        addr = instruction.operand + cpu.x;
+    }
+    else if constexpr (M == Mode::AbsoluteY) {
+        addr = instruction.operand + cpu.y;
+    }
+    else if constexpr (M == Mode::Indirect) {
+        addr = cpu.indirect(instruction.operand);
+    }
+    else if constexpr (M == Mode::IndexedIndirectX) {
+        addr = cpu.indexedIndirectX(zero_page);
+    }
+    else if constexpr (M == Mode::IndirectIndexedY) {
+        addr = cpu.indirectIndexedY(zero_page);
+    }
+
+    if constexpr (std::is_invocable_v<decltype(Op), CPU&>) {
+        (cpu.*Op)();
+    }
+    else {
+        (cpu.*Op)(addr); // 0 for the accumulator forms and RTS, as execute passes
+    }
+
+    uint8_t cycles = Cycles;
+    if constexpr (E == Extra::PageCrossX) {
+        if ((addr & 0xFF00) != ((addr - cpu.x) & 0xFF00)) {
+            cycles += 1;
+        }
+    }
+    else if constexpr (E == Extra::PageCrossY) {
+        if ((addr & 0xFF00) != ((addr - cpu.y) & 0xFF00)) {
+            cycles += 1;
+        }
+    }
+    else if constexpr (E == Extra::Branch) {
+        if ((cpu.*Flag)() == Taken) {
+            cycles += 1;
+            if ((addr & 0xFF00) != (cpu.program_counter & 0xFF00)) {
+                cycles += 1;
+            }
+        }
+    }
     return cycles;
 }
 
+// Opcodes execute has no case for: fetched and skipped, taking no cycles
+uint8_t CPU::runUnknown(CPU& cpu, const DecodedInstruction& instruction)
+{
+    #ifdef NES_BUS_STATS
+    cpu.m_bus->stats.read(instruction.pc);
+    #endif
+    cpu.program_counter = instruction.pc + 1;
+    return 0;
+}
+
+CPU::DecodedOpcode CPU::DecodedHandler(uint8_t opcode)
+{
+    static const std::array<DecodedOpcode, 256> handlers = [] {
+        std::array<DecodedOpcode, 256> table;
+        table.fill({ &CPU::runUnknown, 1 });
+        // One line per case in execute, with the same addressing and cycles. BlockCache_Tests
+        // runs every opcode both ways.
+        table[0x00] = decoded<Mode::Implied, &CPU::BRK, 7>();
+        table[0x01] = decoded<Mode::IndexedIndirectX, &CPU::ORA, 6>();
+        table[0x05] = decoded<Mode::ZeroPage, &CPU::ORA, 3>();
+        table[0x06] = decoded<Mode::ZeroPage, &CPU::ASL, 5>();
+        table[0x08] = decoded<Mode::Implied, &CPU::PHP, 3>();
+        table[0x09] = decoded<Mode::Immediate, &CPU::ORA, 2>();
+        table[0x0A] = decoded<Mode::Accumulator, &CPU::ASL_ACCU, 2>();
+        table[0x0D] = decoded<Mode::Absolute, &CPU::ORA, 4>();
+        table[0x0E] = decoded<Mode::Absolute, &CPU::ASL, 6>();
+        table[0x10] = decoded<Mode::Relative, &CPU::BPL, 2, Extra::Branch, &CPU::getNegativeFlag, false>();
+        table[0x11] = decoded<Mode::IndirectIndexedY, &CPU::ORA, 5, Extra::PageCrossY>();
+        table[0x15] = decoded<Mode::ZeroPageX, &CPU::ORA, 4>();
+        table[0x16] = decoded<Mode::ZeroPageX, &CPU::ASL, 6>();
+        table[0x18] = decoded<Mode::Implied, &CPU::CLC, 2>();
+        table[0x19] = decoded<Mode::AbsoluteY, &CPU::ORA, 4, Extra::PageCrossY>();
+        table[0x1D] = decoded<Mode::AbsoluteX, &CPU::ORA, 4, Extra::PageCrossX>();
+        table[0x1E] = decoded<Mode::AbsoluteX, &CPU::ASL, 7>();
+        table[0x20] = decoded<Mode::Absolute, &CPU::JSR, 6>();
+        table[0x21] = decoded<Mode::IndexedIndirectX, &CPU::AND, 6>();
+        table[0x24] = decoded<Mode::ZeroPage, &CPU::BIT, 3>();
+        table[0x25] = decoded<Mode::ZeroPage, &CPU::AND, 3>();
+        table[0x26] = decoded<Mode::ZeroPage, &CPU::ROL, 5>();
+        table[0x28] = decoded<Mode::Implied, &CPU::PLP, 4>();
+        table[0x29] = decoded<Mode::Immediate, &CPU::AND, 2>();
+        table[0x2A] = decoded<Mode::Accumulator, &CPU::ROL, 2>();
+        table[0x2C] = decoded<Mode::Absolute, &CPU::BIT, 4>();
+        table[0x2D] = decoded<Mode::Absolute, &CPU::AND, 4>();
+        table[0x2E] = decoded<Mode::Absolute, &CPU::ROL, 6>();
+        table[0x30] = decoded<Mode::Relative, &CPU::BMI, 2, Extra::Branch, &CPU::getNegativeFlag, true>();
+        table[0x31] = decoded<Mode::IndirectIndexedY, &CPU::AND, 5, Extra::PageCrossY>();
+        table[0x35] = decoded<Mode::ZeroPageX, &CPU::AND, 4>();
+        table[0x36] = decoded<Mode::ZeroPageX, &CPU::ROL, 6>();
+        table[0x38] = decoded<Mode::Implied, &CPU::SEC, 2>();
+        table[0x39] = decoded<Mode::AbsoluteY, &CPU::AND, 4, Extra::PageCrossY>();
+        table[0x3D] = decoded<Mode::AbsoluteX, &CPU::AND, 4, Extra::PageCrossX>();
+        table[0x3E] = decoded<Mode::AbsoluteX, &CPU::ROL, 7>();
+        table[0x40] = decoded<Mode::Implied, &CPU::RTI, 6>();
+        table[0x41] = decoded<Mode::IndexedIndirectX, &CPU::EOR, 6>();
+        table[0x45] = decoded<Mode::ZeroPage, &CPU::EOR, 3>();
+        table[0x46] = decoded<Mode::ZeroPage, &CPU::LSR, 5>();
+        table[0x48] = decoded<Mode::Implied, &CPU::PHA, 3>();
+        table[0x49] = decoded<Mode::Immediate, &CPU::EOR, 2>();
+        table[0x4A] = decoded<Mode::Accumulator, &CPU::LSR_ACCU, 2>();
+        table[0x4C] = decoded<Mode::Absolute, &CPU::JMP_ABS, 3>();
+        table[0x4D] = decoded<Mode::Absolute, &CPU::EOR, 4>();
+        table[0x4E] = decoded<Mode::Absolute, &CPU::LSR, 6>();
+        table[0x50] = decoded<Mode::Relative, &CPU::BVC, 2, Extra::Branch, &CPU::getOverFlowFlag, false>();
+        table[0x51] = decoded<Mode::IndirectIndexedY, &CPU::EOR, 5, Extra::PageCrossY>();
+        table[0x55] = decoded<Mode::ZeroPageX, &CPU::EOR, 4>();
+        table[0x56] = decoded<Mode::ZeroPageX, &CPU::LSR, 6>();
+        table[0x58] = decoded<Mode::Implied, &CPU::CLI, 2>();
+        table[0x59] = decoded<Mode::AbsoluteY, &CPU::EOR, 4, Extra::PageCrossY>();
+        table[0x5D] = decoded<Mode::AbsoluteX, &CPU::EOR, 4, Extra::PageCrossX>();
+        table[0x5E] = decoded<Mode::AbsoluteX, &CPU::LSR, 7>();
+        table[0x60] = decoded<Mode::Implied, &CPU::RTS, 6>();
+        table[0x61] = decoded<Mode::IndexedIndirectX, &CPU::ADC, 6>();
+        table[0x65] = decoded<Mode::ZeroPage, &CPU::ADC, 3>();
+        table[0x66] = decoded<Mode::ZeroPage, &CPU::ROR, 5>();
+        table[0x68] = decoded<Mode::Implied, &CPU::PLA, 4>();
+        table[0x69] = decoded<Mode::Immediate, &CPU::ADC, 2>();
+        table[0x6A] = decoded<Mode::Accumulator, &CPU::ROR, 2>();
+        table[0x6C] = decoded<Mode::Indirect, &CPU::JMP_IND, 5>();
+        table[0x6D] = decoded<Mode::Absolute, &CPU::ADC, 4>();
+        table[0x6E] = decoded<Mode::Absolute, &CPU::ROR, 6>();
+        table[0x70] = decoded<Mode::Relative, &CPU::BVS, 2, Extra::Branch, &CPU::getOverFlowFlag, true>();
+        table[0x71] = decoded<Mode::IndirectIndexedY, &CPU::ADC, 5, Extra::PageCrossY>();
+        table[0x75] = decoded<Mode::ZeroPageX, &CPU::ADC, 4>();
+        table[0x76] = decoded<Mode::ZeroPageX, &CPU::ROR, 6>();
+        table[0x78] = decoded<Mode::Implied, &CPU::SEI, 2>();
+        table[0x79] = decoded<Mode::AbsoluteY, &CPU::ADC, 4, Extra::PageCrossY>();
+        table[0x7D] = decoded<Mode::AbsoluteX, &CPU::ADC, 4, Extra::PageCrossX>();
+        table[0x7E] = decoded<Mode::AbsoluteX, &CPU::ROR, 7>();
+        table[0x81] = decoded<Mode::IndexedIndirectX, &CPU::STA, 6>();
+        table[0x84] = decoded<Mode::ZeroPage, &CPU::STY, 3>();
+        table[0x85] = decoded<Mode::ZeroPage, &CPU::STA, 3>();
+        table[0x86] = decoded<Mode::ZeroPage, &CPU::STX, 3>();
+        table[0x88] = decoded<Mode::Implied, &CPU::DEY, 2>();
+        table[0x8A] = decoded<Mode::Implied, &CPU::TXA, 2>();
+        table[0x8C] = decoded<Mode::Absolute, &CPU::STY, 4>();
+        table[0x8D] = decoded<Mode::Absolute, &CPU::STA, 4>();
+        table[0x8E] = decoded<Mode::Absolute, &CPU::STX, 4>();
+        table[0x90] = decoded<Mode::Relative, &CPU::BCC, 2, Extra::Branch, &CPU::getCarryFlag, false>();
+        table[0x91] = decoded<Mode::IndirectIndexedY, &CPU::STA, 6>();
+        table[0x94] = decoded<Mode::ZeroPageX, &CPU::STY, 4>();
+        table[0x95] = decoded<Mode::ZeroPageX, &CPU::STA, 4>();
+        table[0x96] = decoded<Mode::ZeroPageY, &CPU::STX, 4>();
+        table[0x98] = decoded<Mode::Implied, &CPU::TYA, 2>();
+        table[0x99] = decoded<Mode::AbsoluteY, &CPU::STA, 5>();
+        table[0x9A] = decoded<Mode::Implied, &CPU::TXS, 2>();
+        table[0x9D] = decoded<Mode::AbsoluteX, &CPU::STA, 5>();
+        table[0xA0] = decoded<Mode::Immediate, &CPU::LDY, 2>();
+        table[0xA1] = decoded<Mode::IndexedIndirectX, &CPU::LDA, 6>();
+        table[0xA2] = decoded<Mode::Immediate, &CPU::LDX, 2>();
+        table[0xA4] = decoded<Mode::ZeroPage, &CPU::LDY, 3>();
+        table[0xA5] = decoded<Mode::ZeroPage, &CPU::LDA, 3>();
+        table[0xA6] = decoded<Mode::ZeroPage, &CPU::LDX, 3>();
+        table[0xA8] = decoded<Mode::Implied, &CPU::TAY, 2>();
+        table[0xA9] = decoded<Mode::Immediate, &CPU::LDA, 2>();
+        table[0xAA] = decoded<Mode::Implied, &CPU::TAX, 2>();
+        table[0xAC] = decoded<Mode::Absolute, &CPU::LDY, 4>();
+        table[0xAD] = decoded<Mode::Absolute, &CPU::LDA, 4>();
+        table[0xAE] = decoded<Mode::Absolute, &CPU::LDX, 4>();
+        table[0xB0] = decoded<Mode::Relative, &CPU::BCS, 2, Extra::Branch, &CPU::getCarryFlag, true>();
+        table[0xB1] = decoded<Mode::IndirectIndexedY, &CPU::LDA, 5, Extra::PageCrossY>();
+        table[0xB4] = decoded<Mode::ZeroPageX, &CPU::LDY, 4>();
+        table[0xB5] = decoded<Mode::ZeroPageX, &CPU::LDA, 4>();
+        table[0xB6] = decoded<Mode::ZeroPageY, &CPU::LDX, 4>();
+        table[0xB8] = decoded<Mode::Implied, &CPU::CLV, 2>();
+        table[0xB9] = decoded<Mode::AbsoluteY, &CPU::LDA, 4, Extra::PageCrossY>();
+        table[0xBA] = decoded<Mode::Implied, &CPU::TSX, 2>();
+        table[0xBC] = decoded<Mode::AbsoluteX, &CPU::LDY, 4, Extra::PageCrossX>();
+        table[0xBD] = decoded<Mode::AbsoluteX, &CPU::LDA, 4, Extra::PageCrossX>();
+        table[0xBE] = decoded<Mode::AbsoluteY, &CPU::LDX, 4, Extra::PageCrossY>();
+        table[0xC0] = decoded<Mode::Immediate, &CPU::CPY, 2>();
+        table[0xC1] = decoded<Mode::IndexedIndirectX, &CPU::CMP, 6>();
+        table[0xC4] = decoded<Mode::ZeroPage, &CPU::CPY, 3>();
+        table[0xC5] = decoded<Mode::ZeroPage, &CPU::CMP, 3>();
+        table[0xC6] = decoded<Mode::ZeroPage, &CPU::DEC, 5>();
+        table[0xC8] = decoded<Mode::Implied, &CPU::INY, 2>();
+        table[0xC9] = decoded<Mode::Immediate, &CPU::CMP, 2>();
+        table[0xCA] = decoded<Mode::Implied, &CPU::DEX, 2>();
+        table[0xCC] = decoded<Mode::Absolute, &CPU::CPY, 4>();
+        table[0xCD] = decoded<Mode::Absolute, &CPU::CMP, 4>();
+        table[0xCE] = decoded<Mode::Absolute, &CPU::DEC, 6>();
+        table[0xD0] = decoded<Mode::Relative, &CPU::BNE, 2, Extra::Branch, &CPU::getZeroFlag, false>();
+        table[0xD1] = decoded<Mode::IndirectIndexedY, &CPU::CMP, 5, Extra::PageCrossY>();
+        table[0xD5] = decoded<Mode::ZeroPageX, &CPU::CMP, 4>();
+        table[0xD6] = decoded<Mode::ZeroPageX, &CPU::DEC, 6>();
+        table[0xD8] = decoded<Mode::Implied, &CPU::CLD, 2>();
+        table[0xD9] = decoded<Mode::AbsoluteY, &CPU::CMP, 4, Extra::PageCrossY>();
+        table[0xDD] = decoded<Mode::AbsoluteX, &CPU::CMP, 4, Extra::PageCrossX>();
+        table[0xDE] = decoded<Mode::AbsoluteX, &CPU::DEC, 7>();
+        table[0xE0] = decoded<Mode::Immediate, &CPU::CPX, 2>();
+        table[0xE1] = decoded<Mode::IndexedIndirectX, &CPU::SBC, 6>();
+        table[0xE4] = decoded<Mode::ZeroPage, &CPU::CPX, 3>();
+        table[0xE5] = decoded<Mode::ZeroPage, &CPU::SBC, 3>();
+        table[0xE6] = decoded<Mode::ZeroPage, &CPU::INC, 5>();
+        table[0xE8] = decoded<Mode::Implied, &CPU::INX, 2>();
+        table[0xE9] = decoded<Mode::Immediate, &CPU::SBC, 2>();
+        table[0xEA] = decoded<Mode::Implied, &CPU::NOP, 2>();
+        table[0xEC] = decoded<Mode::Absolute, &CPU::CPX, 4>();
+        table[0xED] = decoded<Mode::Absolute, &CPU::SBC, 4>();
+        table[0xEE] = decoded<Mode::Absolute, &CPU::INC, 6>();
+        table[0xF0] = decoded<Mode::Relative, &CPU::BEQ, 2, Extra::Branch, &CPU::getZeroFlag, true>();
+        table[0xF1] = decoded<Mode::IndirectIndexedY, &CPU::SBC, 5, Extra::PageCrossY>();
+        table[0xF5] = decoded<Mode::ZeroPageX, &CPU::SBC, 4>();
+        table[0xF6] = decoded<Mode::ZeroPageX, &CPU::INC, 6>();
+        table[0xF8] = decoded<Mode::Implied, &CPU::SED, 2>();
+        table[0xF9] = decoded<Mode::AbsoluteY, &CPU::SBC, 4, Extra::PageCrossY>();
+        table[0xFD] = decoded<Mode::AbsoluteX, &CPU::SBC, 4, Extra::PageCrossX>();
+        table[0xFE] = decoded<Mode::AbsoluteX, &CPU::INC, 7>();
+        return table;
+    }();
+    return handlers[opcode];
+}
+
+std::string CPU::opcodeName(uint8_t opcode) const
+{
+    auto name = opcodeMap.find(opcode);
+    return name == opcodeMap.end() ? "???" : name->second;
+}
+
+uint8_t CPU::peek(uint16_t addr) const
+{
+    return addr >= 0x8000 ? m_cart->ReadPrgRom(addr - 0x8000) : memory[addr];
+}
+
+std::string CPU::disassemble(uint16_t addr, int* length) const
+{
+    uint8_t opcode = peek(addr);
+    auto name = opcodeMap.find(opcode);
+    if (name == opcodeMap.end()) {
+        if (length) {
+            *length = 1;
+        }
+        char unknown[16];
+        std::snprintf(unknown, sizeof(unknown), ".byte $%02X", opcode);
+        return unknown;
+    }
+
+    // Official opcodes are laid out aaabbbcc: cc picks the group, bbb the addressing mode
+    enum { Implied, Accumulator, Immediate, ZeroPage, ZeroPageX, ZeroPageY, Absolute, AbsoluteX, AbsoluteY,
+        Indirect, IndirectX, IndirectY, Relative } mode = Implied;
+    uint8_t group = opcode & 0x03;
+    uint8_t bbb = (opcode >> 2) & 0x07;
+    bool usesY = opcode == 0x96 || opcode == 0xB6 || opcode == 0xBE; // STX/LDX index with Y instead
+    if (group == 0x01) {
+        static constexpr int modes[8] = { IndirectX, ZeroPage, Immediate, Absolute, IndirectY, ZeroPageX, AbsoluteY, AbsoluteX };
+        mode = static_cast<decltype(mode)>(modes[bbb]);
+    }
+    else if (opcode == 0x20 || opcode == 0x4C) {
+        mode = Absolute;
+    }
+    else if (opcode == 0x6C) {
+        mode = Indirect;
+    }
+    else if (opcode == 0x0A || opcode == 0x2A || opcode == 0x4A || opcode == 0x6A) {
+        mode = Accumulator;
+    }
+    else if (bbb == 0x04 && group == 0x00) {
+        mode = Relative;
+    }
+    else if (bbb == 0x00 && opcode >= 0x80) {
+        mode = Immediate; // LDY, CPY, CPX, LDX
+    }
+    else if (bbb == 0x01) {
+        mode = ZeroPage;
+    }
+    else if (bbb == 0x03) {
+        mode = Absolute;
+    }
+    else if (bbb == 0x05) {
+        mode = usesY ? ZeroPageY : ZeroPageX;
+    }
+    else if (bbb == 0x07) {
+        mode = usesY ? AbsoluteY : AbsoluteX;
+    }
+
+    uint8_t low = peek(addr + 1);
+    uint16_t word = low | (peek(addr + 2) << 8);
+    char operand[32] = "";
+    int size = 2;
+    switch (mode) {
+    case Implied: size = 1; break;
+    case Accumulator: size = 1; std::snprintf(operand, sizeof(operand), " A"); break;
+    case Immediate: std::snprintf(operand, sizeof(operand), " #$%02X", low); break;
+    case ZeroPage: std::snprintf(operand, sizeof(operand), " $%02X", low); break;
+    case ZeroPageX: std::snprintf(operand, sizeof(operand), " $%02X,X", low); break;
+    case ZeroPageY: std::snprintf(operand, sizeof(operand), " $%02X,Y", low); break;
+    case IndirectX: std::snprintf(operand, sizeof(operand), " ($%02X,X)", low); break;
+    case IndirectY: std::snprintf(operand, sizeof(operand), " ($%02X),Y", low); break;
+    case Relative: std::snprintf(operand, sizeof(operand), " $%04X", static_cast<uint16_t>(addr + 2 + static_cast<int8_t>(low))); break;
+    case Absolute: size = 3; std::snprintf(operand, sizeof(operand), " $%04X", word); break;
+    case AbsoluteX: size = 3; std::snprintf(operand, sizeof(operand), " $%04X,X", word); break;
+    case AbsoluteY: size = 3; std::snprintf(operand, sizeof(operand), " $%04X,Y", word); break;
+    case Indirect: size = 3; std::snprintf(operand, sizeof(operand), " ($%04X)", word); break;
+    }
+    if (length) {
+        *length = size;
+    }
+    return name->second + operand;
+}
+
 void CPU::SetCartridge(std::shared_ptr<Cartridge> cartridge)
 {
     this->m_cart = cartridge;
@@ -9,10 +9,17 @@
 #include <unordered_map>
 #include "OAM.h"
 #include "Bus.h"
+#include "SaveState.h"
+#include "apu.h"
+#include "ControllerPorts.h"
+#include "Profiler.h"
+#include "BlockCache.h"
 #include <fstream>
 #include <iostream>
 
-#define __DEBUG_PRINT
+// Appends a trace of every executed instruction to out.txt. Every CPU instance
+// shares that file, so leave this off unless a single instance is being debugged.
+// #define __DEBUG_PRINT
 
 class CPU
 {
@@ -26,16 +33,17 @@ public:
 	uint8_t status = 0x00;					// 8-bit register that contains status flags
   std::ofstream file;
     // controller info
-    uint8_t controller1_state = 0;   // Latest button input (from InputHandler)
+    uint8_t controller1_state = 0;   // Buttons as of the last strobe (from the ControllerPorts, if set)
     uint8_t controller1_shift = 0;   // Shifting register for serial reads
     bool controller_strobe = false;  // True if strobe is active
-    uint8_t controller2_state = 0;   // Latest button input (from InputHandler)
+    uint8_t controller2_state = 0;   // Buttons as of the last strobe (from the ControllerPorts, if set)
     uint8_t controller2_shift = 0;   // Shifting register for serial reads
 
 	// Interrupt signals
 	bool irq_signal = false;
 	bool nmi_signal = false;
 	bool reset_signal = false;
+	bool previous_nmi_state = false; // NMI is edge-triggered, this holds the last level seen
 
 	CPU(std::shared_ptr<Bus> bus, std::shared_ptr<Cartridge> cart, std::shared_ptr<OAM> oam);
   CPU();
@@ -43,6 +51,10 @@ public:
 	void respTest();
 	uint8_t read(uint16_t addr);
 	void write(uint16_t addr, uint8_t data);
+	uint8_t peek(uint16_t addr) const; // What read would return, without its side effects (the $2002 flag, controller shifts)
+	// The instruction at addr as text ("LDA $10,X"), read without side effects. length gets its size in bytes.
+	std::string disassemble(uint16_t addr, int* length = nullptr) const;
+	std::string opcodeName(uint8_t opcode) const; // Mnemonic, "???" for unofficial opcodes
 
 	uint64_t instructionCount = 0;
 	std::vector<uint8_t> getStackTESTING() const;
@@ -52,11 +64,40 @@ public:
 	uint8_t execute();
 	void SetCartridge(std::shared_ptr<Cartridge> cartridge);
   void SetOAM(std::shared_ptr<OAM> oam) {m_oam = oam;}
+  void SetAPU(std::shared_ptr<APU> apu) {m_apu = apu;} // Without one, APU registers are plain memory
+  void SetControllerPorts(const ControllerPorts* ports) {m_ports = ports;} // Without them, controllerN_state is used as set
+  void SetProfiler(Profiler* profiler) {m_profiler = profiler;} // Only fed in NES_PROFILER builds, see Profiler.h
+  void SetBlockCache(BlockCache* cache) {m_blockCache = cache;} // Runs PRG ROM code from pre-decoded blocks, nullptr to interpret it
+  BlockCache* GetBlockCache() const {return m_blockCache;}
+
+	// Addressing modes as the cached interpreter and the JIT see them
+	enum class Mode : uint8_t { Implied, Accumulator, Immediate, ZeroPage, ZeroPageX, ZeroPageY, Absolute, AbsoluteX, AbsoluteY,
+		Indirect, IndexedIndirectX, IndirectIndexedY, Relative };
+	// Cycles execute adds on top: a page crossed (checked against X or Y, as each case does) or a branch taken
+	enum class Extra : uint8_t { None, PageCrossX, PageCrossY, Branch };
+	// How BlockCache runs an opcode: its handler (the same work as its case in execute), length in bytes,
+	// and the mode and cycles its case uses. Opcodes execute doesn't know take 0 cycles.
+	struct DecodedOpcode {
+		uint8_t (*handler)(CPU& cpu, const DecodedInstruction& instruction);
+		uint8_t length;
+		Mode mode = Mode::Implied;
+		uint8_t cycles = 0;
+		Extra extra = Extra::None;
+	};
+	static DecodedOpcode DecodedHandler(uint8_t opcode);
 	// Interrupt signal setters and handler
 	void setIRQ(bool state);   
 	void setNMI(bool state);    
 	void setRESET(bool state);  
 	void handleInterrupts();
+	// Whether execute has an interrupt to take, or an NMI line change to follow, before the next instruction
+	bool interruptPending() const {
+		return reset_signal || nmi_signal || m_bus->nmi != previous_nmi_state || (irq_signal && !(status & interrupt_disable_mask));
+	}
+
+	// Savestates - registers, interrupt lines, controller latches and the stack
+	void saveState(StateWriter& out) const;
+	bool loadState(StateReader& in);
 
 private:
 	// Masks for status register
@@ -74,11 +115,19 @@ private:
   
   static constexpr int oamAddr = 0x200; // 256 bytes starting here for OAM 
   static constexpr int oamEnd = oamAddr + (oamSize * sizeof(Sprite)); // OAM size is 64 sprites, each sprite is 4 bytes
-  std::vector<uint8_t> memory;
+  std::shared_ptr<Bus> m_bus; // Pointer to the bus
+  std::vector<uint8_t>& memory; // CPU address space, lives on the bus so there is no copy to keep in sync
 	std::vector<uint8_t> stack;
 	std::shared_ptr<Cartridge> m_cart;
   std::shared_ptr<OAM> m_oam;
-  std::shared_ptr<Bus> m_bus; // Pointer to the bus
+  std::shared_ptr<APU> m_apu;
+  const ControllerPorts* m_ports = nullptr;
+  Profiler* m_profiler = nullptr;
+  BlockCache* m_blockCache = nullptr;
+  void latchControllers();
+  uint8_t pull(); // Pops the stack for RTS and RTI, 0 once it is empty
+  void addWithCarry(uint8_t value);
+  void checkPull(const char* instruction, size_t bytes) const;
 
 public: // Flag Operations - Sets, unsets, or clears status flags
 	bool getOverFlowFlag() const;
@@ -110,6 +159,10 @@ public: // Addressing Modes - Returns the effective address for each addressing
 	uint16_t addr_indexed_indirect_x();    // Indexed Indirect (X)
 	uint16_t addr_indirect_indexed_y();    // Indirect Indexed (Y) 
 	uint16_t addr_relative();              // Relative 
+	// The pointer reads behind the indirect modes, shared with the cached interpreter
+	uint16_t indirect(uint16_t ptr);
+	uint16_t indexedIndirectX(uint8_t base);
+	uint16_t indirectIndexedY(uint8_t ptr);
   void ASL_ACCU(uint16_t addr);
 
 public: // 6502 Opcodes - Base implementation of each opcode
@@ -193,6 +246,21 @@ public: // 6502 Opcodes - Base implementation of each opcode
 	// No Operation
 	void NOP();
 
+private: // Cached interpreter, see BlockCache.h
+	static constexpr uint8_t LengthOf(Mode mode) {
+		return mode <= Mode::Accumulator ? 1 : (mode >= Mode::Absolute && mode <= Mode::Indirect) ? 3 : 2;
+	}
+	template <Mode M, auto Op, uint8_t Cycles, Extra E = Extra::None, auto Flag = nullptr, bool Taken = false>
+	static uint8_t runDecoded(CPU& cpu, const DecodedInstruction& instruction);
+	template <Mode M, auto Op, uint8_t Cycles, Extra E = Extra::None, auto Flag = nullptr, bool Taken = false>
+	static constexpr DecodedOpcode decoded() { return { &runDecoded<M, Op, Cycles, E, Flag, Taken>, LengthOf(M), M, Cycles, E }; }
+	static uint8_t runUnknown(CPU& cpu, const DecodedInstruction& instruction);
+	// OAM copy and profiler, after every instruction however it was run
+	uint8_t finishInstruction(uint16_t pc, uint8_t opcode, uint8_t cycles);
+	void copyOam();
+	friend class Jit; // Runs whole blocks and copies OAM once after them
+public:
+
 	private:
     std::unordered_map<uint8_t, std::string> opcodeMap = {
     {0x00, "BRK"},
@@ -1,7 +1,7 @@
 #include "Cartridge.h"
 #include <fstream>
 
-Cartridge::Cartridge(std::vector<uint8_t>& romData){
+Cartridge::Cartridge(const std::vector<uint8_t>& romData){
 	// TODO: Reset vector needs to be based on mapper.
 	resetVector = 0xFFFC;
 	// Load the ROM into the memory mapper
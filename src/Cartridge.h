@@ -15,7 +15,7 @@ public:
 	 *
 	 * @param rom Path to the ROM file to load
 	 */
-	Cartridge(std::vector<uint8_t> &romData);
+	Cartridge(const std::vector<uint8_t> &romData);
 	~Cartridge();
 	inline int PrgRomEnd() const { return prgRomStart + prgRomSize; }
 	inline int ChrRomEnd() const { return chrRomStart + chrRomSize; }
@@ -26,6 +26,7 @@ public:
 	inline uint8_t ReadChrRom(uint16_t addr) const { return chrRom[addr]; }
 	std::vector<uint8_t> chrRom;
 	const std::vector<uint8_t>& getCHRROM() const { return chrRom; }
+	const std::vector<uint8_t>& getPRGROM() const { return prgRom; }
 
 private:
 	// Constants for data sizes and offsets
@@ -0,0 +1,33 @@
+#ifndef CONTROLLERPORTS_H
+#define CONTROLLERPORTS_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @brief Live button state of both controller ports, written from any thread.
+ *
+ * Whoever produces input (the SDL loop, a bot, a test harness) stores the
+ * newest state here whenever it changes; the CPU reads it at the moment the
+ * game strobes $4016. Each port is a single atomic byte, so neither side ever
+ * takes a lock or waits, and a press that lands mid-frame is seen by the
+ * game's next controller read instead of the next frame.
+ *
+ * Buttons are one bit each, in InputHandler's order.
+ */
+class ControllerPorts
+{
+public:
+	void set(int port, uint8_t state) {
+		m_state[port & 1].store(state, std::memory_order_relaxed);
+	}
+	uint8_t get(int port) const {
+		return m_state[port & 1].load(std::memory_order_relaxed);
+	}
+
+private:
+	std::array<std::atomic<uint8_t>, 2> m_state{};
+};
+
+#endif // CONTROLLERPORTS_H
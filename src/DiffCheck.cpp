@@ -0,0 +1,81 @@
+#include "DiffCheck.h"
+#include "Emulator.h"
+#include "Hash.h"
+#include "Movie.h"
+#include <barrier>
+#include <iostream>
+#include <thread>
+
+void DiffCheck::Fast(Emulator& emulator) {
+	emulator.setIdleLoopSkipping(true);
+	emulator.setBlockCache(true);
+	emulator.setJit(Jit::Available);
+}
+
+void DiffCheck::Accurate(Emulator& emulator) {
+	emulator.setIdleLoopSkipping(false);
+	emulator.setBlockCache(false);
+	emulator.setJit(false);
+}
+
+uint64_t DiffCheck::CpuHash(const CPU& cpu) {
+	uint8_t registers[] = { cpu.accumulator, cpu.x, cpu.y, cpu.status, cpu.stack_pointer,
+		static_cast<uint8_t>(cpu.program_counter & 0xFF), static_cast<uint8_t>(cpu.program_counter >> 8) };
+	return Hash::XXH64(registers, sizeof(registers));
+}
+
+bool DiffCheck::run(std::shared_ptr<Cartridge> cart, const Movie* movie, uint64_t frames, Result& result) const {
+	auto fastEmulator = std::make_unique<Emulator>();
+	auto accurateEmulator = std::make_unique<Emulator>();
+	for (Emulator* emulator : { fastEmulator.get(), accurateEmulator.get() }) {
+		if (!emulator->loadRom(cart)) {
+			return false;
+		}
+		if (movie && !movie->seek(*emulator, 0)) {
+			return false;
+		}
+	}
+	fast(*fastEmulator);
+	accurate(*accurateEmulator);
+
+	result = Result();
+	bool stop = frames == 0;
+	// Runs once both have finished a frame, before either starts the next; the barrier orders
+	// everything the threads wrote before it against everything they read after it
+	auto compare = [&]() noexcept {
+		result.frames++;
+		result.fastCpuHash = CpuHash(fastEmulator->cpu());
+		result.accurateCpuHash = CpuHash(accurateEmulator->cpu());
+		result.fastFrameHash = fastEmulator->frameHash();
+		result.accurateFrameHash = accurateEmulator->frameHash();
+		result.diverged = result.fastCpuHash != result.accurateCpuHash || result.fastFrameHash != result.accurateFrameHash;
+		stop = result.diverged || result.frames == frames;
+	};
+	std::barrier frameDone(2, compare);
+
+	auto runFrames = [&](Emulator& emulator, std::vector<uint8_t>* startState) {
+		for (uint64_t frame = 0; !stop; ++frame) {
+			if (startState) {
+				emulator.saveState(*startState);
+			}
+			if (movie && !movie->apply(emulator, frame)) {
+				emulator.setInput(0, 0);
+				emulator.setInput(1, 0);
+			}
+			emulator.runFrame();
+			frameDone.arrive_and_wait();
+		}
+	};
+	std::thread accurateThread(runFrames, std::ref(*accurateEmulator), &result.startState);
+	runFrames(*fastEmulator, nullptr);
+	accurateThread.join();
+
+	if (result.diverged) {
+		result.fastState = fastEmulator->saveState();
+		result.accurateState = accurateEmulator->saveState();
+	}
+	else {
+		result.startState.clear();
+	}
+	return true;
+}
@@ -0,0 +1,65 @@
+#ifndef DIFFCHECK_H
+#define DIFFCHECK_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class Cartridge;
+class CPU;
+class Emulator;
+class Movie;
+
+/**
+ * @brief Runs a ROM on a fast and an accurate Emulator side by side and finds the first frame they disagree on.
+ *
+ * Every fast path (idle-loop skipping, the decoded-block cache, the JIT) has
+ * to leave the machine exactly as the plain interpreter would. The checker
+ * is how one is qualified: both instances load the same cartridge and replay
+ * the same movie, the accurate one on a second thread, and after every frame
+ * the hashes of their CPU registers and framebuffers are compared. The two
+ * meet once per frame, so a check takes about as long as the accurate
+ * instance alone.
+ *
+ * At the first frame either hash differs both stop. The result then holds
+ * each machine's savestate after that frame, and the accurate machine's
+ * savestate from before it, which replays the frame for a closer look.
+ */
+class DiffCheck
+{
+public:
+	// Configures one instance after its ROM is loaded
+	using Setup = std::function<void(Emulator& emulator)>;
+	// Every fast path on (the JIT only where it is available), or every one off
+	static void Fast(Emulator& emulator);
+	static void Accurate(Emulator& emulator);
+
+	Setup fast = Fast;
+	Setup accurate = Accurate;
+
+	struct Result {
+		bool diverged = false;
+		uint64_t frames = 0; // Frames both instances ran, the diverging one included
+		uint64_t fastCpuHash = 0, accurateCpuHash = 0;     // After the last frame run
+		uint64_t fastFrameHash = 0, accurateFrameHash = 0;
+		// Only filled in when they diverged
+		std::vector<uint8_t> fastState, accurateState;
+		std::vector<uint8_t> startState; // The accurate instance before the diverging frame
+	};
+
+	/**
+	 * @brief Runs both instances for frames frames, or until they disagree.
+	 *
+	 * @param movie Input for every frame, starting from its first keyframe. Frames past its end
+	 *              get no buttons pressed. nullptr runs from power-on with no input.
+	 * @return false (with a message on stderr) if the ROM won't load or the movie is for
+	 *         another ROM; result is only filled in otherwise
+	 */
+	bool run(std::shared_ptr<Cartridge> cart, const Movie* movie, uint64_t frames, Result& result) const;
+
+	// XXH64 of A, X, Y, P, S and PC; framebuffers are compared by Emulator::frameHash
+	static uint64_t CpuHash(const CPU& cpu);
+};
+
+#endif // DIFFCHECK_H
@@ -0,0 +1,403 @@
+#include "Emulator.h"
+#include "Hash.h"
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+namespace {
+	// The components are written against shared_ptr, but here the Emulator owns
+	// them. An aliasing pointer with no control block hands out the address
+	// without taking ownership or allocating.
+	template <typename T>
+	std::shared_ptr<T> unowned(T& object) {
+		return std::shared_ptr<T>(std::shared_ptr<T>(), &object);
+	}
+
+	constexpr uint32_t emulatorChunk = SaveState::ChunkTag("EMU ");
+	constexpr uint32_t busChunk = SaveState::ChunkTag("BUS ");
+	constexpr uint32_t oamChunk = SaveState::ChunkTag("OAM ");
+	constexpr uint32_t cpuChunk = SaveState::ChunkTag("CPU ");
+	constexpr uint32_t ppuChunk = SaveState::ChunkTag("PPU ");
+	constexpr uint32_t apuChunk = SaveState::ChunkTag("APU ");
+	constexpr std::array<uint32_t, 6> chunkTags = { emulatorChunk, busChunk, oamChunk, cpuChunk, ppuChunk, apuChunk };
+	constexpr size_t headerSize = 16;
+
+	using Clock = std::chrono::steady_clock;
+	double microsSince(Clock::time_point start) {
+		return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+	}
+}
+
+bool Emulator::IsNesRom(const std::vector<uint8_t>& romData) {
+	if (romData.size() < 16) {
+		return false;
+	}
+	return std::equal(magicNumbers.begin(), magicNumbers.end(), romData.begin());
+}
+
+bool Emulator::loadRom(const std::vector<uint8_t>& romData) {
+	if (!IsNesRom(romData)) {
+		std::cout << "Invalid NES ROM file" << std::endl;
+		return false;
+	}
+	return loadRom(std::make_shared<Cartridge>(romData));
+}
+
+bool Emulator::loadRom(std::shared_ptr<Cartridge> cart) {
+	if (!cart) {
+		return false;
+	}
+	m_cart = cart;
+	m_romHash = Hash::XXH64(cart->getPRGROM().data(), cart->getPRGROM().size());
+	powerOn();
+	return true;
+}
+
+void Emulator::powerOn() {
+	// Clear everything the previous cartridge may have left behind
+	m_apu.reset();
+	m_ppu.reset();
+	m_cpu.reset();
+	std::fill(m_bus.memory.begin(), m_bus.memory.end(), 0x00);
+	m_bus.nmi = false;
+	m_oam = {};
+	m_frameCycles = 0;
+	m_frame = 0;
+	m_audio.clear();
+
+	m_cpu.emplace(unowned(m_bus), m_cart, unowned(m_oam));
+	m_ppu.emplace(unowned(m_bus), m_cart, unowned(m_oam));
+	m_apu.emplace(unowned(m_bus), m_cart);
+	m_apu->setSampleRate(m_sampleRate);
+	m_apu->setOutputEnabled(m_audioEnabled);
+	m_scheduler.clear();
+	m_apu->attach(&m_scheduler);
+	m_cpu->SetAPU(unowned(*m_apu));
+	m_cpu->SetControllerPorts(&m_input);
+	m_cpu->SetProfiler(m_profiler);
+	m_idleLoop.reset();
+	m_blockCache.clear();
+	m_jit.clear();
+	m_cpu->SetBlockCache(m_blockCacheEnabled ? &m_blockCache : nullptr);
+	if (!m_cart->getCHRROM().empty()) {
+		m_ppu->loadPatternTable(m_cart->getCHRROM()); // load the CHR ROM into PPU's pattern tables
+	}
+}
+
+void Emulator::reset() {
+	if (!isLoaded()) {
+		return;
+	}
+	m_apu->cpuWrite(0x4015, 0x00); // Silences every channel, as on hardware
+	m_cpu->setRESET(true);
+	m_idleLoop.reset();
+}
+
+void Emulator::runFrame(bool render) {
+	if (!isLoaded()) {
+		return;
+	}
+	TRACE_SCOPE("frame");
+	Clock::time_point start = Clock::now();
+	m_audio.clear();
+	if (m_runAhead == 0) {
+		emulateFrame(render, true);
+	}
+	else {
+		// The real frame, the one the machine stays at and the only one that is heard
+		emulateFrame(false, true);
+
+		TRACE_SCOPE("run-ahead");
+		Clock::time_point runAheadStart = Clock::now();
+		saveState(m_runAheadState);
+		m_metrics.saveStateMicros = microsSince(runAheadStart);
+		for (int i = 1; i <= m_runAhead; ++i) {
+			emulateFrame(render && i == m_runAhead, false);
+		}
+		// Savestates don't include the framebuffer, so the run-ahead picture survives the restore
+		Clock::time_point loadStart = Clock::now();
+		loadState(m_runAheadState);
+		m_metrics.loadStateMicros = microsSince(loadStart);
+		m_metrics.runAheadMicros = microsSince(runAheadStart);
+	}
+
+	m_metrics.frames++;
+	m_metrics.frameMicros = microsSince(start);
+	m_metrics.averageFrameMicros += (m_metrics.frameMicros - m_metrics.averageFrameMicros) / 60.0;
+}
+
+void Emulator::emulateFrame(bool render, bool audio) {
+	m_ppu->skipRendering = !render;
+	m_apu->setOutputEnabled(audio && m_audioEnabled);
+	m_ppu->frameComplete = false;
+#ifdef NES_BUS_STATS
+	m_bus.stats.frameStart();
+#endif
+	uint32_t framecycles = 0;
+	uint32_t idleCycles = 0;
+	bool jit = m_jitEnabled && Jit::Available && !(Profiler::Available && m_profiler);
+	Trace::Clock::time_point runStart = Trace::Now();
+	// The cycle limit only matters if the PPU stops stepping, a frame is normally just under it
+	while (!m_ppu->frameComplete && framecycles < CPU_CYCLES_PER_FRAME * 2) {
+		int cycles = m_idleLoop.skip(*m_cpu, m_bus);
+		if (cycles != 0) {
+			idleCycles += cycles;
+		}
+		else if (jit && (cycles = m_jit.run(*m_cpu, m_bus, jitBudget(framecycles))) != 0) {
+			m_idleLoop.reset(); // It only follows instructions the CPU runs one at a time
+		}
+		else {
+			cycles = m_cpu->execute(); // Executes one instruction
+			m_idleLoop.executed(*m_cpu, cycles);
+		}
+		m_scheduler.advance(cycles);
+		m_apu->clock(cycles); // Only adds up cycles, the APU catches up when it's next touched
+		if (m_scheduler.due()) {
+			cycles += runEvents();
+		}
+		framecycles += cycles;
+
+		// Step the PPU for each CPU cycle (3 PPU steps per CPU cycle)
+		for (int i = 0; i < cycles * 3; ++i) {
+			m_ppu->step();
+		}
+	}
+	// The PPU catches up three dots after every instruction, so CPU and PPU share one event
+	Trace::Clock::time_point runEnd = Trace::Now();
+	Trace::Complete("CPU + PPU run", runStart, runEnd);
+	m_apu->endFrame(m_audio);
+	Trace::Complete("audio mix", runEnd, Trace::Now());
+	m_apu->setOutputEnabled(m_audioEnabled);
+	m_frameCycles = framecycles;
+	m_frame++;
+
+	m_metrics.emulatedFrames++;
+	m_metrics.renderedFrames += render ? 1 : 0;
+	m_metrics.frameCycles = framecycles;
+	m_metrics.idleCycles = idleCycles;
+}
+
+// Answers every event that has come due, returns the CPU cycles lost to DMC fetches
+uint32_t Emulator::runEvents() {
+	uint32_t stall = 0;
+	SchedulerEvent event;
+	while (m_scheduler.pop(event)) {
+		switch (event) {
+		case SchedulerEvent::ApuIrq:
+		case SchedulerEvent::DmcDma:
+			m_apu->sync(); // Raises the interrupt or makes the fetch, and books the next ones
+			stall += m_apu->takeDmaStall();
+			break;
+		default:
+			break;
+		}
+	}
+	m_cpu->setIRQ(m_apu->irqPending()); // Level triggered, taken straight away if I is clear
+
+	// The CPU sits out the fetches while everything else keeps running
+	m_scheduler.advance(stall);
+	m_apu->clock(stall);
+	return stall;
+}
+
+// CPU cycles the JIT may run before anything it doesn't step could change what the CPU sees: it starts
+// no instruction this many cycles or more in, so the instruction an interpreted run would take the NMI,
+// an APU event or the end of the frame after is where the JIT stops too.
+uint32_t Emulator::jitBudget(uint32_t framecycles) const {
+	constexpr uint32_t dotsPerLine = 341;
+	constexpr uint32_t dotsPerFrame = 262 * dotsPerLine;
+	uint32_t position = m_ppu->scanline * dotsPerLine + m_ppu->dot;
+	// The step at (241, 1) raises the NMI; instructions may start until it has run
+	uint32_t toNmi = (241 * dotsPerLine + 1 + dotsPerFrame - position) % dotsPerFrame;
+	uint32_t budget = toNmi / 3 + 1;
+	// The step at (239, 340) ends the frame; the last instruction starts before it has run
+	uint32_t toFrameEnd = (239 * dotsPerLine + 340 + dotsPerFrame - position) % dotsPerFrame + 1;
+	budget = std::min(budget, (toFrameEnd + 2) / 3);
+	if (m_scheduler.next() != Scheduler::never) {
+		uint64_t toEvent = m_scheduler.next() > m_scheduler.now() ? m_scheduler.next() - m_scheduler.now() : 0;
+		budget = static_cast<uint32_t>(std::min<uint64_t>(budget, toEvent));
+	}
+	return std::min(budget, CPU_CYCLES_PER_FRAME * 2 - framecycles);
+}
+
+void Emulator::setBlockCache(bool enabled) {
+	m_blockCacheEnabled = enabled;
+	if (m_cpu) {
+		m_cpu->SetBlockCache(enabled ? &m_blockCache : nullptr);
+	}
+}
+
+void Emulator::setAudioSampleRate(double sampleRate) {
+	m_sampleRate = sampleRate;
+	if (m_apu) {
+		m_apu->setSampleRate(sampleRate);
+	}
+}
+
+void Emulator::setAudioEnabled(bool enabled) {
+	m_audioEnabled = enabled;
+	if (m_apu) {
+		m_apu->setOutputEnabled(enabled);
+	}
+}
+
+void Emulator::setRunAhead(int frames) {
+	m_runAhead = std::clamp(frames, 0, MAX_RUN_AHEAD);
+}
+
+void Emulator::setInput(int port, uint8_t state) {
+	if (port == 0 || port == 1) {
+		m_input.set(port, state);
+	}
+}
+
+void Emulator::setProfiler(Profiler* profiler) {
+	m_profiler = profiler;
+	if (m_cpu) {
+		m_cpu->SetProfiler(profiler);
+	}
+}
+
+std::vector<uint8_t> Emulator::saveState() const {
+	std::vector<uint8_t> state;
+	saveState(state);
+	return state;
+}
+
+void Emulator::saveState(std::vector<uint8_t>& state) const {
+	state.clear();
+	if (!isLoaded()) {
+		return;
+	}
+	StateWriter out(state);
+	out.write32(SaveState::magic);
+	out.write16(SaveState::version);
+	out.write16(0);
+	out.write64(m_romHash);
+
+	size_t chunk = out.beginChunk(emulatorChunk);
+	out.write32(m_frameCycles);
+	out.write64(m_frame);
+	out.endChunk(chunk);
+
+	// Both memories go in with a single copy each
+	chunk = out.beginChunk(busChunk);
+	out.writeBytes(m_bus.memory.data(), m_bus.memory.size());
+	out.writeBool(m_bus.nmi);
+	out.endChunk(chunk);
+
+	chunk = out.beginChunk(oamChunk);
+	out.writeBytes(m_oam.sprites.data(), sizeof(m_oam.sprites));
+	out.endChunk(chunk);
+
+	chunk = out.beginChunk(cpuChunk);
+	m_cpu->saveState(out);
+	out.endChunk(chunk);
+
+	chunk = out.beginChunk(ppuChunk);
+	m_ppu->saveState(out);
+	out.endChunk(chunk);
+
+	chunk = out.beginChunk(apuChunk);
+	m_apu->saveState(out);
+	out.endChunk(chunk);
+}
+
+uint64_t Emulator::stateHash() const {
+	std::vector<uint8_t> state = saveState();
+	return Hash::XXH64(state.data(), state.size());
+}
+
+bool Emulator::loadState(const std::vector<uint8_t>& state) {
+	return loadState(state.data(), state.size());
+}
+
+bool Emulator::loadState(const uint8_t* state, size_t size) {
+	if (!isLoaded()) {
+		return false;
+	}
+	StateReader in(state, size);
+	if (in.read32() != SaveState::magic) {
+		std::cerr << "Not an emulator savestate" << std::endl;
+		return false;
+	}
+	uint16_t version = in.read16();
+	in.read16();
+	if (version > SaveState::version) {
+		std::cerr << "Savestate version " << version << " is newer than this build supports" << std::endl;
+		return false;
+	}
+	if (in.read64() != m_romHash) {
+		std::cerr << "Savestate was taken with a different ROM" << std::endl;
+		return false;
+	}
+
+	// Check the chunk framing before changing anything, so a truncated blob is turned away whole
+	StateReader framing(state + headerSize, size - std::min(size, headerSize));
+	uint32_t tag;
+	StateReader chunk(nullptr, 0);
+	uint32_t found = 0; // One bit per entry in chunkTags
+	while (framing.nextChunk(tag, chunk)) {
+		auto known = std::find(chunkTags.begin(), chunkTags.end(), tag);
+		if (known != chunkTags.end()) {
+			found |= 1u << (known - chunkTags.begin());
+		}
+	}
+	if (!in.ok() || !framing.ok()) {
+		std::cerr << "Savestate is truncated" << std::endl;
+		return false;
+	}
+
+	// A chunk's payload is only checked by parsing it, so the chunks go over a backup that
+	// puts back what they changed if one turns out to be damaged
+	saveState(m_loadBackup);
+	if (!loadChunks(state + headerSize, size - headerSize)) {
+		loadChunks(m_loadBackup.data() + headerSize, m_loadBackup.size() - headerSize);
+		std::cerr << "Savestate chunk is damaged" << std::endl;
+		return false;
+	}
+	if (found != (1u << chunkTags.size()) - 1) {
+		// Older states may lack a chunk: that component starts from power-on, the rest as loaded.
+		// Every chunk parsed above, so loading them again can't fail.
+		powerOn();
+		loadChunks(state + headerSize, size - headerSize);
+	}
+	m_idleLoop.reset(); // The loop it was watching may not be where the CPU is now
+	return true;
+}
+
+bool Emulator::loadChunks(const uint8_t* chunks, size_t size) {
+	StateReader in(chunks, size);
+	uint32_t tag;
+	StateReader chunk(nullptr, 0);
+	bool ok = true;
+	while (in.nextChunk(tag, chunk)) {
+		switch (tag) {
+		case emulatorChunk:
+			m_frameCycles = chunk.read32();
+			m_frame = chunk.read64();
+			break;
+		case busChunk:
+			chunk.readBytes(m_bus.memory.data(), m_bus.memory.size());
+			m_bus.nmi = chunk.readBool();
+			break;
+		case oamChunk:
+			chunk.readBytes(m_oam.sprites.data(), sizeof(m_oam.sprites));
+			break;
+		case cpuChunk:
+			m_cpu->loadState(chunk);
+			break;
+		case ppuChunk:
+			m_ppu->loadState(chunk);
+			break;
+		case apuChunk:
+			m_apu->loadState(chunk);
+			break;
+		default:
+			break; // Saved by a newer build, nothing here uses it
+		}
+		ok = ok && chunk.ok();
+	}
+	return ok;
+}
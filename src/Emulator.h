@@ -0,0 +1,191 @@
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+#include "apu.h"
+#include "Bus.h"
+#include "Cartridge.h"
+#include "ControllerPorts.h"
+#include "CPU.h"
+#include "IdleLoop.h"
+#include "Jit.h"
+#include "Metrics.h"
+#include "OAM.h"
+#include "PPU.h"
+#include "Profiler.h"
+#include "Scheduler.h"
+
+#define CPU_CYCLES_PER_FRAME 29780
+#define MAX_RUN_AHEAD 4
+
+/**
+ * @brief A complete NES: bus, OAM, CPU and PPU wired together behind one object.
+ *
+ * Every piece of machine state lives inside the Emulator object itself, so any
+ * number of instances can run side by side in one process (including on
+ * different threads) without seeing each other. Only the cartridge is shared,
+ * since ROM data never changes once it is loaded.
+ *
+ * The components keep pointers into the Emulator, so it can't be copied or
+ * moved. Create it with std::make_unique; it is too big for most stacks.
+ */
+class Emulator
+{
+public:
+	Emulator() = default;
+	~Emulator() = default;
+	Emulator(const Emulator&) = delete;
+	Emulator& operator=(const Emulator&) = delete;
+
+	/**
+	 * @brief Power on with a new cartridge.
+	 *
+	 * @param romData Full contents of an iNES file
+	 * @return false (with a message on stderr) if the data isn't an NES ROM
+	 */
+	bool loadRom(const std::vector<uint8_t>& romData);
+	bool loadRom(std::shared_ptr<Cartridge> cart);
+	bool isLoaded() const { return m_cpu.has_value(); }
+
+	// Reset button: the CPU restarts from the reset vector and the APU goes quiet, memory is kept
+	void reset();
+	// Power cycle with the cartridge that is in
+	void power() { loadRom(m_cart); }
+	// XXH64 of the PRG ROM, what savestates and movies are matched against
+	uint64_t romHash() const { return m_romHash; }
+
+	/**
+	 * @brief Runs the CPU and PPU until the PPU has finished the next picture.
+	 *
+	 * Frames end on the last visible scanline, so the framebuffer always holds
+	 * one whole picture. With render false the frame is emulated exactly the
+	 * same but no pixels are produced and the framebuffer keeps the old picture.
+	 *
+	 * With run-ahead set, the frame is run without a picture, saved, then the
+	 * machine runs that many more frames with the same input, keeps the last
+	 * picture and is restored to the saved frame. The picture shown is the one
+	 * the game would draw a few frames later, hiding the game's own input lag.
+	 */
+	void runFrame(bool render = true);
+
+	// Frames to run ahead, 0 (off) to MAX_RUN_AHEAD
+	void setRunAhead(int frames);
+	int runAhead() const { return m_runAhead; }
+
+	const Metrics& metrics() const { return m_metrics; }
+
+	// Controller state for port 0 or 1, one bit per button (see InputHandler). Safe to call from any
+	// thread at any time, even mid-frame: the game sees the newest state at its next $4016 strobe.
+	void setInput(int port, uint8_t state);
+	uint8_t input(int port) const { return m_input.get(port); }
+
+	// Guest profiler fed by every instruction from now on, across cartridge changes; nullptr detaches.
+	// Only NES_PROFILER builds record anything (Profiler::Available).
+	void setProfiler(Profiler* profiler);
+
+	// Wait loops are skipped rather than executed once they are found to be idle (see IdleLoop.h), on by
+	// default. The machine ends up in exactly the same state either way, only the host time differs.
+	void setIdleLoopSkipping(bool enabled) { m_idleLoop.enabled = enabled; m_idleLoop.reset(); }
+	bool idleLoopSkipping() const { return m_idleLoop.enabled; }
+	const IdleLoop& idleLoop() const { return m_idleLoop; }
+
+	// PRG ROM code runs from pre-decoded blocks (see BlockCache.h), on by default. Off, every
+	// instruction goes through the plain interpreter; the machine behaves the same either way.
+	void setBlockCache(bool enabled);
+	bool blockCacheEnabled() const { return m_blockCacheEnabled; }
+	const BlockCache& blockCache() const { return m_blockCache; }
+
+	// Hot PRG ROM blocks are compiled to host code (see Jit.h), off by default and x86-64 hosts only.
+	// Left off while a profiler is attached. The machine behaves exactly the same either way.
+	void setJit(bool enabled) { m_jitEnabled = enabled; }
+	bool jitEnabled() const { return m_jitEnabled; }
+	Jit& jit() { return m_jit; }
+
+	// 256x240 packed 0x00RRGGBB pixels of the most recent frame
+	const uint32_t* framebuffer() const { return m_ppu ? m_ppu->getFrameBuffer() : nullptr; }
+	// XXH64 of that frame, Hash::XXH64 of framebuffer(); worked out by the PPU as it draws (see PPU::frameHash)
+	uint64_t frameHash() const { return m_ppu ? m_ppu->frameHash() : 0; }
+
+	// Mono float samples produced during the last runFrame (run-ahead frames don't add any)
+	const std::vector<float>& audio() const { return m_audio; }
+	void setAudioSampleRate(double sampleRate);
+
+	// With audio off nothing is mixed or resampled and audio() stays empty. The APU still keeps every bit of
+	// its state, so games, savestates and frame hashes are the same either way.
+	void setAudioEnabled(bool enabled);
+	bool audioEnabled() const { return m_audioEnabled; }
+
+	/**
+	 * @brief Snapshot of the whole machine in the format described in SaveState.h.
+	 *
+	 * The overload taking a buffer reuses its capacity, so saving every frame
+	 * into the same vector doesn't allocate after the first save.
+	 */
+	std::vector<uint8_t> saveState() const;
+	void saveState(std::vector<uint8_t>& state) const;
+	// XXH64 of saveState(), which tells apart machines showing the same picture
+	uint64_t stateHash() const;
+
+	/**
+	 * @brief Restores a snapshot taken with saveState.
+	 *
+	 * Loading is all or nothing: a chunk that fails to parse rolls back the ones
+	 * applied before it. A component whose chunk is missing starts from power-on.
+	 *
+	 * @return false, leaving the machine untouched, if the blob is damaged or was
+	 *         saved with a different ROM or a newer format version
+	 */
+	bool loadState(const std::vector<uint8_t>& state);
+	bool loadState(const uint8_t* state, size_t size);
+
+	uint64_t frameCount() const { return m_frame; }
+	CPU& cpu() { return *m_cpu; }
+	PPU& ppu() { return *m_ppu; }
+	APU& apu() { return *m_apu; }
+	Bus& bus() { return m_bus; }
+
+	static bool IsNesRom(const std::vector<uint8_t>& romData);
+
+private:
+	static constexpr std::array<uint8_t, 4> magicNumbers = { 0x4E, 0x45, 0x53, 0x1A }; // NES<EOF> magic numbers to identify a NES ROM file
+
+	Bus m_bus;
+	OAM m_oam = {};
+	std::shared_ptr<Cartridge> m_cart;
+	std::optional<CPU> m_cpu; // Created once a cartridge is inserted, the CPU reads the reset vector from it
+	std::optional<PPU> m_ppu;
+	std::optional<APU> m_apu;
+	ControllerPorts m_input; // Outlives cartridge changes, held buttons stay held
+	Profiler* m_profiler = nullptr;
+	IdleLoop m_idleLoop; // Only watches the CPU, holds no machine state
+	BlockCache m_blockCache; // Decoded from the cartridge, cleared when it changes
+	bool m_blockCacheEnabled = true;
+	Jit m_jit; // Compiled from the cartridge, cleared when it changes
+	bool m_jitEnabled = false;
+	std::vector<float> m_audio;
+	double m_sampleRate = 44100.0;
+	bool m_audioEnabled = true;
+	uint64_t m_romHash = 0; // Savestates only load into the ROM they were taken with
+
+	void powerOn();
+	bool loadChunks(const uint8_t* chunks, size_t size);
+	void emulateFrame(bool render, bool audio);
+	uint32_t runEvents();
+	uint32_t jitBudget(uint32_t framecycles) const;
+
+	Scheduler m_scheduler; // CPU clock and the timed events on it
+
+	uint32_t m_frameCycles = 0; // CPU cycles the last frame took
+	uint64_t m_frame = 0;
+
+	int m_runAhead = 0;
+	std::vector<uint8_t> m_runAheadState; // Reused every frame so run-ahead doesn't allocate
+	std::vector<uint8_t> m_loadBackup; // What loadState rolls back to, reused like m_runAheadState
+	Metrics m_metrics;
+};
+
+#endif // EMULATOR_H
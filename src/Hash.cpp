@@ -0,0 +1,145 @@
+#include "Hash.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+// Straight implementation of the XXH64 spec: https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+namespace {
+	constexpr uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+	constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+	constexpr uint64_t prime3 = 0x165667B19E3779F9ULL;
+	constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+	constexpr uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+	inline uint64_t rotl(uint64_t value, int bits) {
+		return (value << bits) | (value >> (64 - bits));
+	}
+
+	// Input is read little-endian regardless of the host; on little-endian hosts that's a plain load
+	inline uint64_t read64(const uint8_t* p) {
+		uint64_t value = 0;
+		if constexpr (std::endian::native == std::endian::little) {
+			std::memcpy(&value, p, sizeof(value));
+			return value;
+		}
+		for (int i = 7; i >= 0; --i) {
+			value = (value << 8) | p[i];
+		}
+		return value;
+	}
+
+	inline uint32_t read32(const uint8_t* p) {
+		return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+	}
+
+	inline uint64_t round(uint64_t acc, uint64_t lane) {
+		acc += lane * prime2;
+		acc = rotl(acc, 31);
+		return acc * prime1;
+	}
+
+	inline uint64_t mergeRound(uint64_t acc, uint64_t value) {
+		acc ^= round(0, value);
+		return acc * prime1 + prime4;
+	}
+
+	void startAccumulators(uint64_t acc[4], uint64_t seed) {
+		acc[0] = seed + prime1 + prime2;
+		acc[1] = seed + prime2;
+		acc[2] = seed;
+		acc[3] = seed - prime1;
+	}
+
+	// Runs whole 32-byte stripes through the four lanes
+	void consumeStripes(uint64_t acc[4], const uint8_t* p, size_t stripes) {
+		uint64_t acc1 = acc[0], acc2 = acc[1], acc3 = acc[2], acc4 = acc[3];
+		for (size_t i = 0; i < stripes; ++i, p += 32) {
+			acc1 = round(acc1, read64(p));
+			acc2 = round(acc2, read64(p + 8));
+			acc3 = round(acc3, read64(p + 16));
+			acc4 = round(acc4, read64(p + 24));
+		}
+		acc[0] = acc1; acc[1] = acc2; acc[2] = acc3; acc[3] = acc4;
+	}
+
+	uint64_t convergeAccumulators(const uint64_t acc[4]) {
+		uint64_t result = rotl(acc[0], 1) + rotl(acc[1], 7) + rotl(acc[2], 12) + rotl(acc[3], 18);
+		for (int i = 0; i < 4; ++i) {
+			result = mergeRound(result, acc[i]);
+		}
+		return result;
+	}
+
+	// Adds the length, consumes the remaining 0-31 bytes and avalanches
+	uint64_t finish(uint64_t acc, uint64_t size, const uint8_t* p, const uint8_t* end) {
+		acc += size;
+		while (p + 8 <= end) {
+			acc ^= round(0, read64(p));
+			acc = rotl(acc, 27) * prime1 + prime4;
+			p += 8;
+		}
+		if (p + 4 <= end) {
+			acc ^= read32(p) * prime1;
+			acc = rotl(acc, 23) * prime2 + prime3;
+			p += 4;
+		}
+		while (p < end) {
+			acc ^= *p * prime5;
+			acc = rotl(acc, 11) * prime1;
+			p++;
+		}
+
+		acc ^= acc >> 33;
+		acc *= prime2;
+		acc ^= acc >> 29;
+		acc *= prime3;
+		acc ^= acc >> 32;
+		return acc;
+	}
+}
+
+uint64_t Hash::XXH64(const void* data, size_t size, uint64_t seed) {
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	uint64_t acc = seed + prime5;
+	if (size >= 32) {
+		uint64_t lanes[4];
+		startAccumulators(lanes, seed);
+		consumeStripes(lanes, p, size / 32);
+		acc = convergeAccumulators(lanes);
+		p += size / 32 * 32;
+	}
+	return finish(acc, size, p, static_cast<const uint8_t*>(data) + size);
+}
+
+void Hash::XXH64Stream::reset(uint64_t seed) {
+	startAccumulators(m_acc, seed);
+	m_buffered = 0;
+	m_size = 0;
+	m_seed = seed;
+}
+
+void Hash::XXH64Stream::update(const void* data, size_t size) {
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	m_size += size;
+	if (m_buffered != 0) {
+		size_t take = std::min(size, sizeof(m_buffer) - m_buffered);
+		std::memcpy(m_buffer + m_buffered, p, take);
+		m_buffered += take;
+		p += take;
+		size -= take;
+		if (m_buffered < sizeof(m_buffer)) {
+			return;
+		}
+		consumeStripes(m_acc, m_buffer, 1);
+		m_buffered = 0;
+	}
+	consumeStripes(m_acc, p, size / 32);
+	p += size / 32 * 32;
+	m_buffered = size % 32;
+	std::memcpy(m_buffer, p, m_buffered);
+}
+
+uint64_t Hash::XXH64Stream::digest() const {
+	uint64_t acc = m_size >= 32 ? convergeAccumulators(m_acc) : m_seed + prime5;
+	return finish(acc, m_size, m_buffer, m_buffer + m_buffered);
+}
@@ -0,0 +1,43 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Hash {
+
+	/**
+	 * @brief 64-bit xxHash (XXH64) of a block of memory.
+	 *
+	 * Used to fingerprint frames, savestates and ROMs. Output matches the
+	 * reference implementation, so hashes can be compared with other tools.
+	 */
+	uint64_t XXH64(const void* data, size_t size, uint64_t seed = 0);
+
+	/**
+	 * @brief XXH64 of data fed in pieces, the same value XXH64() gives for all of it at once.
+	 *
+	 * Pieces that are multiples of 32 bytes go straight through without being
+	 * buffered. The PPU feeds it each scanline as it is drawn, so a frame's
+	 * hash is ready with the frame and the pixels are hashed while in cache.
+	 */
+	class XXH64Stream
+	{
+	public:
+		explicit XXH64Stream(uint64_t seed = 0) { reset(seed); }
+
+		void reset(uint64_t seed = 0);
+		void update(const void* data, size_t size);
+		// Hash of everything fed since the last reset; more can be fed after
+		uint64_t digest() const;
+
+	private:
+		uint64_t m_acc[4] = {};
+		uint8_t m_buffer[32] = {}; // Start of a stripe not yet complete
+		size_t m_buffered = 0;
+		uint64_t m_size = 0;
+		uint64_t m_seed = 0;
+	};
+}
+
+#endif // HASH_H
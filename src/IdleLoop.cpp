@@ -0,0 +1,192 @@
+#include "IdleLoop.h"
+#include "Bus.h"
+#include "CPU.h"
+#include <algorithm>
+
+namespace {
+	enum class Kind : uint8_t { Other, Implied, Immediate, ZeroPage, Absolute, Relative, Jump };
+
+	// The instructions a wait loop may contain; everything else is Other and ends the search
+	struct KindTable {
+		Kind kinds[256] = {};
+		constexpr KindTable() {
+			for (uint8_t opcode : { 0xEA, 0x18, 0x38, 0xB8, 0xAA, 0xA8, 0x8A, 0x98 }) { // NOP CLC SEC CLV TAX TAY TXA TYA
+				kinds[opcode] = Kind::Implied;
+			}
+			for (uint8_t opcode : { 0xA9, 0xA2, 0xA0, 0xC9, 0xE0, 0xC0, 0x29, 0x09, 0x49 }) { // LDA LDX LDY CMP CPX CPY AND ORA EOR
+				kinds[opcode] = Kind::Immediate;
+			}
+			for (uint8_t opcode : { 0xA5, 0xA6, 0xA4, 0x24, 0xC5, 0xE4, 0xC4, 0x25, 0x05, 0x45 }) { // the same and BIT
+				kinds[opcode] = Kind::ZeroPage;
+			}
+			for (uint8_t opcode : { 0xAD, 0xAE, 0xAC, 0x2C, 0xCD, 0xEC, 0xCC, 0x2D, 0x0D, 0x4D }) {
+				kinds[opcode] = Kind::Absolute;
+			}
+			for (uint8_t opcode : { 0x10, 0x30, 0x50, 0x70, 0x90, 0xB0, 0xD0, 0xF0 }) {
+				kinds[opcode] = Kind::Relative;
+			}
+			kinds[0x4C] = Kind::Jump;
+		}
+	};
+	constexpr KindTable table;
+
+	constexpr uint8_t interruptDisable = 0x04;
+	constexpr uint8_t vblankFlag = 0x80;
+	constexpr uint16_t ppuStatus = 0x2002;
+}
+
+int IdleLoop::skip(CPU& cpu, Bus& bus) {
+	m_pendingAllowed = false;
+	if (!enabled) {
+		return 0;
+	}
+	// Anything execute would take before its fetch
+	bool interrupt = cpu.reset_signal || cpu.nmi_signal || (bus.nmi && !cpu.previous_nmi_state) ||
+		(cpu.irq_signal && !(cpu.status & interruptDisable));
+	uint16_t pc = cpu.program_counter;
+
+	if (m_state == State::Skipping) {
+		const Step& step = m_previous[m_cursor];
+		if (!interrupt && pc == step.pc && (!step.reads || bus.memory[step.address] == step.value)) {
+			cpu.previous_nmi_state = bus.nmi; // What execute's setNMI leaves behind when there's no edge
+			cpu.accumulator = step.a;
+			cpu.x = step.x;
+			cpu.y = step.y;
+			cpu.status = step.status;
+			cpu.program_counter = step.next;
+			m_cursor = (m_cursor + 1) % m_previousLength;
+			m_skippedInstructions++;
+			m_skippedCycles += step.cycles;
+#ifdef NES_BUS_STATS
+			countReads(bus, cpu.peek(step.pc), step);
+#endif
+			return step.cycles;
+		}
+		m_state = State::Searching; // Something changed, the CPU takes it from here
+	}
+
+	if (interrupt || pc < 0x8000) {
+		return 0;
+	}
+	Kind kind = table.kinds[cpu.peek(pc)];
+	if (kind == Kind::Other) {
+		return 0;
+	}
+	m_pending = Step();
+	m_pending.pc = pc;
+	if (kind == Kind::ZeroPage || kind == Kind::Absolute) {
+		uint16_t address = cpu.peek(static_cast<uint16_t>(pc + 1));
+		if (kind == Kind::Absolute) {
+			address |= cpu.peek(static_cast<uint16_t>(pc + 2)) << 8;
+		}
+		m_pending.address = address;
+		if (address < 0x2000 || address == ppuStatus) {
+			m_pending.reads = true;
+			m_pending.value = bus.memory[address];
+			if (address == ppuStatus && (m_pending.value & vblankFlag)) {
+				return 0; // This read clears the flag, the next one won't see the same value
+			}
+		}
+		else if (address < 0x8000) {
+			return 0; // Other registers have side effects or change under the loop
+		}
+	}
+	m_pendingAllowed = true;
+	m_pendingStackPointer = cpu.stack_pointer;
+	return 0;
+}
+
+#ifdef NES_BUS_STATS
+// The reads execute would have made: opcode and operand fetches, then the operation's own
+void IdleLoop::countReads(Bus& bus, uint8_t opcode, const Step& step) {
+	Kind kind = table.kinds[opcode];
+	bus.stats.read(step.pc);
+	switch (kind) {
+	case Kind::Immediate:
+		bus.stats.read(static_cast<uint16_t>(step.pc + 1));
+		break;
+	case Kind::ZeroPage:
+	case Kind::Absolute:
+		bus.stats.read(static_cast<uint16_t>(step.pc + 1));
+		if (kind == Kind::Absolute) {
+			bus.stats.read(static_cast<uint16_t>(step.pc + 2));
+		}
+		bus.stats.read(step.address);
+		break;
+	case Kind::Relative:
+		if (step.next != static_cast<uint16_t>(step.pc + 2)) {
+			bus.stats.read(static_cast<uint16_t>(step.pc + 1)); // The offset, only read when the branch is taken
+		}
+		break;
+	case Kind::Jump:
+		bus.stats.read(static_cast<uint16_t>(step.pc + 1));
+		bus.stats.read(static_cast<uint16_t>(step.pc + 2));
+		break;
+	default:
+		break;
+	}
+}
+#endif
+
+void IdleLoop::executed(const CPU& cpu, int cycles) {
+	if (!enabled) {
+		return;
+	}
+	// An instruction a loop can't contain, or an interrupt was taken after all
+	if (!m_pendingAllowed || cpu.stack_pointer != m_pendingStackPointer) {
+		m_state = State::Searching;
+		return;
+	}
+	Step step = m_pending;
+	step.next = cpu.program_counter;
+	step.cycles = static_cast<uint8_t>(cycles);
+	step.a = cpu.accumulator;
+	step.x = cpu.x;
+	step.y = cpu.y;
+	step.status = cpu.status;
+	// Only a taken branch or a JMP goes backwards
+	bool closesLoop = step.next <= step.pc && step.pc - step.next < maxBytes;
+
+	if (m_state == State::Recording) {
+		uint16_t expected = m_currentLength == 0 ? m_head : m_current[m_currentLength - 1].next;
+		if (step.pc == expected && m_currentLength < maxInstructions) {
+			m_current[m_currentLength++] = step;
+			if (!closesLoop) {
+				return;
+			}
+			if (step.next != m_head) {
+				startRecording(step.next); // An inner or different loop
+				return;
+			}
+			// A whole pass. If it matches the one before, every pass after it will too.
+			if (m_currentLength == m_previousLength &&
+				std::equal(m_current.begin(), m_current.begin() + m_currentLength, m_previous.begin())) {
+				m_state = State::Skipping;
+				m_cursor = 0;
+				return;
+			}
+			m_previous = m_current;
+			m_previousLength = m_currentLength;
+			m_currentLength = 0;
+			return;
+		}
+		m_state = State::Searching;
+	}
+	if (closesLoop) {
+		startRecording(step.next);
+	}
+}
+
+void IdleLoop::startRecording(uint16_t head) {
+	m_state = State::Recording;
+	m_head = head;
+	m_previousLength = 0;
+	m_currentLength = 0;
+}
+
+void IdleLoop::reset() {
+	m_state = State::Searching;
+	m_previousLength = 0;
+	m_currentLength = 0;
+	m_pendingAllowed = false;
+}
@@ -0,0 +1,98 @@
+#ifndef IDLELOOP_H
+#define IDLELOOP_H
+
+#include <array>
+#include <cstdint>
+
+class Bus;
+class CPU;
+
+/**
+ * @brief Stands in for the CPU while it spins in a wait loop.
+ *
+ * Games spend much of each frame in loops like "BIT $2002 / BPL" or
+ * "LDA flag / BEQ" waiting for vblank or their NMI handler. Such a loop only
+ * reads, so once one pass through it comes out exactly like the pass before,
+ * every further pass will too until something it reads changes or an
+ * interrupt comes in. From then on the instructions don't need executing:
+ * skip() moves the registers and PC to what the instruction would have left
+ * them at and returns its cycles, so the PPU, APU and scheduler are stepped
+ * exactly as before and an NMI lands on the same cycle.
+ *
+ * To stay exact the detector only accepts:
+ *  - loops closed by a backward branch or JMP, of at most maxInstructions
+ *    instructions and maxBytes bytes, running from PRG ROM;
+ *  - loads, compares, BIT, AND/ORA/EOR, register transfers, flag changes,
+ *    branches, JMP and NOP, immediate, zero page or absolute only, so nothing
+ *    is written and the stack is never touched;
+ *  - reads of RAM ($0000-$1FFF), PRG ROM, and $2002 while its vblank bit is
+ *    clear (the one read whose side effect, clearing that bit, is then a no-op).
+ * Before each skipped instruction the byte it reads is checked against the
+ * recorded pass, and any pending interrupt hands control back to the CPU.
+ *
+ * Skipped instructions don't reach the guest profiler; in NES_BUS_STATS builds
+ * the reads they would have made are still counted.
+ */
+class IdleLoop
+{
+public:
+	static constexpr int maxInstructions = 8;
+	static constexpr int maxBytes = 32;
+
+	bool enabled = true;
+
+	// Before each instruction. Returns the cycles of the instruction it stood in for,
+	// 0 if the CPU has to execute this one itself.
+	int skip(CPU& cpu, Bus& bus);
+	// After each instruction the CPU did execute, with the cycles it took
+	void executed(const CPU& cpu, int cycles);
+	// Forgets the loop being watched; after a savestate load, reset or new cartridge
+	void reset();
+
+	uint64_t skippedInstructions() const { return m_skippedInstructions; }
+	uint64_t skippedCycles() const { return m_skippedCycles; }
+
+private:
+	// One instruction of a pass, with what it read and the registers it left
+	struct Step {
+		uint16_t pc = 0;
+		uint16_t next = 0;
+		uint16_t address = 0; // What a zero page or absolute operand points at
+		bool reads = false; // address is RAM or $2002, so value has to match before a skip
+		uint8_t value = 0;
+		uint8_t cycles = 0;
+		uint8_t a = 0, x = 0, y = 0, status = 0;
+
+		bool operator==(const Step& other) const {
+			return pc == other.pc && next == other.next && address == other.address && reads == other.reads &&
+				value == other.value && cycles == other.cycles && a == other.a && x == other.x && y == other.y &&
+				status == other.status;
+		}
+	};
+	using Pass = std::array<Step, maxInstructions>;
+
+	enum class State { Searching, Recording, Skipping };
+
+	void startRecording(uint16_t head);
+#ifdef NES_BUS_STATS
+	static void countReads(Bus& bus, uint8_t opcode, const Step& step);
+#endif
+
+	State m_state = State::Searching;
+	uint16_t m_head = 0;
+	Pass m_previous = {}; // The last complete pass, what the next has to match
+	int m_previousLength = 0;
+	Pass m_current = {};
+	int m_currentLength = 0;
+	int m_cursor = 0; // Next step to skip
+
+	// Decoded by skip() for executed() when the CPU runs the instruction itself
+	Step m_pending;
+	bool m_pendingAllowed = false;
+	uint8_t m_pendingStackPointer = 0;
+
+	uint64_t m_skippedInstructions = 0;
+	uint64_t m_skippedCycles = 0;
+};
+
+#endif // IDLELOOP_H
@@ -0,0 +1,74 @@
+#include "ImageWriter.h"
+#include <fstream>
+#include <vector>
+
+namespace {
+	void put16(std::vector<uint8_t>& out, uint16_t value) {
+		out.push_back(value & 0xFF);
+		out.push_back(value >> 8);
+	}
+
+	void put32(std::vector<uint8_t>& out, uint32_t value) {
+		put16(out, value & 0xFFFF);
+		put16(out, value >> 16);
+	}
+}
+
+bool ImageWriter::WriteBmp(const std::string& path, const uint32_t* pixels, int width, int height) {
+	const int rowSize = (width * 3 + 3) & ~3; // Rows are padded to 4 bytes
+	const uint32_t headerSize = 14 + 40;
+	const uint32_t imageSize = rowSize * height;
+
+	std::vector<uint8_t> file;
+	file.reserve(headerSize + imageSize);
+
+	// BITMAPFILEHEADER
+	file.push_back('B');
+	file.push_back('M');
+	put32(file, headerSize + imageSize);
+	put32(file, 0);
+	put32(file, headerSize);
+
+	// BITMAPINFOHEADER
+	put32(file, 40);
+	put32(file, width);
+	put32(file, height);
+	put16(file, 1);  // Planes
+	put16(file, 24); // Bits per pixel
+	put32(file, 0);  // No compression
+	put32(file, imageSize);
+	put32(file, 2835); // 72 DPI
+	put32(file, 2835);
+	put32(file, 0);
+	put32(file, 0);
+
+	// BMP rows go bottom to top, pixels are stored BGR
+	for (int y = height - 1; y >= 0; --y) {
+		const uint32_t* row = pixels + y * width;
+		for (int x = 0; x < width; ++x) {
+			file.push_back(row[x] & 0xFF);
+			file.push_back((row[x] >> 8) & 0xFF);
+			file.push_back((row[x] >> 16) & 0xFF);
+		}
+		file.resize(file.size() + (rowSize - width * 3), 0);
+	}
+
+	std::ofstream out(path, std::ios::binary);
+	out.write(reinterpret_cast<const char*>(file.data()), file.size());
+	return static_cast<bool>(out);
+}
+
+bool ImageWriter::WritePpm(const std::string& path, const uint32_t* pixels, int width, int height) {
+	std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+	std::vector<uint8_t> file(header.begin(), header.end());
+	file.reserve(header.size() + static_cast<size_t>(width) * height * 3);
+	for (int i = 0; i < width * height; ++i) {
+		file.push_back((pixels[i] >> 16) & 0xFF);
+		file.push_back((pixels[i] >> 8) & 0xFF);
+		file.push_back(pixels[i] & 0xFF);
+	}
+
+	std::ofstream out(path, std::ios::binary);
+	out.write(reinterpret_cast<const char*>(file.data()), file.size());
+	return static_cast<bool>(out);
+}
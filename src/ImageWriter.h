@@ -0,0 +1,20 @@
+#ifndef IMAGEWRITER_H
+#define IMAGEWRITER_H
+
+#include <cstdint>
+#include <string>
+
+namespace ImageWriter {
+
+	/**
+	 * @brief Saves packed 0x00RRGGBB pixels (the PPU framebuffer format) as a 24-bit BMP.
+	 *
+	 * @return false if the file couldn't be written
+	 */
+	bool WriteBmp(const std::string& path, const uint32_t* pixels, int width, int height);
+
+	// Same pixels as a binary PPM (P6), which nearly every image viewer and converter reads
+	bool WritePpm(const std::string& path, const uint32_t* pixels, int width, int height);
+}
+
+#endif // IMAGEWRITER_H
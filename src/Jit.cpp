@@ -0,0 +1,754 @@
+#include "Jit.h"
+#include "Bus.h"
+#include "CPU.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <string>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace {
+	enum Reg : int { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+	// Where things live while a block runs. All callee-saved on both x86-64 ABIs, so call-outs keep them.
+	constexpr int FRAME = RBX, MEMORY = RBP, A = R12, X = R13, Y = R14, P = R15;
+	// EDX holds the effective address; EAX and ECX are scratch
+#ifdef _WIN32
+	constexpr int ARG0 = RCX, ARG1 = RDX;
+#else
+	constexpr int ARG0 = RDI, ARG1 = RSI;
+#endif
+	enum Alu : int { ADD = 0, OR = 1, AND = 4, SUB = 5, XOR = 6, CMP = 7 };
+	enum Condition : int { Below = 0x2, AboveOrEqual = 0x3, Equal = 0x4, NotEqual = 0x5, Above = 0x7 };
+	enum Shift : int { SHL = 4, SHR = 5 };
+
+	constexpr int32_t offCycles = offsetof(Jit::Frame, cycles);
+	constexpr int32_t offBudget = offsetof(Jit::Frame, budget);
+	constexpr int32_t offPc = offsetof(Jit::Frame, pc);
+	constexpr int32_t offStop = offsetof(Jit::Frame, stop);
+	constexpr int32_t offZn = offsetof(Jit::Frame, zn);
+	constexpr int32_t offMemory = offsetof(Jit::Frame, memory);
+
+	constexpr uint8_t carry = 0x01, zero = 0x02, interruptDisable = 0x04, decimal = 0x08, overflow = 0x40, negative = 0x80;
+
+	// Just enough of an x86-64 assembler for the blocks below. Operations are 32-bit unless noted;
+	// guest registers are kept zero-extended, so they can index memory as they are.
+	class Emitter
+	{
+	public:
+		std::vector<uint8_t> code;
+
+		// movzx dst, byte [base + index + disp] (index -1 for none)
+		void loadByte(int dst, int base, int index, int32_t disp) { rex(false, dst, index, base); put(0x0F); put(0xB6); memory(dst, base, index, disp); }
+		// mov byte [base + index + disp], src
+		void storeByte(int base, int index, int32_t disp, int src) { rex(false, src, index, base, src >= RSP && src <= RDI); put(0x88); memory(src, base, index, disp); }
+		void storeByteImm(int base, int32_t disp, uint8_t value) { rex(false, 0, -1, base); put(0xC6); memory(0, base, -1, disp); put(value); }
+		void storeWordImm(int base, int32_t disp, uint16_t value) { put(0x66); rex(false, 0, -1, base); put(0xC7); memory(0, base, -1, disp); put(value & 0xFF); put(value >> 8); }
+		void load64(int dst, int base, int32_t disp) { rex(true, dst, -1, base); put(0x8B); memory(dst, base, -1, disp); }
+		void mov(int dst, int src) { rex(false, src, -1, dst); put(0x89); direct(src, dst); }
+		void mov64(int dst, int src) { rex(true, src, -1, dst); put(0x89); direct(src, dst); }
+		void movImm(int dst, uint32_t value) { rex(false, 0, -1, dst); put(0xB8 + (dst & 7)); put32(value); }
+		void movImm64(int dst, uint64_t value) { rex(true, 0, -1, dst); put(0xB8 + (dst & 7)); put32(static_cast<uint32_t>(value)); put32(static_cast<uint32_t>(value >> 32)); }
+		void alu(Alu op, int dst, int src) { rex(false, src, -1, dst); put(op * 8 + 1); direct(src, dst); }
+		void aluImm(Alu op, int dst, int32_t value, bool wide = false) { rex(wide, 0, -1, dst); put(0x81); direct(op, dst); put32(value); }
+		// op dword [base + disp], value
+		void aluMemImm(Alu op, int base, int32_t disp, int32_t value) { rex(false, 0, -1, base); put(0x81); memory(op, base, -1, disp); put32(value); }
+		// op dword [base + disp], src
+		void aluMem(Alu op, int base, int32_t disp, int src) { rex(false, src, -1, base); put(op * 8 + 1); memory(src, base, -1, disp); }
+		// op dst, dword [base + disp]
+		void aluFromMem(Alu op, int dst, int base, int32_t disp) { rex(false, dst, -1, base); put(op * 8 + 3); memory(dst, base, -1, disp); }
+		void shift(Shift op, int dst, uint8_t count) { rex(false, 0, -1, dst); put(0xC1); direct(op, dst); put(count); }
+		void test(int a, int b) { rex(false, b, -1, a); put(0x85); direct(b, a); }
+		void testImm(int dst, uint32_t value) { rex(false, 0, -1, dst); put(0xF7); direct(0, dst); put32(value); }
+		// dst = condition ? 1 : 0, all 32 bits
+		void set(Condition condition, int dst) {
+			bool low = dst >= RSP && dst <= RDI;
+			rex(false, 0, -1, dst, low); put(0x0F); put(0x90 + condition); direct(0, dst);
+			rex(false, dst, -1, dst, low); put(0x0F); put(0xB6); direct(dst, dst);
+		}
+		void push(int reg) { rex(false, 0, -1, reg); put(0x50 + (reg & 7)); }
+		void pop(int reg) { rex(false, 0, -1, reg); put(0x58 + (reg & 7)); }
+		void call(int reg) { rex(false, 0, -1, reg); put(0xFF); direct(2, reg); }
+		void ret() { put(0xC3); }
+
+		// Forward jumps return the end of the instruction, for bind() to point at the code that follows it
+		size_t jump(Condition condition) { put(0x0F); put(0x80 + condition); put32(0); return code.size(); }
+		size_t jump() { put(0xE9); put32(0); return code.size(); }
+		void bind(size_t patch) { write32(patch - 4, static_cast<uint32_t>(code.size() - patch)); }
+		// Backward jump to code already emitted
+		void jumpTo(Condition condition, size_t target) {
+			put(0x0F);
+			put(0x80 + condition);
+			put32(static_cast<uint32_t>(static_cast<int32_t>(target) - static_cast<int32_t>(code.size() + 4)));
+		}
+
+	private:
+		void put(uint8_t byte) { code.push_back(byte); }
+		void put32(uint32_t value) {
+			for (int i = 0; i < 4; ++i) {
+				put(static_cast<uint8_t>(value >> (8 * i)));
+			}
+		}
+		void write32(size_t at, uint32_t value) {
+			for (int i = 0; i < 4; ++i) {
+				code[at + i] = static_cast<uint8_t>(value >> (8 * i));
+			}
+		}
+		// Needed for registers from R8 up, 64-bit operands, and SPL-DIL as byte registers
+		void rex(bool wide, int reg, int index, int base, bool force = false) {
+			uint8_t prefix = 0x40 | (wide ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) | (index >= 0 && (index & 8) ? 0x02 : 0) | ((base & 8) ? 0x01 : 0);
+			if (prefix != 0x40 || force) {
+				put(prefix);
+			}
+		}
+		void direct(int reg, int rm) { put(static_cast<uint8_t>(0xC0 | ((reg & 7) << 3) | (rm & 7))); }
+		// [base + index + disp32]
+		void memory(int reg, int base, int index, int32_t disp) {
+			if (index < 0 && (base & 7) != RSP) {
+				put(static_cast<uint8_t>(0x80 | ((reg & 7) << 3) | (base & 7)));
+			}
+			else {
+				put(static_cast<uint8_t>(0x80 | ((reg & 7) << 3) | RSP));
+				put(static_cast<uint8_t>((((index < 0 ? RSP : index) & 7) << 3) | (base & 7)));
+			}
+			put32(static_cast<uint32_t>(disp));
+		}
+	};
+
+	// How a block handles an opcode
+	enum class Kind {
+		Unknown,      // No case in execute; the block ends before it
+		CallOut,      // The CPU's handler runs it: stack operations and the accumulator forms with quirks
+		CallOutLast,  // The same, then the block ends (PLP can unmask an interrupt)
+		CallOutJump,  // The same, and the handler decides where execution goes (JSR, RTS, RTI, BRK)
+		IndirectJump, // JMP ($nnnn) reads memory as it is, so it only runs first
+		Native,
+		Branch,
+		Jump
+	};
+
+	Kind KindOf(const std::string& name, CPU::Mode mode) {
+		if (name == "???") {
+			return Kind::Unknown;
+		}
+		if (name == "JSR" || name == "RTS" || name == "RTI" || name == "BRK") {
+			return Kind::CallOutJump;
+		}
+		if (name == "JMP") {
+			return mode == CPU::Mode::Indirect ? Kind::IndirectJump : Kind::Jump;
+		}
+		if (mode == CPU::Mode::Relative) {
+			return Kind::Branch;
+		}
+		if (name == "PLP") {
+			return Kind::CallOutLast;
+		}
+		if (name == "PHA" || name == "PHP" || name == "PLA" || name == "TXS" || name == "TSX" ||
+			(mode == CPU::Mode::Accumulator && name != "ASL")) {
+			return Kind::CallOut;
+		}
+		return Kind::Native;
+	}
+
+	// Most cycles an instruction can take
+	uint32_t MaxCycles(const CPU::DecodedOpcode& decoded) {
+		return decoded.cycles + (decoded.extra == CPU::Extra::Branch ? 2 : decoded.extra == CPU::Extra::None ? 0 : 1);
+	}
+
+	class BlockCompiler
+	{
+	public:
+		using CallOutFunction = void (*)(Jit::Frame*, const DecodedInstruction*);
+
+		BlockCompiler(uint16_t entry, CallOutFunction callOut) : m_entry(entry), m_callOut(callOut) {}
+
+		std::vector<uint8_t>& code() { return e.code; }
+
+		void prologue() {
+			for (int reg : { RBX, RBP, R12, R13, R14, R15 }) {
+				e.push(reg);
+			}
+			e.aluImm(SUB, RSP, 40, true); // Shadow space for Windows, and 16-byte alignment for both
+			e.mov64(FRAME, ARG0);
+			e.load64(MEMORY, FRAME, offMemory);
+			loadRegisters();
+			m_start = e.code.size();
+		}
+
+		void epilogue() {
+			for (size_t patch : m_exits) {
+				e.bind(patch);
+			}
+			storeRegisters();
+			e.aluImm(ADD, RSP, 40, true);
+			for (int reg : { R15, R14, R13, R12, RBP, RBX }) {
+				e.pop(reg);
+			}
+			e.ret();
+		}
+
+		// Emits one instruction. Returns false if it ends the block.
+		bool instruction(const DecodedInstruction& instruction, const std::string& name, const CPU::DecodedOpcode& decoded,
+			Kind kind, uint32_t maxStartCycles) {
+			m_maxStartCycles = maxStartCycles;
+			switch (kind) {
+			case Kind::CallOut:
+				callOut(instruction);
+				return true;
+			case Kind::CallOutLast:
+				callOut(instruction);
+				exitTo(static_cast<uint16_t>(instruction.pc + instruction.length), false);
+				return false;
+			case Kind::CallOutJump:
+				callOut(instruction);
+				m_exits.push_back(e.jump());
+				return false;
+			case Kind::IndirectJump:
+				registerAccess(instruction, false);
+				return false;
+			case Kind::Jump:
+				addCycles(decoded.cycles);
+				exitTo(instruction.operand, true);
+				return false;
+			case Kind::Branch:
+				branch(instruction, name);
+				return false;
+			default:
+				break;
+			}
+
+			if (decoded.mode == CPU::Mode::Implied || decoded.mode == CPU::Mode::Accumulator || decoded.mode == CPU::Mode::Immediate) {
+				if (decoded.mode == CPU::Mode::Immediate) {
+					e.movImm(RCX, instruction.operand & 0xFF);
+				}
+				operation(name, decoded.mode);
+				addCycles(decoded.cycles);
+				if (name == "CLI") {
+					exitTo(static_cast<uint16_t>(instruction.pc + 1), false); // A masked IRQ may be waiting
+					return false;
+				}
+				return true;
+			}
+
+			// Memory operand: RAM is worked on here, PRG space and registers go through the CPU
+			enum { Ram, Rom, Register, Unknown } where = Unknown;
+			address(instruction, decoded.mode);
+			if (decoded.mode == CPU::Mode::ZeroPage || decoded.mode == CPU::Mode::ZeroPageX || decoded.mode == CPU::Mode::ZeroPageY) {
+				where = Ram;
+			}
+			else if (decoded.mode == CPU::Mode::Absolute) {
+				where = instruction.operand < 0x2000 ? Ram : instruction.operand >= 0x8000 ? Rom : Register;
+			}
+			if (where == Rom) {
+				callOut(instruction);
+				return true;
+			}
+			if (where == Register) {
+				return registerAccess(instruction, true);
+			}
+			size_t toRam = 0, toRegister = 0, done = 0;
+			if (where == Unknown) {
+				e.aluImm(CMP, RDX, 0x2000);
+				toRam = e.jump(Below);
+				e.aluImm(CMP, RDX, 0x8000);
+				toRegister = e.jump(Below);
+				callOut(instruction);
+				done = e.jump();
+				e.bind(toRegister);
+				registerAccess(instruction, true);
+				e.bind(toRam);
+			}
+			if (name != "STA" && name != "STX" && name != "STY") {
+				e.loadByte(RCX, MEMORY, RDX, 0);
+			}
+			operation(name, decoded.mode);
+			addCycles(decoded.cycles);
+			if (decoded.extra == CPU::Extra::PageCrossX || decoded.extra == CPU::Extra::PageCrossY) {
+				// (addr & 0xFF00) != ((addr - index) & 0xFF00), as execute checks it after the operation
+				e.mov(RAX, RDX);
+				e.alu(SUB, RAX, decoded.extra == CPU::Extra::PageCrossX ? X : Y);
+				e.alu(XOR, RAX, RDX);
+				e.testImm(RAX, 0xFF00);
+				e.set(NotEqual, RAX);
+				e.aluMem(ADD, FRAME, offCycles, RAX);
+			}
+			if (where == Unknown) {
+				e.bind(done);
+			}
+			return true;
+		}
+
+		// Where a block that runs out of instructions goes
+		void finish(uint16_t next) { exitTo(next, false); }
+
+	private:
+		void loadRegisters() {
+			e.loadByte(A, FRAME, -1, offsetof(Jit::Frame, a));
+			e.loadByte(X, FRAME, -1, offsetof(Jit::Frame, x));
+			e.loadByte(Y, FRAME, -1, offsetof(Jit::Frame, y));
+			e.loadByte(P, FRAME, -1, offsetof(Jit::Frame, status));
+		}
+
+		void storeRegisters() {
+			e.storeByte(FRAME, -1, offsetof(Jit::Frame, a), A);
+			e.storeByte(FRAME, -1, offsetof(Jit::Frame, x), X);
+			e.storeByte(FRAME, -1, offsetof(Jit::Frame, y), Y);
+			e.storeByte(FRAME, -1, offsetof(Jit::Frame, status), P);
+		}
+
+		void addCycles(uint32_t cycles) { e.aluMemImm(ADD, FRAME, offCycles, static_cast<int32_t>(cycles)); }
+
+		// The CPU's handler runs the instruction on the registers as they are; it adds its cycles and sets the PC
+		void callOut(const DecodedInstruction& instruction) {
+			storeRegisters();
+			e.mov64(ARG0, FRAME);
+			e.movImm64(ARG1, reinterpret_cast<uint64_t>(&instruction));
+			e.movImm64(RAX, reinterpret_cast<uint64_t>(m_callOut));
+			e.call(RAX);
+			loadRegisters();
+		}
+
+		// Leaves the block for target, or loops straight back if target is its start and the budget allows
+		void exitTo(uint16_t target, bool mayLoop) {
+			if (mayLoop && target == m_entry) {
+				// The same check run() makes before entering: another pass only if all of it starts inside the budget
+				e.movImm(RAX, m_maxStartCycles);
+				e.aluFromMem(ADD, RAX, FRAME, offCycles);
+				e.aluFromMem(CMP, RAX, FRAME, offBudget);
+				e.jumpTo(Below, m_start);
+			}
+			e.storeWordImm(FRAME, offPc, target);
+			m_exits.push_back(e.jump());
+		}
+
+		// $2000-$7FFF: only the first instruction of a run may touch them, the PPU and APU are behind otherwise
+		bool registerAccess(const DecodedInstruction& instruction, bool stops) {
+			e.aluMemImm(CMP, FRAME, offCycles, 0);
+			size_t later = e.jump(NotEqual);
+			callOut(instruction);
+			if (stops) {
+				e.storeByteImm(FRAME, offStop, 1); // A write may have raised an IRQ
+			}
+			m_exits.push_back(e.jump());
+			e.bind(later);
+			e.storeWordImm(FRAME, offPc, instruction.pc);
+			e.storeByteImm(FRAME, offStop, 1);
+			m_exits.push_back(e.jump());
+			return false;
+		}
+
+		// EDX = effective address, with the pointer reads of the indirect modes done straight from zero page
+		void address(const DecodedInstruction& instruction, CPU::Mode mode) {
+			uint8_t zeroPage = instruction.operand & 0xFF;
+			switch (mode) {
+			case CPU::Mode::ZeroPage:
+				e.movImm(RDX, zeroPage);
+				break;
+			case CPU::Mode::Absolute:
+				e.movImm(RDX, instruction.operand);
+				break;
+			case CPU::Mode::ZeroPageX:
+			case CPU::Mode::ZeroPageY:
+				e.mov(RDX, mode == CPU::Mode::ZeroPageX ? X : Y);
+				e.aluImm(ADD, RDX, zeroPage);
+				e.aluImm(AND, RDX, 0xFF);
+				break;
+			case CPU::Mode::AbsoluteX:
+			case CPU::Mode::AbsoluteY:
+				e.mov(RDX, mode == CPU::Mode::AbsoluteX ? X : Y);
+				e.aluImm(ADD, RDX, instruction.operand);
+				e.aluImm(AND, RDX, 0xFFFF);
+				break;
+			case CPU::Mode::IndexedIndirectX:
+				e.mov(RAX, X);
+				e.aluImm(ADD, RAX, zeroPage);
+				e.aluImm(AND, RAX, 0xFF);
+				e.loadByte(RDX, MEMORY, RAX, 0);
+				e.aluImm(ADD, RAX, 1);
+				e.aluImm(AND, RAX, 0xFF);
+				e.loadByte(RAX, MEMORY, RAX, 0);
+				e.shift(SHL, RAX, 8);
+				e.alu(OR, RDX, RAX);
+				break;
+			case CPU::Mode::IndirectIndexedY:
+				e.loadByte(RDX, MEMORY, -1, zeroPage);
+				e.loadByte(RAX, MEMORY, -1, (zeroPage + 1) & 0xFF);
+				e.shift(SHL, RAX, 8);
+				e.alu(OR, RDX, RAX);
+				e.alu(ADD, RDX, Y);
+				e.aluImm(AND, RDX, 0xFFFF);
+				break;
+			default:
+				break;
+			}
+		}
+
+		// Z and N from a value register, through the frame's table
+		void setZN(int value, int scratch) {
+			e.aluImm(AND, P, 0xFF & ~(zero | negative));
+			e.loadByte(scratch, FRAME, value, offZn);
+			e.alu(OR, P, scratch);
+		}
+
+		// The operation itself: ECX holds the operand's value (read modes), EDX its address (memory modes)
+		void operation(const std::string& name, CPU::Mode mode) {
+			bool accumulator = mode == CPU::Mode::Accumulator;
+			if (name == "LDA" || name == "LDX" || name == "LDY") {
+				int reg = name == "LDA" ? A : name == "LDX" ? X : Y;
+				e.mov(reg, RCX);
+				setZN(reg, RAX);
+			}
+			else if (name == "STA" || name == "STX" || name == "STY") {
+				e.storeByte(MEMORY, RDX, 0, name == "STA" ? A : name == "STX" ? X : Y);
+			}
+			else if (name == "AND" || name == "ORA" || name == "EOR") {
+				e.alu(name == "AND" ? AND : name == "ORA" ? OR : XOR, A, RCX);
+				setZN(A, RAX);
+			}
+			else if (name == "CMP" || name == "CPX" || name == "CPY") {
+				e.aluImm(AND, P, 0xFF & ~(carry | zero | negative));
+				e.mov(RAX, name == "CMP" ? A : name == "CPX" ? X : Y);
+				e.alu(SUB, RAX, RCX);
+				e.set(AboveOrEqual, RCX); // No borrow: register >= value
+				e.alu(OR, P, RCX);
+				e.aluImm(AND, RAX, 0xFF);
+				setZN(RAX, RCX);
+			}
+			else if (name == "BIT") {
+				e.aluImm(AND, P, 0xFF & ~(zero | overflow | negative));
+				e.mov(RAX, RCX);
+				e.aluImm(AND, RAX, overflow | negative);
+				e.alu(OR, P, RAX);
+				e.test(RCX, A);
+				e.set(Equal, RAX);
+				e.shift(SHL, RAX, 1);
+				e.alu(OR, P, RAX);
+			}
+			else if (name == "ADC" || name == "SBC") {
+				if (name == "SBC") {
+					e.aluImm(XOR, RCX, 0xFF);
+				}
+				// sum = A + value + C, flagged as CPU::addWithCarry does it
+				e.mov(RAX, P);
+				e.aluImm(AND, RAX, carry);
+				e.alu(ADD, RAX, A);
+				e.alu(ADD, RAX, RCX);
+				e.aluImm(AND, P, 0xFF & ~(carry | overflow));
+				// V from bit 7 of (A ^ sum) & (value ^ sum), moved down to bit 6
+				e.alu(XOR, RCX, RAX);
+				e.alu(XOR, A, RAX);
+				e.alu(AND, RCX, A);
+				e.aluImm(AND, RCX, negative);
+				e.shift(SHR, RCX, 1);
+				e.alu(OR, P, RCX);
+				e.aluImm(CMP, RAX, 0xFF);
+				e.set(Above, RCX);
+				e.alu(OR, P, RCX);
+				e.mov(A, RAX);
+				e.aluImm(AND, A, 0xFF);
+				setZN(A, RAX);
+			}
+			else if (name == "ASL" || name == "LSR" || name == "ROL" || name == "ROR") {
+				int value = accumulator ? A : RCX;
+				if (name == "ROL" || name == "ROR") {
+					e.mov(RAX, P);
+					e.aluImm(AND, RAX, carry);
+					if (name == "ROR") {
+						e.shift(SHL, RAX, 8);
+					}
+				}
+				e.aluImm(AND, P, 0xFF & ~carry);
+				if (name == "ASL" || name == "ROL") {
+					e.shift(SHL, value, 1);
+					if (name == "ROL") {
+						e.alu(OR, value, RAX);
+					}
+					e.mov(RAX, value);
+					e.shift(SHR, RAX, 8); // Bit 7 shifted out
+					e.alu(OR, P, RAX);
+					e.aluImm(AND, value, 0xFF);
+				}
+				else {
+					if (name == "ROR") {
+						e.alu(OR, value, RAX);
+					}
+					e.mov(RAX, value);
+					e.aluImm(AND, RAX, carry); // Bit 0 shifted out
+					e.alu(OR, P, RAX);
+					e.shift(SHR, value, 1);
+				}
+				if (!accumulator) {
+					e.storeByte(MEMORY, RDX, 0, RCX);
+				}
+				setZN(value, RAX);
+			}
+			else if (name == "INC" || name == "DEC") {
+				e.aluImm(name == "INC" ? ADD : SUB, RCX, 1);
+				e.aluImm(AND, RCX, 0xFF);
+				e.storeByte(MEMORY, RDX, 0, RCX);
+				setZN(RCX, RAX);
+			}
+			else if (name == "INX" || name == "INY" || name == "DEX" || name == "DEY") {
+				int reg = name[2] == 'X' ? X : Y;
+				e.aluImm(name[0] == 'I' ? ADD : SUB, reg, 1);
+				e.aluImm(AND, reg, 0xFF);
+				setZN(reg, RAX);
+			}
+			else if (name == "TAX" || name == "TAY" || name == "TXA" || name == "TYA") {
+				int from = name[1] == 'A' ? A : name[1] == 'X' ? X : Y;
+				int to = name[2] == 'A' ? A : name[2] == 'X' ? X : Y;
+				e.mov(to, from);
+				setZN(to, RAX);
+			}
+			else if (name == "CLC" || name == "CLI" || name == "CLV" || name == "CLD") {
+				uint8_t flag = name == "CLC" ? carry : name == "CLI" ? interruptDisable : name == "CLV" ? overflow : decimal;
+				e.aluImm(AND, P, 0xFF & ~flag);
+			}
+			else if (name == "SEC" || name == "SEI" || name == "SED") {
+				e.aluImm(OR, P, name == "SEC" ? carry : name == "SEI" ? interruptDisable : decimal);
+			}
+			// NOP: nothing
+		}
+
+		// The branch, with both ways out resolved here: the offset is in ROM and the page-cross check
+		// (against the offset byte's address, as execute does it) only depends on where it goes
+		void branch(const DecodedInstruction& instruction, const std::string& name) {
+			uint8_t flag = name == "BPL" || name == "BMI" ? negative : name == "BVC" || name == "BVS" ? overflow :
+				name == "BCC" || name == "BCS" ? carry : zero;
+			bool takenWhenSet = name == "BMI" || name == "BVS" || name == "BCS" || name == "BEQ";
+			int8_t offset = static_cast<int8_t>(instruction.operand & 0xFF);
+			uint16_t next = static_cast<uint16_t>(instruction.pc + 2);
+			uint16_t target = static_cast<uint16_t>(next + offset);
+			uint16_t operandAddress = static_cast<uint16_t>(instruction.pc + 1);
+			uint32_t takenCycles = 3 + ((operandAddress & 0xFF00) != (target & 0xFF00) ? 1 : 0);
+
+			e.testImm(P, flag);
+			size_t taken = e.jump(takenWhenSet ? NotEqual : Equal);
+			addCycles(2);
+			exitTo(next, true);
+			e.bind(taken);
+			addCycles(takenCycles);
+			exitTo(target, true);
+		}
+
+		Emitter e;
+		uint16_t m_entry;
+		CallOutFunction m_callOut;
+		size_t m_start = 0;
+		uint32_t m_maxStartCycles = 0;
+		std::vector<size_t> m_exits; // Jumps to the epilogue
+	};
+}
+
+Jit::Jit() {
+	for (int value = 0; value < 256; ++value) {
+		m_frame.zn[value] = static_cast<uint8_t>((value == 0 ? zero : 0) | (value & negative));
+	}
+}
+
+Jit::~Jit() {
+	clear();
+}
+
+int Jit::run(CPU& cpu, Bus& bus, uint32_t budget) {
+	// Whatever execute would take before its fetch is left to it
+	bool interrupt = cpu.reset_signal || cpu.nmi_signal || (bus.nmi && !cpu.previous_nmi_state) ||
+		(cpu.irq_signal && !(cpu.status & interruptDisable));
+	if (!Available || interrupt || cpu.program_counter < 0x8000) {
+		return 0;
+	}
+	Frame& frame = m_frame;
+	frame.memory = bus.memory.data();
+	frame.cpu = &cpu;
+	frame.cycles = 0;
+	frame.budget = budget;
+	frame.stop = 0;
+	frame.pc = cpu.program_counter;
+	frame.a = cpu.accumulator;
+	frame.x = cpu.x;
+	frame.y = cpu.y;
+	frame.status = cpu.status;
+
+	while (frame.pc >= 0x8000) {
+		uint16_t index = frame.pc & 0x7FFF;
+		Block* block = m_entries[index];
+		if (!block) {
+			if (m_heat[index] < threshold) {
+				m_heat[index]++;
+				break;
+			}
+			block = compile(cpu, frame.pc);
+		}
+		// The cycle check at every block exit: no instruction in it may start at or past the budget
+		if (!block->code || frame.cycles + block->maxStartCycles >= budget) {
+			break;
+		}
+		block->code(&frame);
+		if (frame.stop || (cpu.irq_signal && !(frame.status & interruptDisable))) {
+			break;
+		}
+	}
+	if (frame.cycles == 0) {
+		return 0;
+	}
+	cpu.accumulator = frame.a;
+	cpu.x = frame.x;
+	cpu.y = frame.y;
+	cpu.status = frame.status;
+	cpu.program_counter = frame.pc;
+	cpu.previous_nmi_state = bus.nmi; // What each execute's setNMI leaves behind when there's no edge
+	cpu.copyOam();
+	m_cyclesRun += frame.cycles;
+	return static_cast<int>(frame.cycles);
+}
+
+void Jit::CallOut(Frame* frame, const DecodedInstruction* instruction) {
+	CPU& cpu = *frame->cpu;
+	cpu.accumulator = frame->a;
+	cpu.x = frame->x;
+	cpu.y = frame->y;
+	cpu.status = frame->status;
+	frame->cycles += instruction->handler(cpu, *instruction);
+	frame->a = cpu.accumulator;
+	frame->x = cpu.x;
+	frame->y = cpu.y;
+	frame->status = cpu.status;
+	frame->pc = cpu.program_counter;
+}
+
+Jit::Block* Jit::compile(const CPU& cpu, uint16_t pc) {
+	auto block = std::make_unique<Block>();
+	block->bank = BlockCache::BankOf(pc);
+	block->pc = pc;
+	int limit = std::clamp(blockInstructions, 1, maxBlockInstructions);
+	block->instructions.reserve(limit); // Call-outs point into it
+
+	BlockCompiler compiler(pc, &Jit::CallOut);
+	compiler.prologue();
+	uint32_t address = pc;
+	uint32_t elapsed = 0; // Most cycles the instructions so far can take
+	bool open = true;
+	while (open && static_cast<int>(block->instructions.size()) < limit) {
+		DecodedInstruction instruction;
+		instruction.pc = static_cast<uint16_t>(address);
+		instruction.opcode = cpu.peek(instruction.pc);
+		CPU::DecodedOpcode decoded = CPU::DecodedHandler(instruction.opcode);
+		instruction.handler = decoded.handler;
+		instruction.length = decoded.length;
+		std::string name = cpu.opcodeName(instruction.opcode);
+		Kind kind = KindOf(name, decoded.mode);
+		if (kind == Kind::Unknown || address + instruction.length > 0x10000 ||
+			BlockCache::BankOf(instruction.pc) != block->bank) {
+			break;
+		}
+		for (int i = 1; i < instruction.length; ++i) {
+			instruction.operand |= cpu.peek(static_cast<uint16_t>(address + i)) << (8 * (i - 1));
+		}
+		block->instructions.push_back(instruction);
+		block->maxStartCycles = elapsed;
+		open = compiler.instruction(block->instructions.back(), name, decoded, kind, elapsed);
+		elapsed += MaxCycles(decoded);
+		address += instruction.length;
+	}
+	if (open) {
+		compiler.finish(static_cast<uint16_t>(address));
+	}
+	compiler.epilogue();
+
+	if (!block->instructions.empty()) {
+		block->code = reinterpret_cast<void (*)(Frame*)>(install(compiler.code()));
+	}
+	m_entries[pc & 0x7FFF] = block.get();
+	m_blocks.push_back(std::move(block));
+	return m_blocks.back().get();
+}
+
+void* Jit::install(const std::vector<uint8_t>& code) {
+	constexpr size_t chunkSize = 256 * 1024;
+	if (m_executeRefused) {
+		return nullptr;
+	}
+	if (m_chunks.empty() || m_chunks.back().size - m_chunks.back().used < code.size()) {
+		Chunk chunk;
+		chunk.size = std::max(chunkSize, (code.size() + 0xFFFF) & ~size_t(0xFFFF));
+#ifdef _WIN32
+		chunk.memory = static_cast<uint8_t*>(VirtualAlloc(nullptr, chunk.size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+#else
+		void* memory = mmap(nullptr, chunk.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		chunk.memory = memory == MAP_FAILED ? nullptr : static_cast<uint8_t*>(memory);
+#endif
+		if (!chunk.memory) {
+			std::cerr << "JIT: couldn't allocate memory for code, interpreting instead" << std::endl;
+			return nullptr;
+		}
+		m_chunks.push_back(chunk);
+	}
+	// Writable only while the code goes in
+	Chunk& chunk = m_chunks.back();
+	uint8_t* target = chunk.memory + chunk.used;
+	// Hosts that forbid executable anonymous memory (SELinux execmem, PaX) fail the second call
+#ifdef _WIN32
+	DWORD old = 0;
+	bool written = VirtualProtect(chunk.memory, chunk.size, PAGE_READWRITE, &old);
+	if (written) {
+		std::memcpy(target, code.data(), code.size());
+	}
+	bool executable = written && VirtualProtect(chunk.memory, chunk.size, PAGE_EXECUTE_READ, &old);
+	if (executable) {
+		FlushInstructionCache(GetCurrentProcess(), target, code.size());
+	}
+#else
+	bool written = mprotect(chunk.memory, chunk.size, PROT_READ | PROT_WRITE) == 0;
+	if (written) {
+		std::memcpy(target, code.data(), code.size());
+	}
+	bool executable = written && mprotect(chunk.memory, chunk.size, PROT_READ | PROT_EXEC) == 0;
+#endif
+	if (!executable) {
+		std::cerr << "JIT: the host won't make generated code executable, interpreting instead" << std::endl;
+		m_executeRefused = true;
+		return nullptr;
+	}
+	chunk.used = (chunk.used + code.size() + 15) & ~size_t(15);
+	return target;
+}
+
+void Jit::invalidateBank(int bank) {
+	auto stale = std::stable_partition(m_blocks.begin(), m_blocks.end(),
+		[bank](const std::unique_ptr<Block>& block) { return block->bank != bank; });
+	for (auto it = stale; it != m_blocks.end(); ++it) {
+		m_entries[(*it)->pc & 0x7FFF] = nullptr;
+	}
+	m_blocks.erase(stale, m_blocks.end());
+}
+
+void Jit::clear() {
+	m_blocks.clear();
+	std::fill(m_entries.begin(), m_entries.end(), nullptr);
+	std::fill(m_heat.begin(), m_heat.end(), 0);
+	for (const Chunk& chunk : m_chunks) {
+#ifdef _WIN32
+		VirtualFree(chunk.memory, 0, MEM_RELEASE);
+#else
+		munmap(chunk.memory, chunk.size);
+#endif
+	}
+	m_chunks.clear();
+}
+
+size_t Jit::blockCount() const {
+	return m_blocks.size();
+}
+
+size_t Jit::codeSize() const {
+	size_t size = 0;
+	for (const Chunk& chunk : m_chunks) {
+		size += chunk.used;
+	}
+	return size;
+}
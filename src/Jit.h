@@ -0,0 +1,116 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "BlockCache.h"
+
+class Bus;
+class CPU;
+
+/**
+ * @brief Optional x86-64 recompiler for hot PRG ROM blocks, a tier on top of the interpreter.
+ *
+ * The run loop offers run() every instruction. Code at a PC it has seen fewer
+ * than threshold times is left to the interpreter; after that the block
+ * starting there (up to the next branch, jump, call or return) is translated
+ * into host code once and run from then on. Inside a block A, X, Y and P live
+ * in host registers and RAM is read and written directly. Stack operations,
+ * the opcodes with odd side effects and anything outside RAM call the CPU's
+ * own handler for that opcode, the one BlockCache uses, so every quirk of the
+ * interpreter is kept.
+ *
+ * The PPU, APU and scheduler are only stepped after run() returns, so blocks
+ * stay exact by never letting anything notice the difference:
+ *  - run() is given a budget, the CPU cycles until the next NMI, frame end or
+ *    scheduler event, and enters a block (or loops back to its start) only if
+ *    every instruction in it would start before the budget runs out. The
+ *    counter is checked at each block exit, so interrupts are taken on the
+ *    same instruction as when interpreting.
+ *  - PPU, APU and controller registers ($2000-$7FFF) are only touched by the
+ *    first instruction of a run, which calls CPU::read/write through its
+ *    handler with the PPU caught up; one met later ends the run before it.
+ *  - Nothing runs while an interrupt is pending, and CLI, PLP and RTI end the block.
+ *
+ * Off by default (Emulator::setJit) and only built for x86-64 hosts (Available).
+ * On a host that won't map executable memory every block is left to the interpreter.
+ * Instructions run by the JIT reach neither the guest profiler nor the bus
+ * stats; the Emulator leaves it off while a profiler is attached.
+ */
+class Jit
+{
+public:
+	// Whether this host can run generated code. When false run() always leaves the work to the interpreter.
+	static constexpr bool Available =
+#if defined(__x86_64__) || defined(_M_X64)
+		true;
+#else
+		false;
+#endif
+	static constexpr int maxBlockInstructions = 64;
+
+	// Interpreted runs of a block's first instruction before the block is compiled
+	int threshold = 16;
+	// Instructions per compiled block, at most maxBlockInstructions
+	int blockInstructions = maxBlockInstructions;
+
+	Jit();
+	~Jit();
+	Jit(const Jit&) = delete;
+	Jit& operator=(const Jit&) = delete;
+
+	// Runs compiled blocks from the CPU's PC, starting no instruction budget or more cycles in.
+	// Returns the cycles run, 0 if the interpreter has to take the next instruction.
+	int run(CPU& cpu, Bus& bus, uint32_t budget);
+
+	// Drops the blocks compiled from a PRG bank being switched out (see BlockCache::BankOf)
+	void invalidateBank(int bank);
+	// Drops everything, for a new cartridge
+	void clear();
+
+	size_t blockCount() const;
+	size_t codeSize() const; // Bytes of host code generated
+	uint64_t cyclesRun() const { return m_cyclesRun; }
+
+	// What generated code works on, kept in the Jit so it needs no allocation per run
+	struct Frame {
+		uint8_t* memory = nullptr;
+		CPU* cpu = nullptr;
+		uint32_t cycles = 0;
+		uint32_t budget = 0;
+		uint16_t pc = 0;
+		uint8_t a = 0, x = 0, y = 0, status = 0;
+		uint8_t stop = 0; // Set by a block that touched a register or left before one; run() returns
+		uint8_t zn[256] = {}; // Z and N for each value
+	};
+
+private:
+	struct Block {
+		int bank = 0;
+		uint16_t pc = 0;
+		void (*code)(Frame* frame) = nullptr; // nullptr if the first instruction can't be compiled
+		uint32_t maxStartCycles = 0; // Latest any instruction in it can start, relative to the block start
+		std::vector<DecodedInstruction> instructions; // What call-outs run, never resized once compiled
+	};
+	struct Chunk {
+		uint8_t* memory = nullptr;
+		size_t size = 0;
+		size_t used = 0;
+	};
+
+	Block* compile(const CPU& cpu, uint16_t pc);
+	void* install(const std::vector<uint8_t>& code);
+	static void CallOut(Frame* frame, const DecodedInstruction* instruction);
+
+	Frame m_frame;
+	std::vector<std::unique_ptr<Block>> m_blocks;
+	std::vector<Block*> m_entries = std::vector<Block*>(0x8000, nullptr); // By PC - $8000
+	std::vector<uint16_t> m_heat = std::vector<uint16_t>(0x8000, 0); // Interpreted runs by PC - $8000, up to threshold
+	std::vector<Chunk> m_chunks; // Executable memory, only given back by clear()
+	bool m_executeRefused = false; // The host wouldn't make a chunk executable, so install() gives up for good
+	uint64_t m_cyclesRun = 0;
+};
+
+#endif // JIT_H
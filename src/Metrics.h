@@ -0,0 +1,42 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @brief Host-side cost of running the emulator, for frontends and benchmarks.
+ *
+ * Filled in by Emulator as it runs. Times are wall clock microseconds on the
+ * host, never part of the emulated machine, so they are not saved in
+ * savestates and don't affect determinism.
+ */
+struct Metrics {
+	uint64_t frames = 0;          // Calls to runFrame
+	uint64_t emulatedFrames = 0;  // Frames actually emulated, run-ahead included
+	uint64_t renderedFrames = 0;  // Emulated frames that produced a picture
+
+	double frameMicros = 0.0;         // Last runFrame, run-ahead included
+	double averageFrameMicros = 0.0;  // Moving average over roughly the last second
+	double runAheadMicros = 0.0;      // Part of the last frame spent saving, running ahead and restoring
+	double saveStateMicros = 0.0;     // Last run-ahead savestate
+	double loadStateMicros = 0.0;     // Last run-ahead restore
+	uint32_t frameCycles = 0;         // CPU cycles in the last emulated frame
+	uint32_t idleCycles = 0;          // Of those, cycles spent in wait loops the CPU didn't have to execute
+};
+
+/**
+ * @brief Health of the audio stream between emulation and the sound device.
+ *
+ * The audio callback runs on SDL's thread, so everything here is atomic and
+ * only ever bumped with relaxed increments; readers get a close enough snapshot.
+ */
+struct AudioMetrics {
+	std::atomic<uint64_t> callbacks{ 0 };
+	std::atomic<uint64_t> underruns{ 0 };        // Callbacks that ran out of samples and padded the rest
+	std::atomic<uint64_t> underrunSamples{ 0 };  // Samples of padding those callbacks played
+	std::atomic<uint64_t> overruns{ 0 };         // Pushes that found the ring full
+	std::atomic<uint64_t> overrunSamples{ 0 };   // Samples those pushes had to drop
+};
+
+#endif // METRICS_H
@@ -0,0 +1,233 @@
+#include "Movie.h"
+#include "Emulator.h"
+#include "RewindBuffer.h"
+#include "SaveState.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace {
+	constexpr uint32_t movieMagic = 0x4D53454E; // "NESM"
+	constexpr uint16_t movieVersion = 1;
+
+	void applyInput(Emulator& emulator, const MovieInput& input) {
+		if (input.commands & MovieInput::Power) {
+			emulator.power();
+		}
+		if (input.commands & MovieInput::Reset) {
+			emulator.reset();
+		}
+		emulator.setInput(0, input.pads[0]);
+		emulator.setInput(1, input.pads[1]);
+	}
+}
+
+void Movie::start(const Emulator& emulator, uint32_t keyframeInterval) {
+	m_romHash = emulator.romHash();
+	m_keyframeInterval = std::max<uint32_t>(keyframeInterval, 1);
+	m_inputs.clear();
+	m_keyframes.clear();
+	addKeyframe(emulator);
+}
+
+void Movie::record(Emulator& emulator, const MovieInput& input) {
+	if (empty()) {
+		start(emulator);
+	}
+	if (m_inputs.size() >= m_keyframes.back().frame + m_keyframeInterval) {
+		addKeyframe(emulator);
+	}
+	m_inputs.push_back(input);
+	applyInput(emulator, input);
+}
+
+void Movie::truncate(uint64_t frame) {
+	if (frame >= m_inputs.size()) {
+		return;
+	}
+	m_inputs.resize(frame);
+	// A keyframe at frame itself is the state before that frame ran, which is still right
+	while (m_keyframes.size() > 1 && m_keyframes.back().frame > frame) {
+		m_keyframes.pop_back();
+	}
+}
+
+bool Movie::apply(Emulator& emulator, uint64_t frame) const {
+	if (frame >= m_inputs.size()) {
+		return false;
+	}
+	applyInput(emulator, m_inputs[frame]);
+	return true;
+}
+
+bool Movie::seek(Emulator& emulator, uint64_t frame) const {
+	if (empty()) {
+		std::cerr << "Movie is empty" << std::endl;
+		return false;
+	}
+	if (m_romHash != emulator.romHash()) {
+		std::cerr << "Movie was recorded with a different ROM" << std::endl;
+		return false;
+	}
+	if (frame > m_inputs.size()) {
+		std::cerr << "Movie has no frame " << frame << ", it is " << m_inputs.size() << " frames long" << std::endl;
+		return false;
+	}
+
+	auto keyframe = std::upper_bound(m_keyframes.begin(), m_keyframes.end(), frame,
+		[](uint64_t target, const Keyframe& key) { return target < key.frame; }) - 1;
+	std::vector<uint8_t> state(keyframe->stateSize, 0);
+	if (!RewindBuffer::Apply(keyframe->encoded, state) || !emulator.loadState(state)) {
+		std::cerr << "Movie keyframe at frame " << keyframe->frame << " is damaged" << std::endl;
+		return false;
+	}
+
+	// Run-ahead would only add work here, the frames in between are never shown
+	int runAhead = emulator.runAhead();
+	emulator.setRunAhead(0);
+	for (uint64_t i = keyframe->frame; i < frame; ++i) {
+		applyInput(emulator, m_inputs[i]);
+		emulator.runFrame(i + 1 == frame); // Only the last one is drawn
+	}
+	emulator.setRunAhead(runAhead);
+	return true;
+}
+
+void Movie::addKeyframe(const Emulator& emulator) {
+	emulator.saveState(m_scratch);
+	Keyframe keyframe;
+	keyframe.frame = m_inputs.size();
+	keyframe.stateSize = static_cast<uint32_t>(m_scratch.size());
+	RewindBuffer::Encode(m_scratch.data(), nullptr, m_scratch.size(), keyframe.encoded);
+	m_keyframes.push_back(std::move(keyframe));
+}
+
+std::vector<uint8_t> Movie::serialize() const {
+	std::vector<uint8_t> data;
+	StateWriter out(data);
+	out.write32(movieMagic);
+	out.write16(movieVersion);
+	out.write16(0);
+	out.write64(m_romHash);
+	out.write32(static_cast<uint32_t>(m_inputs.size()));
+	out.write32(m_keyframeInterval);
+
+	// Most frames repeat the one before, so the input goes in as runs
+	size_t streamSize = data.size();
+	out.write32(0);
+	for (size_t i = 0; i < m_inputs.size();) {
+		size_t run = 1;
+		while (i + run < m_inputs.size() && m_inputs[i + run] == m_inputs[i]) {
+			run++;
+		}
+		out.writeVarint(run);
+		out.write8(m_inputs[i].pads[0]);
+		out.write8(m_inputs[i].pads[1]);
+		out.write8(m_inputs[i].commands);
+		i += run;
+	}
+	uint32_t streamBytes = static_cast<uint32_t>(data.size() - streamSize - 4);
+	for (int i = 0; i < 4; ++i) {
+		data[streamSize + i] = (streamBytes >> (i * 8)) & 0xFF;
+	}
+
+	out.write32(static_cast<uint32_t>(m_keyframes.size()));
+	for (const Keyframe& keyframe : m_keyframes) {
+		out.write32(static_cast<uint32_t>(keyframe.frame));
+		out.write32(keyframe.stateSize);
+		out.write32(static_cast<uint32_t>(keyframe.encoded.size()));
+		out.writeBytes(keyframe.encoded.data(), keyframe.encoded.size());
+	}
+	return data;
+}
+
+bool Movie::deserialize(const std::vector<uint8_t>& data) {
+	StateReader in(data.data(), data.size());
+	if (in.read32() != movieMagic) {
+		std::cerr << "Not a movie file" << std::endl;
+		return false;
+	}
+	uint16_t version = in.read16();
+	in.read16();
+	if (version > movieVersion) {
+		std::cerr << "Movie version " << version << " is newer than this build supports" << std::endl;
+		return false;
+	}
+	uint64_t romHash = in.read64();
+	uint32_t frameCount = in.read32();
+	uint32_t keyframeInterval = std::max<uint32_t>(in.read32(), 1);
+
+	// Decode into locals so a damaged file leaves the movie as it was
+	std::vector<MovieInput> inputs;
+	uint32_t streamBytes = in.read32();
+	const uint8_t* streamData = in.view(streamBytes);
+	StateReader stream(streamData, streamData ? streamBytes : 0);
+	while (stream.ok() && stream.remaining() > 0 && inputs.size() <= frameCount) {
+		uint64_t run = stream.readVarint();
+		MovieInput input;
+		input.pads[0] = stream.read8();
+		input.pads[1] = stream.read8();
+		input.commands = stream.read8();
+		if (run > frameCount - inputs.size()) {
+			break;
+		}
+		inputs.insert(inputs.end(), run, input);
+	}
+	bool inputsOk = stream.ok() && stream.remaining() == 0 && inputs.size() == frameCount;
+
+	uint32_t keyframeCount = in.read32();
+	if (keyframeCount > in.remaining() / 12) {
+		keyframeCount = 0; // More than could fit in what's left
+	}
+	std::vector<Keyframe> keyframes(keyframeCount);
+	for (Keyframe& keyframe : keyframes) {
+		keyframe.frame = in.read32();
+		keyframe.stateSize = in.read32();
+		uint32_t encodedSize = in.read32();
+		const uint8_t* encoded = in.view(encodedSize);
+		if (!encoded) {
+			break;
+		}
+		keyframe.encoded.assign(encoded, encoded + encodedSize);
+	}
+	bool keyframesOk = !keyframes.empty() && keyframes.front().frame == 0;
+	for (size_t i = 1; i < keyframes.size() && keyframesOk; ++i) {
+		keyframesOk = keyframes[i].frame > keyframes[i - 1].frame && keyframes[i].frame <= frameCount;
+	}
+	if (!in.ok() || !inputsOk || !keyframesOk) {
+		std::cerr << "Movie file is damaged" << std::endl;
+		return false;
+	}
+
+	m_romHash = romHash;
+	m_keyframeInterval = keyframeInterval;
+	m_inputs = std::move(inputs);
+	m_keyframes = std::move(keyframes);
+	return true;
+}
+
+bool Movie::save(const std::string& path) const {
+	std::vector<uint8_t> data = serialize();
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write(reinterpret_cast<const char*>(data.data()), data.size());
+	if (!file) {
+		std::cerr << "Failed to write movie: " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool Movie::load(const std::string& path) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		std::cerr << "Failed to open movie: " << path << std::endl;
+		return false;
+	}
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	return deserialize(data);
+}
+
+bool Movie::IsMovie(const std::vector<uint8_t>& data) {
+	StateReader in(data.data(), data.size());
+	return in.read32() == movieMagic && in.ok();
+}
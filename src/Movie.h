@@ -0,0 +1,129 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Emulator;
+
+// One frame of movie input, applied just before the frame runs
+struct MovieInput {
+	enum Command : uint8_t {
+		None = 0,
+		Reset = 1 << 0, // Reset button
+		Power = 1 << 1, // Power cycle, the cartridge stays in
+	};
+
+	uint8_t pads[2] = { 0, 0 };
+	uint8_t commands = None;
+
+	bool operator==(const MovieInput& other) const {
+		return pads[0] == other.pads[0] && pads[1] == other.pads[1] && commands == other.commands;
+	}
+	bool operator!=(const MovieInput& other) const { return !(*this == other); }
+};
+
+/**
+ * @brief Recorded controller input that replays a session frame for frame.
+ *
+ * A movie starts from a savestate of wherever the machine was when recording
+ * began (usually power-on), followed by the input of every frame. The
+ * emulator is deterministic, so applying the same input from the same state
+ * gives the same frames, sound and savestates every time.
+ *
+ * Every keyframeInterval frames another savestate is embedded, so seek() can
+ * reach any frame by loading the keyframe before it and running at most
+ * keyframeInterval frames without drawing. Keyframes are zero-run encoded
+ * the same way as RewindBuffer keyframes, a few KB each.
+ *
+ * File layout (version 1), all values little-endian:
+ *
+ *     u32  magic "NESM"
+ *     u16  format version
+ *     u16  reserved, 0
+ *     u64  XXH64 of the PRG ROM, as in savestates
+ *     u32  frame count
+ *     u32  keyframe interval in frames
+ *     u32  input stream size in bytes, then the stream: runs of identical
+ *          frames, each a varint repeat count followed by pad 1, pad 2 and
+ *          the command byte
+ *     u32  keyframe count, then for each keyframe:
+ *          u32 frame, u32 savestate size, u32 encoded size, encoded savestate
+ */
+class Movie
+{
+public:
+	static constexpr uint32_t defaultKeyframeInterval = 60 * 10; // Ten seconds
+
+	/**
+	 * @brief Starts a new recording from the emulator's current state.
+	 *
+	 * Whatever was recorded before is thrown away.
+	 */
+	void start(const Emulator& emulator, uint32_t keyframeInterval = defaultKeyframeInterval);
+
+	/**
+	 * @brief Appends the input for the next frame and applies it to the emulator.
+	 *
+	 * Call it instead of setting input directly, right before runFrame. The
+	 * emulator has to be at frame frameCount() of the movie, which it is as
+	 * long as every frame since start() went through here.
+	 */
+	void record(Emulator& emulator, const MovieInput& input);
+
+	// Drops every frame from frame on, to record again from an earlier point
+	void truncate(uint64_t frame);
+
+	/**
+	 * @brief Applies a recorded frame's input to the emulator, right before runFrame.
+	 *
+	 * @return false once frame is past the end of the movie
+	 */
+	bool apply(Emulator& emulator, uint64_t frame) const;
+
+	/**
+	 * @brief Puts the emulator at the start of a frame: from the nearest keyframe
+	 *        before it, replays the frames in between without drawing.
+	 *
+	 * Seeking to frameCount() is allowed and leaves the machine where the
+	 * recording stopped.
+	 *
+	 * @return false (with a message on stderr) if the movie is for another ROM,
+	 *         frame is past the end or a keyframe won't load
+	 */
+	bool seek(Emulator& emulator, uint64_t frame) const;
+
+	const MovieInput& input(uint64_t frame) const { return m_inputs[frame]; }
+	uint64_t frameCount() const { return m_inputs.size(); }
+	uint64_t romHash() const { return m_romHash; }
+	uint32_t keyframeInterval() const { return m_keyframeInterval; }
+	size_t keyframeCount() const { return m_keyframes.size(); }
+	bool empty() const { return m_keyframes.empty(); } // Nothing recorded or loaded yet
+
+	std::vector<uint8_t> serialize() const;
+	bool deserialize(const std::vector<uint8_t>& data);
+
+	// Wrap serialize/deserialize with a file, false (with a message on stderr) on failure
+	bool save(const std::string& path) const;
+	bool load(const std::string& path);
+
+	static bool IsMovie(const std::vector<uint8_t>& data);
+
+private:
+	struct Keyframe {
+		uint64_t frame = 0;
+		uint32_t stateSize = 0;
+		std::vector<uint8_t> encoded; // RewindBuffer::Encode against nothing
+	};
+
+	void addKeyframe(const Emulator& emulator);
+
+	uint64_t m_romHash = 0;
+	uint32_t m_keyframeInterval = defaultKeyframeInterval;
+	std::vector<MovieInput> m_inputs;
+	std::vector<Keyframe> m_keyframes; // In frame order, the first is at frame 0
+	std::vector<uint8_t> m_scratch;    // Savestate buffer reused between keyframes
+};
+
+#endif // MOVIE_H
@@ -3,14 +3,15 @@
     Last Updated: 3/23/2025
 */
 #include "PPU.h"
+#include "Trace.h"
 #include <iostream>
 #include <fstream>
 #include <string> 
 #include <array>
 //#include <SDL2/SDL.h>
 #include <iomanip>
-
-static uint32_t framebuffer[PPU_WIDTH * PPU_HEIGHT];
+#include <algorithm>
+#include <cstring>
 
 PPU::PPU(std::shared_ptr<Bus> bus, std::shared_ptr<Cartridge> cart, std::shared_ptr<OAM> oam) : dot(0),
     m_cart(cart), m_bus(bus), m_oam(oam) {
@@ -32,8 +33,8 @@ PPU::PPU(){
     patternTables.resize(2, std::vector<uint8_t>(256 * 8 * 8, 0));
 }
 
-const uint32_t* PPU::getFrameBuffer() {
-    return framebuffer;
+const uint32_t* PPU::getFrameBuffer() const {
+    return framebuffer.data();
 }
 
 void PPU::writeToFrameBuffer(int scanline, const std::vector<RGB>& colors) {
@@ -51,40 +52,170 @@ void PPU::writeToFrameBuffer(int scanline, const std::vector<RGB>& colors) {
         int index = (scanline * PPU_WIDTH) + x;
         framebuffer[index] = (colors[x].r << 16) | (colors[x].g << 8) | colors[x].b; // Pack RGB into a 32-bit value
     }
-}
 
-void PPU::loadPatternTable(const std::vector<uint8_t>& chrROM) {
-    if (chrROM.size() < 8192) { // Ensure pattern table is correct size
-        throw std::runtime_error("CHR-ROM not correct size");
+    // Hash the line while it is still in cache
+    if (scanline == 0) {
+        m_lineHash.reset();
+        m_hashedLines = 0;
     }
+    if (scanline == m_hashedLines) {
+        m_lineHash.update(&framebuffer[scanline * PPU_WIDTH], PPU_WIDTH * sizeof(uint32_t));
+        m_hashedLines++;
+    }
+    else {
+        m_hashedLines = -1;
+    }
+    m_frameHashValid = m_hashedLines == PPU_HEIGHT;
+    if (m_frameHashValid) {
+        m_frameHash = m_lineHash.digest();
+    }
+}
 
-    for (int table = 0; table < 2; table++) { //Loop for each pattern table Left and Right
-        
-        for (int tile = 0; tile < 256; tile++) { //Iterate over each tile
-            int tileOffset = (table * 4096) + (tile * 16);
-            
-            for (int row = 0; row < 8; row++) { //Tiles are segmented into lowbit and highbit planes
-                uint8_t lowPlane = chrROM[tileOffset + row];
-                uint8_t highPlane = chrROM[tileOffset + row + 8];
+uint64_t PPU::frameHash() const {
+    if (!m_frameHashValid) {
+        m_frameHash = Hash::XXH64(framebuffer.data(), framebuffer.size() * sizeof(uint32_t));
+        m_frameHashValid = true;
+    }
+    return m_frameHash;
+}
 
-                for (int col = 0; col < 8; col++) {
-                    uint8_t bit1 = (lowPlane >> (7 - col)) & 1; //LSB
-                    uint8_t bit2 = (highPlane >> (7 - col)) & 1; //MSB
+void PPU::saveState(StateWriter& out) const {
+    out.write8(PPUCTRL);
+    out.write8(PPUMASK);
+    out.write8(PPUSTATUS);
+    out.write8(OAMADDR);
+    out.write8(OAMDATA);
+    out.write8(PPUSCROLL);
+    out.write16(PPUADDR);
+    out.write8(PPUDATA);
+    out.write8(OAMDMA);
+    out.write32(dot);
+    out.write16(scanline);
+    out.writeBool(toggle);
+    out.writeBool(toggle2);
+    out.writeBool(scroll_latch);
+    out.write8(scroll_x);
+    out.write8(scroll_y);
+    out.writeBool(addr_latch);
+    out.write8(addr_high);
+    out.write8(addr_low);
+    out.write16(vram_address);
+    out.write8(fetched_nametable_byte);
+    out.write8(fetched_attribute_byte);
+    out.write8(fetched_pattern_low);
+    out.write8(fetched_pattern_high);
+    for (const ShiftRegister* shift : { &tile_low_shift, &tile_high_shift, &attr_low_shift, &attr_high_shift }) {
+        out.writeBytes(shift->reg.data(), shift->reg.size());
+        out.write8(shift->index);
+    }
+    out.writeBytes(sprite_data, sizeof(sprite_data));
+    out.writeBytes(sprite_pattern_low, sizeof(sprite_pattern_low));
+    out.writeBytes(sprite_pattern_high, sizeof(sprite_pattern_high));
+    out.writeVector(paletteMemory);
+    for (const NameTable& table : nameTables) {
+        out.writeVector(table.tiles);
+        out.writeVector(table.attributes);
+    }
+    // Pattern memory. The decoded patternTables are rebuilt from it on load.
+    out.writeVector(chrRam);
+    // The scanline being drawn when the state was taken
+    out.write16(static_cast<uint16_t>(scanlineBuffer.size()));
+    out.writeBytes(scanlineBuffer.data(), scanlineBuffer.size() * sizeof(RGB));
+}
 
-                    /*Store and format MSB and LSB accordingly
-                         //pixelVal = 0b00 ->Transparent 
-                         //         = 0b01 -> Color 1
-                         //         = 0b10 -> Color 2
-                                    = 0b11 -> Color 3 */
-                    uint8_t pixelVal = (bit2 << 1) | bit1;
+bool PPU::loadState(StateReader& in) {
+    PPUCTRL = in.read8();
+    PPUMASK = in.read8();
+    PPUSTATUS = in.read8();
+    OAMADDR = in.read8();
+    OAMDATA = in.read8();
+    PPUSCROLL = in.read8();
+    PPUADDR = in.read16();
+    PPUDATA = in.read8();
+    OAMDMA = in.read8();
+    dot = in.read32();
+    scanline = in.read16();
+    toggle = in.readBool();
+    toggle2 = in.readBool();
+    scroll_latch = in.readBool();
+    scroll_x = in.read8();
+    scroll_y = in.read8();
+    addr_latch = in.readBool();
+    addr_high = in.read8();
+    addr_low = in.read8();
+    vram_address = in.read16();
+    fetched_nametable_byte = in.read8();
+    fetched_attribute_byte = in.read8();
+    fetched_pattern_low = in.read8();
+    fetched_pattern_high = in.read8();
+    for (ShiftRegister* shift : { &tile_low_shift, &tile_high_shift, &attr_low_shift, &attr_high_shift }) {
+        in.readBytes(shift->reg.data(), shift->reg.size());
+        shift->index = in.read8();
+    }
+    in.readBytes(sprite_data, sizeof(sprite_data));
+    in.readBytes(sprite_pattern_low, sizeof(sprite_pattern_low));
+    in.readBytes(sprite_pattern_high, sizeof(sprite_pattern_high));
+    in.readVector(paletteMemory);
+    for (NameTable& table : nameTables) {
+        in.readVector(table.tiles);
+        in.readVector(table.attributes);
+    }
+
+    // Only touch pattern memory when it actually differs. With CHR-ROM it never
+    // does, so loading a state usually costs no pattern table decoding at all.
+    if (in.read32() != chrRam.size()) {
+        return false;
+    }
+    const uint8_t* pattern = in.view(chrRam.size());
+    if (pattern && std::memcmp(pattern, chrRam.data(), chrRam.size()) != 0) {
+        std::memcpy(chrRam.data(), pattern, chrRam.size());
+        patternTablesDirty = true;
+    }
+
+    scanlineBuffer.resize(in.read16());
+    in.readBytes(scanlineBuffer.data(), scanlineBuffer.size() * sizeof(RGB));
+    return in.ok();
+}
 
-                    patternTables[table][(tile * 64) + (row * 8) + col] = pixelVal;
-                }
+// Decodes chrRam into the pattern tables and the tile plane staging arrays.
+void PPU::rebuildPatternTables() {
+    for (int table = 0; table < 2; table++) {
+        for (int tile = 0; tile < 256; tile++) {
+            int tileOffset = (table * 4096) + (tile * 16);
+            for (int row = 0; row < 8; row++) {
+                tilePlaneLow[table][tile][row] = chrRam[tileOffset + row];
+                tilePlaneHigh[table][tile][row] = chrRam[tileOffset + row + 8];
+                decodePatternRow(table, tile, row);
             }
+        }
+    }
+    patternTablesDirty = false;
+}
 
-       }
+// Combines the staged low and high planes of one tile row into 2-bit pixels
+void PPU::decodePatternRow(int table, int tile, int row) {
+    uint8_t low = tilePlaneLow[table][tile][row];
+    uint8_t high = tilePlaneHigh[table][tile][row];
+    for (int col = 0; col < 8; ++col) {
+        uint8_t bit1 = (low >> (7 - col)) & 1;
+        uint8_t bit2 = (high >> (7 - col)) & 1;
+        /*Store and format MSB and LSB accordingly
+             //pixelVal = 0b00 ->Transparent 
+             //         = 0b01 -> Color 1
+             //         = 0b10 -> Color 2
+                        = 0b11 -> Color 3 */
+        patternTables[table][tile * 64 + row * 8 + col] = (bit2 << 1) | bit1;
     }
+}
 
+void PPU::loadPatternTable(const std::vector<uint8_t>& chrROM) {
+    if (chrROM.size() < 8192) { // Ensure pattern table is correct size
+        throw std::runtime_error("CHR-ROM not correct size");
+    }
+
+    // Pattern memory holds the first 8KB of CHR, the decoded tables are derived from it
+    std::copy(chrROM.begin(), chrROM.begin() + chrRam.size(), chrRam.begin());
+    rebuildPatternTables();
 }
 
 void PPU::writePatternTable(uint16_t address, uint8_t data) {
@@ -114,19 +245,9 @@ void PPU::writePatternTable(uint16_t address, uint8_t data) {
     else {
         tilePlaneHigh[tableIndex][tileIndex][row] = data;
     }
-    
-    if (!isLowplane) {
-        uint8_t low = tilePlaneLow[tableIndex][tileIndex][row]; //Pull staged tile data
-        uint8_t high = tilePlaneHigh[tableIndex][tileIndex][row];
-
-        for (int col = 0; col < 8; ++col) {
-            uint8_t bit1 = (low >> (7 - col)) & 1;
-            uint8_t bit2 = (high >> (7 - col)) & 1;
-            uint8_t pixelVal = (bit2 << 1) | bit1;
-            patternTables[tableIndex][tileIndex * 64 + row * 8 + col] = pixelVal;
-        }
 
-    }
+    // Redecode on either plane so the decoded row always matches chrRam
+    decodePatternRow(tableIndex, tileIndex, row);
 }
 
 std::array<uint8_t, 64> PPU::getPatternTile(int tableIndex, int tileIndex) const {
@@ -276,6 +397,9 @@ void PPU::writePaletteMemory(uint16_t address, uint8_t data) {
  * Cycle wraps around at the end.
  */
 void PPU::step() {
+    if (patternTablesDirty) {
+        rebuildPatternTables(); // Pattern memory was replaced by a savestate
+    }
     // Visible scanlines: 0-239. Checking this in the other function
     // VBlank: scanline 241-260 CPU do thing
     // Pre-render: scanline 261
@@ -365,6 +489,7 @@ void PPU::stepScanline()
                 scroll_x = (scroll_x + 1) % 256;
             }
             // if(RenderingEnabled())
+            if (!skipRendering)
                 scanlineBuffer.push_back(RenderScanline()); // This is really just generating the scanline that gets pumped into the following function. Shift registers get updated here?
             }
             else{
@@ -529,14 +654,23 @@ void PPU::stepScanline()
         // }
         // Should be done. Let er rip
         if(scanline < 240){
-            writeToFrameBuffer(scanline, scanlineBuffer); // Gwyn's output to SDL drawing
-            scanlineBuffer = std::vector<RGB>();
+            if (!skipRendering) {
+                writeToFrameBuffer(scanline, scanlineBuffer); // Gwyn's output to SDL drawing
+                if (m_scanlineStart != Trace::Clock::time_point() && Trace::Enabled()) {
+                    Trace::Complete("scanline render", m_scanlineStart, Trace::Now());
+                }
+            }
+            scanlineBuffer.clear(); // Keeps its capacity for the next line
         }
         
     }
     if (dot > 340) {
         dot = 0;
         scanline++;
+        m_scanlineStart = Trace::Enabled() ? Trace::Now() : Trace::Clock::time_point();
+        if (scanline == PPU_HEIGHT) {
+            frameComplete = true; // Last visible line is in the framebuffer
+        }
         if (scanline > 261) {
             scanline = 0;
         }
@@ -16,7 +16,10 @@
 #include "OAM.h"
 #include <memory>
 #include <array>
+#include <chrono>
 #include "Bus.h"
+#include "Hash.h"
+#include "SaveState.h"
 
 #define PPU_WIDTH 256
 #define PPU_HEIGHT 240
@@ -27,7 +30,7 @@ struct RGB {
 
 
 struct ShiftRegister{
-	std::array<uint8_t, 16> reg;
+	std::array<uint8_t, 16> reg = {};
 	int index = 0;
 	void Insert(uint8_t val){
 		for (int i = 0; i < 8; ++i) {
@@ -76,6 +79,7 @@ public:
 
 	std::vector<uint8_t> chrRam = std::vector<uint8_t>(0x2000, 0);
 	std::vector<RGB> scanlineBuffer;
+	std::array<uint32_t, PPU_WIDTH * PPU_HEIGHT> framebuffer = {}; // Packed 0x00RRGGBB pixels, one per dot
 
 	// For PPUSCROLL
 	bool scroll_latch = false; // *
@@ -111,11 +115,19 @@ public:
 	void loadPatternTable(const std::vector<uint8_t>& chrROM);
 	void step();
 	void SetOam(std::shared_ptr<OAM> oam) { m_oam = oam; }
-	const uint32_t* getFrameBuffer();
+	const uint32_t* getFrameBuffer() const;
 	void writeToFrameBuffer(int scanline, const std::vector<RGB>& colors);
+	// Hash::XXH64 of the whole framebuffer. Fed line by line from writeToFrameBuffer as a frame is
+	// drawn, so it is ready when the frame is; hashed in one go only if the lines came out of order
+	// (a savestate loaded mid-frame, say). Writes straight to framebuffer aren't noticed.
+	uint64_t frameHash() const;
   
 	std::array<uint8_t, 64> getPatternTile(int tableIndex, int tileIndex) const;
 
+	// Savestates - registers, latches, VRAM, palette and pattern memory
+	void saveState(StateWriter& out) const;
+	bool loadState(StateReader& in);
+
 	// Local + Test Functions
 	void printPatternTables();
 	void SetCartridge(std::shared_ptr<Cartridge> cart) { m_cart = cart; } 
@@ -145,13 +157,28 @@ public:
 
 	//Pattern Table Functions
 	void writePatternTable(uint16_t address, uint8_t data);
+	void rebuildPatternTables();
+	void decodePatternRow(int table, int tile, int row);
+	bool patternTablesDirty = false; // patternTables are stale after a savestate replaced chrRam, rebuilt on the next step
+
+	// Frame-skip: timing, registers and NMI behave exactly as normal but no pixels are produced
+	bool skipRendering = false;
+	// Set once the last visible scanline is done, cleared by whoever is waiting for the frame
+	bool frameComplete = false;
+	// When the current scanline started, for the "scanline render" trace event (zero while tracing is off)
+	std::chrono::steady_clock::time_point m_scanlineStart{};
+	// Lines 0 to m_hashedLines - 1 went through m_lineHash in order, -1 once one was out of order
+	Hash::XXH64Stream m_lineHash;
+	int m_hashedLines = -1;
+	mutable uint64_t m_frameHash = 0;
+	mutable bool m_frameHashValid = false;
 
 
 	uint8_t GetFineX() {return PPUSCROLL & 0x70;}
 
 
 	// Secondary OAM buffer for sprite evaluation
-	Sprite sprite_data[8];
+	Sprite sprite_data[8] = {};
 
 	// Pattern data for sprites on the current scanline
 	uint8_t sprite_pattern_low[8] = { 0 };
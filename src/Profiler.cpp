@@ -0,0 +1,140 @@
+#include "Profiler.h"
+#include "CPU.h"
+#include <algorithm>
+#include <cstdio>
+
+Profiler::Profiler() : m_cycles(0x10000, 0) {
+	clear();
+}
+
+void Profiler::clear() {
+	std::fill(m_cycles.begin(), m_cycles.end(), 0);
+	std::fill(std::begin(m_opcodeCounts), std::end(m_opcodeCounts), 0);
+	std::fill(std::begin(m_opcodeCycles), std::end(m_opcodeCycles), 0);
+	m_total = 0;
+	m_stack.clear();
+	m_stack.reserve(maxDepth);
+	m_subroutines.clear();
+	m_calls.clear();
+}
+
+void Profiler::enter(uint16_t target, uint16_t site, bool interrupt) {
+	if (m_stack.size() == maxDepth) {
+		m_stack.erase(m_stack.begin()); // Lost track somewhere deep down, the oldest frame is the least useful
+	}
+	m_stack.push_back({ target, site, interrupt, m_total });
+	m_subroutines[target].calls++;
+	if (!interrupt) {
+		m_calls[(static_cast<uint32_t>(site) << 16) | target].calls++;
+	}
+}
+
+uint64_t Profiler::instructions() const {
+	uint64_t instructions = 0;
+	for (uint64_t count : m_opcodeCounts) {
+		instructions += count;
+	}
+	return instructions;
+}
+
+void Profiler::ret(bool interrupt) {
+	// RTS only returns from a JSR and RTI only from an interrupt; anything else means the
+	// program did its own stack tricks, and the frame is left for a later match
+	if (m_stack.empty() || m_stack.back().interrupt != interrupt) {
+		return;
+	}
+	const Frame& frame = m_stack.back();
+	uint64_t cycles = m_total - frame.entryCycles;
+	m_subroutines[frame.target].inclusiveCycles += cycles;
+	if (!interrupt) {
+		m_calls[(static_cast<uint32_t>(frame.site) << 16) | frame.target].inclusiveCycles += cycles;
+	}
+	m_stack.pop_back();
+}
+
+void Profiler::report(std::ostream& out, const CPU& cpu, size_t top) const {
+	char line[160];
+	double total = static_cast<double>(std::max<uint64_t>(m_total, 1));
+	std::snprintf(line, sizeof(line), "Guest profile: %llu instructions, %llu cycles\n",
+		static_cast<unsigned long long>(instructions()), static_cast<unsigned long long>(m_total));
+	out << line;
+
+	std::vector<uint32_t> pcs;
+	for (uint32_t pc = 0; pc < 0x10000; ++pc) {
+		if (m_cycles[pc]) {
+			pcs.push_back(pc);
+		}
+	}
+	size_t count = std::min(top, pcs.size());
+	std::partial_sort(pcs.begin(), pcs.begin() + count, pcs.end(),
+		[this](uint32_t a, uint32_t b) { return m_cycles[a] > m_cycles[b]; });
+	// Nothing follows which subroutine each instruction ran in, so a PC goes under the nearest entry below it
+	std::vector<uint16_t> entries;
+	for (const auto& [target, subroutine] : m_subroutines) {
+		entries.push_back(target);
+	}
+	std::sort(entries.begin(), entries.end());
+	out << "\nHot spots\n      cycles       %  address  instruction          subroutine\n";
+	for (size_t i = 0; i < count; ++i) {
+		uint16_t pc = static_cast<uint16_t>(pcs[i]);
+		std::string owner = "-";
+		auto entry = std::upper_bound(entries.begin(), entries.end(), pc);
+		if (entry != entries.begin()) {
+			std::snprintf(line, sizeof(line), "$%04X", *(entry - 1));
+			owner = line;
+		}
+		std::snprintf(line, sizeof(line), "%12llu  %5.1f%%  $%04X    %-20s %s\n", static_cast<unsigned long long>(m_cycles[pc]),
+			m_cycles[pc] * 100.0 / total, pc, cpu.disassemble(pc).c_str(), owner.c_str());
+		out << line;
+	}
+
+	std::vector<int> opcodes;
+	for (int opcode = 0; opcode < 256; ++opcode) {
+		if (m_opcodeCounts[opcode]) {
+			opcodes.push_back(opcode);
+		}
+	}
+	count = std::min(top, opcodes.size());
+	std::partial_sort(opcodes.begin(), opcodes.begin() + count, opcodes.end(),
+		[this](int a, int b) { return m_opcodeCycles[a] > m_opcodeCycles[b]; });
+	out << "\nOpcodes\n       count          cycles       %  opcode\n";
+	for (size_t i = 0; i < count; ++i) {
+		int opcode = opcodes[i];
+		std::snprintf(line, sizeof(line), "%12llu  %14llu  %5.1f%%  $%02X %s\n", static_cast<unsigned long long>(m_opcodeCounts[opcode]),
+			static_cast<unsigned long long>(m_opcodeCycles[opcode]), m_opcodeCycles[opcode] * 100.0 / total, opcode,
+			cpu.opcodeName(static_cast<uint8_t>(opcode)).c_str());
+		out << line;
+	}
+
+	std::vector<std::pair<uint16_t, Subroutine>> subroutines(m_subroutines.begin(), m_subroutines.end());
+	count = std::min(top, subroutines.size());
+	std::partial_sort(subroutines.begin(), subroutines.begin() + count, subroutines.end(),
+		[](const auto& a, const auto& b) { return a.second.inclusiveCycles > b.second.inclusiveCycles; });
+	out << "\nSubroutines (JSR targets and interrupt handlers, callees included)\n       calls          cycles       %  address  callers\n";
+	for (size_t i = 0; i < count; ++i) {
+		const auto& [target, subroutine] = subroutines[i];
+		std::snprintf(line, sizeof(line), "%12llu  %14llu  %5.1f%%  $%04X   ", static_cast<unsigned long long>(subroutine.calls),
+			static_cast<unsigned long long>(subroutine.inclusiveCycles), subroutine.inclusiveCycles * 100.0 / total, target);
+		out << line;
+		// The busiest few call sites; interrupt handlers have none
+		std::vector<std::pair<uint16_t, uint64_t>> callers;
+		for (const auto& [key, call] : m_calls) {
+			if ((key & 0xFFFF) == target) {
+				callers.emplace_back(static_cast<uint16_t>(key >> 16), call.inclusiveCycles);
+			}
+		}
+		std::sort(callers.begin(), callers.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+		for (size_t j = 0; j < std::min<size_t>(callers.size(), 3); ++j) {
+			std::snprintf(line, sizeof(line), " $%04X (%.0f%%)", callers[j].first,
+				callers[j].second * 100.0 / std::max<uint64_t>(subroutine.inclusiveCycles, 1));
+			out << line;
+		}
+		if (callers.size() > 3) {
+			out << " ...";
+		}
+		if (callers.empty()) {
+			out << " interrupt";
+		}
+		out << "\n";
+	}
+}
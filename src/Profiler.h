@@ -0,0 +1,105 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+class CPU;
+
+/**
+ * @brief Where the guest program spends its cycles: per PC, per opcode and per subroutine.
+ *
+ * The CPU calls record() after every instruction when it has a profiler
+ * attached and was built with NES_PROFILER (cmake -DNES_PROFILER=ON). Without
+ * the flag the hooks aren't compiled at all, so a normal build pays nothing;
+ * with it and no profiler attached it is one null check per instruction.
+ *
+ * record() only adds to flat arrays indexed by PC and opcode. Everything about
+ * subroutines happens where control moves between them: JSR, RTS, RTI and
+ * interrupt entry (BRK included) call the hooks below, which keep a shadow
+ * call stack. A call pushes its target; the matching return pops it and adds
+ * the cycles in between (callees included) to that subroutine and to the
+ * caller-callee edge. Code that plays with the return address on the stack
+ * can leave the shadow stack out of step; it is capped, so that only costs
+ * attribution, never memory. The report lists each hot PC under the nearest
+ * subroutine entry at or below it.
+ */
+class Profiler
+{
+public:
+	// Whether the CPU hook was compiled in (NES_PROFILER). When false nothing is ever recorded.
+	static constexpr bool Available =
+#ifdef NES_PROFILER
+		true;
+#else
+		false;
+#endif
+
+	Profiler();
+
+	// Called by the CPU after every instruction, pc being where it was fetched
+	void record(uint16_t pc, uint8_t opcode, uint8_t cycles) {
+		m_cycles[pc] += cycles;
+		m_opcodeCounts[opcode]++;
+		m_opcodeCycles[opcode] += cycles;
+		m_total += cycles;
+	}
+
+	// Called by the CPU while it runs the instruction that moves control, before record() counts it.
+	// A subroutine's cycles run from the instruction that enters it up to the one that leaves.
+	void call(uint16_t site, uint16_t target) { enter(target, site, false); } // JSR at site
+	void interrupt(uint16_t handler) { enter(handler, 0, true); }              // NMI, IRQ or BRK
+	void ret(bool interrupt);                                                 // RTS, or RTI if interrupt
+
+	// Forget everything recorded so far
+	void clear();
+
+	uint64_t totalCycles() const { return m_total; }
+	uint64_t instructions() const;
+	uint64_t cyclesAt(uint16_t pc) const { return m_cycles[pc]; }
+	uint64_t opcodeCount(uint8_t opcode) const { return m_opcodeCounts[opcode]; }
+	uint64_t opcodeCycles(uint8_t opcode) const { return m_opcodeCycles[opcode]; }
+
+	struct Subroutine {
+		uint64_t calls = 0;
+		uint64_t inclusiveCycles = 0; // From the JSR (or the handler's first instruction) up to the RTS/RTI, callees included
+	};
+	// Subroutines (and interrupt handlers) by entry address
+	const std::unordered_map<uint16_t, Subroutine>& subroutines() const { return m_subroutines; }
+	// JSRs from one site to one target, keyed (call site << 16) | target
+	const std::unordered_map<uint32_t, Subroutine>& calls() const { return m_calls; }
+
+	/**
+	 * @brief Human readable summary: the top PCs with their disassembly and the subroutine
+	 *        they ran in, the busiest opcodes, and the subroutines by inclusive cycles with
+	 *        their callers.
+	 *
+	 * @param cpu Used for disassembly; it reads memory without side effects
+	 * @param top How many lines each table gets
+	 */
+	void report(std::ostream& out, const CPU& cpu, size_t top = 20) const;
+
+private:
+	struct Frame {
+		uint16_t target;
+		uint16_t site;
+		bool interrupt;
+		uint64_t entryCycles;
+	};
+	static constexpr size_t maxDepth = 64;
+
+	void enter(uint16_t target, uint16_t site, bool interrupt);
+
+	std::vector<uint64_t> m_cycles;  // By PC
+	uint64_t m_opcodeCounts[256];
+	uint64_t m_opcodeCycles[256];
+	uint64_t m_total = 0;
+
+	std::vector<Frame> m_stack;
+	std::unordered_map<uint16_t, Subroutine> m_subroutines;
+	std::unordered_map<uint32_t, Subroutine> m_calls;
+};
+
+#endif // PROFILER_H
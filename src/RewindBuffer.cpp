@@ -0,0 +1,203 @@
+#include "RewindBuffer.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+	// A literal only ends at a zero run at least this long, shorter runs cost more to encode than to copy
+	constexpr size_t minZeroRun = 4;
+
+	// Steps pos over whole 8-byte words where data matches reference (or is zero without one)
+	size_t skipUnchanged(const uint8_t* data, const uint8_t* reference, size_t pos, size_t size) {
+		for (; pos + 8 <= size; pos += 8) {
+			uint64_t word, referenceWord = 0;
+			std::memcpy(&word, data + pos, 8);
+			if (reference) {
+				std::memcpy(&referenceWord, reference + pos, 8);
+			}
+			if (word != referenceWord) {
+				break;
+			}
+		}
+		return pos;
+	}
+
+	void writeVarint(std::vector<uint8_t>& out, size_t value) {
+		while (value >= 0x80) {
+			out.push_back(static_cast<uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back(static_cast<uint8_t>(value));
+	}
+
+	bool readVarint(const uint8_t*& p, const uint8_t* end, size_t& value) {
+		value = 0;
+		for (int shift = 0; p < end && shift < 64; shift += 7) {
+			uint8_t byte = *p++;
+			value |= static_cast<size_t>(byte & 0x7F) << shift;
+			if (!(byte & 0x80)) {
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+RewindBuffer::RewindBuffer(size_t capacity, size_t keyframeInterval)
+	: m_capacity(std::max<size_t>(capacity, 2)),
+	// Eviction drops a whole keyframe group, so there must always be room for two of them
+	m_keyframeInterval(std::clamp<size_t>(keyframeInterval, 1, m_capacity / 2)) {
+}
+
+/*
+	Encoded layout, repeated until the whole state is covered:
+		varint  number of bytes that are unchanged (XOR is zero)
+		varint  number of literal bytes that follow
+		...     literal bytes, already XORed with the reference
+*/
+void RewindBuffer::Encode(const uint8_t* data, const uint8_t* reference, size_t size, std::vector<uint8_t>& out) {
+	out.clear();
+	auto delta = [&](size_t i) -> uint8_t { return reference ? data[i] ^ reference[i] : data[i]; };
+
+	size_t pos = 0;
+	while (pos < size) {
+		size_t zeroStart = pos;
+		pos = skipUnchanged(data, reference, pos, size);
+		while (pos < size && delta(pos) == 0) {
+			pos++;
+		}
+		size_t literalStart = pos;
+		size_t zeroRun = 0;
+		while (pos < size && zeroRun < minZeroRun) {
+			zeroRun = delta(pos) == 0 ? zeroRun + 1 : 0;
+			pos++;
+		}
+		pos -= zeroRun; // Leave the zeros for the next run
+
+		writeVarint(out, literalStart - zeroStart);
+		writeVarint(out, pos - literalStart);
+		size_t offset = out.size();
+		out.resize(offset + (pos - literalStart));
+		for (size_t i = literalStart; i < pos; ++i) {
+			out[offset++] = delta(i);
+		}
+	}
+}
+
+bool RewindBuffer::Apply(const std::vector<uint8_t>& encoded, std::vector<uint8_t>& state) {
+	const uint8_t* p = encoded.data();
+	const uint8_t* end = p + encoded.size();
+	size_t pos = 0;
+	while (p < end) {
+		size_t zeros, literal;
+		if (!readVarint(p, end, zeros) || !readVarint(p, end, literal)) {
+			return false;
+		}
+		pos += zeros;
+		if (pos > state.size() || literal > state.size() - pos || literal > static_cast<size_t>(end - p)) {
+			return false;
+		}
+		for (size_t i = 0; i < literal; ++i) {
+			state[pos + i] ^= p[i];
+		}
+		pos += literal;
+		p += literal;
+	}
+	return true;
+}
+
+void RewindBuffer::push(const std::vector<uint8_t>& state) {
+	uint64_t sequence = m_firstSequence + m_frames.size();
+	Frame entry;
+	if (!m_spare.empty()) {
+		entry = std::move(m_spare.back());
+		m_spare.pop_back();
+	}
+	entry.stateSize = static_cast<uint32_t>(state.size());
+
+	bool keyframe = m_frames.empty() || sequence - m_frames.back().keyframe >= m_keyframeInterval ||
+		frame(m_frames.back().keyframe).stateSize != state.size();
+	if (!keyframe && !decodeKeyframe(m_frames.back().keyframe)) {
+		keyframe = true; // Damaged keyframe, start a new group rather than build on it
+	}
+	if (keyframe) {
+		entry.keyframe = sequence;
+		Encode(state.data(), nullptr, state.size(), entry.data);
+		m_keyframe = state;
+		m_keyframeSequence = sequence;
+	}
+	else {
+		entry.keyframe = m_frames.back().keyframe;
+		Encode(state.data(), m_keyframe.data(), state.size(), entry.data);
+	}
+	m_bytes += entry.data.size();
+	m_frames.push_back(std::move(entry));
+
+	// Drop the oldest keyframe and everything built on it
+	while (m_frames.size() > m_capacity) {
+		uint64_t oldest = m_frames.front().keyframe;
+		if (oldest == m_frames.back().keyframe) {
+			break;
+		}
+		if (m_keyframeSequence == oldest) {
+			m_keyframeSequence = UINT64_MAX;
+		}
+		while (!m_frames.empty() && m_frames.front().keyframe == oldest) {
+			m_bytes -= m_frames.front().data.size();
+			m_spare.push_back(std::move(m_frames.front()));
+			m_frames.pop_front();
+			m_firstSequence++;
+		}
+	}
+	// A few spares are enough to cover one eviction; don't hold on to a whole group's worth
+	if (m_spare.size() > m_keyframeInterval) {
+		m_spare.resize(m_keyframeInterval);
+	}
+}
+
+bool RewindBuffer::pop(std::vector<uint8_t>& state) {
+	if (m_frames.empty()) {
+		return false;
+	}
+	uint64_t sequence = m_firstSequence + m_frames.size() - 1;
+	Frame& last = m_frames.back();
+	bool ok;
+	if (last.keyframe == sequence) {
+		state.assign(last.stateSize, 0);
+		ok = Apply(last.data, state);
+		if (m_keyframeSequence == sequence) {
+			m_keyframeSequence = UINT64_MAX; // The sequence number gets reused by the next push
+		}
+	}
+	else {
+		ok = decodeKeyframe(last.keyframe);
+		if (ok) {
+			state = m_keyframe;
+			ok = Apply(last.data, state);
+		}
+	}
+	m_bytes -= last.data.size();
+	m_spare.push_back(std::move(last));
+	m_frames.pop_back();
+	return ok;
+}
+
+void RewindBuffer::clear() {
+	m_frames.clear();
+	m_spare.clear();
+	m_bytes = 0;
+	m_keyframeSequence = UINT64_MAX;
+}
+
+bool RewindBuffer::decodeKeyframe(uint64_t sequence) {
+	if (m_keyframeSequence == sequence) {
+		return true;
+	}
+	const Frame& key = frame(sequence);
+	m_keyframe.assign(key.stateSize, 0);
+	if (!Apply(key.data, m_keyframe)) {
+		m_keyframeSequence = UINT64_MAX;
+		return false;
+	}
+	m_keyframeSequence = sequence;
+	return true;
+}
@@ -0,0 +1,73 @@
+#ifndef REWINDBUFFER_H
+#define REWINDBUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+/**
+ * @brief Ring of compressed per-frame savestates for stepping backwards.
+ *
+ * Every keyframeInterval frames a full state is stored; the frames in between
+ * are stored as the XOR of their state against that keyframe. Consecutive
+ * frames change only a few hundred bytes of a 76 KB state, so the XOR is
+ * almost all zeros and a zero-run encoding shrinks each delta to a few KB.
+ * Keyframes go through the same encoding (against nothing), which squeezes
+ * out the mostly empty CPU address space.
+ *
+ * When the ring is full the oldest keyframe is dropped together with every
+ * delta that depends on it, so the buffer holds between
+ * capacity - keyframeInterval and capacity frames.
+ */
+class RewindBuffer
+{
+public:
+	explicit RewindBuffer(std::size_t capacity = 60 * 60, std::size_t keyframeInterval = 60);
+
+	// Stores a new most recent state
+	void push(const std::vector<uint8_t>& state);
+
+	/**
+	 * @brief Removes the most recent state and writes it to state.
+	 *
+	 * @return false if the buffer is empty
+	 */
+	bool pop(std::vector<uint8_t>& state);
+
+	void clear();
+	std::size_t size() const { return m_frames.size(); }
+	bool empty() const { return m_frames.empty(); }
+	std::size_t capacity() const { return m_capacity; }
+
+	// Compressed bytes currently held, not counting the decoded keyframe cache
+	std::size_t memoryUsage() const { return m_bytes; }
+
+	// Zero-run encoding of data ^ reference (reference may be nullptr for plain data)
+	static void Encode(const uint8_t* data, const uint8_t* reference, std::size_t size, std::vector<uint8_t>& out);
+	// XORs an Encode()d delta into state, which must already hold the reference
+	static bool Apply(const std::vector<uint8_t>& encoded, std::vector<uint8_t>& state);
+
+private:
+	struct Frame {
+		std::vector<uint8_t> data;  // Encoded against the keyframe, or against nothing if this is one
+		uint32_t stateSize = 0;
+		uint64_t keyframe = 0;      // Sequence number of the keyframe this frame is relative to
+	};
+
+	bool decodeKeyframe(uint64_t sequence);
+	const Frame& frame(uint64_t sequence) const { return m_frames[sequence - m_firstSequence]; }
+
+	std::size_t m_capacity;
+	std::size_t m_keyframeInterval;
+	std::deque<Frame> m_frames;
+	uint64_t m_firstSequence = 0; // Sequence number of m_frames.front()
+	std::size_t m_bytes = 0;
+
+	// Most recently used keyframe, decoded, so pushing and stepping back don't decode it every frame
+	std::vector<uint8_t> m_keyframe;
+	uint64_t m_keyframeSequence = UINT64_MAX;
+	std::vector<Frame> m_spare; // Released frame buffers, reused to avoid reallocating every push
+};
+
+#endif // REWINDBUFFER_H
@@ -0,0 +1,194 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/*
+    Savestate layout (version 1), all values little-endian:
+
+        u32  magic "NESS"
+        u16  format version
+        u16  reserved, 0
+        u64  XXH64 of the PRG ROM the state was taken with
+        then any number of chunks:
+            u32  tag, four ASCII characters ("CPU ", "PPU ", ...)
+            u32  payload size in bytes
+            ...  payload, written by the component that owns it
+
+    Loaders skip chunks they don't recognise and start a component from its
+    power-on state when its chunk is missing, so new chunks can be added
+    without breaking old states. A chunk that fails to parse rejects the whole
+    state. Changing the layout inside an existing chunk needs a new format
+    version.
+*/
+namespace SaveState {
+	constexpr uint32_t magic = 0x5353454E; // "NESS"
+	constexpr uint16_t version = 1;
+
+	constexpr uint32_t ChunkTag(const char (&tag)[5]) {
+		return static_cast<uint8_t>(tag[0]) | (static_cast<uint8_t>(tag[1]) << 8) |
+			(static_cast<uint8_t>(tag[2]) << 16) | (static_cast<uint32_t>(static_cast<uint8_t>(tag[3])) << 24);
+	}
+}
+
+/**
+ * @brief Appends little-endian values to a savestate blob.
+ *
+ * Components write their fields in a fixed order and read them back in the
+ * same order through StateReader. Multi-byte values are always stored
+ * little-endian so a blob saved on one host loads on any other.
+ */
+class StateWriter
+{
+public:
+	explicit StateWriter(std::vector<uint8_t>& out) : m_out(out) {}
+
+	void write8(uint8_t value) { m_out.push_back(value); }
+	void writeBool(bool value) { m_out.push_back(value ? 1 : 0); }
+	void write16(uint16_t value) {
+		write8(value & 0xFF);
+		write8(value >> 8);
+	}
+	void write32(uint32_t value) {
+		write16(value & 0xFFFF);
+		write16(value >> 16);
+	}
+	void write64(uint64_t value) {
+		write32(value & 0xFFFFFFFF);
+		write32(value >> 32);
+	}
+	void writeBytes(const void* data, size_t size) {
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		m_out.insert(m_out.end(), bytes, bytes + size);
+	}
+	// 7 bits per byte, low first, top bit set on every byte but the last
+	void writeVarint(uint64_t value) {
+		while (value >= 0x80) {
+			write8(static_cast<uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+		write8(static_cast<uint8_t>(value));
+	}
+	// Length-prefixed byte vector
+	void writeVector(const std::vector<uint8_t>& data) {
+		write32(static_cast<uint32_t>(data.size()));
+		writeBytes(data.data(), data.size());
+	}
+
+	// Starts a chunk, returns the handle endChunk needs to fill in its size
+	size_t beginChunk(uint32_t tag) {
+		write32(tag);
+		write32(0);
+		return m_out.size();
+	}
+	void endChunk(size_t start) {
+		uint32_t size = static_cast<uint32_t>(m_out.size() - start);
+		for (int i = 0; i < 4; ++i) {
+			m_out[start - 4 + i] = (size >> (i * 8)) & 0xFF;
+		}
+	}
+
+private:
+	std::vector<uint8_t>& m_out;
+};
+
+/**
+ * @brief Reads values written by StateWriter back out of a blob.
+ *
+ * Reading past the end of the blob never touches memory outside of it; it
+ * returns zeros and clears ok() so the caller can reject the whole state.
+ */
+class StateReader
+{
+public:
+	StateReader(const uint8_t* data, size_t size) : m_pos(data), m_end(data + size) {}
+
+	bool ok() const { return m_ok; }
+	size_t remaining() const { return m_end - m_pos; }
+
+	uint8_t read8() {
+		if (m_pos >= m_end) {
+			m_ok = false;
+			return 0;
+		}
+		return *m_pos++;
+	}
+	bool readBool() { return read8() != 0; }
+	uint16_t read16() {
+		uint16_t low = read8();
+		return low | (read8() << 8);
+	}
+	uint32_t read32() {
+		uint32_t low = read16();
+		return low | (static_cast<uint32_t>(read16()) << 16);
+	}
+	uint64_t read64() {
+		uint64_t low = read32();
+		return low | (static_cast<uint64_t>(read32()) << 32);
+	}
+	uint64_t readVarint() {
+		uint64_t value = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			uint8_t byte = read8();
+			value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if (!(byte & 0x80)) {
+				return value;
+			}
+		}
+		m_ok = false; // Too long to be a 64-bit value
+		return 0;
+	}
+	bool readBytes(void* data, size_t size) {
+		if (size > remaining()) {
+			m_ok = false;
+			return false;
+		}
+		std::memcpy(data, m_pos, size);
+		m_pos += size;
+		return true;
+	}
+	// Reads a vector written by writeVector. The stored length must match
+	// the size of the destination, which is fixed by the component.
+	bool readVector(std::vector<uint8_t>& data) {
+		if (read32() != data.size()) {
+			m_ok = false;
+			return false;
+		}
+		return readBytes(data.data(), data.size());
+	}
+
+	// Borrows the next size bytes in place, nullptr if there aren't that many
+	const uint8_t* view(size_t size) {
+		if (size > remaining()) {
+			m_ok = false;
+			return nullptr;
+		}
+		const uint8_t* data = m_pos;
+		m_pos += size;
+		return data;
+	}
+
+	// Splits the next chunk off into its own reader. Returns false at the end of the blob.
+	bool nextChunk(uint32_t& tag, StateReader& chunk) {
+		if (remaining() == 0) {
+			return false;
+		}
+		tag = read32();
+		uint32_t size = read32();
+		const uint8_t* payload = view(size);
+		if (!payload) {
+			return false;
+		}
+		chunk = StateReader(payload, size);
+		return true;
+	}
+
+private:
+	const uint8_t* m_pos;
+	const uint8_t* m_end;
+	bool m_ok = true;
+};
+
+#endif // SAVESTATE_H
@@ -0,0 +1,80 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Everything that can be scheduled, one slot each
+enum class SchedulerEvent {
+	ApuIrq,  // Frame counter or DMC interrupt could be raised
+	DmcDma,  // DMC fetches its next sample byte, stalling the CPU
+	Count
+};
+
+/**
+ * @brief Timed events on the CPU clock, the run loop's one source of "something happens now".
+ *
+ * Components put their next event in at an absolute CPU cycle and the run loop
+ * compares the clock against next() once per instruction. Only when that is
+ * due does anything get asked to do work, so a component with nothing coming
+ * up costs nothing between instructions.
+ *
+ * Each kind of event has a single slot: scheduling it again moves it. The
+ * clock isn't saved in savestates; components schedule relative to now() when
+ * they're restored.
+ */
+class Scheduler
+{
+public:
+	static constexpr uint64_t never = UINT64_MAX;
+
+	Scheduler() { clear(); }
+
+	uint64_t now() const { return m_now; }
+	void advance(uint32_t cycles) { m_now += cycles; }
+	bool due() const { return m_now >= m_next; }
+	uint64_t next() const { return m_next; }
+
+	void schedule(SchedulerEvent event, uint64_t cycle) {
+		m_events[static_cast<size_t>(event)] = cycle;
+		updateNext();
+	}
+	void cancel(SchedulerEvent event) { schedule(event, never); }
+	uint64_t when(SchedulerEvent event) const { return m_events[static_cast<size_t>(event)]; }
+
+	// Takes the earliest event that is due, false once nothing is
+	bool pop(SchedulerEvent& event) {
+		if (!due()) {
+			return false;
+		}
+		for (size_t i = 0; i < m_events.size(); ++i) {
+			if (m_events[i] == m_next) {
+				event = static_cast<SchedulerEvent>(i);
+				m_events[i] = never;
+				updateNext();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void clear() {
+		m_events.fill(never);
+		m_next = never;
+	}
+
+private:
+	void updateNext() {
+		m_next = never;
+		for (uint64_t cycle : m_events) {
+			m_next = cycle < m_next ? cycle : m_next;
+		}
+	}
+
+	uint64_t m_now = 0;
+	uint64_t m_next = never;
+	std::array<uint64_t, static_cast<size_t>(SchedulerEvent::Count)> m_events;
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,194 @@
+#include "Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+	struct Event {
+		const char* name;
+		int64_t start; // Nanoseconds since the trace epoch
+		int64_t duration;
+	};
+}
+
+// One thread's events. Only the owner writes them, with no lock: event i goes in slot i % eventsPerThread,
+// and started/finished bracket each write so a reader can tell which slots it may have caught half written.
+struct Trace::Track {
+	std::unique_ptr<Event[]> events{ new Event[eventsPerThread] }; // Reserved up front, pages are touched as it fills
+	std::atomic<uint64_t> started{ 0 };
+	std::atomic<uint64_t> finished{ 0 };
+	std::atomic<uint64_t> first{ 0 }; // Clear drops everything before this
+	std::atomic<const char*> name{ nullptr };
+	uint32_t id = 0;
+};
+
+namespace {
+	using Track = Trace::Track;
+
+	struct Registry {
+		std::mutex mutex; // Only for adding and listing tracks, recording never takes it
+		std::vector<std::shared_ptr<Track>> tracks; // Kept after their thread ends, so its events still get written
+		const Trace::Clock::time_point epoch = Trace::Clock::now();
+	};
+
+	Registry& registry() {
+		static Registry instance;
+		return instance;
+	}
+
+	Track* newTrack(const char* name) {
+		auto created = std::make_shared<Track>();
+		created->name.store(name, std::memory_order_relaxed);
+		Registry& all = registry();
+		std::lock_guard<std::mutex> lock(all.mutex);
+		created->id = static_cast<uint32_t>(all.tracks.size() + 1);
+		all.tracks.push_back(created);
+		return created.get();
+	}
+
+	Track& threadTrack() {
+		thread_local Track* track = newTrack(nullptr);
+		return *track;
+	}
+
+	std::vector<std::shared_ptr<Track>> allTracks() {
+		Registry& all = registry();
+		std::lock_guard<std::mutex> lock(all.mutex);
+		return all.tracks;
+	}
+
+	// The events a track holds, oldest first. Safe while the owner keeps recording: whatever it
+	// may have overwritten during the copy is dropped.
+	std::vector<Event> snapshot(const Track& track) {
+		uint64_t end = track.finished.load(std::memory_order_acquire);
+		uint64_t begin = std::max(track.first.load(std::memory_order_relaxed), end > Trace::eventsPerThread ? end - Trace::eventsPerThread : 0);
+		std::vector<Event> events;
+		events.reserve(end - begin);
+		for (uint64_t i = begin; i < end; ++i) {
+			Event& slot = track.events[i % Trace::eventsPerThread];
+			events.push_back({ std::atomic_ref<const char*>(slot.name).load(std::memory_order_relaxed),
+				std::atomic_ref<int64_t>(slot.start).load(std::memory_order_relaxed),
+				std::atomic_ref<int64_t>(slot.duration).load(std::memory_order_relaxed) });
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t started = track.started.load(std::memory_order_relaxed);
+		uint64_t overwritten = started > Trace::eventsPerThread ? started - Trace::eventsPerThread : 0;
+		if (overwritten > begin) {
+			events.erase(events.begin(), events.begin() + std::min<uint64_t>(overwritten - begin, events.size()));
+		}
+		return events;
+	}
+
+	std::atomic<bool> enabled{ false };
+
+	int64_t sinceEpoch(Trace::Clock::time_point time) {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(time - registry().epoch).count();
+	}
+
+	std::string jsonEscape(const char* text) {
+		std::string out;
+		for (; *text; ++text) {
+			if (*text == '"' || *text == '\\') {
+				out += '\\';
+			}
+			out += *text;
+		}
+		return out;
+	}
+}
+
+namespace Trace {
+	bool Enabled() {
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	void SetEnabled(bool on) {
+		registry(); // Fixes the epoch before the first event
+		enabled.store(on, std::memory_order_relaxed);
+	}
+
+	Track* NewTrack(const char* name) {
+		return newTrack(name);
+	}
+
+	void Complete(const char* name, Clock::time_point start, Clock::time_point end) {
+		Complete(nullptr, name, start, end);
+	}
+
+	void Complete(Track* track, const char* name, Clock::time_point start, Clock::time_point end) {
+		if (!Enabled()) {
+			return;
+		}
+		if (!track) {
+			track = &threadTrack();
+		}
+		uint64_t index = track->finished.load(std::memory_order_relaxed);
+		track->started.store(index + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		Event& slot = track->events[index % eventsPerThread];
+		std::atomic_ref<const char*>(slot.name).store(name, std::memory_order_relaxed);
+		std::atomic_ref<int64_t>(slot.start).store(sinceEpoch(start), std::memory_order_relaxed);
+		std::atomic_ref<int64_t>(slot.duration).store(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(),
+			std::memory_order_relaxed);
+		track->finished.store(index + 1, std::memory_order_release);
+	}
+
+	void SetThreadName(const char* name) {
+		threadTrack().name.store(name, std::memory_order_relaxed);
+	}
+
+	bool WriteJson(const std::string& path) {
+		// Copy everything out first, so nothing is held while the file is written
+		std::vector<std::pair<std::shared_ptr<Track>, std::vector<Event>>> tracks;
+		for (std::shared_ptr<Track>& track : allTracks()) {
+			std::vector<Event> events = snapshot(*track);
+			tracks.emplace_back(std::move(track), std::move(events));
+		}
+
+		std::ofstream out(path);
+		if (!out.is_open()) {
+			std::cerr << "Failed to create " << path << std::endl;
+			return false;
+		}
+		out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+		bool first = true;
+		char number[96];
+		for (const auto& [track, events] : tracks) {
+			const char* name = track->name.load(std::memory_order_relaxed);
+			std::string threadName = name ? jsonEscape(name) : "thread " + std::to_string(track->id);
+			out << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << track->id
+				<< ", \"args\": {\"name\": \"" << threadName << "\"}}";
+			first = false;
+			// Oldest first, so the file reads in time order within each thread
+			for (const Event& event : events) {
+				// Timestamps are in microseconds, three decimals keep the nanoseconds
+				std::snprintf(number, sizeof(number), "\"ts\": %.3f, \"dur\": %.3f", event.start / 1000.0, event.duration / 1000.0);
+				out << ",\n{\"name\": \"" << jsonEscape(event.name) << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << track->id
+					<< ", " << number << "}";
+			}
+		}
+		out << "\n]}\n";
+		return static_cast<bool>(out);
+	}
+
+	void Clear() {
+		for (const std::shared_ptr<Track>& track : allTracks()) {
+			track->first.store(track->finished.load(std::memory_order_acquire), std::memory_order_relaxed);
+		}
+	}
+
+	size_t EventCount() {
+		size_t count = 0;
+		for (const std::shared_ptr<Track>& track : allTracks()) {
+			uint64_t end = track->finished.load(std::memory_order_acquire);
+			uint64_t begin = std::max(track->first.load(std::memory_order_relaxed), end > eventsPerThread ? end - eventsPerThread : 0);
+			count += end - begin;
+		}
+		return count;
+	}
+}
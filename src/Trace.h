@@ -0,0 +1,86 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Timeline of what the host spends its time on, in Chrome trace-event format.
+ *
+ * Code marks the phases it wants to see with TRACE_SCOPE("name"), or with
+ * Now() and Complete() where a phase doesn't fit a C++ scope. Each thread
+ * records into its own ring of eventsPerThread events, reserved when the
+ * thread first records; once full the oldest are overwritten. Recording
+ * takes no lock and doesn't allocate, and WriteJson copies each ring out
+ * without stopping its thread, then writes a file that chrome://tracing and
+ * ui.perfetto.dev open directly.
+ *
+ * Tracing is off until SetEnabled(true) and can be switched at any time.
+ * While it is off a scope costs one relaxed atomic load.
+ *
+ * Names, thread names included, must be string literals (or otherwise live
+ * for the whole program), only the pointer is stored.
+ */
+namespace Trace {
+	using Clock = std::chrono::steady_clock;
+
+	constexpr size_t eventsPerThread = 1 << 20;
+
+	// A relaxed atomic load. Not inline, so every module sees the one flag in the NES library.
+	bool Enabled();
+	void SetEnabled(bool on);
+
+	inline Clock::time_point Now() { return Clock::now(); }
+
+	// Records a finished phase on the calling thread (dropped if tracing is off)
+	void Complete(const char* name, Clock::time_point start, Clock::time_point end);
+
+	// A ring registered from another thread, for a thread that mustn't allocate or lock even the first
+	// time it records (SDL's audio callback). One thread at a time records into it; it lives as long as
+	// the program.
+	struct Track;
+	Track* NewTrack(const char* name);
+	// The same as above into track, or the calling thread's own ring if track is nullptr
+	void Complete(Track* track, const char* name, Clock::time_point start, Clock::time_point end);
+
+	// Name of the calling thread in the timeline, "main", "audio", ...
+	void SetThreadName(const char* name);
+
+	// Writes every thread's events as trace-event JSON, false (with a message on stderr) if it can't
+	bool WriteJson(const std::string& path);
+
+	// Drops every recorded event
+	void Clear();
+
+	// Events currently held, across all threads
+	size_t EventCount();
+
+	class Scope {
+	public:
+		explicit Scope(const char* name, Track* track = nullptr) : m_name(Enabled() ? name : nullptr), m_track(track) {
+			if (m_name) {
+				m_start = Now();
+			}
+		}
+		~Scope() {
+			if (m_name) {
+				Complete(m_track, m_name, m_start, Now());
+			}
+		}
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		const char* m_name;
+		Track* m_track;
+		Clock::time_point m_start;
+	};
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+// Traces the rest of the enclosing block as one event
+#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
+
+#endif // TRACE_H
@@ -0,0 +1,108 @@
+#include "WorkStealingPool.h"
+
+namespace {
+	// Lets submit() find the calling worker's own queue when a task spawns more tasks
+	thread_local const WorkStealingPool* currentPool = nullptr;
+	thread_local unsigned currentWorker = 0;
+}
+
+WorkStealingPool::WorkStealingPool(unsigned threadCount) {
+	if (threadCount == 0) {
+		threadCount = 1; // hardware_concurrency() may not know
+	}
+	for (unsigned i = 0; i < threadCount; ++i) {
+		m_queues.push_back(std::make_unique<Queue>());
+	}
+	for (unsigned i = 0; i < threadCount; ++i) {
+		m_threads.emplace_back(&WorkStealingPool::workerLoop, this, i);
+	}
+}
+
+WorkStealingPool::~WorkStealingPool() {
+	wait();
+	{
+		std::lock_guard<std::mutex> lock(m_stateMutex);
+		m_stop = true;
+	}
+	m_workAvailable.notify_all();
+	for (std::thread& thread : m_threads) {
+		thread.join();
+	}
+}
+
+void WorkStealingPool::submit(std::function<void()> task) {
+	unsigned index;
+	if (currentPool == this) {
+		index = currentWorker;
+	}
+	else {
+		index = m_nextQueue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+	}
+	// Count the task before it becomes visible so a fast worker can't take it first
+	{
+		std::lock_guard<std::mutex> lock(m_stateMutex);
+		m_queued++;
+		m_pending++;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+		m_queues[index]->tasks.push_back(std::move(task));
+	}
+	m_workAvailable.notify_one();
+}
+
+void WorkStealingPool::wait() {
+	std::unique_lock<std::mutex> lock(m_stateMutex);
+	m_allDone.wait(lock, [this] { return m_pending == 0; });
+}
+
+bool WorkStealingPool::popLocal(unsigned index, Task& task) {
+	Queue& queue = *m_queues[index];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.tasks.empty()) {
+		return false;
+	}
+	task = std::move(queue.tasks.back());
+	queue.tasks.pop_back();
+	return true;
+}
+
+bool WorkStealingPool::steal(unsigned thief, Task& task) {
+	// Start with the neighbour so thieves spread out instead of all hitting queue 0
+	for (size_t offset = 1; offset < m_queues.size(); ++offset) {
+		Queue& victim = *m_queues[(thief + offset) % m_queues.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void WorkStealingPool::workerLoop(unsigned index) {
+	currentPool = this;
+	currentWorker = index;
+	while (true) {
+		Task task;
+		if (popLocal(index, task) || steal(index, task)) {
+			{
+				std::lock_guard<std::mutex> lock(m_stateMutex);
+				m_queued--;
+			}
+			task();
+			std::lock_guard<std::mutex> lock(m_stateMutex);
+			if (--m_pending == 0) {
+				m_allDone.notify_all();
+			}
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_stateMutex);
+		m_workAvailable.wait(lock, [this] { return m_stop || m_queued > 0; });
+		if (m_stop && m_queued == 0) {
+			return;
+		}
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Fixed set of worker threads, each with its own task queue.
+ *
+ * A worker takes tasks from the back of its own queue and, once that is
+ * empty, steals from the front of the other workers' queues. Batch jobs vary a
+ * lot in length (a 60 frame smoke test next to a 100k frame soak), so stealing
+ * keeps every core busy until the last job is handed out.
+ */
+class WorkStealingPool
+{
+public:
+	explicit WorkStealingPool(unsigned threadCount = std::thread::hardware_concurrency());
+	~WorkStealingPool(); // Finishes queued tasks, then joins the workers
+	WorkStealingPool(const WorkStealingPool&) = delete;
+	WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+	// Queues a task. Safe to call from any thread, including from inside a task. Tasks must not throw:
+	// as with a std::thread, an exception leaving one calls std::terminate, so catch inside the task.
+	void submit(std::function<void()> task);
+
+	// Blocks until every task submitted so far has finished
+	void wait();
+
+	unsigned size() const { return static_cast<unsigned>(m_threads.size()); }
+
+private:
+	using Task = std::function<void()>;
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	void workerLoop(unsigned index);
+	bool popLocal(unsigned index, Task& task);
+	bool steal(unsigned thief, Task& task);
+
+	std::vector<std::unique_ptr<Queue>> m_queues;
+	std::vector<std::thread> m_threads;
+	std::atomic<unsigned> m_nextQueue{ 0 };
+
+	std::mutex m_stateMutex;
+	std::condition_variable m_workAvailable;
+	std::condition_variable m_allDone;
+	size_t m_queued = 0;   // Tasks sitting in a queue
+	size_t m_pending = 0;  // Tasks queued or running
+	bool m_stop = false;
+};
+
+#endif // WORKSTEALINGPOOL_H
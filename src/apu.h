@@ -6,21 +6,217 @@
 #define APU_H
 
 #include <cstdint>
-#define SDL_MAIN_HANDLED
-#include <SDL2/SDL.h>
+#include <memory>
+#include <vector>
+#include "BlipBuffer.h"
+#include "Bus.h"
+#include "Cartridge.h"
+#include "SaveState.h"
+#include "Scheduler.h"
 
+#define APU_CLOCK_RATE 1789773.0 // NTSC CPU clock, the APU runs off the same clock
+
+// Volume envelope shared by the pulse and noise channels
+struct Envelope {
+	bool start = false;
+	bool loop = false;          // Also halts the length counter
+	bool constantVolume = false;
+	uint8_t period = 0;         // Doubles as the constant volume
+	uint8_t divider = 0;
+	uint8_t decay = 0;
+
+	void clock();
+	uint8_t volume() const { return constantVolume ? period : decay; }
+};
+
+struct PulseChannel {
+	bool enabled = false;
+	uint8_t duty = 0;
+	uint8_t sequence = 0;       // Position in the 8 step duty pattern
+	uint16_t period = 0;        // 11 bit timer reload
+	uint32_t timer = 0;         // CPU cycles until the next sequencer step
+	uint8_t length = 0;
+	Envelope envelope;
+
+	bool sweepEnabled = false;
+	bool sweepNegate = false;
+	bool sweepReload = false;
+	uint8_t sweepPeriod = 0;
+	uint8_t sweepShift = 0;
+	uint8_t sweepDivider = 0;
+	bool onesComplement = false; // Pulse 1 negates with one's complement, pulse 2 with two's
+
+	uint16_t sweepTarget() const;
+	void clockSweep();
+	uint8_t output() const;
+	uint32_t nextChange() const;
+	void advance(uint32_t cycles);
+};
+
+struct TriangleChannel {
+	bool enabled = false;
+	bool control = false;       // Halts the length counter and reloads the linear counter
+	bool linearReload = false;
+	uint8_t linearPeriod = 0;
+	uint8_t linearCounter = 0;
+	uint8_t sequence = 0;       // Position in the 32 step triangle
+	uint16_t period = 0;
+	uint32_t timer = 0;
+	uint8_t length = 0;
+
+	bool running() const { return length > 0 && linearCounter > 0 && period >= 2; } // Periods under 2 are ultrasonic, silence them
+	uint8_t output() const;
+	uint32_t nextChange() const;
+	void advance(uint32_t cycles);
+};
+
+struct NoiseChannel {
+	bool enabled = false;
+	bool mode = false;          // Short (93 step) sequence
+	uint16_t period = 4;        // In CPU cycles
+	uint32_t timer = 0;
+	uint16_t shift = 1;         // 15 bit LFSR
+	uint8_t length = 0;
+	Envelope envelope;
+
+	uint8_t output() const { return (length == 0 || (shift & 1)) ? 0 : envelope.volume(); }
+	uint32_t nextChange() const;
+	void advance(uint32_t cycles);
+};
+
+struct DMCChannel {
+	bool irqEnabled = false;
+	bool loop = false;
+	uint16_t period = 428;      // CPU cycles per output bit
+	uint32_t timer = 0;
+	uint8_t level = 0;          // 7 bit output
+	uint16_t sampleAddress = 0xC000;
+	uint16_t sampleLength = 1;
+	uint16_t currentAddress = 0xC000;
+	uint16_t bytesRemaining = 0;
+	uint8_t buffer = 0;
+	bool bufferFull = false;
+	uint8_t shift = 0;
+	uint8_t bitsRemaining = 8;
+	bool silence = true;
+
+	uint8_t output() const { return level; }
+	bool idle() const { return silence && !bufferFull && bytesRemaining == 0; } // Nothing to play or fetch
+};
+
+/**
+ * @brief The 2A03 audio unit: two pulse channels, triangle, noise and DMC.
+ *
+ * Registers $4000-$4013, $4015 and $4017 arrive through cpuWrite/readStatus.
+ * The APU is evaluated lazily: clock() only adds up CPU cycles, and the
+ * channels catch up when the CPU writes a register, reads $4015, an
+ * interrupt could fire or the frame ends. Catching up doesn't step every
+ * cycle either; each channel works out when its output can next change (a
+ * duty edge, a triangle step, never while muted) and the APU jumps from one
+ * such change or frame sequencer step to the next. Each change goes into a
+ * BlipBuffer as a delta and endFrame() resamples the whole frame at once.
+ * A steady tone costs a few steps per period, silence next to nothing.
+ *
+ * Attached to a Scheduler (as in Emulator) the APU books the exact cycles of
+ * its next interrupt and next DMC sample fetch there instead of checking a
+ * deadline itself, and the run loop syncs it when they come up.
+ */
 class APU
 {
 public:
-    APU();
-    ~APU();
-    void test();
-    void sdlAudioTest();
+	APU(std::shared_ptr<Bus> bus, std::shared_ptr<Cartridge> cart);
+	APU();
+
+	void cpuWrite(uint16_t address, uint8_t data);
+	uint8_t readStatus(); // $4015, clears the frame interrupt
+
+	// Lets CPU cycles pass; the channels catch up later, or now if an interrupt could be due (unattached)
+	void clock(uint32_t cycles) {
+		m_pending += cycles;
+		if (m_pending >= m_syncDeadline) {
+			sync();
+		}
+	}
+	// Brings every channel up to the current time
+	void sync();
+	// Advances every channel by the given number of CPU cycles straight away
+	void run(uint32_t cycles) {
+		m_pending += cycles;
+		sync();
+	}
+
+	// Ends the audio frame at the current time and appends its samples to out
+	void endFrame(std::vector<float>& out);
+
+	// Frame counter or DMC interrupt waiting to be serviced
+	bool irqPending() const { return frameIrq || dmcIrq; }
+
+	// Books interrupts and DMC fetches as ApuIrq/DmcDma events. The scheduler's clock must
+	// advance together with clock(), and both events are answered by calling sync().
+	void attach(Scheduler* scheduler);
+
+	// CPU cycles the DMC has stolen for sample fetches since the last call
+	uint32_t takeDmaStall() {
+		uint32_t stall = m_dmaStall;
+		m_dmaStall = 0;
+		return stall;
+	}
+
+	// When off, channels keep exactly the same state but nothing is mixed or resampled (run-ahead frames,
+	// runs without sound). Only the frame sequencer and DMC cost anything then.
+	void setOutputEnabled(bool enabled) {
+		sync();
+		m_outputEnabled = enabled;
+	}
+	void setSampleRate(double sampleRate) { m_blip.setRates(APU_CLOCK_RATE, sampleRate); }
+	double sampleRate() const { return m_blip.sampleRate(); }
+
+	// Savestates - channel, frame counter and interrupt state. Pending output samples are not saved,
+	// take them between frames when endFrame() has caught the channels up.
+	void saveState(StateWriter& out) const;
+	bool loadState(StateReader& in);
+
+	PulseChannel pulse1;
+	PulseChannel pulse2;
+	TriangleChannel triangle;
+	NoiseChannel noise;
+	DMCChannel dmc;
+
+	bool fiveStepMode = false;
+	bool irqInhibit = false;
+	bool frameIrq = false;
+	bool dmcIrq = false;
+	uint32_t frameCounterCycle = 0; // CPU cycles into the current frame sequence
 
 private:
-    static void audioCallback(void* userdata, Uint8* stream, int len);
-    SDL_AudioSpec want, have;
-    SDL_AudioDeviceID dev;
+	void clockQuarterFrame();
+	void clockHalfFrame();
+	void stepFrameCounter();
+	uint32_t nextFrameCounterEvent() const;
+	uint32_t nextIrqEvent() const;
+	uint32_t nextDmcFetch() const;
+	void scheduleEvents();
+
+	void advance(uint32_t cycles);
+	uint32_t dmcNextChange() const;
+	void advanceDmc(uint32_t cycles);
+	void clockDmc();
+	void fillDmcBuffer();
+
+	float mix() const;
+	void updateOutput();
+
+	std::shared_ptr<Bus> m_bus;
+	std::shared_ptr<Cartridge> m_cart;
+
+	BlipBuffer m_blip;
+	uint32_t m_time = 0;      // CPU cycles since the start of the audio frame, up to where the channels are
+	uint32_t m_pending = 0;   // CPU cycles clocked but not evaluated yet
+	uint32_t m_syncDeadline = 0; // Pending cycles at which an interrupt could fire, sync before it's missed (unattached)
+	Scheduler* m_scheduler = nullptr;
+	uint32_t m_dmaStall = 0;
+	float m_output = 0.0f;    // Mixed level last sent to the blip buffer
+	bool m_outputEnabled = true;
 };
 
-#endif
\ No newline at end of file
+#endif
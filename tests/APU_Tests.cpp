@@ -0,0 +1,253 @@
+#include <gtest/gtest.h>
+#include <apu.h>
+#include <BlipBuffer.h>
+#include <cmath>
+
+namespace APUTests {
+	constexpr uint32_t cyclesPerFrame = 29780;
+
+	class APUTest : public testing::Test {
+	protected:
+		// Runs one frame and returns its samples
+		std::vector<float> frame() {
+			std::vector<float> samples;
+			apu.run(cyclesPerFrame);
+			apu.endFrame(samples);
+			return samples;
+		}
+
+		static int zeroCrossings(const std::vector<float>& samples) {
+			int crossings = 0;
+			for (size_t i = 1; i < samples.size(); ++i) {
+				if ((samples[i - 1] < 0.0f) != (samples[i] < 0.0f)) {
+					crossings++;
+				}
+			}
+			return crossings;
+		}
+
+		static float peak(const std::vector<float>& samples) {
+			float level = 0.0f;
+			for (float sample : samples) {
+				level = std::max(level, std::fabs(sample));
+			}
+			return level;
+		}
+
+		APU apu;
+	};
+
+	TEST_F(APUTest, SilentAtPowerOn) {
+		std::vector<float> samples = frame();
+		ASSERT_NEAR(samples.size(), 44100.0 * cyclesPerFrame / APU_CLOCK_RATE, 1.0);
+		ASSERT_EQ(peak(samples), 0.0f);
+	}
+
+	TEST_F(APUTest, PulseTone) {
+		apu.cpuWrite(0x4015, 0x01);
+		apu.cpuWrite(0x4000, 0xBF); // 50% duty, length halted, constant volume 15
+		apu.cpuWrite(0x4002, 0xFD); // Period 253, about 440 Hz
+		apu.cpuWrite(0x4003, 0x00);
+		frame(); // Let the DC blocker settle
+		std::vector<float> samples;
+		for (int i = 0; i < 10; ++i) {
+			std::vector<float> more = frame();
+			samples.insert(samples.end(), more.begin(), more.end());
+		}
+		// 440 Hz for 1/6 of a second crosses zero about 147 times
+		ASSERT_NEAR(zeroCrossings(samples), 147, 6);
+		ASSERT_GT(peak(samples), 0.03f);
+	}
+
+	TEST_F(APUTest, DisabledChannelIsSilent) {
+		apu.cpuWrite(0x4000, 0xBF);
+		apu.cpuWrite(0x4002, 0xFD);
+		apu.cpuWrite(0x4003, 0x00); // Length isn't loaded while the channel is disabled
+		ASSERT_EQ(peak(frame()), 0.0f);
+		ASSERT_EQ(apu.readStatus() & 0x01, 0);
+	}
+
+	TEST_F(APUTest, LengthCounterRunsOut) {
+		apu.cpuWrite(0x4017, 0x40); // 4-step, no IRQ
+		apu.cpuWrite(0x4015, 0x01);
+		apu.cpuWrite(0x4000, 0x9F); // Length counter not halted
+		apu.cpuWrite(0x4002, 0xFD);
+		apu.cpuWrite(0x4003, 0x00); // Length 10, two half frames per frame
+		ASSERT_EQ(apu.readStatus() & 0x01, 0x01);
+		for (int i = 0; i < 4; ++i) {
+			frame();
+		}
+		ASSERT_EQ(apu.readStatus() & 0x01, 0x01);
+		frame();
+		frame();
+		ASSERT_EQ(apu.readStatus() & 0x01, 0);
+	}
+
+	TEST_F(APUTest, FrameInterrupt) {
+		apu.cpuWrite(0x4017, 0x00);
+		apu.run(29828);
+		ASSERT_FALSE(apu.irqPending());
+		apu.run(2);
+		ASSERT_TRUE(apu.irqPending());
+		ASSERT_EQ(apu.readStatus() & 0x40, 0x40);
+		ASSERT_FALSE(apu.irqPending()); // Reading $4015 acknowledges it
+	}
+
+	TEST_F(APUTest, FrameInterruptInhibited) {
+		apu.cpuWrite(0x4017, 0x40);
+		apu.run(cyclesPerFrame * 2);
+		ASSERT_FALSE(apu.irqPending());
+	}
+
+	TEST_F(APUTest, NoiseAndTriangleProduceSound) {
+		apu.cpuWrite(0x4015, 0x0C);
+		apu.cpuWrite(0x4008, 0xFF);
+		apu.cpuWrite(0x400A, 0x80);
+		apu.cpuWrite(0x400B, 0x00);
+		apu.cpuWrite(0x400C, 0x3F);
+		apu.cpuWrite(0x400E, 0x04);
+		apu.cpuWrite(0x400F, 0x00);
+		frame(); // The linear counter loads on the first quarter frame
+		ASSERT_GT(peak(frame()), 0.01f);
+		ASSERT_EQ(apu.readStatus() & 0x0C, 0x0C);
+	}
+
+	TEST_F(APUTest, DmcDirectLoad) {
+		apu.cpuWrite(0x4011, 0x7F);
+		ASSERT_EQ(apu.dmc.output(), 0x7F);
+		ASSERT_GT(peak(frame()), 0.1f);
+	}
+
+	TEST_F(APUTest, SaveStateRoundTrip) {
+		apu.cpuWrite(0x4015, 0x0F);
+		apu.cpuWrite(0x4000, 0x9F);
+		apu.cpuWrite(0x4002, 0x40);
+		apu.cpuWrite(0x4003, 0x08);
+		apu.cpuWrite(0x400E, 0x83);
+		apu.cpuWrite(0x400F, 0x10);
+		apu.run(12345);
+
+		std::vector<uint8_t> state;
+		StateWriter writer(state);
+		apu.saveState(writer);
+
+		APU copy;
+		StateReader reader(state.data(), state.size());
+		ASSERT_TRUE(copy.loadState(reader));
+		ASSERT_EQ(reader.remaining(), 0u);
+		std::vector<uint8_t> again;
+		StateWriter againWriter(again);
+		copy.saveState(againWriter);
+		ASSERT_EQ(again, state);
+	}
+
+	// Every channel busy, noise and the DMC included, and some of them changing each frame
+	static void playEverything(APU& apu, int frame) {
+		if (frame == 0) {
+			apu.cpuWrite(0x4015, 0x1F);
+			apu.cpuWrite(0x4000, 0x9F);
+			apu.cpuWrite(0x4001, 0x9A); // Sweeping up
+			apu.cpuWrite(0x4003, 0x01);
+			apu.cpuWrite(0x4004, 0x4A); // Decaying envelope
+			apu.cpuWrite(0x4007, 0x08);
+			apu.cpuWrite(0x4008, 0x40);
+			apu.cpuWrite(0x400B, 0x10);
+			apu.cpuWrite(0x400C, 0x38);
+			apu.cpuWrite(0x400F, 0x18);
+			apu.cpuWrite(0x4011, 0x40);
+			apu.cpuWrite(0x4010, 0x4F); // Looping sample at the fastest rate
+		}
+		apu.cpuWrite(0x4002, static_cast<uint8_t>(0x40 + frame * 16));
+		apu.cpuWrite(0x4006, static_cast<uint8_t>(0xF0 - frame * 8));
+		apu.cpuWrite(0x400A, static_cast<uint8_t>(0x30 + frame * 4));
+		apu.cpuWrite(0x400E, static_cast<uint8_t>(frame & 0x8F));
+	}
+
+	static std::vector<uint8_t> stateOf(const APU& apu) {
+		std::vector<uint8_t> state;
+		StateWriter writer(state);
+		apu.saveState(writer);
+		return state;
+	}
+
+	// Clocking a whole instruction at a time and catching up lazily sounds exactly like stepping every cycle
+	TEST_F(APUTest, LazyCatchUpMatchesCycleByCycle) {
+		APU& eager = apu;
+		APU lazy;
+		std::vector<float> eagerSamples;
+		std::vector<float> lazySamples;
+		for (int frame = 0; frame < 6; ++frame) {
+			playEverything(eager, frame);
+			playEverything(lazy, frame);
+			for (uint32_t cycle = 0; cycle < cyclesPerFrame; ++cycle) {
+				eager.run(1);
+			}
+			for (uint32_t cycle = 0, step = 2; cycle < cyclesPerFrame; cycle += step, step = step % 6 + 2) {
+				lazy.clock(std::min(step, cyclesPerFrame - cycle));
+			}
+			eager.endFrame(eagerSamples);
+			lazy.endFrame(lazySamples);
+			ASSERT_EQ(stateOf(lazy), stateOf(eager)) << "frame " << frame;
+		}
+		ASSERT_EQ(lazySamples, eagerSamples);
+		ASSERT_GT(peak(lazySamples), 0.1f);
+	}
+
+	TEST_F(APUTest, FrameInterruptWhileClocked) {
+		apu.cpuWrite(0x4017, 0x00);
+		for (uint32_t cycle = 1; cycle < 29829; ++cycle) {
+			apu.clock(1);
+			ASSERT_FALSE(apu.irqPending()) << "cycle " << cycle;
+		}
+		apu.clock(1);
+		ASSERT_TRUE(apu.irqPending()); // Seen by the CPU without anything else touching the APU
+	}
+
+	TEST_F(APUTest, MixerIsNonlinear) {
+		APU louder;
+		apu.cpuWrite(0x4011, 63);
+		louder.cpuWrite(0x4011, 126);
+		std::vector<float> samples;
+		louder.run(cyclesPerFrame);
+		louder.endFrame(samples);
+		// Twice the DMC level is only about 1.65 times as loud, a linear mix would be 2
+		float ratio = peak(samples) / peak(frame());
+		ASSERT_GT(ratio, 1.55f);
+		ASSERT_LT(ratio, 1.75f);
+	}
+
+	TEST(BlipBufferTest, SimdMatchesScalar) {
+		if (!BlipBuffer::SimdAvailable()) {
+			GTEST_SKIP() << "No vector path on this target";
+		}
+		BlipBuffer simd(APU_CLOCK_RATE, 48000.0);
+		BlipBuffer scalar(APU_CLOCK_RATE, 48000.0);
+		scalar.setSimd(false);
+
+		uint32_t seed = 12345;
+		std::vector<float> simdOut(2000);
+		std::vector<float> scalarOut(2000);
+		float largest = 0.0f;
+		float worst = 0.0f;
+		for (int frame = 0; frame < 20; ++frame) {
+			// Busy frames, a few thousand changes of random size at random times
+			for (int i = 0; i < 3000; ++i) {
+				seed = seed * 1664525u + 1013904223u;
+				uint32_t time = (seed >> 8) % cyclesPerFrame;
+				float delta = static_cast<float>(static_cast<int>(seed & 0xFF) - 128) / 512.0f;
+				simd.addDelta(time, delta);
+				scalar.addDelta(time, delta);
+			}
+			simd.endFrame(cyclesPerFrame);
+			scalar.endFrame(cyclesPerFrame);
+			size_t count = simd.readSamples(simdOut.data(), simdOut.size());
+			ASSERT_EQ(scalar.readSamples(scalarOut.data(), scalarOut.size()), count);
+			for (size_t i = 0; i < count; ++i) {
+				largest = std::max(largest, std::fabs(scalarOut[i]));
+				worst = std::max(worst, std::fabs(simdOut[i] - scalarOut[i]));
+			}
+		}
+		ASSERT_GT(largest, 0.1f);
+		ASSERT_LT(worst, largest * 1e-5f); // Only float rounding apart
+	}
+}
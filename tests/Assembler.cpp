@@ -0,0 +1,561 @@
+#include "Assembler.h"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <sstream>
+
+namespace {
+	struct OpcodeRow {
+		const char* mnemonic;
+		// Implied, Accumulator, Immediate, ZeroPage, ZeroPageX, ZeroPageY, Absolute, AbsoluteX,
+		// AbsoluteY, Indirect, IndirectX, IndirectY, Relative; -1 where the mode doesn't exist
+		std::array<int, 13> opcodes;
+	};
+
+	const OpcodeRow opcodeTable[] = {
+		{ "ADC", { -1, -1, 0x69, 0x65, 0x75, -1, 0x6D, 0x7D, 0x79, -1, 0x61, 0x71, -1 } },
+		{ "AND", { -1, -1, 0x29, 0x25, 0x35, -1, 0x2D, 0x3D, 0x39, -1, 0x21, 0x31, -1 } },
+		{ "ASL", { -1, 0x0A, -1, 0x06, 0x16, -1, 0x0E, 0x1E, -1, -1, -1, -1, -1 } },
+		{ "BCC", { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0x90 } },
+		{ "BCS", { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0xB0 } },
+		{ "BEQ", { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0xF0 } },
+		{ "BIT", { -1, -1, -1, 0x24, -1, -1, 0x2C, -1, -1, -1, -1, -1, -1 } },
+		{ "BMI", { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0x30 } },
+		{ "BNE", { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0xD0 } },
+		{ "BPL", { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0x10 } },
+		{ "BRK", { 0x00, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "BVC", { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0x50 } },
+		{ "BVS", { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0x70 } },
+		{ "CLC", { 0x18, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "CLD", { 0xD8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "CLI", { 0x58, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "CLV", { 0xB8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "CMP", { -1, -1, 0xC9, 0xC5, 0xD5, -1, 0xCD, 0xDD, 0xD9, -1, 0xC1, 0xD1, -1 } },
+		{ "CPX", { -1, -1, 0xE0, 0xE4, -1, -1, 0xEC, -1, -1, -1, -1, -1, -1 } },
+		{ "CPY", { -1, -1, 0xC0, 0xC4, -1, -1, 0xCC, -1, -1, -1, -1, -1, -1 } },
+		{ "DEC", { -1, -1, -1, 0xC6, 0xD6, -1, 0xCE, 0xDE, -1, -1, -1, -1, -1 } },
+		{ "DEX", { 0xCA, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "DEY", { 0x88, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "EOR", { -1, -1, 0x49, 0x45, 0x55, -1, 0x4D, 0x5D, 0x59, -1, 0x41, 0x51, -1 } },
+		{ "INC", { -1, -1, -1, 0xE6, 0xF6, -1, 0xEE, 0xFE, -1, -1, -1, -1, -1 } },
+		{ "INX", { 0xE8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "INY", { 0xC8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "JMP", { -1, -1, -1, -1, -1, -1, 0x4C, -1, -1, 0x6C, -1, -1, -1 } },
+		{ "JSR", { -1, -1, -1, -1, -1, -1, 0x20, -1, -1, -1, -1, -1, -1 } },
+		{ "LDA", { -1, -1, 0xA9, 0xA5, 0xB5, -1, 0xAD, 0xBD, 0xB9, -1, 0xA1, 0xB1, -1 } },
+		{ "LDX", { -1, -1, 0xA2, 0xA6, -1, 0xB6, 0xAE, -1, 0xBE, -1, -1, -1, -1 } },
+		{ "LDY", { -1, -1, 0xA0, 0xA4, 0xB4, -1, 0xAC, 0xBC, -1, -1, -1, -1, -1 } },
+		{ "LSR", { -1, 0x4A, -1, 0x46, 0x56, -1, 0x4E, 0x5E, -1, -1, -1, -1, -1 } },
+		{ "NOP", { 0xEA, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "ORA", { -1, -1, 0x09, 0x05, 0x15, -1, 0x0D, 0x1D, 0x19, -1, 0x01, 0x11, -1 } },
+		{ "PHA", { 0x48, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "PHP", { 0x08, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "PLA", { 0x68, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "PLP", { 0x28, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "ROL", { -1, 0x2A, -1, 0x26, 0x36, -1, 0x2E, 0x3E, -1, -1, -1, -1, -1 } },
+		{ "ROR", { -1, 0x6A, -1, 0x66, 0x76, -1, 0x6E, 0x7E, -1, -1, -1, -1, -1 } },
+		{ "RTI", { 0x40, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "RTS", { 0x60, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "SBC", { -1, -1, 0xE9, 0xE5, 0xF5, -1, 0xED, 0xFD, 0xF9, -1, 0xE1, 0xF1, -1 } },
+		{ "SEC", { 0x38, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "SED", { 0xF8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "SEI", { 0x78, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "STA", { -1, -1, -1, 0x85, 0x95, -1, 0x8D, 0x9D, 0x99, -1, 0x81, 0x91, -1 } },
+		{ "STX", { -1, -1, -1, 0x86, -1, 0x96, 0x8E, -1, -1, -1, -1, -1, -1 } },
+		{ "STY", { -1, -1, -1, 0x84, 0x94, -1, 0x8C, -1, -1, -1, -1, -1, -1 } },
+		{ "TAX", { 0xAA, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "TAY", { 0xA8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "TSX", { 0xBA, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "TXA", { 0x8A, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "TXS", { 0x9A, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+		{ "TYA", { 0x98, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+	};
+
+	const OpcodeRow* findRow(const std::string& mnemonic) {
+		for (const OpcodeRow& row : opcodeTable) {
+			if (mnemonic == row.mnemonic) {
+				return &row;
+			}
+		}
+		return nullptr;
+	}
+
+	std::string trim(const std::string& text) {
+		size_t start = text.find_first_not_of(" \t\r");
+		if (start == std::string::npos) {
+			return "";
+		}
+		size_t end = text.find_last_not_of(" \t\r");
+		return text.substr(start, end - start + 1);
+	}
+
+	std::string upper(std::string text) {
+		std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+		return text;
+	}
+
+	bool isIdentifierStart(char c) {
+		return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
+	}
+
+	bool isIdentifier(const std::string& text) {
+		if (text.empty() || !isIdentifierStart(text[0])) {
+			return false;
+		}
+		return std::all_of(text.begin(), text.end(), [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; });
+	}
+
+	// Ends with ",X" or ",Y" (any case, spaces allowed), which it strips off
+	bool takeIndex(std::string& text, char reg) {
+		std::string upperText = upper(text);
+		size_t comma = upperText.rfind(',');
+		if (comma == std::string::npos || trim(upperText.substr(comma + 1)) != std::string(1, reg)) {
+			return false;
+		}
+		text = trim(text.substr(0, comma));
+		return true;
+	}
+
+	std::vector<std::string> splitList(const std::string& text) {
+		std::vector<std::string> items;
+		std::stringstream stream(text);
+		std::string item;
+		while (std::getline(stream, item, ',')) {
+			items.push_back(trim(item));
+		}
+		return items;
+	}
+}
+
+int Assembler::Opcode(const std::string& mnemonic, Mode mode) {
+	const OpcodeRow* row = findRow(mnemonic);
+	return row ? row->opcodes[mode] : -1;
+}
+
+uint16_t Assembler::label(const std::string& name) const {
+	auto symbol = m_symbols.find(name);
+	return symbol == m_symbols.end() ? 0 : static_cast<uint16_t>(symbol->second);
+}
+
+bool Assembler::fail(int line, const std::string& message) {
+	if (m_error.empty()) {
+		m_error = "line " + std::to_string(line) + ": " + message;
+	}
+	return false;
+}
+
+bool Assembler::evaluate(const std::string& expression, int line, bool allowUndefined, int32_t& value, bool* known) const {
+	std::string text = trim(expression);
+	if (known) {
+		*known = true;
+	}
+	char byteSelect = 0;
+	if (!text.empty() && (text[0] == '<' || text[0] == '>')) {
+		byteSelect = text[0];
+		text = trim(text.substr(1));
+	}
+	if (text.empty()) {
+		const_cast<Assembler*>(this)->fail(line, "missing operand");
+		return false;
+	}
+
+	value = 0;
+	size_t pos = 0;
+	int sign = 1;
+	bool expectTerm = true;
+	while (pos < text.size()) {
+		char c = text[pos];
+		if (c == ' ' || c == '\t') {
+			pos++;
+			continue;
+		}
+		if (!expectTerm) {
+			if (c != '+' && c != '-') {
+				const_cast<Assembler*>(this)->fail(line, "can't read '" + expression + "'");
+				return false;
+			}
+			sign = c == '-' ? -1 : 1;
+			expectTerm = true;
+			pos++;
+			continue;
+		}
+		int32_t term = 0;
+		size_t start = pos;
+		if (c == '-' && sign == 1 && pos == 0) {
+			sign = -1; // Leading minus
+			pos++;
+			continue;
+		}
+		if (c == '$' || c == '%') {
+			int base = c == '$' ? 16 : 2;
+			pos++;
+			size_t digits = pos;
+			while (pos < text.size() && std::isxdigit(static_cast<unsigned char>(text[pos]))) {
+				pos++;
+			}
+			if (pos == digits) {
+				const_cast<Assembler*>(this)->fail(line, "bad number in '" + expression + "'");
+				return false;
+			}
+			term = static_cast<int32_t>(std::stol(text.substr(digits, pos - digits), nullptr, base));
+		}
+		else if (std::isdigit(static_cast<unsigned char>(c))) {
+			while (pos < text.size() && std::isdigit(static_cast<unsigned char>(text[pos]))) {
+				pos++;
+			}
+			term = static_cast<int32_t>(std::stol(text.substr(start, pos - start)));
+		}
+		else if (isIdentifierStart(c)) {
+			while (pos < text.size() && (std::isalnum(static_cast<unsigned char>(text[pos])) || text[pos] == '_')) {
+				pos++;
+			}
+			std::string name = text.substr(start, pos - start);
+			auto symbol = m_symbols.find(name);
+			if (symbol != m_symbols.end()) {
+				term = symbol->second;
+			}
+			else if (allowUndefined) {
+				if (known) {
+					*known = false;
+				}
+			}
+			else {
+				const_cast<Assembler*>(this)->fail(line, "undefined label '" + name + "'");
+				return false;
+			}
+		}
+		else {
+			const_cast<Assembler*>(this)->fail(line, "can't read '" + expression + "'");
+			return false;
+		}
+		value += sign * term;
+		expectTerm = false;
+	}
+	if (expectTerm) {
+		const_cast<Assembler*>(this)->fail(line, "can't read '" + expression + "'");
+		return false;
+	}
+	if (byteSelect == '<') {
+		value &= 0xFF;
+	}
+	else if (byteSelect == '>') {
+		value = (value >> 8) & 0xFF;
+	}
+	return true;
+}
+
+bool Assembler::parseLine(const std::string& text, int line, Statement& statement) {
+	statement.line = line;
+	std::string rest = trim(text.substr(0, text.find(';')));
+
+	size_t colon = rest.find(':');
+	if (colon != std::string::npos && isIdentifier(trim(rest.substr(0, colon)))) {
+		statement.label = trim(rest.substr(0, colon));
+		rest = trim(rest.substr(colon + 1));
+	}
+	if (rest.empty()) {
+		return true;
+	}
+
+	size_t equals = rest.find('=');
+	if (equals != std::string::npos && isIdentifier(trim(rest.substr(0, equals)))) {
+		statement.directive = "=";
+		statement.label = trim(rest.substr(0, equals)); // A constant rather than an address
+		statement.operand = trim(rest.substr(equals + 1));
+		return true;
+	}
+
+	size_t space = rest.find_first_of(" \t");
+	statement.directive = upper(rest.substr(0, space));
+	statement.operand = space == std::string::npos ? "" : trim(rest.substr(space));
+	if (statement.directive[0] == '.') {
+		return true;
+	}
+	if (!findRow(statement.directive)) {
+		return fail(line, "unknown instruction '" + statement.directive + "'");
+	}
+	statement.isInstruction = true;
+	return true;
+}
+
+bool Assembler::decideMode(Statement& statement) {
+	const std::string& mnemonic = statement.directive;
+	std::string operand = statement.operand;
+	statement.expression = operand;
+
+	auto pick = [&](Mode zeroPage, Mode absolute, const std::string& expression) {
+		int32_t value = 0;
+		bool known = false;
+		if (!evaluate(expression, statement.line, true, value, &known)) {
+			return false;
+		}
+		bool small = known && value >= 0 && value <= 0xFF;
+		statement.mode = small && Opcode(mnemonic, zeroPage) != -1 ? zeroPage : absolute;
+		statement.expression = expression;
+		return true;
+	};
+
+	if (operand.empty() || upper(operand) == "A") {
+		statement.mode = operand.empty() && Opcode(mnemonic, Implied) != -1 ? Implied : Accumulator;
+	}
+	else if (Opcode(mnemonic, Relative) != -1) {
+		statement.mode = Relative;
+	}
+	else if (operand[0] == '#') {
+		statement.mode = Immediate;
+		statement.expression = operand.substr(1);
+	}
+	else if (operand[0] == '(') {
+		std::string inner = operand;
+		if (takeIndex(inner, 'Y') && inner.back() == ')') {
+			statement.mode = IndirectY;
+			statement.expression = inner.substr(1, inner.size() - 2);
+		}
+		else if (inner.back() == ')') {
+			inner = trim(inner.substr(1, inner.size() - 2));
+			if (takeIndex(inner, 'X')) {
+				statement.mode = IndirectX;
+			}
+			else {
+				statement.mode = Indirect;
+			}
+			statement.expression = inner;
+		}
+		else {
+			return fail(statement.line, "can't read '" + operand + "'");
+		}
+	}
+	else if (takeIndex(operand, 'X')) {
+		if (!pick(ZeroPageX, AbsoluteX, operand)) {
+			return false;
+		}
+	}
+	else if (takeIndex(operand, 'Y')) {
+		if (!pick(ZeroPageY, AbsoluteY, operand)) {
+			return false;
+		}
+	}
+	else if (!pick(ZeroPage, Absolute, operand)) {
+		return false;
+	}
+
+	if (Opcode(mnemonic, statement.mode) == -1) {
+		return fail(statement.line, mnemonic + " doesn't take '" + statement.operand + "'");
+	}
+	return true;
+}
+
+int Assembler::sizeOf(const Statement& statement) {
+	if (statement.isInstruction) {
+		switch (statement.mode) {
+		case Implied:
+		case Accumulator:
+			return 1;
+		case Absolute:
+		case AbsoluteX:
+		case AbsoluteY:
+		case Indirect:
+			return 3;
+		default:
+			return 2;
+		}
+	}
+	if (statement.directive == ".BYTE") {
+		return static_cast<int>(splitList(statement.operand).size());
+	}
+	if (statement.directive == ".WORD") {
+		return static_cast<int>(splitList(statement.operand).size()) * 2;
+	}
+	if (statement.directive == ".FILL") {
+		int32_t count = 0;
+		std::vector<std::string> items = splitList(statement.operand);
+		if (items.empty() || !evaluate(items[0], statement.line, false, count)) {
+			return -1;
+		}
+		return count;
+	}
+	return 0;
+}
+
+void Assembler::put(uint16_t address, uint8_t value) {
+	size_t index = static_cast<size_t>(address - 0x8000);
+	if (index < m_prg.size()) {
+		m_prg[index] = value;
+	}
+}
+
+bool Assembler::emit(const Statement& statement) {
+	int line = statement.line;
+	uint16_t address = statement.address;
+	if (statement.isInstruction) {
+		put(address, static_cast<uint8_t>(Opcode(statement.directive, statement.mode)));
+		if (statement.mode == Implied || statement.mode == Accumulator) {
+			return true;
+		}
+		int32_t value = 0;
+		if (!evaluate(statement.expression, line, false, value)) {
+			return false;
+		}
+		switch (statement.mode) {
+		case Relative: {
+			int32_t offset = value - (address + 2);
+			if (offset < -128 || offset > 127) {
+				return fail(line, "branch is " + std::to_string(offset) + " bytes away, out of reach");
+			}
+			put(address + 1, static_cast<uint8_t>(offset));
+			return true;
+		}
+		case Immediate:
+			if (value < -128 || value > 0xFF) {
+				return fail(line, "immediate value " + std::to_string(value) + " doesn't fit in a byte");
+			}
+			put(address + 1, static_cast<uint8_t>(value));
+			return true;
+		case Absolute:
+		case AbsoluteX:
+		case AbsoluteY:
+		case Indirect:
+			if (value < 0 || value > 0xFFFF) {
+				return fail(line, "address " + std::to_string(value) + " is out of range");
+			}
+			put(address + 1, static_cast<uint8_t>(value & 0xFF));
+			put(address + 2, static_cast<uint8_t>(value >> 8));
+			return true;
+		default:
+			if (value < 0 || value > 0xFF) {
+				return fail(line, "zero page address " + std::to_string(value) + " is out of range");
+			}
+			put(address + 1, static_cast<uint8_t>(value));
+			return true;
+		}
+	}
+
+	std::vector<std::string> items = splitList(statement.operand);
+	if (statement.directive == ".BYTE" || statement.directive == ".WORD") {
+		bool word = statement.directive == ".WORD";
+		for (const std::string& item : items) {
+			int32_t value = 0;
+			if (!evaluate(item, line, false, value)) {
+				return false;
+			}
+			if (value < (word ? -32768 : -128) || value > (word ? 0xFFFF : 0xFF)) {
+				return fail(line, "'" + item + "' doesn't fit");
+			}
+			put(address++, static_cast<uint8_t>(value & 0xFF));
+			if (word) {
+				put(address++, static_cast<uint8_t>((value >> 8) & 0xFF));
+			}
+		}
+	}
+	else if (statement.directive == ".FILL") {
+		int32_t value = 0;
+		if (items.size() > 1 && !evaluate(items[1], line, false, value)) {
+			return false;
+		}
+		for (int i = 0; i < statement.size; ++i) {
+			put(address++, static_cast<uint8_t>(value));
+		}
+	}
+	return true;
+}
+
+bool Assembler::assemble(const std::string& source) {
+	m_symbols.clear();
+	m_prg.clear();
+	m_large = false;
+	m_error.clear();
+
+	std::vector<Statement> statements;
+	std::stringstream lines(source);
+	std::string text;
+	for (int line = 1; std::getline(lines, text); ++line) {
+		Statement statement;
+		if (!parseLine(text, line, statement)) {
+			return false;
+		}
+		statements.push_back(statement);
+	}
+
+	// Pass 1: addresses of every label, sizes of every statement
+	int32_t address = 0x8000;
+	for (Statement& statement : statements) {
+		if (statement.directive == "=") {
+			int32_t value = 0;
+			if (!evaluate(statement.operand, statement.line, false, value)) {
+				return false;
+			}
+			if (!m_symbols.emplace(statement.label, value).second) {
+				return fail(statement.line, "'" + statement.label + "' is already defined");
+			}
+			continue;
+		}
+		if (!statement.label.empty() && !m_symbols.emplace(statement.label, address).second) {
+			return fail(statement.line, "'" + statement.label + "' is already defined");
+		}
+		if (statement.directive == ".ORG") {
+			if (!evaluate(statement.operand, statement.line, false, address)) {
+				return false;
+			}
+			continue;
+		}
+		if (statement.directive.empty()) {
+			continue;
+		}
+		if (statement.directive[0] == '.' && statement.directive != ".BYTE" && statement.directive != ".WORD" && statement.directive != ".FILL") {
+			return fail(statement.line, "unknown directive '" + statement.directive + "'");
+		}
+		if (statement.isInstruction && !decideMode(statement)) {
+			return false;
+		}
+		statement.address = static_cast<uint16_t>(address);
+		statement.size = sizeOf(statement);
+		if (statement.size < 0) {
+			return false;
+		}
+		if (address < 0x8000 || address + statement.size > 0xFFFA) {
+			return fail(statement.line, "outside $8000-$FFF9, the vectors take the last six bytes");
+		}
+		m_large = m_large || address + statement.size > 0xC000;
+		address += statement.size;
+	}
+	// A 16 KB image shows up at $C000 too, so its vectors sit at $BFFA
+	if (!m_large) {
+		for (const Statement& statement : statements) {
+			if (statement.size > 0 && statement.address + statement.size > 0xBFFA) {
+				return fail(statement.line, "runs into the vectors at $BFFA, move it to $C000 or above for a 32 KB image");
+			}
+		}
+	}
+
+	// Pass 2: the bytes
+	m_prg.assign(m_large ? 0x8000 : 0x4000, 0x00);
+	for (const Statement& statement : statements) {
+		if (statement.size > 0 && !emit(statement)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+std::vector<uint8_t> Assembler::rom(const std::vector<uint8_t>& chr) const {
+	std::vector<uint8_t> image = { 'N', 'E', 'S', 0x1A, static_cast<uint8_t>(m_large ? 2 : 1), 1 };
+	image.resize(16, 0x00);
+	image.insert(image.end(), m_prg.begin(), m_prg.end());
+
+	auto vector = [this](const char* name, uint16_t fallback) {
+		return m_symbols.count(name) ? label(name) : fallback;
+	};
+	size_t vectors = image.size() - 6;
+	uint16_t addresses[3] = { vector("nmi", 0x0000), vector("reset", 0x8000), vector("irq", 0x0000) };
+	for (int i = 0; i < 3; ++i) {
+		image[vectors + i * 2] = addresses[i] & 0xFF;
+		image[vectors + i * 2 + 1] = addresses[i] >> 8;
+	}
+
+	size_t chrStart = image.size();
+	image.resize(chrStart + 0x2000, 0x00);
+	for (size_t i = 0; i < 0x2000; ++i) {
+		image[chrStart + i] = chr.empty() ? static_cast<uint8_t>(i * 7) : i < chr.size() ? chr[i] : 0x00;
+	}
+	return image;
+}
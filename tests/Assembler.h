@@ -0,0 +1,87 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Two-pass 6502 assembler that turns source text into an NROM image.
+ *
+ * Covers every official opcode and addressing mode, which is all the
+ * synthetic test and benchmark ROMs need:
+ *
+ *     LDA #$10        immediate             ASL A / ASL     accumulator
+ *     LDA $10         zero page             LDA $10,X       zero page,X (,Y for LDX/STX)
+ *     LDA $1234       absolute              LDA $1234,X     absolute,X / ,Y
+ *     JMP ($1234)     indirect              LDA ($10,X)     indexed indirect
+ *     LDA ($10),Y     indirect indexed      BNE loop        relative
+ *
+ * Numbers are decimal, $hex or %binary. Operands can add or subtract
+ * numbers and labels, and <expr / >expr take the low / high byte.
+ * "name:" defines a label at the current address, "name = expr" a
+ * constant. A value known to fit in a byte when it's first seen (a number
+ * or a constant defined above) picks zero page; anything else is absolute.
+ * ';' starts a comment.
+ *
+ * Directives: .org addr, .byte list, .word list, .fill count[, value].
+ *
+ * The image has 16 KB of PRG at $8000 (mirrored at $C000) unless code or
+ * data is placed at $C000 or above, which makes it 32 KB. The NMI, reset
+ * and IRQ vectors point at the labels nmi, reset and irq if they exist;
+ * reset defaults to $8000 and the other two to $0000.
+ */
+class Assembler
+{
+public:
+	// Assembles source, false (with the first error in error()) if it doesn't
+	bool assemble(const std::string& source);
+
+	const std::string& error() const { return m_error; }
+	uint16_t label(const std::string& name) const; // 0 if not defined
+
+	// Assembled bytes of $8000-$FFFF (only as much as the image holds)
+	const std::vector<uint8_t>& prg() const { return m_prg; }
+
+	/**
+	 * @brief The iNES file: header, PRG with vectors and 8 KB of CHR.
+	 *
+	 * @param chr Pattern data for CHR ROM, padded or cut to 8 KB. Empty
+	 *            fills it with a fixed non-zero pattern, so tiles aren't blank.
+	 */
+	std::vector<uint8_t> rom(const std::vector<uint8_t>& chr = {}) const;
+
+private:
+	enum Mode { Implied, Accumulator, Immediate, ZeroPage, ZeroPageX, ZeroPageY, Absolute, AbsoluteX,
+		AbsoluteY, Indirect, IndirectX, IndirectY, Relative, ModeCount };
+
+	struct Statement {
+		int line = 0;
+		uint16_t address = 0;
+		std::string label;       // Defined here, before anything else on the line
+		std::string directive;   // ".byte", ... or a mnemonic (upper case)
+		std::string operand;     // Raw text after it
+		std::string expression;  // The operand with the addressing mode's syntax taken off
+		Mode mode = Implied;
+		bool isInstruction = false;
+		int size = 0;
+	};
+
+	bool parseLine(const std::string& text, int line, Statement& statement);
+	bool decideMode(Statement& statement);
+	int sizeOf(const Statement& statement);
+	bool emit(const Statement& statement);
+	bool evaluate(const std::string& expression, int line, bool allowUndefined, int32_t& value, bool* known = nullptr) const;
+	bool fail(int line, const std::string& message);
+	void put(uint16_t address, uint8_t value);
+
+	static int Opcode(const std::string& mnemonic, Mode mode); // -1 if the pair doesn't exist
+
+	std::map<std::string, int32_t> m_symbols;
+	std::vector<uint8_t> m_prg;
+	bool m_large = false;  // 32 KB of PRG
+	std::string m_error;
+};
+
+#endif // ASSEMBLER_H
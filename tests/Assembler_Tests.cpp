@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+#include <Emulator.h>
+#include "Assembler.h"
+#include "TestRom.h"
+#include "Workloads.h"
+
+namespace AssemblerTests {
+	std::vector<uint8_t> assemble(const std::string& source) {
+		Assembler assembler;
+		EXPECT_TRUE(assembler.assemble(source)) << assembler.error();
+		std::vector<uint8_t> prg = assembler.prg();
+		// Just the code, without the zero padding up to the vectors
+		while (!prg.empty() && prg.back() == 0x00) {
+			prg.pop_back();
+		}
+		return prg;
+	}
+
+	std::string errorOf(const std::string& source) {
+		Assembler assembler;
+		EXPECT_FALSE(assembler.assemble(source));
+		return assembler.error();
+	}
+
+	TEST(AssemblerTest, EncodesEveryAddressingMode) {
+		EXPECT_EQ(assemble("NOP"), std::vector<uint8_t>({ 0xEA }));
+		EXPECT_EQ(assemble("ASL A\nLSR"), std::vector<uint8_t>({ 0x0A, 0x4A }));
+		EXPECT_EQ(assemble("LDA #$10"), std::vector<uint8_t>({ 0xA9, 0x10 }));
+		EXPECT_EQ(assemble("LDA $10"), std::vector<uint8_t>({ 0xA5, 0x10 }));
+		EXPECT_EQ(assemble("LDA $10,X"), std::vector<uint8_t>({ 0xB5, 0x10 }));
+		EXPECT_EQ(assemble("LDX $10,Y"), std::vector<uint8_t>({ 0xB6, 0x10 }));
+		EXPECT_EQ(assemble("LDA $1234"), std::vector<uint8_t>({ 0xAD, 0x34, 0x12 }));
+		EXPECT_EQ(assemble("LDA $1234,X"), std::vector<uint8_t>({ 0xBD, 0x34, 0x12 }));
+		EXPECT_EQ(assemble("LDA $1234, y"), std::vector<uint8_t>({ 0xB9, 0x34, 0x12 }));
+		EXPECT_EQ(assemble("JMP ($1234)"), std::vector<uint8_t>({ 0x6C, 0x34, 0x12 }));
+		EXPECT_EQ(assemble("LDA ($10,X)"), std::vector<uint8_t>({ 0xA1, 0x10 }));
+		EXPECT_EQ(assemble("lda ($10),y"), std::vector<uint8_t>({ 0xB1, 0x10 }));
+		EXPECT_EQ(assemble("loop: BNE loop"), std::vector<uint8_t>({ 0xD0, 0xFE }));
+	}
+
+	TEST(AssemblerTest, FallsBackToAbsoluteWhenZeroPageDoesNotExist) {
+		// LDA has no zero page,Y and JMP no zero page at all (the NOPs keep the high bytes from being trimmed)
+		EXPECT_EQ(assemble("LDA $10,Y\nNOP"), std::vector<uint8_t>({ 0xB9, 0x10, 0x00, 0xEA }));
+		EXPECT_EQ(assemble("JMP $10\nNOP"), std::vector<uint8_t>({ 0x4C, 0x10, 0x00, 0xEA }));
+		EXPECT_EQ(assemble("STA $0300"), std::vector<uint8_t>({ 0x8D, 0x00, 0x03 }));
+	}
+
+	TEST(AssemblerTest, ResolvesLabelsConstantsAndExpressions) {
+		std::vector<uint8_t> prg = assemble(R"(
+counter = $10       ; a zero page constant
+table = $0300
+start:
+    LDA #<table
+    LDX #>table+1
+    STA counter
+    JMP forward
+    .byte 1, $02, %11
+forward:
+    BNE start
+    .word forward, table-1
+)");
+		EXPECT_EQ(prg, std::vector<uint8_t>({
+			0xA9, 0x00,             // LDA #<table
+			0xA2, 0x03,             // LDX #>table+1, the high byte of the whole expression
+			0x85, 0x10,             // STA counter picks zero page
+			0x4C, 0x0C, 0x80,       // JMP forward, defined below
+			0x01, 0x02, 0x03,       // .byte
+			0xD0, 0xF2,             // BNE start, 14 bytes back
+			0x0C, 0x80, 0xFF, 0x02, // .word
+		}));
+	}
+
+	TEST(AssemblerTest, PlacesCodeAndVectors) {
+		Assembler assembler;
+		ASSERT_TRUE(assembler.assemble(R"(
+reset:
+    JMP reset
+nmi:
+    RTI
+    .org $9000
+irq:
+    .fill 3, $EA
+)")) << assembler.error();
+		EXPECT_EQ(assembler.label("nmi"), 0x8003);
+		EXPECT_EQ(assembler.label("irq"), 0x9000);
+		ASSERT_EQ(assembler.prg().size(), 0x4000u);
+		EXPECT_EQ(assembler.prg()[0x1002], 0xEA);
+
+		std::vector<uint8_t> rom = assembler.rom();
+		ASSERT_EQ(rom.size(), 16u + 0x4000 + 0x2000);
+		EXPECT_TRUE(Emulator::IsNesRom(rom));
+		EXPECT_EQ(rom[4], 1);
+		const uint8_t* vectors = &rom[16 + 0x3FFA];
+		EXPECT_EQ(vectors[0] | (vectors[1] << 8), 0x8003);
+		EXPECT_EQ(vectors[2] | (vectors[3] << 8), 0x8000);
+		EXPECT_EQ(vectors[4] | (vectors[5] << 8), 0x9000);
+
+		// Code at $C000 and above needs the 32 KB layout
+		ASSERT_TRUE(assembler.assemble(".org $C000\nreset: JMP reset")) << assembler.error();
+		rom = assembler.rom();
+		EXPECT_EQ(rom[4], 2);
+		EXPECT_EQ(rom[16 + 0x4000], 0x4C);
+		EXPECT_EQ(rom[16 + 0x7FFC] | (rom[16 + 0x7FFD] << 8), 0xC000);
+	}
+
+	TEST(AssemblerTest, ReportsErrorsWithTheLine) {
+		EXPECT_EQ(errorOf("NOP\nFOO $10"), "line 2: unknown instruction 'FOO'");
+		EXPECT_EQ(errorOf("JMP nowhere"), "line 1: undefined label 'nowhere'");
+		EXPECT_EQ(errorOf("STA #$10"), "line 1: STA doesn't take '#$10'");
+		EXPECT_EQ(errorOf("LDA #$100"), "line 1: immediate value 256 doesn't fit in a byte");
+		EXPECT_EQ(errorOf("a: NOP\na: NOP"), "line 2: 'a' is already defined");
+		EXPECT_EQ(errorOf("start:\n.fill 200\nBNE start"), "line 3: branch is -202 bytes away, out of reach");
+		EXPECT_EQ(errorOf(".org $BFF9\nJMP $8000"), "line 2: runs into the vectors at $BFFA, move it to $C000 or above for a 32 KB image");
+		EXPECT_EQ(errorOf(".bank 2"), "line 1: unknown directive '.BANK'");
+	}
+
+	TEST(AssemblerTest, AluLoopComputesTheSameAsTheModel) {
+		uint8_t sum = 0, sumHigh = 0, checksum = 0;
+		for (int round = 0; round < 256; ++round) {
+			int total = sum + 3;
+			sum = static_cast<uint8_t>(total);
+			sumHigh = static_cast<uint8_t>(sumHigh + (total >> 8));
+			checksum = static_cast<uint8_t>((((sum ^ checksum) & 0x7F) | 0x01) << 1);
+			checksum = static_cast<uint8_t>(checksum - 3);
+		}
+
+		auto emulator = std::make_unique<Emulator>();
+		ASSERT_TRUE(emulator->loadRom(Workloads::Build(Workloads::aluLoop)));
+		for (int frame = 0; frame < 5; ++frame) {
+			emulator->runFrame(false);
+		}
+		const auto& ram = emulator->bus().memory;
+		ASSERT_GT(ram[0x23], 0);
+		EXPECT_EQ(ram[0x20], sum);
+		EXPECT_EQ(ram[0x21], sumHigh);
+		EXPECT_EQ(ram[0x22], checksum);
+	}
+
+	TEST(AssemblerTest, MemcpyLoopCopiesThePage) {
+		auto emulator = std::make_unique<Emulator>();
+		ASSERT_TRUE(emulator->loadRom(Workloads::Build(Workloads::memcpyLoop)));
+		emulator->runFrame(false);
+		emulator->runFrame(false);
+		const auto& ram = emulator->bus().memory;
+		ASSERT_GT(ram[0x10], 0);
+		for (int i = 0; i < 256; ++i) {
+			ASSERT_EQ(ram[0x0300 + i], i ^ 0xA5) << i;
+			ASSERT_EQ(ram[0x0400 + i], i ^ 0xA5) << i;
+		}
+	}
+
+	TEST(AssemblerTest, NmiWorkloadsRunOncePerFrame) {
+		for (const char* source : { Workloads::spriteScene, Workloads::scrollScene, Workloads::nmiFrameLoop }) {
+			auto emulator = std::make_unique<Emulator>();
+			ASSERT_TRUE(emulator->loadRom(Workloads::Build(source)));
+			for (int frame = 0; frame < 20; ++frame) {
+				emulator->runFrame(false);
+			}
+			int nmis = emulator->bus().memory[0x10];
+			EXPECT_GE(nmis, 19);
+			EXPECT_LE(nmis, 20);
+		}
+
+		auto emulator = std::make_unique<Emulator>();
+		ASSERT_TRUE(emulator->loadRom(Workloads::Build(Workloads::nmiFrameLoop)));
+		for (int frame = 0; frame < 20; ++frame) {
+			emulator->runFrame(false);
+		}
+		// The main loop keeps up with the NMIs, finishing one frame of work for each
+		EXPECT_LE(emulator->bus().memory[0x10] - emulator->bus().memory[0x11], 1);
+	}
+
+	TEST(AssemblerTest, MatchesTheHandAssembledTestRom) {
+		Assembler assembler;
+		ASSERT_TRUE(assembler.assemble(R"(
+reset:
+    LDA #$80
+    STA $2000
+nmi:
+    INX
+    STX $10
+    STX $2000
+    JMP nmi
+)")) << assembler.error();
+		std::vector<uint8_t> rom = assembler.rom();
+		std::vector<uint8_t> expected = TestRom::Make();
+		EXPECT_EQ(rom, expected);
+	}
+}
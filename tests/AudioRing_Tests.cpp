@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+#include <AudioRing.h>
+#include <AudioOutput.h>
+#include <algorithm>
+#include <thread>
+
+namespace AudioRingTests {
+	TEST(AudioRingTest, CapacityIsPowerOfTwo) {
+		AudioRing ring(1000);
+		ASSERT_EQ(ring.capacity(), 1024u);
+		ASSERT_EQ(ring.size(), 0u);
+	}
+
+	TEST(AudioRingTest, WriteThenRead) {
+		AudioRing ring(8);
+		float in[5] = { 1, 2, 3, 4, 5 };
+		ASSERT_EQ(ring.write(in, 5), 5u);
+		ASSERT_EQ(ring.size(), 5u);
+		float out[5] = {};
+		ASSERT_EQ(ring.read(out, 5), 5u);
+		for (int i = 0; i < 5; ++i) {
+			ASSERT_EQ(out[i], in[i]);
+		}
+		ASSERT_EQ(ring.size(), 0u);
+	}
+
+	TEST(AudioRingTest, WrapsAround) {
+		AudioRing ring(8);
+		float in[6] = { 1, 2, 3, 4, 5, 6 };
+		float out[6] = {};
+		ring.write(in, 6);
+		ring.read(out, 6);
+		// Starts at index 6, so this write wraps
+		ASSERT_EQ(ring.write(in, 6), 6u);
+		ASSERT_EQ(ring.read(out, 6), 6u);
+		for (int i = 0; i < 6; ++i) {
+			ASSERT_EQ(out[i], in[i]);
+		}
+	}
+
+	TEST(AudioRingTest, FullRingTakesWhatFits) {
+		AudioRing ring(4);
+		float in[6] = { 1, 2, 3, 4, 5, 6 };
+		ASSERT_EQ(ring.write(in, 6), 4u);
+		ASSERT_EQ(ring.write(in, 1), 0u);
+		float out[6] = {};
+		ASSERT_EQ(ring.read(out, 6), 4u);
+		ASSERT_EQ(out[3], 4.0f);
+	}
+
+	TEST(AudioRingTest, ProducerAndConsumerThreads) {
+		AudioRing ring(256);
+		const int total = 200000;
+		std::thread producer([&ring, total] {
+			float block[37];
+			int next = 0;
+			while (next < total) {
+				int count = std::min(37, total - next);
+				for (int i = 0; i < count; ++i) {
+					block[i] = static_cast<float>(next + i);
+				}
+				size_t written = ring.write(block, count);
+				next += static_cast<int>(written);
+				if (written == 0) {
+					std::this_thread::yield();
+				}
+			}
+		});
+
+		// Every sample arrives exactly once and in order
+		float block[53];
+		int expected = 0;
+		bool inOrder = true;
+		while (expected < total) {
+			size_t got = ring.read(block, 53);
+			for (size_t i = 0; i < got; ++i) {
+				inOrder = inOrder && block[i] == static_cast<float>(expected);
+				expected++;
+			}
+			if (got == 0) {
+				std::this_thread::yield();
+			}
+		}
+		producer.join();
+		ASSERT_TRUE(inOrder);
+		ASSERT_EQ(ring.size(), 0u);
+	}
+
+	TEST(RateControlTest, OnTargetKeepsRate) {
+		ASSERT_DOUBLE_EQ(AudioOutput::AdjustRate(44100.0, 1000, 1000, 0.005), 44100.0);
+	}
+
+	TEST(RateControlTest, StaysWithinLimit) {
+		ASSERT_DOUBLE_EQ(AudioOutput::AdjustRate(44100.0, 0, 1000, 0.005), 44100.0 * 1.005);
+		ASSERT_DOUBLE_EQ(AudioOutput::AdjustRate(44100.0, 5000, 1000, 0.005), 44100.0 * 0.995);
+		ASSERT_LT(AudioOutput::AdjustRate(44100.0, 1200, 1000, 0.005), 44100.0);
+	}
+
+	// A 60 Hz display paces the emulator while the card plays 44100 samples a second.
+	// The NES makes 44100 / 60.0988 samples per frame, a little short of the 735 played.
+	TEST(RateControlTest, HoldsRingLevelAgainstClockMismatch) {
+		const double nesFrameRate = 60.0988;
+		const size_t target = 1247;
+		for (bool control : { false, true }) {
+			size_t buffered = target;
+			double fraction = 0.0;
+			size_t lowest = buffered;
+			for (int frame = 0; frame < 60 * 60; ++frame) {
+				double rate = control ? AudioOutput::AdjustRate(44100.0, buffered, target, 0.005) : 44100.0;
+				fraction += rate / nesFrameRate;
+				size_t produced = static_cast<size_t>(fraction);
+				fraction -= produced;
+				buffered += produced;
+				buffered -= std::min<size_t>(buffered, 735);
+				lowest = std::min(lowest, buffered);
+			}
+			if (control) {
+				ASSERT_GT(lowest, target / 2); // Settles where the extra 0.16% is made up, about a third under target
+			}
+			else {
+				ASSERT_EQ(lowest, 0u); // Drains within the minute and starts crackling
+			}
+		}
+	}
+}
@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+#include <AudioWriter.h>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace AudioWriterTests {
+	std::vector<uint8_t> readFile(const std::filesystem::path& path) {
+		std::ifstream file(path, std::ios::binary);
+		return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+	uint32_t get32(const std::vector<uint8_t>& data, size_t offset) {
+		return data[offset] | (data[offset + 1] << 8) | (data[offset + 2] << 16) | (static_cast<uint32_t>(data[offset + 3]) << 24);
+	}
+
+	uint16_t get16(const std::vector<uint8_t>& data, size_t offset) {
+		return static_cast<uint16_t>(data[offset] | (data[offset + 1] << 8));
+	}
+
+	float getFloat(const std::vector<uint8_t>& data, size_t offset) {
+		uint32_t bits = get32(data, offset);
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	// Frame-sized pushes of a ramp, enough to cross several block handovers
+	std::vector<float> pushRamp(AudioWriter& writer, size_t total) {
+		std::vector<float> all;
+		std::vector<float> frame;
+		while (all.size() < total) {
+			frame.clear();
+			for (size_t i = 0; i < 735 && all.size() < total; ++i) {
+				frame.push_back(static_cast<float>(all.size()) / 65536.0f);
+				all.push_back(frame.back());
+			}
+			writer.push(frame);
+		}
+		return all;
+	}
+
+	TEST(AudioWriterTest, WavHeaderAndSamples) {
+		auto path = std::filesystem::temp_directory_path() / "nes_audio_writer_test.wav";
+		AudioWriter writer;
+		ASSERT_TRUE(writer.open(path.string(), 44100, AudioWriter::Format::Wav));
+		std::vector<float> expected = pushRamp(writer, AudioWriter::blockSamples * 3 + 123);
+		ASSERT_EQ(writer.samplesPushed(), expected.size());
+		ASSERT_TRUE(writer.close());
+		ASSERT_FALSE(writer.isOpen());
+
+		std::vector<uint8_t> data = readFile(path);
+		const size_t header = 58;
+		ASSERT_EQ(data.size(), header + expected.size() * 4);
+		ASSERT_EQ(std::memcmp(data.data(), "RIFF", 4), 0);
+		ASSERT_EQ(get32(data, 4), data.size() - 8);
+		ASSERT_EQ(std::memcmp(data.data() + 8, "WAVE", 4), 0);
+		ASSERT_EQ(std::memcmp(data.data() + 12, "fmt ", 4), 0);
+		ASSERT_EQ(get16(data, 20), 3); // IEEE float
+		ASSERT_EQ(get16(data, 22), 1);
+		ASSERT_EQ(get32(data, 24), 44100u);
+		ASSERT_EQ(get32(data, 28), 44100u * 4);
+		ASSERT_EQ(get16(data, 34), 32);
+		ASSERT_EQ(std::memcmp(data.data() + 38, "fact", 4), 0);
+		ASSERT_EQ(get32(data, 46), expected.size());
+		ASSERT_EQ(std::memcmp(data.data() + 50, "data", 4), 0);
+		ASSERT_EQ(get32(data, 54), expected.size() * 4);
+		for (size_t i = 0; i < expected.size(); ++i) {
+			ASSERT_EQ(getFloat(data, header + i * 4), expected[i]) << "sample " << i;
+		}
+		std::filesystem::remove(path);
+	}
+
+	TEST(AudioWriterTest, RawFloatHasNoHeader) {
+		auto path = std::filesystem::temp_directory_path() / "nes_audio_writer_test.f32";
+		std::vector<float> expected;
+		{
+			AudioWriter writer;
+			ASSERT_TRUE(writer.open(path.string(), 48000, AudioWriter::Format::RawFloat));
+			expected = pushRamp(writer, AudioWriter::blockSamples + 1000);
+			// The destructor finishes the file
+		}
+		std::vector<uint8_t> data = readFile(path);
+		ASSERT_EQ(data.size(), expected.size() * 4);
+		for (size_t i = 0; i < expected.size(); ++i) {
+			ASSERT_EQ(getFloat(data, i * 4), expected[i]) << "sample " << i;
+		}
+		std::filesystem::remove(path);
+	}
+
+	TEST(AudioWriterTest, FormatFromName) {
+		ASSERT_EQ(AudioWriter::FormatFor("capture.wav"), AudioWriter::Format::Wav);
+		ASSERT_EQ(AudioWriter::FormatFor("CAPTURE.WAV"), AudioWriter::Format::Wav);
+		ASSERT_EQ(AudioWriter::FormatFor("capture.raw"), AudioWriter::Format::RawFloat);
+		ASSERT_EQ(AudioWriter::FormatFor("wav"), AudioWriter::Format::RawFloat);
+	}
+
+	TEST(AudioWriterTest, OpenFailsForMissingDirectory) {
+		AudioWriter writer;
+		auto path = std::filesystem::temp_directory_path() / "nes_no_such_dir" / "out.wav";
+		ASSERT_FALSE(writer.open(path.string(), 44100, AudioWriter::Format::Wav));
+		ASSERT_FALSE(writer.isOpen());
+		writer.push(std::vector<float>(10, 0.5f)); // Ignored while closed
+		ASSERT_EQ(writer.samplesPushed(), 0u);
+	}
+}
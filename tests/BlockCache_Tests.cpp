@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+#include <Emulator.h>
+#include <random>
+#include "Assembler.h"
+#include "Lockstep.h"
+#include "TestRom.h"
+#include "Workloads.h"
+
+namespace BlockCacheTests {
+	std::unique_ptr<Emulator> load(const std::vector<uint8_t>& rom, bool cached) {
+		return Lockstep::Load(rom, &Emulator::setBlockCache, cached);
+	}
+
+	// Puts both machines in the same random state, with registers pointing somewhere interesting
+	void randomize(Emulator& a, Emulator& b, std::mt19937& random) {
+		for (uint32_t address = 0; address < 0x0800; ++address) {
+			uint8_t value = static_cast<uint8_t>(random());
+			a.bus().memory[address] = value;
+			b.bus().memory[address] = value;
+		}
+		CPU* cpus[] = { &a.cpu(), &b.cpu() };
+		uint8_t accumulator = static_cast<uint8_t>(random());
+		uint8_t x = static_cast<uint8_t>(random());
+		uint8_t y = static_cast<uint8_t>(random());
+		uint8_t status = static_cast<uint8_t>(random()) & ~0x04; // I clear, so BRK and RTI paths vary
+		for (CPU* cpu : cpus) {
+			cpu->accumulator = accumulator;
+			cpu->x = x;
+			cpu->y = y;
+			cpu->status = status;
+			cpu->program_counter = 0x8000;
+			for (int i = 0; i < 3; ++i) {
+				cpu->setStackBackTESTING(static_cast<uint8_t>(0x80 + i)); // Something for RTS and RTI to pull
+			}
+		}
+	}
+
+	TEST(BlockCacheTest, EveryOpcodeMatchesTheInterpreter) {
+		std::mt19937 random(2024);
+		for (int opcode = 0; opcode < 256; ++opcode) {
+			for (int round = 0; round < 8; ++round) {
+				std::vector<uint8_t> code = { static_cast<uint8_t>(opcode), static_cast<uint8_t>(random()), static_cast<uint8_t>(random()) };
+				if (round % 2) {
+					code[2] = static_cast<uint8_t>(random() & 0x07); // Absolute operands in RAM, not just anywhere
+				}
+				std::vector<uint8_t> rom = TestRom::Make(code, 0x8000, 0, 0x8000);
+				auto cached = load(rom, true);
+				auto interpreted = load(rom, false);
+				randomize(*cached, *interpreted, random);
+
+				int cachedCycles = cached->cpu().execute();
+				int interpretedCycles = interpreted->cpu().execute();
+				ASSERT_EQ(cachedCycles, interpretedCycles) << "opcode " << opcode;
+				ASSERT_EQ(cached->cpu().program_counter, interpreted->cpu().program_counter) << "opcode " << opcode;
+				ASSERT_EQ(cached->saveState(), interpreted->saveState()) << "opcode " << opcode;
+			}
+		}
+	}
+
+	TEST(BlockCacheTest, WorkloadsRunTheSameCachedAndInterpreted) {
+		for (const char* source : { Workloads::aluLoop, Workloads::memcpyLoop, Workloads::spriteScene, Workloads::nmiFrameLoop }) {
+			std::vector<uint8_t> rom = Workloads::Build(source);
+			auto cached = load(rom, true);
+			auto interpreted = load(rom, false);
+			ASSERT_NO_FATAL_FAILURE(Lockstep::ExpectSame(*cached, *interpreted, 30));
+			EXPECT_GT(cached->blockCache().blockCount(), 0u);
+			EXPECT_EQ(interpreted->blockCache().blockCount(), 0u);
+		}
+	}
+
+	TEST(BlockCacheTest, CodeInRamIsAlwaysInterpreted) {
+		// Copies "LDA #n / RTS" to $0300, calls it, then rewrites the immediate and calls it again
+		Assembler assembler;
+		ASSERT_TRUE(assembler.assemble(R"(
+routine = $0300
+reset:
+    LDA #$A9        ; LDA #
+    STA routine
+    LDA #1
+    STA routine+1
+    LDA #$60        ; RTS
+    STA routine+2
+    JSR routine
+    STA $10
+    LDA #2
+    STA routine+1
+    JSR routine
+    STA $11
+done:
+    JMP done
+)")) << assembler.error();
+		auto emulator = load(assembler.rom(), true);
+		emulator->runFrame();
+		EXPECT_EQ(emulator->bus().memory[0x10], 1);
+		EXPECT_EQ(emulator->bus().memory[0x11], 2);
+	}
+
+	TEST(BlockCacheTest, InvalidatingABankDropsItsBlocks) {
+		std::vector<uint8_t> rom = Workloads::Build(Workloads::aluLoop);
+		auto emulator = load(rom, true);
+		auto interpreted = load(rom, false);
+		emulator->runFrame();
+		interpreted->runFrame();
+		BlockCache& cache = *emulator->cpu().GetBlockCache();
+		size_t blocks = cache.blockCount();
+		ASSERT_GT(blocks, 0u);
+		EXPECT_GT(cache.instructionCount(), blocks);
+
+		cache.invalidateBank(1); // Nothing is mapped from bank 1
+		EXPECT_EQ(cache.blockCount(), blocks);
+		cache.invalidateBank(BlockCache::BankOf(0x8000));
+		EXPECT_EQ(cache.blockCount(), 0u);
+
+		// Decoded again as the code runs on
+		emulator->runFrame();
+		interpreted->runFrame();
+		EXPECT_GT(cache.blockCount(), 0u);
+		EXPECT_EQ(emulator->saveState(), interpreted->saveState());
+	}
+}
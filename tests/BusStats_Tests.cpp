@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+#include <BusStats.h>
+#include <Emulator.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include "Assembler.h"
+
+namespace BusStatsTests {
+	TEST(BusStatsTest, CountsPagesAndFoldsRegisterMirrors) {
+		BusStats stats;
+		stats.read(0x0010);
+		stats.read(0x0011);
+		stats.write(0x0300);
+		stats.read(0x2002);
+		stats.read(0x3FFA); // Mirror of $2002
+		stats.write(0x4014);
+		stats.read(0x8000);
+
+		EXPECT_EQ(stats.pageReads(0x00), 2u);
+		EXPECT_EQ(stats.pageWrites(0x03), 1u);
+		EXPECT_EQ(stats.pageReads(0x3F), 1u);
+		EXPECT_EQ(stats.registerReads(2), 2u);
+		EXPECT_EQ(stats.registerWrites(BusStats::ppuRegisters + 0x14), 1u);
+		EXPECT_EQ(BusStats::RegisterName(2), "PPUSTATUS ($2002)");
+		EXPECT_EQ(BusStats::RegisterName(BusStats::ppuRegisters + 0x16), "JOY1 ($4016)");
+
+		std::ostringstream report;
+		stats.report(report);
+		EXPECT_NE(report.str().find("PPUSTATUS ($2002)"), std::string::npos);
+		EXPECT_NE(report.str().find("$8000-$80FF"), std::string::npos);
+
+		stats.resetEachFrame = false;
+		stats.frameStart();
+		EXPECT_EQ(stats.pageReads(0x00), 2u);
+		stats.resetEachFrame = true;
+		stats.frameStart();
+		EXPECT_EQ(stats.pageReads(0x00), 0u);
+		EXPECT_EQ(stats.registerReads(2), 0u);
+	}
+
+	TEST(BusStatsTest, HeatmapShadesReadsAndWrites) {
+		BusStats stats;
+		for (int i = 0; i < 1000; ++i) {
+			stats.read(0x2002);
+		}
+		stats.write(0x0000);
+
+		std::vector<uint32_t> pixels = stats.heatmap();
+		ASSERT_EQ(pixels.size(), static_cast<size_t>(BusStats::heatmapWidth * BusStats::heatmapHeight));
+		auto cell = [&](int page) { return pixels[((page / 16) * 16 + 8) * BusStats::heatmapWidth + (page % 16) * 16 + 8]; };
+		EXPECT_EQ(cell(0x20), 0x0000FF00u);        // Busiest, all reads
+		EXPECT_EQ(cell(0x00) & 0x0000FF00u, 0u);   // Only written
+		EXPECT_GT(cell(0x00) & 0x00FF0000u, 0u);
+		EXPECT_EQ(cell(0x50), 0u);                 // Never touched
+
+		auto path = std::filesystem::temp_directory_path() / "nes_bus_heatmap.ppm";
+		ASSERT_TRUE(stats.writeHeatmap(path.string()));
+		std::ifstream in(path, std::ios::binary);
+		std::string magic, size;
+		std::getline(in, magic);
+		std::getline(in, size);
+		EXPECT_EQ(magic, "P6");
+		EXPECT_EQ(size, "256 272");
+		in.close();
+		std::filesystem::remove(path);
+	}
+
+	TEST(BusStatsTest, CountsAPollingLoop) {
+#ifdef NES_BUS_STATS
+		Assembler assembler;
+		ASSERT_TRUE(assembler.assemble(R"(
+reset:
+    LDA #$80
+    STA $2000
+wait:
+    LDA $2002
+    BPL wait
+    INC $10
+    JMP wait
+nmi:
+    RTI
+)")) << assembler.error();
+		auto emulator = std::make_unique<Emulator>();
+		ASSERT_TRUE(emulator->loadRom(assembler.rom()));
+		BusStats& stats = emulator->bus().stats;
+		stats.resetEachFrame = true;
+		emulator->runFrame(false);
+		emulator->runFrame(false);
+
+		// Nearly a frame of LDA $2002 / BPL: two reads of $80xx code for every PPUSTATUS read
+		EXPECT_GT(stats.registerReads(2), 2000u);
+		EXPECT_EQ(stats.registerWrites(0), 0u); // Written once at reset, two frames ago
+		EXPECT_GT(stats.pageReads(0x80), stats.registerReads(2));
+#else
+		GTEST_SKIP() << "Built without NES_BUS_STATS";
+#endif
+	}
+
+	TEST(BusStatsTest, CountsInstructionsThatUseRamDirectly) {
+#ifdef NES_BUS_STATS
+		Assembler assembler;
+		ASSERT_TRUE(assembler.assemble(R"(
+reset:
+    ADC $0300
+    SBC $0301
+    INC $0302
+    DEC $0303
+done:
+    JMP done
+nmi:
+    RTI
+)")) << assembler.error();
+		auto emulator = std::make_unique<Emulator>();
+		ASSERT_TRUE(emulator->loadRom(assembler.rom()));
+		emulator->runFrame(false);
+
+		BusStats& stats = emulator->bus().stats;
+		EXPECT_EQ(stats.pageReads(0x03), 4u);
+		EXPECT_EQ(stats.pageWrites(0x03), 2u);
+#else
+		GTEST_SKIP() << "Built without NES_BUS_STATS";
+#endif
+	}
+}
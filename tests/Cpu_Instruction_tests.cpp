@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 #include <CPU.h>
+#include <Emulator.h>
+#include "TestRom.h"
 
 namespace ProcessorTests {
 	class CPUADCTest : public testing::Test {
@@ -42,12 +44,35 @@ namespace ProcessorTests {
 	TEST_F(CPUADCTest, ADC_signed_underflow) {
 		EXPECT_FALSE(cpu.getOverFlowFlag());
 		cpu.write(0x01, 0x3F);
-		cpu.write(0x02, 0x3F);
+		cpu.write(0x02, 0x41);
 		cpu.ADC(0x01);
-		cpu.ADC(0x02);
+		cpu.ADC(0x02); // 63 + 65 doesn't fit in a signed byte
+		ASSERT_EQ(cpu.accumulator, 0x80);
 		ASSERT_TRUE(cpu.getOverFlowFlag());
 	}
 
+	TEST_F(CPUADCTest, ADC_NoOverflowWhileTheResultFits) {
+		cpu.setOverflowFlag(true);
+		cpu.write(0x01, 0x3F);
+		cpu.ADC(0x01);
+		cpu.ADC(0x01);
+		ASSERT_EQ(cpu.accumulator, 0x7E);
+		ASSERT_FALSE(cpu.getOverFlowFlag());
+		cpu.write(0x02, 0xFF);
+		cpu.ADC(0x02); // 126 + -1: opposite signs never overflow
+		ASSERT_FALSE(cpu.getOverFlowFlag());
+	}
+
+	TEST_F(CPUADCTest, ADC_ZeroWhenTheSumWrapsToZero) {
+		cpu.accumulator = 0xFF;
+		cpu.write(0x01, 0x01);
+		cpu.ADC(0x01);
+		ASSERT_EQ(cpu.accumulator, 0);
+		ASSERT_TRUE(cpu.getZeroFlag());
+		ASSERT_TRUE(cpu.getCarryFlag());
+		ASSERT_FALSE(cpu.getOverFlowFlag());
+	}
+
 	TEST_F(CPUADCTest, ADC_negative) {
 		EXPECT_FALSE(cpu.getNegativeFlag());
 		cpu.write(0x01, 0x80);
@@ -400,12 +425,24 @@ namespace ProcessorTests {
 	TEST_F(CPUSBCTest, SBC_signed_underflow) {
 		EXPECT_FALSE(cpu.getOverFlowFlag());
 		cpu.write(0x01, 0x3F);
-		cpu.write(0x02, 0x3F);
+		cpu.write(0x02, 0x7F);
 		cpu.SBC(0x01);
-		cpu.SBC(0x02);
+		EXPECT_FALSE(cpu.getOverFlowFlag()); // 10 - 63 - 1 is -54
+		cpu.SBC(0x02); // -54 - 127 - 1 is below -128
+		ASSERT_EQ(cpu.accumulator, 0x4A);
 		ASSERT_TRUE(cpu.getOverFlowFlag());
 	}
 
+	TEST_F(CPUSBCTest, SBC_ZeroWithCarryWhenEqual) {
+		cpu.setCarryFlag(true);
+		cpu.write(0x01, 10);
+		cpu.SBC(0x01);
+		ASSERT_EQ(cpu.accumulator, 0);
+		ASSERT_TRUE(cpu.getZeroFlag());
+		ASSERT_TRUE(cpu.getCarryFlag()); // No borrow
+		ASSERT_FALSE(cpu.getOverFlowFlag());
+	}
+
 	TEST_F(CPUSBCTest, SBC_negative) {
 		EXPECT_FALSE(cpu.getNegativeFlag());
 		cpu.write(0x01, 0x80);
@@ -1178,6 +1215,17 @@ namespace ProcessorTests {
 		ASSERT_EQ(cpu.program_counter, 0x0F82);
 	}
 
+	TEST_F(CPUBranchTest, BCS_TakenLandsWhereATakenBCCDoes) {
+		for (uint8_t opcode : { 0x90, 0xB0 }) { // BCC, BCS
+			cpu.setCarryFlag(opcode == 0xB0);
+			cpu.program_counter = 0x0200;
+			cpu.write(0x0200, opcode);
+			cpu.write(0x0201, 0x05);
+			ASSERT_EQ(cpu.execute(), 3);
+			ASSERT_EQ(cpu.program_counter, 0x0207) << std::hex << int(opcode);
+		}
+	}
+
 	TEST_F(CPUBranchTest, BMI_BranchWithPositiveOffsetNegativeSet) {
 		cpu.setNegativeFlag(true);
 		cpu.program_counter = 0x1000;
@@ -1587,4 +1635,184 @@ namespace ProcessorTests {
 		ASSERT_EQ(test_addr, 0x0FFB); // 0x1005 + (-10) = 0x0FFB
 		ASSERT_EQ(cpu.program_counter, 0x1005);
 	}
+
+	class CPUInterruptTest : public ::testing::Test {
+	protected:
+		void SetUp() override {
+			// NOPs from $8000, where reset, IRQ and BRK go; NMI goes to $8100
+			auto cart = std::make_shared<Cartridge>(TestRom::Make(std::vector<uint8_t>(0x200, 0xEA), 0x8100, 0, 0x8000));
+			cpu = std::make_unique<CPU>(bus, cart, std::make_shared<OAM>());
+			cpu->clearStatus();
+		}
+
+		std::shared_ptr<Bus> bus = std::make_shared<Bus>();
+		std::unique_ptr<CPU> cpu;
+	};
+
+	TEST_F(CPUInterruptTest, BRK_PushesTheAddressPastItsPaddingByteAndStatusWithB) {
+		cpu->program_counter = 0x8001; // Just past the BRK opcode at $8000
+		cpu->setCarryFlag(true);
+		cpu->BRK();
+		ASSERT_EQ(cpu->getStackTESTING(), (std::vector<uint8_t>{ 0x80, 0x02, 0x11 }));
+		ASSERT_EQ(cpu->stack_pointer, 0xFC);
+		ASSERT_EQ(cpu->program_counter, 0x8000);
+		ASSERT_EQ(cpu->status, 0x05); // I set, B only in the pushed copy
+	}
+
+	TEST_F(CPUInterruptTest, BRK_RunsFromExecuteIn7Cycles) {
+		cpu->program_counter = 0x1000;
+		cpu->write(0x1000, 0x00);
+		ASSERT_EQ(cpu->execute(), 7);
+		ASSERT_EQ(cpu->program_counter, 0x8000);
+		ASSERT_EQ(cpu->getStackTESTING(), (std::vector<uint8_t>{ 0x10, 0x02, 0x10 }));
+	}
+
+	TEST_F(CPUInterruptTest, RTI_ReturnsFromBRK) {
+		cpu->program_counter = 0x8001;
+		cpu->setCarryFlag(true);
+		cpu->BRK();
+		cpu->RTI();
+		ASSERT_EQ(cpu->program_counter, 0x8002);
+		ASSERT_EQ(cpu->status, 0x01); // As before BRK: I clear again, B never set
+		ASSERT_EQ(cpu->stack_pointer, 0xFF);
+		ASSERT_TRUE(cpu->getStackTESTING().empty());
+	}
+
+	TEST_F(CPUInterruptTest, RTI_ReturnsFromIRQAndTakesOneStillHeld) {
+		cpu->program_counter = 0x9000;
+		cpu->setIRQ(true); // I is clear, so it is taken straight away
+		ASSERT_EQ(cpu->program_counter, 0x8000);
+		ASSERT_EQ(cpu->getStackTESTING(), (std::vector<uint8_t>{ 0x90, 0x00, 0x00 }));
+		ASSERT_FALSE(cpu->interruptPending()); // Masked while the handler runs
+
+		cpu->RTI();
+		ASSERT_EQ(cpu->program_counter, 0x9000);
+		ASSERT_EQ(cpu->status, 0x00);
+		ASSERT_TRUE(cpu->interruptPending()); // The line is still up and I is clear again
+		cpu->execute(); // Takes it, then runs the handler's NOP
+		ASSERT_EQ(cpu->program_counter, 0x8001);
+		ASSERT_EQ(cpu->getStackTESTING(), (std::vector<uint8_t>{ 0x90, 0x00, 0x00 }));
+	}
+
+	TEST_F(CPUInterruptTest, RTI_ReportsAStackTooShortForItsFrame) {
+		cpu->program_counter = 0x1001;
+		cpu->setStackBackTESTING(0x34);
+		testing::internal::CaptureStderr();
+		cpu->RTI();
+		std::string error = testing::internal::GetCapturedStderr();
+		EXPECT_NE(error.find("RTI at $1000"), std::string::npos) << error;
+		// The byte there is pulled as the status, the missing ones read as 0
+		ASSERT_EQ(cpu->status, 0x24);
+		ASSERT_EQ(cpu->program_counter, 0x0000);
+		ASSERT_EQ(cpu->stack_pointer, 0x01);
+		ASSERT_TRUE(cpu->getStackTESTING().empty());
+	}
+
+	TEST_F(CPUInterruptTest, RTS_ReportsAnEmptyStack) {
+		cpu->program_counter = 0x2001;
+		testing::internal::CaptureStderr();
+		cpu->RTS(0);
+		std::string error = testing::internal::GetCapturedStderr();
+		EXPECT_NE(error.find("RTS at $2000"), std::string::npos) << error;
+		ASSERT_EQ(cpu->program_counter, 0x0001);
+	}
+
+	TEST_F(CPUInterruptTest, NMI_TakenOnTheLinesRisingEdgeEvenWithIRQsMasked) {
+		cpu->program_counter = 0x9000;
+		cpu->setInterruptDisableFlag(true);
+		bus->nmi = true; // What the PPU does at vblank
+		ASSERT_TRUE(cpu->interruptPending());
+		cpu->execute(); // Takes it, then runs the handler's NOP
+		ASSERT_EQ(cpu->program_counter, 0x8101);
+		ASSERT_EQ(cpu->getStackTESTING(), (std::vector<uint8_t>{ 0x90, 0x00, 0x04 }));
+		ASSERT_FALSE(bus->nmi); // Taken, so the line is cleared
+	}
+
+	TEST_F(CPUInterruptTest, NMI_FiresAgainOnlyAfterTheLineDrops) {
+		cpu->program_counter = 0x9000;
+		bus->nmi = true;
+		cpu->execute();
+		ASSERT_EQ(cpu->getStackTESTING().size(), 3u);
+
+		// Raised again before the CPU has seen it low: no new edge
+		bus->nmi = true;
+		cpu->execute();
+		ASSERT_EQ(cpu->getStackTESTING().size(), 3u);
+		ASSERT_TRUE(cpu->previous_nmi_state);
+
+		// The edge detector follows the line down on the next instruction, then the next rise fires
+		bus->nmi = false;
+		cpu->execute();
+		ASSERT_FALSE(cpu->previous_nmi_state);
+		ASSERT_EQ(cpu->getStackTESTING().size(), 3u);
+		bus->nmi = true;
+		cpu->execute();
+		ASSERT_EQ(cpu->getStackTESTING().size(), 6u);
+		ASSERT_EQ(cpu->program_counter, 0x8101);
+	}
+
+	TEST(CPUImmediateTest, ADC_And_SBC_ReadTheOperandFromTheRom) {
+		auto bus = std::make_shared<Bus>();
+		auto cart = std::make_shared<Cartridge>(TestRom::Make(std::vector<uint8_t>(0x200, 0xEA), 0x8000, 0, 0x8000));
+		CPU cpu(bus, cart, std::make_shared<OAM>());
+		cpu.clearStatus();
+		bus->memory[0x8001] = 0x11; // Under the ROM, never seen by the CPU
+
+		cpu.program_counter = 0x8001;
+		cpu.ADC(cpu.addr_immediate()); // ADC #$EA
+		ASSERT_EQ(cpu.accumulator, 0xEA);
+		ASSERT_EQ(cpu.program_counter, 0x8002);
+		cpu.setCarryFlag(true);
+		cpu.SBC(cpu.addr_immediate()); // SBC #$EA
+		ASSERT_EQ(cpu.accumulator, 0);
+		ASSERT_TRUE(cpu.getZeroFlag());
+	}
+
+	// A CPU about to run code from $8000, through the interpreter or the block cache
+	CPU& cpuAtRom(Emulator& emulator, const std::vector<uint8_t>& code, bool cached) {
+		EXPECT_TRUE(emulator.loadRom(TestRom::Make(code, 0x8000, 0, 0x8000)));
+		emulator.setBlockCache(cached);
+		CPU& cpu = emulator.cpu();
+		cpu.clearStatus();
+		cpu.accumulator = 0;
+		cpu.program_counter = 0x8000;
+		emulator.bus().memory[0x10] = 0xF0; // ($10) points at $02F0
+		emulator.bus().memory[0x11] = 0x02;
+		return cpu;
+	}
+
+	TEST(CPUIndexedTest, YIndexedReadsCrossPagesOnY) {
+		struct Case { uint8_t opcode; int cycles; };
+		// ORA, AND and ADC with abs,Y and (zp),Y
+		for (Case test : { Case{ 0x19, 4 }, Case{ 0x11, 5 }, Case{ 0x39, 4 }, Case{ 0x31, 5 }, Case{ 0x79, 4 }, Case{ 0x71, 5 } }) {
+			bool indirect = (test.opcode & 0x0F) == 0x01;
+			std::vector<uint8_t> code = { test.opcode, static_cast<uint8_t>(indirect ? 0x10 : 0xF0), 0x02 }; // $02F0,Y or ($10),Y
+			for (bool cached : { false, true }) {
+				for (bool crossing : { false, true }) {
+					auto emulator = std::make_unique<Emulator>();
+					CPU& cpu = cpuAtRom(*emulator, code, cached);
+					// Y crosses into $03xx or stays in $02xx; X is chosen to cross if it were used instead
+					cpu.x = crossing ? 0x00 : 0xFF;
+					cpu.y = crossing ? 0x20 : 0x08;
+					EXPECT_EQ(cpu.execute(), test.cycles + (crossing ? 1 : 0))
+						<< std::hex << "opcode " << int(test.opcode) << (cached ? " cached" : "") << (crossing ? " crossing" : "");
+				}
+			}
+		}
+	}
+
+	TEST(CPUIndexedTest, ADC_71_IsIndirectIndexedY) {
+		for (bool cached : { false, true }) {
+			auto emulator = std::make_unique<Emulator>();
+			CPU& cpu = cpuAtRom(*emulator, { 0x71, 0x10 }, cached);
+			cpu.x = 0x20;
+			cpu.y = 0x20;
+			emulator->bus().memory[0x0310] = 0x42; // ($10),Y
+			emulator->bus().memory[0x30] = 0x00;   // ($10,X) would point at $0500 instead
+			emulator->bus().memory[0x31] = 0x05;
+			ASSERT_EQ(cpu.execute(), 6);
+			ASSERT_EQ(cpu.accumulator, 0x42) << (cached ? "cached" : "interpreted");
+			ASSERT_EQ(cpu.program_counter, 0x8002);
+		}
+	}
 }
\ No newline at end of file
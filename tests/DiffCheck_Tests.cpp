@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+#include <Cartridge.h>
+#include <DiffCheck.h>
+#include <Emulator.h>
+#include <Movie.h>
+#include "TestRom.h"
+#include "Workloads.h"
+
+namespace DiffCheckTests {
+	std::shared_ptr<Cartridge> cart(const std::vector<uint8_t>& rom) {
+		EXPECT_TRUE(Emulator::IsNesRom(rom));
+		return std::make_shared<Cartridge>(rom);
+	}
+
+	TEST(DiffCheckTest, FastAndAccurateCoresAgreeOnTheWorkloads) {
+		DiffCheck check;
+		for (const char* source : { Workloads::aluLoop, Workloads::memcpyLoop, Workloads::spriteScene,
+			Workloads::scrollScene, Workloads::nmiFrameLoop, Workloads::vblankWait }) {
+			DiffCheck::Result result;
+			ASSERT_TRUE(check.run(cart(Workloads::Build(source)), nullptr, 20, result));
+			EXPECT_FALSE(result.diverged);
+			EXPECT_EQ(result.frames, 20u);
+			EXPECT_EQ(result.fastFrameHash, result.accurateFrameHash);
+			EXPECT_TRUE(result.fastState.empty());
+			EXPECT_TRUE(result.startState.empty());
+		}
+	}
+
+	TEST(DiffCheckTest, ReplaysTheMovieOnBoth) {
+		std::vector<uint8_t> rom = TestRom::Make(TestRom::PadLoop(), 0x8000);
+		auto recorder = std::make_unique<Emulator>();
+		ASSERT_TRUE(recorder->loadRom(rom));
+		Movie movie;
+		movie.start(*recorder, 16);
+		for (int frame = 0; frame < 40; ++frame) {
+			MovieInput input;
+			input.pads[0] = static_cast<uint8_t>(frame * 37);
+			input.pads[1] = static_cast<uint8_t>(frame * 11);
+			movie.record(*recorder, input);
+			recorder->runFrame();
+		}
+
+		DiffCheck check;
+		DiffCheck::Result result;
+		ASSERT_TRUE(check.run(cart(rom), &movie, 50, result)); // The last ten frames with no buttons
+		EXPECT_FALSE(result.diverged);
+		EXPECT_EQ(result.frames, 50u);
+
+		// Both replayed what was recorded: after 40 frames they are where the recorder was
+		ASSERT_TRUE(check.run(cart(rom), &movie, 40, result));
+		EXPECT_EQ(result.fastCpuHash, result.accurateCpuHash);
+		EXPECT_EQ(result.accurateCpuHash, DiffCheck::CpuHash(recorder->cpu()));
+		EXPECT_EQ(result.accurateFrameHash, recorder->frameHash());
+	}
+
+	TEST(DiffCheckTest, StopsAtTheFirstDivergenceWithBothSavestates) {
+		// Counts NMIs in $10, then loads $0200 into A once five have come in
+		std::vector<uint8_t> rom = Workloads::Build(R"(
+reset:
+    LDA #%10000000
+    STA $2000
+wait:
+    LDA $10
+    CMP #5
+    BCC wait
+    LDA $0200
+done:
+    JMP done
+nmi:
+    INC $10
+    RTI
+)");
+		DiffCheck check;
+		check.fast = [](Emulator& emulator) {
+			DiffCheck::Fast(emulator);
+			emulator.bus().memory[0x0200] = 0x42; // The accurate side reads 0
+		};
+		DiffCheck::Result result;
+		ASSERT_TRUE(check.run(cart(rom), nullptr, 100, result));
+		ASSERT_TRUE(result.diverged);
+		EXPECT_GE(result.frames, 5u);
+		EXPECT_LE(result.frames, 7u);
+		EXPECT_NE(result.fastCpuHash, result.accurateCpuHash);
+		EXPECT_EQ(result.fastFrameHash, result.accurateFrameHash); // Rendering is off
+
+		auto fast = std::make_unique<Emulator>();
+		ASSERT_TRUE(fast->loadRom(rom));
+		ASSERT_TRUE(fast->loadState(result.fastState));
+		EXPECT_EQ(fast->cpu().accumulator, 0x42);
+		EXPECT_EQ(DiffCheck::CpuHash(fast->cpu()), result.fastCpuHash);
+
+		// The state before the frame replays it into the accurate side's state after it
+		auto accurate = std::make_unique<Emulator>();
+		ASSERT_TRUE(accurate->loadRom(rom));
+		ASSERT_TRUE(accurate->loadState(result.startState));
+		EXPECT_LT(accurate->bus().memory[0x10], 5);
+		accurate->runFrame();
+		EXPECT_EQ(accurate->saveState(), result.accurateState);
+		EXPECT_EQ(DiffCheck::CpuHash(accurate->cpu()), result.accurateCpuHash);
+	}
+
+	TEST(DiffCheckTest, RejectsAMovieForAnotherRom) {
+		auto recorder = std::make_unique<Emulator>();
+		ASSERT_TRUE(recorder->loadRom(TestRom::Make(TestRom::counterLoop, 0x8005, 1)));
+		Movie movie;
+		movie.start(*recorder);
+		DiffCheck check;
+		DiffCheck::Result result;
+		EXPECT_FALSE(check.run(cart(TestRom::Make()), &movie, 10, result));
+	}
+}
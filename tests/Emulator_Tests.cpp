@@ -0,0 +1,237 @@
+#include <gtest/gtest.h>
+#include <Emulator.h>
+#include "TestRom.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace EmulatorTests {
+	class EmulatorTest : public testing::Test {
+	protected:
+		void SetUp() override {
+			emulator = std::make_unique<Emulator>();
+			reference = std::make_unique<Emulator>();
+			ASSERT_TRUE(emulator->loadRom(TestRom::Make()));
+			ASSERT_TRUE(reference->loadRom(TestRom::Make()));
+		}
+
+		static std::vector<uint32_t> frame(const Emulator& emulator) {
+			return std::vector<uint32_t>(emulator.framebuffer(), emulator.framebuffer() + PPU_WIDTH * PPU_HEIGHT);
+		}
+
+		std::unique_ptr<Emulator> emulator;
+		std::unique_ptr<Emulator> reference;
+	};
+
+	TEST_F(EmulatorTest, FramesEndAfterLastVisibleLine) {
+		emulator->runFrame();
+		ASSERT_EQ(emulator->ppu().scanline, PPU_HEIGHT);
+		emulator->runFrame();
+		ASSERT_EQ(emulator->ppu().scanline, PPU_HEIGHT);
+		ASSERT_EQ(emulator->frameCount(), 2u);
+	}
+
+	TEST_F(EmulatorTest, SkippedFrameMatchesRenderedFrame) {
+		for (int i = 0; i < 5; ++i) {
+			emulator->runFrame(false);
+			reference->runFrame();
+		}
+		ASSERT_EQ(emulator->saveState(), reference->saveState());
+		ASSERT_EQ(emulator->metrics().renderedFrames, 0u);
+
+		// Rendering picks straight back up with a whole picture
+		emulator->runFrame();
+		reference->runFrame();
+		ASSERT_EQ(frame(*emulator), frame(*reference));
+	}
+
+	TEST_F(EmulatorTest, RunAheadShowsLaterFrame) {
+		const int runAhead = 2;
+		emulator->setRunAhead(runAhead);
+		for (int i = 0; i < runAhead; ++i) {
+			reference->runFrame();
+		}
+		for (int i = 0; i < 10; ++i) {
+			emulator->runFrame();
+			reference->runFrame();
+			ASSERT_EQ(frame(*emulator), frame(*reference));
+		}
+		ASSERT_EQ(emulator->frameCount(), 10u);
+		ASSERT_EQ(emulator->metrics().emulatedFrames, 10u * (runAhead + 1));
+	}
+
+	TEST_F(EmulatorTest, RunAheadLeavesMachineOnRealFrame) {
+		emulator->setRunAhead(3);
+		for (int i = 0; i < 10; ++i) {
+			emulator->runFrame();
+			reference->runFrame();
+		}
+		emulator->setRunAhead(0);
+		ASSERT_EQ(emulator->saveState(), reference->saveState());
+	}
+
+	TEST_F(EmulatorTest, RunAheadIsClamped) {
+		emulator->setRunAhead(100);
+		ASSERT_EQ(emulator->runAhead(), MAX_RUN_AHEAD);
+		emulator->setRunAhead(-1);
+		ASSERT_EQ(emulator->runAhead(), 0);
+	}
+
+	// Starts a pulse tone and noise with running length counters, then keeps copying $4015 to zero page
+	//   $8000  LDA/STA $4015, $4000, $4002, $4003, $400C, $400E, $400F, $2000
+	//   $8028  LDA $4015 / STA $10 / INX / STX $11 / JMP $8028
+	const std::vector<uint8_t> soundLoop = {
+		0xA9, 0x0F, 0x8D, 0x15, 0x40,
+		0xA9, 0x9F, 0x8D, 0x00, 0x40,
+		0xA9, 0xFD, 0x8D, 0x02, 0x40,
+		0xA9, 0x08, 0x8D, 0x03, 0x40,
+		0xA9, 0x1F, 0x8D, 0x0C, 0x40,
+		0xA9, 0x03, 0x8D, 0x0E, 0x40,
+		0xA9, 0x18, 0x8D, 0x0F, 0x40,
+		0xA9, 0x80, 0x8D, 0x00, 0x20,
+		0xAD, 0x15, 0x40, 0x85, 0x10, 0xE8, 0x86, 0x11, 0x4C, 0x28, 0x80,
+	};
+
+	TEST_F(EmulatorTest, AudioOffKeepsMachineState) {
+		ASSERT_TRUE(emulator->loadRom(TestRom::Make(soundLoop, 0x8028)));
+		ASSERT_TRUE(reference->loadRom(TestRom::Make(soundLoop, 0x8028)));
+		emulator->setAudioEnabled(false);
+		bool heard = false;
+		for (int i = 0; i < 300; ++i) {
+			emulator->runFrame();
+			reference->runFrame();
+			ASSERT_TRUE(emulator->audio().empty());
+			heard = heard || !reference->audio().empty();
+		}
+		ASSERT_TRUE(heard);
+		ASSERT_EQ(emulator->saveState(), reference->saveState());
+		ASSERT_EQ(emulator->bus().memory[0x10] & 0x01, 0); // The length counter ran out the same way
+
+		// And it picks straight back up
+		emulator->setAudioEnabled(true);
+		emulator->runFrame();
+		ASSERT_FALSE(emulator->audio().empty());
+	}
+
+	uint8_t readPad(Emulator& emulator) {
+		uint8_t buttons = 0;
+		for (int i = 0; i < 8; ++i) {
+			buttons |= (emulator.bus().memory[0x10 + i] & 1) << i;
+		}
+		return buttons;
+	}
+
+	TEST_F(EmulatorTest, StrobeLatchesNewestInput) {
+		CPU& cpu = emulator->cpu();
+		emulator->setInput(0, 0x5A);
+		cpu.write(0x4016, 1);
+		ASSERT_EQ(cpu.read(0x4016) & 1, 0); // Strobe high reads button A as it is now
+		emulator->setInput(0, 0x81);
+		ASSERT_EQ(cpu.read(0x4016) & 1, 1);
+		cpu.write(0x4016, 0); // Dropping the strobe holds what the buttons were at that moment
+		emulator->setInput(0, 0x00);
+		uint8_t read = 0;
+		for (int i = 0; i < 8; ++i) {
+			read |= (cpu.read(0x4016) & 1) << i;
+		}
+		ASSERT_EQ(read, 0x81);
+		ASSERT_EQ(emulator->input(0), 0x00);
+	}
+
+	TEST_F(EmulatorTest, InputFromAnotherThread) {
+		emulator->setInput(1, 0x42); // Held buttons stay held across a cartridge change
+		ASSERT_TRUE(emulator->loadRom(TestRom::Make(TestRom::PadLoop())));
+		emulator->runFrame();
+		ASSERT_EQ(readPad(*emulator), 0x00);
+
+		// A bot thread presses buttons while frames run, the game picks each one up without any locking
+		std::atomic<bool> done{ false };
+		std::thread bot([this, &done] {
+			for (int buttons = 1; buttons < 256; buttons <<= 1) {
+				emulator->setInput(0, static_cast<uint8_t>(buttons));
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			done = true;
+		});
+		while (!done) {
+			emulator->runFrame(false);
+		}
+		bot.join();
+		emulator->runFrame();
+		ASSERT_EQ(readPad(*emulator), 0x80);
+		ASSERT_EQ(emulator->input(1), 0x42);
+	}
+
+	TEST_F(EmulatorTest, InstancesDontShareMachineState) {
+		ASSERT_NE(emulator->bus().memory.data(), reference->bus().memory.data());
+		ASSERT_NE(&emulator->cpu(), &reference->cpu());
+		ASSERT_NE(&emulator->ppu(), &reference->ppu());
+
+		// Poking one machine's RAM, registers and PPU leaves the other exactly where it was
+		std::vector<uint8_t> before = reference->saveState();
+		emulator->bus().memory[0x0010] = 0x99;
+		emulator->cpu().x = 0x42;
+		emulator->cpu().write(0x2000, 0x00);
+		emulator->runFrame();
+		ASSERT_EQ(reference->saveState(), before);
+		ASSERT_NE(emulator->saveState(), before);
+
+		// And running the other doesn't reach back either
+		std::vector<uint8_t> after = emulator->saveState();
+		reference->runFrame();
+		ASSERT_EQ(emulator->saveState(), after);
+	}
+
+	TEST_F(EmulatorTest, InstancesSharingACartridgeRunIndependently) {
+		auto cart = std::make_shared<Cartridge>(TestRom::Make());
+		auto first = std::make_unique<Emulator>();
+		auto second = std::make_unique<Emulator>();
+		ASSERT_TRUE(first->loadRom(cart));
+		ASSERT_TRUE(second->loadRom(cart));
+		for (int i = 0; i < 3; ++i) {
+			first->runFrame();
+		}
+		second->runFrame();
+		ASSERT_EQ(first->frameCount(), 3u);
+		ASSERT_EQ(second->frameCount(), 1u);
+		ASSERT_NE(first->saveState(), second->saveState());
+
+		// Dropping one leaves the cartridge and the other machine working
+		first.reset();
+		for (int i = 0; i < 2; ++i) {
+			second->runFrame();
+			reference->runFrame();
+		}
+		reference->runFrame();
+		ASSERT_EQ(second->saveState(), reference->saveState());
+	}
+
+	TEST_F(EmulatorTest, InstancesOnThreadsMatchOneRunAlone) {
+		constexpr int frames = 20;
+		for (int i = 0; i < frames; ++i) {
+			reference->runFrame();
+		}
+		std::vector<uint8_t> expected = reference->saveState();
+
+		std::vector<std::vector<uint8_t>> states(4);
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < states.size(); ++t) {
+			threads.emplace_back([&states, t] {
+				auto machine = std::make_unique<Emulator>();
+				if (!machine->loadRom(TestRom::Make())) {
+					return;
+				}
+				for (int i = 0; i < frames; ++i) {
+					machine->runFrame();
+				}
+				states[t] = machine->saveState();
+			});
+		}
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+		for (const std::vector<uint8_t>& state : states) {
+			ASSERT_EQ(state, expected);
+		}
+	}
+}
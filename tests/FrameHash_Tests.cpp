@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+#include <Emulator.h>
+#include <Hash.h>
+#include <random>
+#include "Workloads.h"
+
+namespace FrameHashTests {
+	uint64_t fullHash(const Emulator& emulator) {
+		return Hash::XXH64(emulator.framebuffer(), PPU_WIDTH * PPU_HEIGHT * sizeof(uint32_t));
+	}
+
+	TEST(FrameHashTest, MatchesTheReferenceXXH64) {
+		EXPECT_EQ(Hash::XXH64("", 0), 0xEF46DB3751D8E999ULL);
+		EXPECT_EQ(Hash::XXH64("abc", 3), 0x44BC2CF5AD770999ULL);
+		Hash::XXH64Stream stream;
+		EXPECT_EQ(stream.digest(), 0xEF46DB3751D8E999ULL);
+		stream.update("ab", 2);
+		stream.update("c", 1);
+		EXPECT_EQ(stream.digest(), 0x44BC2CF5AD770999ULL);
+	}
+
+	TEST(FrameHashTest, StreamMatchesOneShotHowEverTheDataIsSplit) {
+		std::mt19937 random(77);
+		std::vector<uint8_t> data(5000);
+		for (uint8_t& byte : data) {
+			byte = static_cast<uint8_t>(random());
+		}
+		for (size_t size : { 0, 1, 31, 32, 33, 64, 100, 1024, 5000 }) {
+			for (uint64_t seed : { 0ULL, 12345ULL }) {
+				uint64_t expected = Hash::XXH64(data.data(), size, seed);
+				Hash::XXH64Stream stream(seed);
+				size_t offset = 0;
+				while (offset < size) {
+					size_t piece = std::min<size_t>(random() % 70, size - offset);
+					stream.update(data.data() + offset, piece);
+					offset += piece;
+				}
+				EXPECT_EQ(stream.digest(), expected) << "size " << size << " seed " << seed;
+			}
+		}
+	}
+
+	TEST(FrameHashTest, PpuHashIsTheHashOfTheFramebuffer) {
+		for (const char* source : { Workloads::spriteScene, Workloads::scrollScene, Workloads::vblankWait }) {
+			auto emulator = std::make_unique<Emulator>();
+			ASSERT_TRUE(emulator->loadRom(Workloads::Build(source)));
+			EXPECT_EQ(emulator->frameHash(), fullHash(*emulator)); // Nothing drawn yet
+			for (int frame = 0; frame < 10; ++frame) {
+				emulator->runFrame();
+				ASSERT_EQ(emulator->frameHash(), fullHash(*emulator)) << "frame " << frame;
+			}
+			// A frame run without a picture leaves the old one, and its hash
+			uint64_t shown = emulator->frameHash();
+			emulator->runFrame(false);
+			EXPECT_EQ(emulator->frameHash(), shown);
+			emulator->runFrame();
+			EXPECT_EQ(emulator->frameHash(), fullHash(*emulator));
+		}
+	}
+
+	TEST(FrameHashTest, FollowsLinesDrawnOutOfOrder) {
+		auto emulator = std::make_unique<Emulator>();
+		ASSERT_TRUE(emulator->loadRom(Workloads::Build(Workloads::spriteScene)));
+		emulator->runFrame();
+		while (emulator->ppu().scanline != 100) {
+			emulator->ppu().step();
+		}
+		std::vector<uint8_t> midFrame = emulator->saveState();
+		emulator->runFrame();
+		// Only lines 100 to 239 are drawn after this, over the frame before
+		ASSERT_TRUE(emulator->loadState(midFrame));
+		emulator->runFrame();
+		EXPECT_EQ(emulator->frameHash(), fullHash(*emulator));
+
+		emulator->ppu().writeToFrameBuffer(7, std::vector<RGB>(PPU_WIDTH, RGB{ 1, 2, 3 }));
+		EXPECT_EQ(emulator->frameHash(), fullHash(*emulator));
+	}
+}
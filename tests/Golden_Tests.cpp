@@ -0,0 +1,149 @@
+/*
+    nes_golden_tests - golden-frame regression tests.
+
+    Each test runs a ROM headless for a fixed number of frames. After every
+    frame it takes two hashes: the picture's (Emulator::frameHash, XXH64 of the
+    framebuffer) and the whole machine's (Emulator::stateHash, XXH64 of the
+    savestate). It compares them with tests/golden/<name>.frames, which holds
+    one "<frame> <state>" pair of hex hashes per line, as nes_batch writes them.
+    A test fails on the first frame where either hash differs, naming it.
+
+    The frame hash is not a renderer gate yet. PPU::RenderScanline masks the
+    pixel it builds with 0xF0, but the shift register and attribute bits only
+    reach bits 0-3, so every pixel is colour $00 whatever the ROM's CHR,
+    nametables or palette hold. Every frame of every ROM hashes the same.
+    Fixing that takes the pattern fetches and ShiftRegister::Insert as well as
+    the mux; whoever does it regenerates these files with it.
+
+    The state hash is what catches a change in what the CPU, PPU or APU did.
+    A change to the savestate format changes it too.
+
+    After a change that is meant to alter the picture, run with
+    NES_GOLDEN_UPDATE=1 in the environment to rewrite the golden files, look
+    at the frames that changed and commit the new files with the change.
+*/
+#include <gtest/gtest.h>
+#include <Emulator.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include "TestRom.h"
+#include "Workloads.h"
+
+namespace GoldenTests {
+	constexpr int frames = 60;
+
+	std::string goldenPath(const std::string& name) {
+		return std::string(NES_GOLDEN_DIR) + "/" + name + ".frames";
+	}
+
+	struct Hashes {
+		uint64_t frame = 0;
+		uint64_t state = 0;
+	};
+
+	std::vector<Hashes> readGolden(const std::string& path) {
+		std::vector<Hashes> hashes;
+		std::ifstream file(path);
+		std::string line;
+		while (std::getline(file, line)) {
+			if (!line.empty() && line[0] != '#') {
+				char* end = nullptr;
+				Hashes frame;
+				frame.frame = std::strtoull(line.c_str(), &end, 16);
+				frame.state = std::strtoull(end, nullptr, 16);
+				hashes.push_back(frame);
+			}
+		}
+		return hashes;
+	}
+
+	std::string hex64(uint64_t value) {
+		char text[17];
+		std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(value));
+		return text;
+	}
+
+	bool writeGolden(const std::string& path, const std::vector<Hashes>& hashes) {
+		std::ofstream file(path);
+		for (const Hashes& frame : hashes) {
+			file << hex64(frame.frame) << ' ' << hex64(frame.state) << '\n';
+		}
+		return static_cast<bool>(file);
+	}
+
+	// Runs the ROM for frames frames, pad 1 set from input before each, and checks every frame's hashes
+	void expectGolden(const std::string& name, const std::vector<uint8_t>& rom, uint8_t (*input)(int frame) = nullptr) {
+		ASSERT_FALSE(rom.empty());
+		auto emulator = std::make_unique<Emulator>();
+		ASSERT_TRUE(emulator->loadRom(rom));
+		std::vector<Hashes> hashes;
+		for (int frame = 0; frame < frames; ++frame) {
+			if (input) {
+				emulator->setInput(0, input(frame));
+			}
+			emulator->runFrame();
+			hashes.push_back({ emulator->frameHash(), emulator->stateHash() });
+		}
+
+		std::string path = goldenPath(name);
+		if (std::getenv("NES_GOLDEN_UPDATE")) {
+			ASSERT_TRUE(writeGolden(path, hashes)) << "can't write " << path;
+			return;
+		}
+		std::vector<Hashes> golden = readGolden(path);
+		ASSERT_EQ(golden.size(), hashes.size()) << path << " is missing or has the wrong length, run with NES_GOLDEN_UPDATE=1";
+		for (int frame = 0; frame < frames; ++frame) {
+			if (hashes[frame].frame != golden[frame].frame) {
+				FAIL() << name << " frame " << frame << " hashes to " << hex64(hashes[frame].frame) << ", " << path << " has "
+					<< hex64(golden[frame].frame);
+			}
+			if (hashes[frame].state != golden[frame].state) {
+				FAIL() << name << " state after frame " << frame << " hashes to " << hex64(hashes[frame].state) << ", " << path
+					<< " has " << hex64(golden[frame].state);
+			}
+		}
+	}
+
+	TEST(GoldenTest, CounterLoop) {
+		expectGolden("counter_loop", TestRom::Make());
+	}
+
+	TEST(GoldenTest, RenderLoop) {
+		// Background and sprites on, NMI on, counting in X
+		std::vector<uint8_t> code = {
+			0xA9, 0x1E, 0x8D, 0x01, 0x20, 0xA9, 0x80, 0x8D, 0x00, 0x20,
+			0xE8, 0x86, 0x10, 0x4C, 0x0A, 0x80,
+		};
+		expectGolden("render_loop", TestRom::Make(code, 0x800A));
+	}
+
+	TEST(GoldenTest, PadLoop) {
+		expectGolden("pad_loop", TestRom::Make(TestRom::PadLoop(), 0x8000), [](int frame) { return static_cast<uint8_t>(frame * 37); });
+	}
+
+	TEST(GoldenTest, AluLoop) {
+		expectGolden("alu_loop", Workloads::Build(Workloads::aluLoop));
+	}
+
+	TEST(GoldenTest, MemcpyLoop) {
+		expectGolden("memcpy_loop", Workloads::Build(Workloads::memcpyLoop));
+	}
+
+	TEST(GoldenTest, SpriteScene) {
+		expectGolden("sprite_scene", Workloads::Build(Workloads::spriteScene));
+	}
+
+	TEST(GoldenTest, ScrollScene) {
+		expectGolden("scroll_scene", Workloads::Build(Workloads::scrollScene));
+	}
+
+	TEST(GoldenTest, NmiFrameLoop) {
+		expectGolden("nmi_frame_loop", Workloads::Build(Workloads::nmiFrameLoop));
+	}
+
+	TEST(GoldenTest, VblankWait) {
+		expectGolden("vblank_wait", Workloads::Build(Workloads::vblankWait));
+	}
+}
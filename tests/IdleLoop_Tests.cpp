@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+#include <Emulator.h>
+#include "Assembler.h"
+#include "Lockstep.h"
+#include "Workloads.h"
+
+namespace IdleLoopTests {
+	std::unique_ptr<Emulator> load(const std::string& source, bool skipping) {
+		std::vector<uint8_t> rom = Workloads::Build(source);
+		EXPECT_FALSE(rom.empty());
+		return Lockstep::Load(rom, &Emulator::setIdleLoopSkipping, skipping);
+	}
+
+	// Runs the workload with and without skipping and expects the same machine after every frame.
+	// Returns the CPU cycles that were skipped.
+	uint64_t expectSameMachine(const char* source, int frames) {
+		auto skipped = load(source, true);
+		auto executed = load(source, false);
+		Lockstep::ExpectSame(*skipped, *executed, frames);
+		EXPECT_EQ(executed->idleLoop().skippedCycles(), 0u);
+		return skipped->idleLoop().skippedCycles();
+	}
+
+	TEST(IdleLoopTest, SkippingLeavesTheMachineExactlyTheSame) {
+		EXPECT_GT(expectSameMachine(Workloads::nmiFrameLoop, 120), 0u);  // CMP flag / BEQ, broken by the NMI
+		EXPECT_GT(expectSameMachine(Workloads::vblankWait, 120), 0u);    // BIT $2002 / BPL, broken by the flag
+		EXPECT_GT(expectSameMachine(Workloads::spriteScene, 60), 0u);    // JMP to itself
+		EXPECT_GT(expectSameMachine(Workloads::scrollScene, 60), 0u);
+		EXPECT_EQ(expectSameMachine(Workloads::aluLoop, 30), 0u);        // Never idle
+	}
+
+	TEST(IdleLoopTest, SkipsMostOfAWaitForVblank) {
+		auto emulator = load(Workloads::vblankWait, true);
+		for (int frame = 0; frame < 10; ++frame) {
+			emulator->runFrame();
+		}
+		// The work after each vblank is a few hundred cycles, the rest of the frame is waiting
+		EXPECT_GT(emulator->metrics().idleCycles, emulator->metrics().frameCycles * 9 / 10);
+		EXPECT_EQ(emulator->bus().memory[0x10], 9); // Frames end at scanline 240, before the first frame's vblank
+	}
+
+	TEST(IdleLoopTest, LeavesLoopsThatChangeStateAlone) {
+		const char* loops[] = {
+			"loop: INC $10\n JMP loop",            // Writes
+			"loop: INX\n JMP loop",                 // Counts, no two passes alike
+			"loop: LDA $4016\n JMP loop",           // Shifts the controller on every read
+			"loop: PHA\n PLA\n JMP loop",           // Uses the stack
+			"loop: LDA ($00),Y\n BEQ loop",         // Indirect
+		};
+		for (const char* source : loops) {
+			auto emulator = load(source, true);
+			for (int frame = 0; frame < 3; ++frame) {
+				emulator->runFrame();
+			}
+			EXPECT_EQ(emulator->idleLoop().skippedInstructions(), 0u) << source;
+		}
+	}
+
+	TEST(IdleLoopTest, SavestatesTakenWhileSkippingRestoreExactly) {
+		auto emulator = load(Workloads::nmiFrameLoop, true);
+		for (int frame = 0; frame < 10; ++frame) {
+			emulator->runFrame();
+		}
+		std::vector<uint8_t> state = emulator->saveState();
+		emulator->runFrame();
+		emulator->runFrame();
+		std::vector<uint8_t> expected = emulator->saveState();
+
+		auto restored = load(Workloads::nmiFrameLoop, false);
+		ASSERT_TRUE(restored->loadState(state));
+		restored->runFrame();
+		restored->runFrame();
+		EXPECT_EQ(restored->saveState(), expected);
+	}
+}
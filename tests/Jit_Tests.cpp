@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include <Emulator.h>
+#include <random>
+#include "Lockstep.h"
+#include "TestRom.h"
+#include "Workloads.h"
+
+namespace JitTests {
+	std::unique_ptr<Emulator> load(const std::vector<uint8_t>& rom, bool jit) {
+		return Lockstep::Load(rom, &Emulator::setJit, jit);
+	}
+
+	TEST(JitTest, EveryOpcodeMatchesTheInterpreter) {
+		if (!Jit::Available) {
+			GTEST_SKIP() << "no code generator for this host";
+		}
+		std::mt19937 random(2048);
+		for (int opcode = 0; opcode < 256; ++opcode) {
+			for (int round = 0; round < 8; ++round) {
+				std::vector<uint8_t> code = { static_cast<uint8_t>(opcode), static_cast<uint8_t>(random()), static_cast<uint8_t>(random()) };
+				if (round % 2) {
+					code[2] = static_cast<uint8_t>(random() & 0x07); // Absolute operands in RAM, not just anywhere
+				}
+				std::vector<uint8_t> rom = TestRom::Make(code, 0x8000, 0, 0x8000);
+				auto compiled = load(rom, true);
+				auto interpreted = load(rom, false);
+				Emulator* emulators[] = { compiled.get(), interpreted.get() };
+				for (uint32_t address = 0; address < 0x0800; ++address) {
+					uint8_t value = static_cast<uint8_t>(random());
+					for (Emulator* emulator : emulators) {
+						emulator->bus().memory[address] = value;
+					}
+				}
+				uint8_t accumulator = static_cast<uint8_t>(random());
+				uint8_t x = static_cast<uint8_t>(random());
+				uint8_t y = static_cast<uint8_t>(random());
+				uint8_t status = static_cast<uint8_t>(random()) & ~0x04;
+				for (Emulator* emulator : emulators) {
+					CPU& cpu = emulator->cpu();
+					cpu.accumulator = accumulator;
+					cpu.x = x;
+					cpu.y = y;
+					cpu.status = status;
+					cpu.program_counter = 0x8000;
+					for (int i = 0; i < 3; ++i) {
+						cpu.setStackBackTESTING(static_cast<uint8_t>(0x80 + i));
+					}
+				}
+
+				// A one-instruction block compiled on first sight; a budget of 1 still lets it start
+				Jit& jit = compiled->jit();
+				jit.threshold = 0;
+				jit.blockInstructions = 1;
+				int compiledCycles = jit.run(compiled->cpu(), compiled->bus(), 1);
+				if (compiledCycles == 0) {
+					compiledCycles = compiled->cpu().execute(); // Not compiled, the interpreter's anyway
+				}
+				int interpretedCycles = interpreted->cpu().execute();
+				ASSERT_EQ(compiledCycles, interpretedCycles) << "opcode " << opcode;
+				ASSERT_EQ(compiled->cpu().program_counter, interpreted->cpu().program_counter) << "opcode " << opcode;
+				ASSERT_EQ(compiled->saveState(), interpreted->saveState()) << "opcode " << opcode;
+			}
+		}
+	}
+
+	TEST(JitTest, WorkloadsRunInLockstep) {
+		if (!Jit::Available) {
+			GTEST_SKIP() << "no code generator for this host";
+		}
+		for (const char* source : { Workloads::aluLoop, Workloads::memcpyLoop, Workloads::spriteScene,
+			Workloads::scrollScene, Workloads::nmiFrameLoop, Workloads::vblankWait }) {
+			std::vector<uint8_t> rom = Workloads::Build(source);
+			auto compiled = load(rom, true);
+			auto interpreted = load(rom, false);
+			ASSERT_NO_FATAL_FAILURE(Lockstep::ExpectSame(*compiled, *interpreted, 30));
+			EXPECT_GT(compiled->jit().blockCount(), 0u);
+			EXPECT_GT(compiled->jit().cyclesRun(), 0u);
+		}
+	}
+
+	TEST(JitTest, RandomProgramsRunInLockstep) {
+		if (!Jit::Available) {
+			GTEST_SKIP() << "no code generator for this host";
+		}
+		// Random bytes make for every kind of jump, register write and unknown opcode. Pulls become NOPs:
+		// the CPU keeps its stack in a vector and doesn't cope with more pulls than pushes.
+		std::mt19937 random(4096);
+		for (int program = 0; program < 16; ++program) {
+			std::vector<uint8_t> code(0x3FF0);
+			for (uint8_t& byte : code) {
+				byte = static_cast<uint8_t>(random());
+				if (byte == 0x60 || byte == 0x40 || byte == 0x68 || byte == 0x28) { // RTS RTI PLA PLP
+					byte = 0xEA;
+				}
+			}
+			std::vector<uint8_t> rom = TestRom::Make(code, 0x8000 + (random() & 0x3FFF), 0, 0x8000 + (random() & 0x3FFF));
+			auto compiled = load(rom, true);
+			auto interpreted = load(rom, false);
+			compiled->jit().threshold = 2;
+			Lockstep::ExpectSame(*compiled, *interpreted, 10);
+			if (::testing::Test::HasFailure()) {
+				FAIL() << "program " << program;
+			}
+			EXPECT_GT(compiled->jit().cyclesRun(), 0u) << "program " << program;
+		}
+	}
+
+	TEST(JitTest, OffByDefault) {
+		auto emulator = load(Workloads::Build(Workloads::aluLoop), false);
+		EXPECT_FALSE(Emulator().jitEnabled());
+		emulator->runFrame();
+		EXPECT_EQ(emulator->jit().blockCount(), 0u);
+		EXPECT_EQ(emulator->jit().cyclesRun(), 0u);
+	}
+}
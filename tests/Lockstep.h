@@ -0,0 +1,32 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <gtest/gtest.h>
+#include <Emulator.h>
+#include <memory>
+#include <vector>
+
+// Runs a machine with a fast path on next to one with it off, for the tests of each fast path
+namespace Lockstep {
+	// The ROM loaded with one fast path switched, e.g. Load(rom, &Emulator::setJit, true)
+	inline std::unique_ptr<Emulator> Load(const std::vector<uint8_t>& rom, void (Emulator::*setting)(bool), bool on) {
+		auto emulator = std::make_unique<Emulator>();
+		EXPECT_TRUE(emulator->loadRom(rom));
+		(emulator.get()->*setting)(on);
+		return emulator;
+	}
+
+	// Runs both frame by frame and expects the same savestate, picture and cycle count after each,
+	// stopping at the first frame that differs
+	inline void ExpectSame(Emulator& fast, Emulator& reference, int frames) {
+		for (int frame = 0; frame < frames; ++frame) {
+			fast.runFrame();
+			reference.runFrame();
+			ASSERT_EQ(fast.saveState(), reference.saveState()) << "frame " << frame;
+			ASSERT_EQ(fast.frameHash(), reference.frameHash()) << "frame " << frame;
+			ASSERT_EQ(fast.metrics().frameCycles, reference.metrics().frameCycles) << "frame " << frame;
+		}
+	}
+}
+
+#endif // LOCKSTEP_H
@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+#include <Emulator.h>
+#include <Hash.h>
+#include <Movie.h>
+#include "TestRom.h"
+
+namespace MovieTests {
+	class MovieTest : public testing::Test {
+	protected:
+		void SetUp() override {
+			recorder = std::make_unique<Emulator>();
+			player = std::make_unique<Emulator>();
+			ASSERT_TRUE(recorder->loadRom(TestRom::Make(TestRom::PadLoop())));
+			ASSERT_TRUE(player->loadRom(TestRom::Make(TestRom::PadLoop())));
+		}
+
+		// Records frames with changing buttons, a reset and a power cycle, keeping
+		// the hash of the state after every frame
+		void record(int frames, uint32_t keyframeInterval) {
+			movie.start(*recorder, keyframeInterval);
+			hashes.clear();
+			for (int frame = 0; frame < frames; ++frame) {
+				MovieInput input;
+				input.pads[0] = static_cast<uint8_t>((frame / 4) * 37);
+				input.pads[1] = static_cast<uint8_t>(frame / 16);
+				input.commands = frame == 40 ? MovieInput::Reset : frame == 70 ? MovieInput::Power : MovieInput::None;
+				movie.record(*recorder, input);
+				recorder->runFrame();
+				hashes.push_back(stateHash(*recorder));
+			}
+		}
+
+		static uint64_t stateHash(const Emulator& emulator) {
+			std::vector<uint8_t> state = emulator.saveState();
+			return Hash::XXH64(state.data(), state.size());
+		}
+
+		std::unique_ptr<Emulator> recorder;
+		std::unique_ptr<Emulator> player;
+		Movie movie;
+		std::vector<uint64_t> hashes;
+	};
+
+	TEST_F(MovieTest, ReplayIsExact) {
+		record(100, 30);
+		ASSERT_EQ(movie.frameCount(), 100u);
+		ASSERT_EQ(movie.keyframeCount(), 4u); // Frames 0, 30, 60 and 90
+
+		ASSERT_TRUE(movie.seek(*player, 0));
+		for (uint64_t frame = 0; frame < movie.frameCount(); ++frame) {
+			ASSERT_TRUE(movie.apply(*player, frame));
+			player->runFrame();
+			ASSERT_EQ(stateHash(*player), hashes[frame]) << "frame " << frame;
+		}
+		ASSERT_FALSE(movie.apply(*player, movie.frameCount()));
+	}
+
+	TEST_F(MovieTest, SeekLandsOnRecordedState) {
+		record(100, 30);
+		for (uint64_t frame : { 100, 77, 30, 1, 89, 90, 41 }) {
+			ASSERT_TRUE(movie.seek(*player, frame));
+			ASSERT_EQ(stateHash(*player), hashes[frame - 1]) << "frame " << frame;
+		}
+		ASSERT_FALSE(movie.seek(*player, 101));
+	}
+
+	TEST_F(MovieTest, FileRoundTrip) {
+		record(100, 30);
+		std::vector<uint8_t> data = movie.serialize();
+		ASSERT_TRUE(Movie::IsMovie(data));
+
+		Movie loaded;
+		ASSERT_TRUE(loaded.deserialize(data));
+		ASSERT_EQ(loaded.frameCount(), movie.frameCount());
+		ASSERT_EQ(loaded.keyframeCount(), movie.keyframeCount());
+		ASSERT_EQ(loaded.romHash(), recorder->romHash());
+		for (uint64_t frame = 0; frame < movie.frameCount(); ++frame) {
+			ASSERT_EQ(loaded.input(frame), movie.input(frame));
+		}
+		ASSERT_EQ(loaded.serialize(), data);
+		ASSERT_TRUE(loaded.seek(*player, 55));
+		ASSERT_EQ(stateHash(*player), hashes[54]);
+	}
+
+	TEST_F(MovieTest, HeldInputCostsAlmostNothing) {
+		movie.start(*recorder, 100000);
+		MovieInput held;
+		held.pads[0] = 0x81;
+		movie.record(*recorder, held);
+		size_t oneFrame = movie.serialize().size();
+		for (int frame = 1; frame < 5000; ++frame) {
+			movie.record(*recorder, held);
+		}
+		ASSERT_LE(movie.serialize().size(), oneFrame + 2); // Only the run's repeat count grows
+	}
+
+	TEST_F(MovieTest, RejectsOtherRomAndDamagedFiles) {
+		record(20, 10);
+		auto other = std::make_unique<Emulator>();
+		ASSERT_TRUE(other->loadRom(TestRom::Make(TestRom::PadLoop(), 0x8005, 1)));
+		ASSERT_FALSE(movie.seek(*other, 0));
+
+		std::vector<uint8_t> data = movie.serialize();
+		Movie loaded;
+		for (size_t size : { size_t(0), size_t(10), size_t(30), data.size() / 2, data.size() - 1 }) {
+			ASSERT_FALSE(loaded.deserialize(std::vector<uint8_t>(data.begin(), data.begin() + size))) << "size " << size;
+		}
+		ASSERT_TRUE(loaded.empty()); // Untouched by the failed loads
+	}
+
+	TEST_F(MovieTest, TruncateThenRecordAgain) {
+		record(50, 10);
+		movie.truncate(25);
+		ASSERT_EQ(movie.frameCount(), 25u);
+		ASSERT_EQ(movie.keyframeCount(), 3u); // 0, 10 and 20
+
+		// Pick up from frame 25 with other input
+		ASSERT_TRUE(movie.seek(*recorder, 25));
+		ASSERT_EQ(stateHash(*recorder), hashes[24]);
+		MovieInput input;
+		input.pads[0] = 0xFF;
+		for (int frame = 25; frame < 40; ++frame) {
+			movie.record(*recorder, input);
+			recorder->runFrame();
+		}
+		ASSERT_EQ(movie.frameCount(), 40u);
+		ASSERT_EQ(movie.keyframeCount(), 4u);
+		ASSERT_TRUE(movie.seek(*player, 40));
+		ASSERT_EQ(stateHash(*player), stateHash(*recorder));
+	}
+}
@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+#include <Emulator.h>
+#include <Profiler.h>
+#include <sstream>
+#include "Assembler.h"
+
+namespace ProfilerTests {
+	TEST(ProfilerTest, CountsCyclesPerPcAndOpcode) {
+		Profiler profiler;
+		profiler.record(0x8000, 0xA9, 2); // LDA #
+		profiler.record(0x8002, 0xE8, 2); // INX
+		profiler.record(0x8003, 0x4C, 3); // JMP $8000
+		profiler.record(0x8000, 0xA9, 2);
+
+		EXPECT_EQ(profiler.instructions(), 4u);
+		EXPECT_EQ(profiler.totalCycles(), 9u);
+		EXPECT_EQ(profiler.cyclesAt(0x8000), 4u);
+		EXPECT_EQ(profiler.cyclesAt(0x8003), 3u);
+		EXPECT_EQ(profiler.opcodeCount(0xA9), 2u);
+		EXPECT_EQ(profiler.opcodeCycles(0x4C), 3u);
+		EXPECT_TRUE(profiler.subroutines().empty()); // Only the CPU's JSR and interrupt hooks add them
+
+		profiler.clear();
+		EXPECT_EQ(profiler.totalCycles(), 0u);
+		EXPECT_EQ(profiler.cyclesAt(0x8000), 0u);
+	}
+
+	TEST(ProfilerTest, AttributesSubroutinesAndInterrupts) {
+		Profiler profiler;
+		// In the order the CPU calls them: the hook while an instruction runs, then its record
+		profiler.call(0x8000, 0x9000);
+		profiler.record(0x8000, 0x20, 6); // JSR $9000
+		profiler.call(0x9000, 0xA000);
+		profiler.record(0x9000, 0x20, 6); //   JSR $A000
+		profiler.record(0xA000, 0xEA, 2); //     NOP
+		profiler.ret(false);
+		profiler.record(0xA001, 0x60, 6); //     RTS
+		profiler.ret(true);               //   An RTI doesn't return from a JSR, the frame stays
+		profiler.ret(false);
+		profiler.record(0x9003, 0x60, 6); //   RTS
+		profiler.interrupt(0xC000);       // NMI cuts in
+		profiler.record(0xC000, 0xE6, 5); //   INC $10
+		profiler.ret(true);
+		profiler.record(0xC002, 0x40, 6); //   RTI
+		profiler.record(0x8003, 0xEA, 2);
+
+		EXPECT_EQ(profiler.instructions(), 8u);
+		const auto& subroutines = profiler.subroutines();
+		ASSERT_EQ(subroutines.size(), 3u);
+		EXPECT_EQ(subroutines.at(0x9000).calls, 1u);
+		EXPECT_EQ(subroutines.at(0x9000).inclusiveCycles, 6u + 6 + 2 + 6); // From the JSR up to the RTS
+		EXPECT_EQ(subroutines.at(0xA000).inclusiveCycles, 6u + 2);
+		EXPECT_EQ(subroutines.at(0xC000).inclusiveCycles, 5u);
+		EXPECT_EQ(profiler.calls().at((0x9000u << 16) | 0xA000).calls, 1u);
+		EXPECT_EQ(profiler.calls().count((0x8003u << 16) | 0xC000), 0u); // Interrupts have no call site
+	}
+
+	TEST(ProfilerTest, DisassemblesEveryAddressingMode) {
+		Assembler assembler;
+		ASSERT_TRUE(assembler.assemble(R"(
+    NOP
+    ASL A
+    LDA #$12
+    LDA $34
+    LDA $34,X
+    LDX $34,Y
+    LDA $1234
+    LDA $1234,X
+    LDA $1234,Y
+    JMP ($1234)
+    LDA ($34,X)
+    LDA ($34),Y
+back:
+    BNE back
+)")) << assembler.error();
+		auto emulator = std::make_unique<Emulator>();
+		ASSERT_TRUE(emulator->loadRom(assembler.rom()));
+		const char* expected[] = { "NOP", "ASL A", "LDA #$12", "LDA $34", "LDA $34,X", "LDX $34,Y", "LDA $1234", "LDA $1234,X",
+			"LDA $1234,Y", "JMP ($1234)", "LDA ($34,X)", "LDA ($34),Y", "BNE $801A" };
+		uint16_t address = 0x8000;
+		for (const char* text : expected) {
+			int length = 0;
+			EXPECT_EQ(emulator->cpu().disassemble(address, &length), text);
+			address += length;
+		}
+		EXPECT_EQ(address, 0x801C);
+		EXPECT_EQ(emulator->cpu().opcodeName(0x02), "???");
+	}
+
+	TEST(ProfilerTest, ReportsTheHotSubroutine) {
+		if (!Profiler::Available) {
+			GTEST_SKIP() << "Built without NES_PROFILER";
+		}
+		Assembler assembler;
+		ASSERT_TRUE(assembler.assemble(R"(
+reset:
+    JSR slow
+    JSR fast
+    JMP reset
+fast:
+    RTS
+slow:
+    LDX #20
+spin:
+    DEX
+    BNE spin
+    RTS
+)")) << assembler.error();
+		auto emulator = std::make_unique<Emulator>();
+		Profiler profiler;
+		emulator->setProfiler(&profiler);
+		ASSERT_TRUE(emulator->loadRom(assembler.rom()));
+		emulator->runFrame(false);
+
+		uint16_t slow = assembler.label("slow");
+		uint16_t fast = assembler.label("fast");
+		const auto& subroutines = profiler.subroutines();
+		ASSERT_TRUE(subroutines.count(slow) && subroutines.count(fast));
+		EXPECT_GT(subroutines.at(slow).inclusiveCycles, subroutines.at(fast).inclusiveCycles * 10);
+		EXPECT_GT(profiler.cyclesAt(assembler.label("spin")), profiler.totalCycles() / 4);
+		EXPECT_GT(profiler.instructions(), 1000u);
+
+		std::ostringstream report;
+		profiler.report(report, emulator->cpu(), 5);
+		std::string text = report.str();
+		EXPECT_NE(text.find("DEX"), std::string::npos);
+		EXPECT_NE(text.find("BNE $800C"), std::string::npos);
+		EXPECT_NE(text.find("$8000 ("), std::string::npos); // slow's caller
+		size_t dex = text.find("DEX");
+		ASSERT_NE(dex, std::string::npos);
+		EXPECT_EQ(text.substr(dex, text.find('\n', dex) - dex).substr(21), "$800A"); // Listed under slow
+	}
+}
@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include <RewindBuffer.h>
+
+namespace RewindTests {
+	// A state where each frame only touches a handful of bytes, like a real savestate
+	std::vector<uint8_t> makeState(int frame) {
+		std::vector<uint8_t> state(4096, 0);
+		for (size_t i = 0; i < state.size(); i += 64) {
+			state[i] = static_cast<uint8_t>(i / 64);
+		}
+		state[100] = static_cast<uint8_t>(frame);
+		state[101] = static_cast<uint8_t>(frame >> 8);
+		state[2000 + frame % 50] ^= 0xFF;
+		return state;
+	}
+
+	TEST(RewindEncodingTest, RoundTrip) {
+		std::vector<uint8_t> reference = makeState(0);
+		std::vector<uint8_t> state = makeState(7);
+		std::vector<uint8_t> encoded;
+		RewindBuffer::Encode(state.data(), reference.data(), state.size(), encoded);
+		ASSERT_LT(encoded.size(), 32u);
+
+		ASSERT_TRUE(RewindBuffer::Apply(encoded, reference));
+		ASSERT_EQ(reference, state);
+	}
+
+	TEST(RewindEncodingTest, PlainRoundTrip) {
+		std::vector<uint8_t> state = makeState(3);
+		std::vector<uint8_t> encoded;
+		RewindBuffer::Encode(state.data(), nullptr, state.size(), encoded);
+		std::vector<uint8_t> decoded(state.size(), 0);
+		ASSERT_TRUE(RewindBuffer::Apply(encoded, decoded));
+		ASSERT_EQ(decoded, state);
+	}
+
+	TEST(RewindEncodingTest, RejectsOverrun) {
+		std::vector<uint8_t> state = makeState(3);
+		std::vector<uint8_t> encoded;
+		RewindBuffer::Encode(state.data(), nullptr, state.size(), encoded);
+		std::vector<uint8_t> tooSmall(state.size() / 2, 0);
+		ASSERT_FALSE(RewindBuffer::Apply(encoded, tooSmall));
+	}
+
+	TEST(RewindBufferTest, PopsInReverseOrder) {
+		RewindBuffer rewind(100, 10);
+		for (int frame = 0; frame < 35; ++frame) {
+			rewind.push(makeState(frame));
+		}
+		ASSERT_EQ(rewind.size(), 35u);
+		std::vector<uint8_t> state;
+		for (int frame = 34; frame >= 0; --frame) {
+			ASSERT_TRUE(rewind.pop(state));
+			ASSERT_EQ(state, makeState(frame));
+		}
+		ASSERT_FALSE(rewind.pop(state));
+	}
+
+	TEST(RewindBufferTest, DropsOldestKeyframeGroup) {
+		RewindBuffer rewind(40, 10);
+		for (int frame = 0; frame < 45; ++frame) {
+			rewind.push(makeState(frame));
+		}
+		// Frames 0-9 were dropped as a group once frame 40 went in
+		ASSERT_EQ(rewind.size(), 35u);
+		std::vector<uint8_t> state;
+		for (int frame = 44; frame >= 10; --frame) {
+			ASSERT_TRUE(rewind.pop(state));
+			ASSERT_EQ(state, makeState(frame));
+		}
+		ASSERT_TRUE(rewind.empty());
+		ASSERT_EQ(rewind.memoryUsage(), 0u);
+	}
+
+	TEST(RewindBufferTest, PushAfterPop) {
+		RewindBuffer rewind(100, 10);
+		for (int frame = 0; frame < 25; ++frame) {
+			rewind.push(makeState(frame));
+		}
+		std::vector<uint8_t> state;
+		for (int i = 0; i < 8; ++i) {
+			rewind.pop(state); // Back to frame 16, past the keyframe at 20
+		}
+		// Play forward on a different timeline
+		for (int frame = 17; frame < 30; ++frame) {
+			rewind.push(makeState(frame + 1000));
+		}
+		for (int frame = 29; frame >= 17; --frame) {
+			ASSERT_TRUE(rewind.pop(state));
+			ASSERT_EQ(state, makeState(frame + 1000));
+		}
+		ASSERT_TRUE(rewind.pop(state));
+		ASSERT_EQ(state, makeState(16));
+	}
+
+	TEST(RewindBufferTest, DeltasAreSmall) {
+		RewindBuffer rewind(600, 60);
+		for (int frame = 0; frame < 600; ++frame) {
+			rewind.push(makeState(frame));
+		}
+		// Ten keyframes plus 590 deltas of a few bytes each
+		ASSERT_LT(rewind.memoryUsage(), 600u * 4096u / 20u);
+	}
+}
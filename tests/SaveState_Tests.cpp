@@ -0,0 +1,159 @@
+#include <gtest/gtest.h>
+#include <Emulator.h>
+#include <SaveState.h>
+#include "TestRom.h"
+
+namespace SaveStateTests {
+	class SaveStateTest : public testing::Test {
+	protected:
+		void SetUp() override {
+			emulator = std::make_unique<Emulator>();
+			ASSERT_TRUE(emulator->loadRom(TestRom::Make()));
+			for (int i = 0; i < 10; ++i) {
+				emulator->runFrame();
+			}
+		}
+
+		std::vector<uint32_t> frame() const {
+			return std::vector<uint32_t>(emulator->framebuffer(), emulator->framebuffer() + PPU_WIDTH * PPU_HEIGHT);
+		}
+
+		std::unique_ptr<Emulator> emulator;
+	};
+
+	std::vector<uint8_t> payload(const std::vector<uint8_t>& state, const char (&tag)[5]) {
+		StateReader in(state.data() + 16, state.size() - 16);
+		uint32_t chunkTag;
+		StateReader chunk(nullptr, 0);
+		while (in.nextChunk(chunkTag, chunk)) {
+			if (chunkTag == SaveState::ChunkTag(tag)) {
+				size_t size = chunk.remaining();
+				const uint8_t* data = chunk.view(size);
+				return std::vector<uint8_t>(data, data + size);
+			}
+		}
+		return {};
+	}
+
+	// Copies state with the payload of the chunk tagged tag cut to keep bytes, or the chunk left out if keep < 0
+	std::vector<uint8_t> withChunk(const std::vector<uint8_t>& state, const char (&tag)[5], int keep) {
+		std::vector<uint8_t> out(state.begin(), state.begin() + 16);
+		StateWriter writer(out);
+		StateReader in(state.data() + 16, state.size() - 16);
+		uint32_t chunkTag;
+		StateReader chunk(nullptr, 0);
+		while (in.nextChunk(chunkTag, chunk)) {
+			size_t size = chunk.remaining();
+			const uint8_t* payload = chunk.view(size);
+			if (chunkTag == SaveState::ChunkTag(tag)) {
+				if (keep < 0) {
+					continue;
+				}
+				size = std::min<size_t>(size, keep);
+			}
+			size_t start = writer.beginChunk(chunkTag);
+			writer.writeBytes(payload, size);
+			writer.endChunk(start);
+		}
+		return out;
+	}
+
+	TEST_F(SaveStateTest, Header) {
+		std::vector<uint8_t> state = emulator->saveState();
+		StateReader reader(state.data(), state.size());
+		ASSERT_EQ(reader.read32(), SaveState::magic);
+		ASSERT_EQ(reader.read16(), SaveState::version);
+	}
+
+	TEST_F(SaveStateTest, RoundTripIsDeterministic) {
+		std::vector<uint8_t> state = emulator->saveState();
+		for (int i = 0; i < 5; ++i) {
+			emulator->runFrame();
+		}
+		std::vector<uint32_t> expected = frame();
+		uint8_t expectedX = emulator->cpu().x;
+
+		ASSERT_TRUE(emulator->loadState(state));
+		ASSERT_EQ(emulator->frameCount(), 10u);
+		for (int i = 0; i < 5; ++i) {
+			emulator->runFrame();
+		}
+		ASSERT_EQ(emulator->cpu().x, expectedX);
+		ASSERT_EQ(frame(), expected);
+	}
+
+	TEST_F(SaveStateTest, SaveIntoBufferMatchesCopy) {
+		std::vector<uint8_t> buffer;
+		emulator->saveState(buffer);
+		ASSERT_EQ(buffer, emulator->saveState());
+	}
+
+	TEST_F(SaveStateTest, LoadsIntoAnotherInstance) {
+		std::vector<uint8_t> state = emulator->saveState();
+		auto other = std::make_unique<Emulator>();
+		ASSERT_TRUE(other->loadRom(TestRom::Make()));
+		ASSERT_TRUE(other->loadState(state));
+		ASSERT_EQ(other->saveState(), state);
+	}
+
+	TEST_F(SaveStateTest, RejectsOtherRom) {
+		std::vector<uint8_t> state = emulator->saveState();
+		auto other = std::make_unique<Emulator>();
+		ASSERT_TRUE(other->loadRom(TestRom::Make(TestRom::counterLoop, 0x8005, 1)));
+		ASSERT_FALSE(other->loadState(state));
+	}
+
+	TEST_F(SaveStateTest, RejectsTruncatedState) {
+		std::vector<uint8_t> state = emulator->saveState();
+		state.resize(state.size() - 1);
+		emulator->runFrame();
+		uint8_t x = emulator->cpu().x;
+		ASSERT_FALSE(emulator->loadState(state));
+		ASSERT_EQ(emulator->cpu().x, x); // Nothing was applied
+	}
+
+	TEST_F(SaveStateTest, DamagedChunkRollsBackTheChunksBeforeIt) {
+		// The CPU chunk comes after the bus and OAM chunks, which load fine
+		std::vector<uint8_t> damaged = withChunk(emulator->saveState(), "CPU ", 3);
+		for (int i = 0; i < 3; ++i) {
+			emulator->runFrame();
+		}
+		std::vector<uint8_t> before = emulator->saveState();
+		ASSERT_FALSE(emulator->loadState(damaged));
+		ASSERT_EQ(emulator->saveState(), before);
+		ASSERT_EQ(emulator->frameCount(), 13u);
+	}
+
+	TEST_F(SaveStateTest, MissingChunkLoadsAsPowerOn) {
+		std::vector<uint8_t> state = emulator->saveState();
+		auto fresh = std::make_unique<Emulator>();
+		ASSERT_TRUE(fresh->loadRom(TestRom::Make()));
+		std::vector<uint8_t> powerOn = fresh->saveState();
+
+		for (int i = 0; i < 3; ++i) {
+			emulator->runFrame();
+		}
+		emulator->bus().memory[0x0300] = 0x5A;
+		ASSERT_TRUE(emulator->loadState(withChunk(state, "BUS ", -1)));
+		ASSERT_EQ(emulator->bus().memory[0x0300], 0x00);
+		// Every other chunk as saved, the bus as it was at power-on
+		std::vector<uint8_t> loaded = emulator->saveState();
+		ASSERT_EQ(withChunk(loaded, "BUS ", -1), withChunk(state, "BUS ", -1));
+		ASSERT_EQ(payload(loaded, "BUS "), payload(powerOn, "BUS "));
+	}
+
+	TEST_F(SaveStateTest, RejectsNewerVersion) {
+		std::vector<uint8_t> state = emulator->saveState();
+		state[4] = SaveState::version + 1;
+		ASSERT_FALSE(emulator->loadState(state));
+	}
+
+	TEST_F(SaveStateTest, SkipsUnknownChunks) {
+		std::vector<uint8_t> state = emulator->saveState();
+		StateWriter writer(state);
+		size_t chunk = writer.beginChunk(SaveState::ChunkTag("XTRA"));
+		writer.write32(0xDEADBEEF);
+		writer.endChunk(chunk);
+		ASSERT_TRUE(emulator->loadState(state));
+	}
+}
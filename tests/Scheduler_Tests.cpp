@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+#include <Emulator.h>
+#include <Scheduler.h>
+#include "TestRom.h"
+
+namespace SchedulerTests {
+	TEST(SchedulerTest, EventsComeOutInTimeOrder) {
+		Scheduler scheduler;
+		scheduler.schedule(SchedulerEvent::DmcDma, 100);
+		scheduler.schedule(SchedulerEvent::ApuIrq, 50);
+		ASSERT_EQ(scheduler.next(), 50u);
+
+		SchedulerEvent event;
+		scheduler.advance(49);
+		ASSERT_FALSE(scheduler.pop(event));
+		scheduler.advance(100);
+		ASSERT_TRUE(scheduler.pop(event));
+		ASSERT_EQ(event, SchedulerEvent::ApuIrq);
+		ASSERT_TRUE(scheduler.pop(event));
+		ASSERT_EQ(event, SchedulerEvent::DmcDma);
+		ASSERT_FALSE(scheduler.pop(event));
+		ASSERT_EQ(scheduler.next(), Scheduler::never);
+	}
+
+	TEST(SchedulerTest, RescheduleMovesTheEvent) {
+		Scheduler scheduler;
+		scheduler.schedule(SchedulerEvent::ApuIrq, 10);
+		scheduler.schedule(SchedulerEvent::ApuIrq, 500);
+		ASSERT_EQ(scheduler.next(), 500u);
+		scheduler.cancel(SchedulerEvent::ApuIrq);
+		ASSERT_EQ(scheduler.when(SchedulerEvent::ApuIrq), Scheduler::never);
+		ASSERT_EQ(scheduler.next(), Scheduler::never);
+	}
+
+	TEST(SchedulerTest, FrameInterruptBookedAtStepFour) {
+		Scheduler scheduler;
+		APU apu;
+		scheduler.advance(1000);
+		apu.attach(&scheduler);
+		apu.cpuWrite(0x4017, 0x00);
+		ASSERT_EQ(scheduler.when(SchedulerEvent::ApuIrq), 1000u + 29829);
+
+		// Nothing happens until the event is answered
+		scheduler.advance(29829);
+		apu.clock(29829);
+		ASSERT_FALSE(apu.irqPending());
+		SchedulerEvent event;
+		ASSERT_TRUE(scheduler.pop(event));
+		apu.sync();
+		ASSERT_TRUE(apu.irqPending());
+
+		apu.cpuWrite(0x4017, 0x40); // Inhibit
+		ASSERT_EQ(scheduler.when(SchedulerEvent::ApuIrq), Scheduler::never);
+	}
+
+	TEST(SchedulerTest, DmcFetchesAtByteBoundaries) {
+		Scheduler scheduler;
+		APU apu;
+		apu.attach(&scheduler);
+		apu.cpuWrite(0x4017, 0x40); // No frame interrupts, only DMC events
+		apu.cpuWrite(0x4010, 0x0F); // 54 cycles a bit
+		apu.cpuWrite(0x4013, 0x01); // 17 bytes
+		apu.cpuWrite(0x4015, 0x10); // Start, the first byte is fetched straight away
+		ASSERT_EQ(scheduler.when(SchedulerEvent::DmcDma), scheduler.now());
+
+		int fetches = 0;
+		uint64_t lastFetch = 0;
+		SchedulerEvent event;
+		for (int events = 0; scheduler.next() != Scheduler::never && events < 1000; ++events) {
+			uint32_t step = static_cast<uint32_t>(scheduler.next() - scheduler.now());
+			scheduler.advance(step);
+			apu.clock(step);
+			while (scheduler.pop(event)) {
+				apu.sync();
+				uint32_t stall = apu.takeDmaStall();
+				if (stall == 0) {
+					continue;
+				}
+				ASSERT_EQ(stall, 4u);
+				if (fetches >= 2) {
+					ASSERT_EQ(scheduler.now() - lastFetch, 8u * 54); // One byte's worth of bits apart
+				}
+				lastFetch = scheduler.now();
+				fetches++;
+			}
+		}
+		ASSERT_EQ(fetches, 17); // The whole sample, then it stops
+		ASSERT_EQ(apu.readStatus() & 0x10, 0);
+	}
+
+	// Turns on the frame interrupt and counts interrupts in $20
+	//   $8000  LDA #$00 / STA $4017 / CLI / JMP $8006
+	//   $8010  INC $20 / LDA $4015 / RTI
+	const std::vector<uint8_t> irqCounter = [] {
+		std::vector<uint8_t> code = { 0xA9, 0x00, 0x8D, 0x17, 0x40, 0x58, 0x4C, 0x06, 0x80 };
+		code.resize(0x10, 0xEA);
+		code.insert(code.end(), { 0xE6, 0x20, 0xAD, 0x15, 0x40, 0x40 });
+		return code;
+	}();
+
+	TEST(SchedulerTest, FrameInterruptReachesCpu) {
+		auto emulator = std::make_unique<Emulator>();
+		ASSERT_TRUE(emulator->loadRom(TestRom::Make(irqCounter, 0x8006, 0, 0x8010)));
+		for (int i = 0; i < 10; ++i) {
+			emulator->runFrame();
+		}
+		// One every 29830 cycles, frames are 29780
+		ASSERT_GE(emulator->bus().memory[0x20], 9);
+		ASSERT_LE(emulator->bus().memory[0x20], 10);
+		ASSERT_FALSE(emulator->apu().frameIrq); // Every one acknowledged
+	}
+}
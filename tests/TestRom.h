@@ -0,0 +1,56 @@
+#ifndef TESTROM_H
+#define TESTROM_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace TestRom {
+	// Reset handler used when a test doesn't care what runs: turns on NMI, then keeps
+	// writing a counter to zero page and PPUCTRL so machine state differs from frame to frame.
+	//   $8000  LDA #$80 / STA $2000
+	//   $8005  INX / STX $10 / STX $2000 / JMP $8005
+	inline const std::vector<uint8_t> counterLoop = {
+		0xA9, 0x80, 0x8D, 0x00, 0x20,
+		0xE8, 0x86, 0x10, 0x8E, 0x00, 0x20, 0x4C, 0x05, 0x80,
+	};
+
+	// Strobes the controller and stores the eight button reads to $10-$17, over and over
+	//   $8000  LDA #1 / STA $4016 / LDA #0 / STA $4016
+	//   $800A  LDA $4016 / STA $10 ... LDA $4016 / STA $17 / JMP $8000
+	inline std::vector<uint8_t> PadLoop() {
+		std::vector<uint8_t> code = { 0xA9, 0x01, 0x8D, 0x16, 0x40, 0xA9, 0x00, 0x8D, 0x16, 0x40 };
+		for (uint8_t i = 0; i < 8; ++i) {
+			code.insert(code.end(), { 0xAD, 0x16, 0x40, 0x85, static_cast<uint8_t>(0x10 + i) });
+		}
+		code.insert(code.end(), { 0x4C, 0x00, 0x80 });
+		return code;
+	}
+
+	/**
+	 * @brief Builds an NROM image (16 KB PRG, 8 KB CHR) around a block of code.
+	 *
+	 * The code is placed at $8000, where reset starts; NMI jumps to nmiAddress
+	 * and IRQ to irqAddress. Changing seed changes an unused PRG byte, giving a
+	 * different ROM that runs the same way.
+	 */
+	inline std::vector<uint8_t> Make(const std::vector<uint8_t>& code = counterLoop, uint16_t nmiAddress = 0x8005, uint8_t seed = 0,
+		uint16_t irqAddress = 0x0000) {
+		std::vector<uint8_t> rom(16 + 0x4000 + 0x2000, 0);
+		rom[0] = 'N'; rom[1] = 'E'; rom[2] = 'S'; rom[3] = 0x1A;
+		rom[4] = 1; // 16KB PRG
+		rom[5] = 1; // 8KB CHR
+		std::copy(code.begin(), code.end(), rom.begin() + 16);
+		rom[16 + 0x3FF0] = seed;
+		uint8_t* vectors = &rom[16 + 0x3FFA];
+		vectors[0] = nmiAddress & 0xFF; vectors[1] = nmiAddress >> 8;
+		vectors[2] = 0x00; vectors[3] = 0x80; // Reset
+		vectors[4] = irqAddress & 0xFF; vectors[5] = irqAddress >> 8;
+		for (int i = 0; i < 0x2000; ++i) {
+			rom[16 + 0x4000 + i] = static_cast<uint8_t>(i * 7);
+		}
+		return rom;
+	}
+}
+
+#endif // TESTROM_H
@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+#include <Emulator.h>
+#include <Trace.h>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include "TestRom.h"
+
+namespace TraceTests {
+	class TraceTest : public testing::Test {
+	protected:
+		void SetUp() override {
+			Trace::Clear();
+		}
+		void TearDown() override {
+			Trace::SetEnabled(false);
+			Trace::Clear();
+			std::filesystem::remove(path);
+		}
+
+		std::string writeAndRead() {
+			EXPECT_TRUE(Trace::WriteJson(path.string()));
+			std::ifstream in(path);
+			std::stringstream text;
+			text << in.rdbuf();
+			return text.str();
+		}
+
+		static size_t count(const std::string& text, const std::string& what) {
+			size_t found = 0;
+			for (size_t at = text.find(what); at != std::string::npos; at = text.find(what, at + 1)) {
+				found++;
+			}
+			return found;
+		}
+
+		std::filesystem::path path = std::filesystem::temp_directory_path() / "nes_trace_test.json";
+	};
+
+	TEST_F(TraceTest, RecordsNothingWhileOff) {
+		{
+			TRACE_SCOPE("off");
+		}
+		Trace::Complete("off", Trace::Now(), Trace::Now());
+		EXPECT_EQ(Trace::EventCount(), 0u);
+	}
+
+	TEST_F(TraceTest, WritesScopesFromEveryThread) {
+		Trace::SetEnabled(true);
+		Trace::SetThreadName("test main");
+		{
+			TRACE_SCOPE("outer");
+			TRACE_SCOPE("inner");
+		}
+		std::thread worker([] {
+			Trace::SetThreadName("test worker");
+			for (int i = 0; i < 3; ++i) {
+				TRACE_SCOPE("work");
+			}
+		});
+		worker.join();
+		Trace::SetEnabled(false);
+		{
+			TRACE_SCOPE("after");
+		}
+		EXPECT_EQ(Trace::EventCount(), 5u);
+
+		std::string json = writeAndRead();
+		EXPECT_EQ(json.rfind("{\"displayTimeUnit\": \"ns\", \"traceEvents\": [", 0), 0u);
+		EXPECT_EQ(count(json, "\"name\": \"outer\", \"ph\": \"X\""), 1u);
+		EXPECT_EQ(count(json, "\"name\": \"inner\""), 1u);
+		EXPECT_EQ(count(json, "\"name\": \"work\""), 3u);
+		EXPECT_EQ(count(json, "\"name\": \"after\""), 0u);
+		EXPECT_EQ(count(json, "{\"name\": \"test main\"}"), 1u);
+		EXPECT_EQ(count(json, "{\"name\": \"test worker\"}"), 1u);
+		EXPECT_EQ(json.substr(json.size() - 4), "\n]}\n");
+	}
+
+	TEST_F(TraceTest, TrackTakesEventsFromAThreadThatNeverRegistered) {
+		static Trace::Track* track = Trace::NewTrack("test callback");
+		Trace::SetEnabled(true);
+		std::thread callback([] {
+			for (int i = 0; i < 3; ++i) {
+				Trace::Scope scope("callback", track);
+			}
+		});
+		callback.join();
+		EXPECT_EQ(Trace::EventCount(), 3u);
+
+		std::string json = writeAndRead();
+		EXPECT_EQ(count(json, "{\"name\": \"test callback\"}"), 1u);
+		EXPECT_EQ(count(json, "\"name\": \"callback\""), 3u);
+	}
+
+	TEST_F(TraceTest, WritesWhileAThreadKeepsRecording) {
+		Trace::SetEnabled(true);
+		std::atomic<bool> stop{ false };
+		std::thread recorder([&stop] {
+			Trace::SetThreadName("test recorder");
+			// Past the ring's size, so the writes below catch it overwriting
+			for (size_t i = 0; i < Trace::eventsPerThread + 1000 || !stop; ++i) {
+				Trace::Complete("tick", Trace::Now(), Trace::Now());
+			}
+		});
+		for (int i = 0; i < 3; ++i) {
+			std::string json = writeAndRead();
+			EXPECT_EQ(json.substr(json.size() - 4), "\n]}\n");
+			EXPECT_LE(count(json, "\"name\": \"tick\""), Trace::eventsPerThread);
+		}
+		stop = true;
+		recorder.join();
+		EXPECT_EQ(Trace::EventCount(), Trace::eventsPerThread); // Only the newest are kept
+		Trace::Clear();
+		EXPECT_EQ(Trace::EventCount(), 0u);
+	}
+
+	TEST_F(TraceTest, EmulatorMarksFramePhases) {
+		auto emulator = std::make_unique<Emulator>();
+		ASSERT_TRUE(emulator->loadRom(TestRom::Make()));
+		emulator->runFrame();
+		EXPECT_EQ(Trace::EventCount(), 0u);
+
+		Trace::SetEnabled(true);
+		emulator->runFrame();
+		emulator->runFrame();
+		Trace::SetEnabled(false);
+
+		std::string json = writeAndRead();
+		EXPECT_EQ(count(json, "\"name\": \"frame\""), 2u);
+		EXPECT_EQ(count(json, "\"name\": \"CPU + PPU run\""), 2u);
+		EXPECT_EQ(count(json, "\"name\": \"audio mix\""), 2u);
+		// The first traced frame starts mid-scanline, which isn't reported
+		EXPECT_GE(count(json, "\"name\": \"scanline render\""), 239u);
+	}
+}
@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+#include <WorkStealingPool.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace WorkStealingPoolTests {
+	// Spins until done is set or a few seconds pass, so a broken pool fails the test instead of hanging it
+	bool waitFor(const std::atomic<bool>& done) {
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+		while (!done) {
+			if (std::chrono::steady_clock::now() > deadline) {
+				return false;
+			}
+			std::this_thread::yield();
+		}
+		return true;
+	}
+
+	TEST(WorkStealingPoolTest, RunsEveryTaskOnce) {
+		WorkStealingPool pool(4);
+		std::vector<std::atomic<int>> runs(1000);
+		for (size_t i = 0; i < runs.size(); ++i) {
+			pool.submit([&runs, i] { runs[i]++; });
+		}
+		pool.wait();
+		for (const std::atomic<int>& count : runs) {
+			ASSERT_EQ(count, 1);
+		}
+	}
+
+	TEST(WorkStealingPoolTest, WaitBlocksUntilInFlightTasksFinish) {
+		WorkStealingPool pool(2);
+		std::atomic<int> finished{ 0 };
+		for (int i = 0; i < 8; ++i) {
+			pool.submit([&finished] {
+				std::this_thread::sleep_for(std::chrono::milliseconds(20));
+				finished++;
+			});
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(5)); // Some of them running by now
+		pool.wait();
+		ASSERT_EQ(finished, 8);
+		pool.wait(); // Nothing pending returns straight away
+	}
+
+	TEST(WorkStealingPoolTest, TasksSubmittedFromATaskAreStolenByIdleWorkers) {
+		WorkStealingPool pool(2);
+		std::atomic<bool> childrenDone{ false };
+		std::atomic<bool> timedOut{ false };
+		std::atomic<int> children{ 0 };
+		std::mutex idsMutex;
+		std::set<std::thread::id> childThreads;
+		std::thread::id parentThread;
+		pool.submit([&] {
+			parentThread = std::this_thread::get_id();
+			// Queued on this worker's own queue, which it won't get back to until they are all done:
+			// only the other worker, stealing, can run them
+			for (int i = 0; i < 16; ++i) {
+				pool.submit([&] {
+					{
+						std::lock_guard<std::mutex> lock(idsMutex);
+						childThreads.insert(std::this_thread::get_id());
+					}
+					if (++children == 16) {
+						childrenDone = true;
+					}
+				});
+			}
+			timedOut = !waitFor(childrenDone);
+		});
+		pool.wait();
+		ASSERT_FALSE(timedOut);
+		ASSERT_EQ(children, 16);
+		ASSERT_EQ(childThreads.size(), 1u);
+		ASSERT_EQ(childThreads.count(parentThread), 0u);
+	}
+
+	TEST(WorkStealingPoolTest, DestructionFinishesQueuedWork) {
+		std::atomic<int> finished{ 0 };
+		std::atomic<bool> release{ false };
+		{
+			WorkStealingPool pool(1);
+			pool.submit([&release] { waitFor(release); }); // Holds the only worker while the rest queue up
+			for (int i = 0; i < 100; ++i) {
+				pool.submit([&finished] { finished++; });
+			}
+			release = true;
+		}
+		ASSERT_EQ(finished, 100);
+	}
+
+	TEST(WorkStealingPoolTest, ZeroThreadsMeansOne) {
+		WorkStealingPool pool(0);
+		ASSERT_EQ(pool.size(), 1u);
+		std::atomic<bool> ran{ false };
+		pool.submit([&ran] { ran = true; });
+		pool.wait();
+		ASSERT_TRUE(ran);
+	}
+}
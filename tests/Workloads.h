@@ -0,0 +1,260 @@
+#ifndef WORKLOADS_H
+#define WORKLOADS_H
+
+#include "Assembler.h"
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Assembly sources for synthetic workloads, shared by the end-to-end tests and nes_bench.
+// Each one says in its header comment which RAM it leaves results in.
+namespace Workloads {
+	// Tight ALU loop: 256 rounds of add, subtract, logic and shift on zero page, then the
+	// results are published and it starts over. $20/$21 = 16-bit sum of 3 per round ($0300),
+	// $22 = checksum, $23 = completed passes.
+	inline const char* aluLoop = R"(
+step = 3
+reset:
+    LDX #0
+    STX $00
+    STX $01
+    STX $02
+    STX $04
+    LDA #step
+    STA $03
+round:
+    CLC
+    LDA $00
+    ADC $03
+    STA $00
+    LDA $01
+    ADC $04
+    STA $01
+    LDA $00
+    EOR $02
+    AND #$7F
+    ORA #$01
+    STA $02
+    ASL $02
+    SEC
+    LDA $02
+    SBC $03
+    STA $02
+    INX
+    BNE round
+    LDA $00
+    STA $20
+    LDA $01
+    STA $21
+    LDA $02
+    STA $22
+    INC $23
+    JMP reset
+)";
+
+	// memcpy loop: fills 256 bytes at $0300 with a pattern, then copies them to $0400 through
+	// (zp),Y pointers over and over. $10 counts completed copies.
+	inline const char* memcpyLoop = R"(
+src = $0300
+dst = $0400
+reset:
+    LDX #0
+fill:
+    TXA
+    EOR #$A5
+    STA src,X
+    INX
+    BNE fill
+    LDA #<src
+    STA $00
+    LDA #>src
+    STA $01
+    LDA #<dst
+    STA $02
+    LDA #>dst
+    STA $03
+copy:
+    LDY #0
+byte:
+    LDA ($00),Y
+    STA ($02),Y
+    INY
+    BNE byte
+    INC $10
+    JMP copy
+)";
+
+	// Sprite-heavy scene: 64 sprites in the $0200 OAM page, sent with OAM DMA and moved
+	// every NMI, background and sprites on. $10 counts NMIs.
+	inline const char* spriteScene = R"(
+oam = $0200
+reset:
+    SEI
+    LDX #$FF
+    TXS
+    LDX #0
+    LDY #0
+init:
+    TYA
+    STA oam,X        ; Y position
+    INX
+    STA oam,X        ; Tile
+    INX
+    LDA #0
+    STA oam,X        ; Attributes
+    INX
+    TYA
+    ASL A
+    STA oam,X        ; X position
+    INX
+    INY
+    INY
+    INY
+    CPX #0
+    BNE init
+    LDA #%10000000
+    STA $2000
+    LDA #%00011110
+    STA $2001
+main:
+    JMP main
+nmi:
+    PHA
+    TXA
+    PHA
+    LDA #0
+    STA $2003
+    LDA #>oam
+    STA $4014
+    LDX #0
+move:
+    INC oam+3,X
+    INC oam,X
+    INX
+    INX
+    INX
+    INX
+    BNE move
+    INC $10
+    PLA
+    TAX
+    PLA
+    RTI
+)";
+
+	// Scroll-heavy scene: fills the first nametable through $2006/$2007, then changes the
+	// $2005 scroll every NMI. $10 counts NMIs, $11 is the horizontal scroll.
+	inline const char* scrollScene = R"(
+reset:
+    SEI
+    LDX #$FF
+    TXS
+    LDA #$20
+    STA $2006
+    LDA #$00
+    STA $2006
+    LDY #4
+    LDX #0
+tiles:
+    TXA
+    STA $2007
+    INX
+    BNE tiles
+    DEY
+    BNE tiles
+    LDA #%10000000
+    STA $2000
+    LDA #%00001110
+    STA $2001
+main:
+    JMP main
+nmi:
+    PHA
+    INC $11
+    LDA $11
+    STA $2005
+    LDA #0
+    STA $2005
+    INC $10
+    PLA
+    RTI
+)";
+
+	// NMI-driven frame loop, the shape of most games: the NMI handler only sets a flag, the
+	// main loop waits for it and then does a frame's worth of work (32 table updates and a
+	// checksum). $10 counts NMIs, $11 frames the main loop finished, $12 the checksum.
+	inline const char* nmiFrameLoop = R"(
+table = $0300
+reset:
+    SEI
+    LDX #$FF
+    TXS
+    LDA #%10000000
+    STA $2000
+frame:
+    LDA $13
+wait:
+    CMP $13
+    BEQ wait
+    LDX #31
+update:
+    LDA table,X
+    CLC
+    ADC $11
+    STA table,X
+    EOR $12
+    STA $12
+    DEX
+    BPL update
+    INC $11
+    JMP frame
+nmi:
+    INC $10
+    INC $13
+    RTI
+)";
+
+	// $2002 polling with NMI off, the way games wait before their NMI handler is set up: spin on
+	// the vblank flag, then a burst of work. $10 counts vblanks seen, $11 is a checksum, $12 the
+	// sprite 0 and overflow bits seen on the way.
+	inline const char* vblankWait = R"(
+reset:
+    SEI
+    LDX #$FF
+    TXS
+    LDA #%00011110
+    STA $2001
+frame:
+    BIT $2002
+    BPL frame
+    INC $10
+    LDX #63
+work:
+    TXA
+    EOR $11
+    ADC $10
+    STA $11
+    DEX
+    BPL work
+    LDA $2002
+    AND #$60
+    ORA $12
+    STA $12
+    JMP frame
+nmi:
+    RTI
+)";
+
+	// Assembles source into an iNES image, empty (with the error on stderr) if it doesn't assemble
+	inline std::vector<uint8_t> Build(const std::string& source) {
+		Assembler assembler;
+		if (!assembler.assemble(source)) {
+			std::cerr << "Workload doesn't assemble: " << assembler.error() << std::endl;
+			return {};
+		}
+		return assembler.rom();
+	}
+}
+
+#endif // WORKLOADS_H